@@ -0,0 +1,43 @@
+/** \file
+ * Art-Net packet parsing.
+ */
+#include <string.h>
+#include "artnet.h"
+
+#define ARTNET_OPCODE_DMX 0x5000
+#define ARTNET_OPCODE_SYNC 0x5200
+
+static const char ARTNET_ID[8] = "Art-Net";
+
+dmx_packet_type_t artnet_parse_packet(
+	const uint8_t* packet,
+	uint32_t packet_size,
+	bool sync_active,
+	dmx_packet_t* out_packet
+) {
+	memset(out_packet, 0, sizeof(*out_packet));
+	out_packet->type = DMX_PACKET_NONE;
+
+	if (packet_size < ARTNET_SYNC_PACKET_SIZE || memcmp(packet, ARTNET_ID, sizeof(ARTNET_ID)) != 0) {
+		return out_packet->type;
+	}
+
+	// The opcode is little-endian, unlike everything else in the header
+	const uint16_t opcode = (uint16_t) (packet[8] | packet[9] << 8);
+
+	if (opcode == ARTNET_OPCODE_SYNC) {
+		out_packet->type = DMX_PACKET_SYNC;
+		out_packet->universe = ARTNET_SYNC_ADDRESS;
+	} else if (opcode == ARTNET_OPCODE_DMX && packet_size >= ARTNET_DMX_HEADER_SIZE) {
+		const uint32_t length = (uint32_t) (packet[16] << 8 | packet[17]);
+
+		out_packet->type = DMX_PACKET_DATA;
+		out_packet->sequence = packet[12] == 0 ? -1 : packet[12]; // zero disables sequencing
+		out_packet->universe = (uint16_t) (((packet[15] & 0x7F) << 8 | packet[14]) + 1);
+		out_packet->sync_address = sync_active ? ARTNET_SYNC_ADDRESS : 0;
+		out_packet->data = packet + ARTNET_DMX_HEADER_SIZE;
+		out_packet->data_size = length < packet_size - ARTNET_DMX_HEADER_SIZE ? length : packet_size - ARTNET_DMX_HEADER_SIZE;
+	}
+
+	return out_packet->type;
+}
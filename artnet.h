@@ -0,0 +1,36 @@
+/** \file
+ * Art-Net packet parsing.
+ *
+ * Art-Net Port-Addresses start at 0 while E1.31 universes start at 1, so ArtDmx data for Port-Address N is reported as
+ * universe N+1. That way one dmxUniverses table serves both protocols, and the default mapping drives strip 0 from
+ * Art-Net universe 0.
+ */
+#ifndef _artnet_h_
+#define _artnet_h_
+
+#include <stdint.h>
+#include "dmx.h"
+
+#define ARTNET_DEFAULT_PORT 6454
+
+#define ARTNET_DMX_HEADER_SIZE 18
+#define ARTNET_SYNC_PACKET_SIZE 14
+
+/**
+ * ArtSync carries no address, so while a controller is sending it, data is reported as synchronized on this
+ * (otherwise unused) address and ArtSync releases it.
+ */
+#define ARTNET_SYNC_ADDRESS 0xFFFF
+
+/**
+ * Decode a received packet for the DMX assembler. ArtDmx data is reported as synchronized when sync_active is set.
+ * Opcodes other than ArtDmx and ArtSync are reported as DMX_PACKET_NONE.
+ */
+extern dmx_packet_type_t artnet_parse_packet(
+	const uint8_t* packet,
+	uint32_t packet_size,
+	bool sync_active,
+	dmx_packet_t* out_packet
+);
+
+#endif
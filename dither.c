@@ -0,0 +1,177 @@
+/** \file
+ * Temporal dithering state and its self-check; the per-pixel work is inlined from dither.h into the render kernels.
+ */
+#include <stdlib.h>
+#include <string.h>
+#include "util.h"
+#include "dither.h"
+
+#define min(a, b) ((a) < (b) ? (a) : (b))
+#define max(a, b) ((a) > (b) ? (a) : (b))
+
+uint8_t dither_min_residual(uint8_t max_frames) {
+	// The odd level of a value residual/256 away from the nearest one comes up every 256/residual frames
+	if (max_frames < 2) {
+		return 255;
+	}
+
+	return (uint8_t) ((256 + max_frames - 1) / max_frames);
+}
+
+void dither_state_reset(dither_state_t* states, uint32_t count) {
+	memset(states, 0, count * sizeof(dither_state_t));
+}
+
+////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+// Self-check
+
+typedef struct {
+	uint16_t value;
+	uint8_t min_output;
+	uint8_t max_output;
+	uint8_t last_output;
+	uint32_t run_length;
+	uint32_t longest_run;
+	uint32_t change_count;
+	uint64_t output_sum;
+} dither_self_check_channel_t;
+
+int dither_self_check(FILE* out) {
+	// Every low-level value, the same again rounding the other way, and the top of the range where outputs saturate
+	const uint32_t pixel_count = 0x1000;
+	const uint32_t frame_count = 4096;
+	const uint32_t warmup_frames = DITHER_MAX_FRAMES + 1;
+	const uint8_t max_frame_values[] = { 4, 16, 60, DITHER_MAX_FRAMES };
+
+	dither_state_t* states = malloc(pixel_count * sizeof(dither_state_t));
+	dither_self_check_channel_t* channels = malloc(pixel_count * 3 * sizeof(dither_self_check_channel_t));
+	int failure_count = 0;
+
+	for (unsigned m=0; m<sizeof(max_frame_values)/sizeof(max_frame_values[0]); m++) {
+		const uint8_t max_frames = max_frame_values[m];
+		const uint8_t min_residual = dither_min_residual(max_frames);
+
+		dither_state_reset(states, pixel_count);
+		memset(channels, 0, pixel_count * 3 * sizeof(dither_self_check_channel_t));
+
+		for (uint32_t i=0; i<pixel_count; i++) {
+			channels[i*3 + 0].value = (uint16_t) i;
+			channels[i*3 + 1].value = (uint16_t) (i + 0x80);
+			channels[i*3 + 2].value = (uint16_t) (0xF000 + i);
+			for (unsigned c=0; c<3; c++) {
+				channels[i*3 + c].min_output = 255;
+			}
+		}
+
+		// Start just short of the frame counter wrapping, and wrap it many times over
+		uint8_t frame = 250;
+
+		for (uint32_t frame_num=0; frame_num<frame_count; frame_num++, frame++) {
+			for (uint32_t i=0; i<pixel_count; i++) {
+				dither_state_t* state = &states[i];
+				int8_t* errors[3] = { &state->r, &state->g, &state->b };
+				bool changed = false;
+
+				dither_expire(state, frame, max_frames);
+
+				for (unsigned c=0; c<3; c++) {
+					dither_self_check_channel_t* channel = &channels[i*3 + c];
+					const uint8_t output = dither_quantize(channel->value, errors[c], min_residual, &changed);
+
+					if (frame_num < warmup_frames) {
+						channel->last_output = output;
+						continue;
+					}
+
+					channel->min_output = min(channel->min_output, output);
+					channel->max_output = max(channel->max_output, output);
+					channel->output_sum += output;
+
+					if (frame_num > warmup_frames && output != channel->last_output) {
+						channel->longest_run = max(channel->longest_run, channel->run_length);
+						channel->change_count++;
+						channel->run_length = 0;
+					}
+
+					channel->last_output = output;
+					channel->run_length++;
+				}
+
+				if (changed) {
+					state->last_effect_frame = frame;
+				}
+			}
+		}
+
+		uint32_t dithered_count = 0;
+		double max_dithered_mean_error = 0;
+		double max_undithered_mean_error = 0;
+
+		for (uint32_t i=0; i<pixel_count*3; i++) {
+			dither_self_check_channel_t* channel = &channels[i];
+			if (channel->change_count > 0) {
+				channel->longest_run = max(channel->longest_run, channel->run_length);
+			}
+
+			const uint32_t measured_frames = frame_count - warmup_frames;
+
+			// Values past the top level can only ever show as 255
+			const double target = min(channel->value, 0xFF00) / 256.0;
+			const double mean = (double) channel->output_sum / measured_frames;
+			const double mean_error = mean > target ? mean - target : target - mean;
+
+			// Undithered values are at most min_residual/256 off. Dithered ones must average out to their value, give
+			// or take the part of a level still carried in the error at the end and the error's 1/256 resolution.
+			const bool flickers = channel->change_count > 0 && channel->longest_run > max_frames;
+			const bool strays = channel->max_output - channel->min_output > 1;
+			const bool biased = channel->change_count > 0
+				? mean_error > 2.0 / measured_frames + 1 / 256.0
+				: mean_error > (min_residual + 1) / 256.0;
+
+			if (channel->change_count > 0) {
+				dithered_count++;
+				max_dithered_mean_error = max(max_dithered_mean_error, mean_error);
+			} else {
+				max_undithered_mean_error = max(max_undithered_mean_error, mean_error);
+			}
+
+			if (flickers || strays || biased) {
+				if (out != NULL && failure_count < 10) {
+					fprintf(out,
+						"[self-check] MISMATCH dithering value=0x%04x max_frames=%u outputs=%u-%u longest_run=%u mean=%.4f\n",
+						channel->value,
+						max_frames,
+						channel->min_output,
+						channel->max_output,
+						channel->longest_run,
+						mean
+					);
+				}
+				failure_count++;
+			}
+		}
+
+		if (out != NULL) {
+			fprintf(out,
+				"[self-check] dithering with a %u frame limit: %u of %u steady values dithered, worst mean error %.4f levels (%.3f undithered)\n",
+				max_frames,
+				dithered_count,
+				pixel_count * 3,
+				max_dithered_mean_error,
+				max_undithered_mean_error
+			);
+		}
+	}
+
+	if (out != NULL) {
+		fprintf(out, "[self-check] dithering: %u frames of steady input checked, %d problems\n",
+			frame_count,
+			failure_count
+		);
+	}
+
+	free(states);
+	free(channels);
+
+	return failure_count;
+}
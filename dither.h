@@ -0,0 +1,100 @@
+/** \file
+ * Temporal dithering: carries each pixel's quantization error from 16-bit working values to 8-bit outputs into the
+ * next frame, so that over a few frames the outputs average out to the 16-bit value.
+ *
+ * Two rules keep dithering from being seen as flicker:
+ *  - A channel is only dithered if its value is far enough from the nearest output level that the odd level comes up
+ *    at least once every max_dither_frames frames (see dither_min_residual()).
+ *  - A pixel whose output dithering hasn't changed for more than max_dither_frames frames has its error cleared.
+ *
+ * Everything per pixel is byte arithmetic on a 4-byte state, so the render kernels can do 8 or 16 pixels at once.
+ */
+#ifndef _dither_h_
+#define _dither_h_
+
+#include <stdio.h>
+#include <stdint.h>
+#include <stdbool.h>
+
+/**
+ * Ages are compared modulo 256, which is only unambiguous while they stay under 128 frames apart. No pixel's error
+ * outlives this many frames without its age being refreshed.
+ */
+#define DITHER_MAX_FRAMES 127
+
+/**
+ * Dithering state of one pixel: the error carried into the next frame for each channel, in 1/256ths of an output
+ * level, and the frame (modulo 256) in which dithering last changed any of its outputs.
+ */
+typedef struct {
+	int8_t r;
+	int8_t g;
+	int8_t b;
+
+	uint8_t last_effect_frame;
+} dither_state_t;
+
+/** Clamp a dither frame limit to what dither_state_t can tell apart. */
+static inline uint8_t dither_max_frames(uint32_t max_dither_frames) {
+	return (uint8_t) (max_dither_frames < DITHER_MAX_FRAMES ? max_dither_frames : DITHER_MAX_FRAMES);
+}
+
+/**
+ * The smallest distance (in 1/256ths of an output level) from the nearest level that a channel's value must be to be
+ * dithered: closer values would only show the odd level every 256/distance frames, which is slower than max_frames.
+ * 255 means nothing is dithered.
+ */
+extern uint8_t dither_min_residual(uint8_t max_frames);
+
+/** Wrap-safe: true if last_effect_frame is more than max_frames frames before frame. */
+static inline bool dither_is_stale(uint8_t frame, uint8_t last_effect_frame, uint8_t max_frames) {
+	return (uint8_t) (frame - last_effect_frame) > max_frames;
+}
+
+/** Clear the error of a pixel that dithering hasn't visibly changed for more than max_frames frames. */
+static inline void dither_expire(dither_state_t* state, uint8_t frame, uint8_t max_frames) {
+	if (dither_is_stale(frame, state->last_effect_frame, max_frames)) {
+		state->r = 0;
+		state->g = 0;
+		state->b = 0;
+		state->last_effect_frame = frame;
+	}
+}
+
+/**
+ * Quantize a 16-bit value to 8 bits, adding in and updating the channel's carried error. Sets *changed if dithering
+ * made the output differ from plain rounding.
+ *
+ * The value rounds up when its low byte plus the error reaches 0x80, and the new error is whatever is left of the low
+ * byte plus the error after that, which always fits in an int8_t. At the top of the range the output saturates at 255
+ * but the error is kept as if it hadn't, so it can't wind up.
+ */
+static inline uint8_t dither_quantize(uint16_t value, int8_t* error, uint8_t min_residual, bool* changed) {
+	const uint8_t high = (uint8_t) (value >> 8);
+	const uint8_t low = (uint8_t) value;
+	const uint8_t exact_carry = low >> 7;
+
+	// The low byte, read as signed, is the distance from the nearest level
+	const int8_t residual = (int8_t) low;
+	const bool dithered = (residual < 0 ? -residual : residual) >= min_residual;
+	const int32_t carried = dithered ? *error : 0;
+
+	const uint8_t carry = (uint8_t) ((low + carried + 0x80) >> 8);
+	*error = dithered ? (int8_t) (uint8_t) (low + carried) : 0;
+	*changed = *changed || carry != exact_carry;
+
+	return (uint8_t) (high + carry > 255 ? 255 : high + carry);
+}
+
+/** Start count pixels afresh, e.g. when dithering is switched back on. */
+extern void dither_state_reset(dither_state_t* states, uint32_t count);
+
+/**
+ * Run constant low-level values through dithering for thousands of frames and check that every output averages out to
+ * its value without any flicker slower than the frame limit.
+ *
+ * \returns the number of problems found
+ */
+extern int dither_self_check(FILE* out);
+
+#endif
@@ -0,0 +1,308 @@
+/** \file
+ * DMX universe mapping and frame assembly, shared by the E1.31 and Art-Net servers.
+ */
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "util.h"
+#include "render.h"
+#include "dmx.h"
+
+#define min(a, b) ((a) < (b) ? (a) : (b))
+#define max(a, b) ((a) > (b) ? (a) : (b))
+
+static inline uint64_t usec_since(const struct timeval* now_tv, const struct timeval* then_tv) {
+	struct timeval delta_tv;
+	timersub(now_tv, then_tv, &delta_tv);
+	return delta_tv.tv_sec < 0 ? 0 : (uint64_t) delta_tv.tv_sec * 1000000 + delta_tv.tv_usec;
+}
+
+////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+// Universe mapping
+
+int dmx_universe_map_compile(
+	dmx_universe_map_t* out_map,
+	const dmx_universe_mapping_t* mappings,
+	uint32_t mapping_count,
+	const strip_layout_t* layout,
+	uint32_t pixel_size,
+	char* error,
+	size_t error_size
+) {
+	dmx_universe_mapping_t default_mappings[LEDSCAPE_NUM_STRIPS];
+
+	memset(out_map, 0, sizeof(*out_map));
+
+	// Default: universe N carries all of strip N-1, however long. Strips without pixels get no universe.
+	if (mapping_count == 0) {
+		for (uint16_t strip=0; strip<LEDSCAPE_NUM_STRIPS; strip++) {
+			if (layout->lengths[strip] == 0) continue;
+
+			default_mappings[mapping_count++] = (dmx_universe_mapping_t) {
+				.universe = strip + 1,
+				.strip = strip,
+				.start_pixel = 0,
+				.channel_count = layout->lengths[strip] * pixel_size
+			};
+		}
+
+		// Nothing to map; still compile an (unused) map for universe 1 so that lookups have an array to index
+		if (mapping_count == 0) {
+			default_mappings[mapping_count++] = (dmx_universe_mapping_t) { .universe = 1 };
+		}
+
+		mappings = default_mappings;
+	} else if (mapping_count > DMX_MAX_MAPPED_UNIVERSES) {
+		if (error != NULL) snprintf(error, error_size, "Too many DMX universes mapped (%u); at most %d are supported", mapping_count, DMX_MAX_MAPPED_UNIVERSES);
+		return -1;
+	} else {
+		for (uint32_t i=0; i<mapping_count; i++) {
+			const dmx_universe_mapping_t* mapping = &mappings[i];
+			const char* problem = NULL;
+
+			if (mapping->universe < 1 || mapping->universe > DMX_MAX_UNIVERSE) {
+				problem = "universe is outside of range 1-63999";
+			} else if (mapping->strip < 0 || mapping->strip >= LEDSCAPE_NUM_STRIPS) {
+				problem = "strip is outside of range 0-47";
+			} else if (mapping->channel_count < 1 || mapping->channel_count > 512) {
+				problem = "channelCount is outside of range 1-512";
+			} else if (mapping->start_pixel < 0 || (uint32_t) mapping->start_pixel > layout->lengths[mapping->strip]) {
+				problem = "startPixel is past the end of the strip";
+			} else if (mapping->start_pixel * pixel_size + mapping->channel_count > layout->lengths[mapping->strip] * pixel_size) {
+				problem = "channels run past the end of the strip";
+			}
+
+			if (problem != NULL) {
+				if (error != NULL) snprintf(error, error_size, "DMX universe mapping %u (universe %d): %s", i, mapping->universe, problem);
+				return -1;
+			}
+		}
+	}
+
+	// Every mapping is in range by now
+	uint16_t first_universe = (uint16_t) mappings[0].universe;
+	uint16_t last_universe = (uint16_t) mappings[0].universe;
+	for (uint32_t i=1; i<mapping_count; i++) {
+		first_universe = min(first_universe, (uint16_t) mappings[i].universe);
+		last_universe = max(last_universe, (uint16_t) mappings[i].universe);
+	}
+
+	out_map->first_universe = first_universe;
+	out_map->universe_span = last_universe - first_universe + 1;
+	out_map->slot_by_universe = malloc(out_map->universe_span * sizeof(int16_t));
+	if (out_map->slot_by_universe == NULL)
+		die("malloc failed: %s", strerror(errno));
+
+	memset(out_map->slot_by_universe, 0xFF, out_map->universe_span * sizeof(int16_t));
+
+	for (uint32_t i=0; i<mapping_count; i++) {
+		const dmx_universe_mapping_t* mapping = &mappings[i];
+		int16_t* slot = &out_map->slot_by_universe[mapping->universe - first_universe];
+
+		if (*slot != -1) {
+			if (error != NULL) snprintf(error, error_size, "DMX universe %d is mapped more than once", mapping->universe);
+			dmx_universe_map_free(out_map);
+			return -1;
+		}
+
+		*slot = (int16_t) i;
+		out_map->targets[i] = (dmx_universe_target_t) {
+			.frame_offset = (layout->offsets[mapping->strip] + mapping->start_pixel) * pixel_size,
+			.channel_count = mapping->channel_count
+		};
+	}
+
+	out_map->slot_count = mapping_count;
+	return 0;
+}
+
+void dmx_universe_map_free(dmx_universe_map_t* map) {
+	free(map->slot_by_universe);
+	map->slot_by_universe = NULL;
+	map->universe_span = 0;
+	map->slot_count = 0;
+}
+
+////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+// Frame assembly
+
+static inline bool slot_test(const uint64_t* slots, int slot) {
+	return (slots[slot / 64] >> (slot % 64)) & 1;
+}
+
+static inline void slot_set(uint64_t* slots, int slot) {
+	slots[slot / 64] |= 1ULL << (slot % 64);
+}
+
+static inline void slot_clear(uint64_t* slots, int slot) {
+	slots[slot / 64] &= ~(1ULL << (slot % 64));
+}
+
+void dmx_assembler_init(
+	dmx_assembler_t* assembler,
+	const char* log_prefix,
+	const dmx_universe_map_t* map,
+	uint32_t frame_data_size,
+	dmx_commit_fn commit,
+	void* commit_context
+) {
+	memset(assembler, 0, sizeof(*assembler));
+
+	assembler->log_prefix = log_prefix;
+	assembler->map = map;
+
+	assembler->frame_data_size = frame_data_size;
+	assembler->frame_data = calloc(1, frame_data_size);
+	if (assembler->frame_data == NULL)
+		die("calloc failed: %s", strerror(errno));
+
+	assembler->commit = commit;
+	assembler->commit_context = commit_context;
+
+	for (int i=0; i<DMX_MAX_MAPPED_UNIVERSES; i++) {
+		assembler->last_sequence[i] = -1;
+	}
+}
+
+void dmx_assembler_free(dmx_assembler_t* assembler) {
+	free(assembler->frame_data);
+	assembler->frame_data = NULL;
+}
+
+static void dmx_assembler_commit(dmx_assembler_t* assembler) {
+	assembler->commit(assembler->frame_data, assembler->frame_data_size, assembler->commit_context);
+
+	memset(assembler->received_slots, 0, sizeof(assembler->received_slots));
+	assembler->received_count = 0;
+	assembler->sync_address = 0;
+}
+
+/** Stop waiting for universes that have gone quiet. */
+static void dmx_assembler_expire_universes(dmx_assembler_t* assembler, const struct timeval* now_tv) {
+	for (uint32_t slot=0; slot<assembler->map->slot_count; slot++) {
+		if (slot_test(assembler->active_slots, slot)
+			&& usec_since(now_tv, &assembler->slot_seen_tv[slot]) > DMX_UNIVERSE_TIMEOUT_USEC
+		) {
+			slot_clear(assembler->active_slots, slot);
+		}
+	}
+}
+
+static bool dmx_assembler_frame_complete(const dmx_assembler_t* assembler) {
+	for (int i=0; i<DMX_SLOT_WORDS; i++) {
+		if (assembler->active_slots[i] & ~assembler->received_slots[i]) {
+			return false;
+		}
+	}
+	return true;
+}
+
+void dmx_assembler_add_packet(dmx_assembler_t* assembler, const dmx_packet_t* packet, const struct timeval* now_tv) {
+	if (packet->type == DMX_PACKET_SYNC) {
+		assembler->sync_lost = false;
+
+		if (assembler->received_count != 0 && assembler->sync_address == packet->universe) {
+			dmx_assembler_commit(assembler);
+		}
+		return;
+	}
+
+	if (packet->type != DMX_PACKET_DATA) {
+		return;
+	}
+
+	// Universes that aren't mapped are someone else's
+	const int slot = dmx_universe_map_slot(assembler->map, packet->universe);
+	if (slot < 0) {
+		return;
+	}
+
+	// Sequence numbers are kept per universe
+	const int16_t last_sequence = assembler->last_sequence[slot];
+	if (packet->sequence >= 0 && last_sequence != -1 && packet->sequence < last_sequence && (last_sequence - packet->sequence) <= 64) {
+		fprintf(stderr, "%s out of order packet for universe %d; current %d, old %d \n", assembler->log_prefix, packet->universe, packet->sequence, last_sequence);
+		return;
+	}
+	assembler->last_sequence[slot] = packet->sequence;
+
+	if (packet->stream_terminated) {
+		slot_clear(assembler->active_slots, slot);
+		assembler->last_sequence[slot] = -1;
+		return;
+	}
+
+	slot_set(assembler->active_slots, slot);
+	assembler->slot_seen_tv[slot] = *now_tv;
+
+	if (slot_test(assembler->received_slots, slot)) {
+		if (assembler->sync_address != 0) {
+			// Still waiting for the sync packet; newer data replaces the old
+			assembler->packets_coalesced++;
+		} else {
+			// The sender has moved on to the next frame without completing this one
+			assembler->frames_incomplete++;
+			dmx_assembler_commit(assembler);
+		}
+	}
+
+	if (assembler->received_count == 0) {
+		assembler->frame_start_tv = *now_tv;
+	}
+
+	const dmx_universe_target_t* target = &assembler->map->targets[slot];
+	memcpy(
+		assembler->frame_data + target->frame_offset,
+		packet->data,
+		min(packet->data_size, target->channel_count)
+	);
+
+	if (!slot_test(assembler->received_slots, slot)) {
+		slot_set(assembler->received_slots, slot);
+		assembler->received_count++;
+	}
+
+	if (packet->sync_address != 0 && !assembler->sync_lost) {
+		// Hold the frame until the sync packet releases it
+		assembler->sync_address = packet->sync_address;
+	} else if (assembler->sync_address == 0) {
+		dmx_assembler_expire_universes(assembler, now_tv);
+
+		if (dmx_assembler_frame_complete(assembler)) {
+			dmx_assembler_commit(assembler);
+		}
+	}
+}
+
+static uint64_t dmx_assembler_deadline_usec(const dmx_assembler_t* assembler) {
+	return assembler->sync_address != 0 ? DMX_SYNC_DEADLINE_USEC : DMX_FRAME_DEADLINE_USEC;
+}
+
+void dmx_assembler_check_deadline(dmx_assembler_t* assembler, const struct timeval* now_tv) {
+	if (assembler->received_count == 0) {
+		return;
+	}
+
+	if (usec_since(now_tv, &assembler->frame_start_tv) < dmx_assembler_deadline_usec(assembler)) {
+		return;
+	}
+
+	if (assembler->sync_address != 0) {
+		fprintf(stderr, "%s No sync packet for synchronization address %d; ignoring synchronization until one arrives\n", assembler->log_prefix, assembler->sync_address);
+		assembler->sync_lost = true;
+	} else {
+		assembler->frames_incomplete++;
+	}
+
+	dmx_assembler_commit(assembler);
+}
+
+int dmx_assembler_deadline_timeout_ms(const dmx_assembler_t* assembler, const struct timeval* now_tv) {
+	if (assembler->received_count == 0) {
+		return -1;
+	}
+
+	const uint64_t elapsed_usec = usec_since(now_tv, &assembler->frame_start_tv);
+	const uint64_t deadline_usec = dmx_assembler_deadline_usec(assembler);
+
+	return elapsed_usec >= deadline_usec ? 0 : (int) ((deadline_usec - elapsed_usec + 999) / 1000);
+}
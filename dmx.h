@@ -0,0 +1,173 @@
+/** \file
+ * DMX universe mapping and frame assembly, shared by the E1.31 and Art-Net servers.
+ *
+ * A logical frame arrives as many separate universe packets. The universe map says where in the frame each universe's
+ * channels go, and the assembler collects the packets and hands over one complete frame at a time: as soon as every
+ * active universe has arrived, when a synchronization packet releases a synchronized frame, or when the frame's
+ * deadline passes with universes still missing.
+ */
+#ifndef _dmx_h_
+#define _dmx_h_
+
+#include <stdint.h>
+#include <stdbool.h>
+#include <stddef.h>
+#include <sys/time.h>
+#include "ledscape.h"
+#include "render.h"
+
+/** Most universes a map can hold; enough for 48 strips of 1024 pixels at 510 channels per universe. */
+#define DMX_MAX_MAPPED_UNIVERSES 384
+
+/** Highest universe number that can be mapped (the E1.31 limit). */
+#define DMX_MAX_UNIVERSE 63999
+
+/** How long an incomplete, unsynchronized frame waits for its missing universes. */
+#define DMX_FRAME_DEADLINE_USEC 30000
+
+/** How long a synchronized frame waits for its sync packet before synchronization is considered lost. */
+#define DMX_SYNC_DEADLINE_USEC 100000
+
+/** A universe not heard from for this long no longer holds up frames. */
+#define DMX_UNIVERSE_TIMEOUT_USEC 1000000
+
+////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+// Universe mapping
+
+/**
+ * One entry of the dmxUniverses config table, as configured: wide and signed, so that out of range values stay out of
+ * range until dmx_universe_map_compile() rejects them.
+ */
+typedef struct {
+	int32_t universe;
+	int32_t strip;
+	int32_t start_pixel;
+	int32_t channel_count;
+} dmx_universe_mapping_t;
+
+/** Where a mapped universe's channels go in the frame. */
+typedef struct {
+	uint32_t frame_offset;
+	uint32_t channel_count;
+} dmx_universe_target_t;
+
+/**
+ * The universe map compiled into a flat lookup array covering the mapped universe numbers, so that finding a packet's
+ * target is a single index.
+ */
+typedef struct {
+	uint16_t first_universe;
+	uint32_t universe_span;
+	int16_t* slot_by_universe; // universe - first_universe -> slot, or -1 if not mapped
+
+	dmx_universe_target_t targets[DMX_MAX_MAPPED_UNIVERSES];
+	uint32_t slot_count;
+} dmx_universe_map_t;
+
+/**
+ * Compile a universe mapping table for frames in the given strip layout, with pixel_size channels per pixel: 3 for
+ * 8-bit pixels, or 6 for 16-bit pixels sent as coarse/fine channel pairs. An empty table gives the default mapping:
+ * universe N drives all of strip N-1.
+ *
+ * \returns 0 on success, or -1 with a description of the first bad entry in error (if non-NULL).
+ */
+extern int dmx_universe_map_compile(
+	dmx_universe_map_t* out_map,
+	const dmx_universe_mapping_t* mappings,
+	uint32_t mapping_count,
+	const strip_layout_t* layout,
+	uint32_t pixel_size,
+	char* error,
+	size_t error_size
+);
+
+extern void dmx_universe_map_free(dmx_universe_map_t* map);
+
+/** \returns the map slot of the given universe, or -1 if it isn't mapped. */
+static inline int dmx_universe_map_slot(const dmx_universe_map_t* map, uint16_t universe) {
+	const uint32_t index = (uint32_t) (universe - map->first_universe);
+	return universe >= map->first_universe && index < map->universe_span ? map->slot_by_universe[index] : -1;
+}
+
+////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+// Frame assembly
+
+typedef enum {
+	DMX_PACKET_NONE, // nothing for the assembler: invalid, preview or non-DMX data
+	DMX_PACKET_DATA,
+	DMX_PACKET_SYNC
+} dmx_packet_type_t;
+
+/** A received packet, decoded by the protocol's parser. */
+typedef struct {
+	dmx_packet_type_t type;
+
+	// Data packets: the universe. Sync packets: the synchronization address being released.
+	uint16_t universe;
+
+	// Data packets only
+	int16_t sequence;      // -1 if the packet is not sequenced
+	uint16_t sync_address; // zero if the data is not synchronized
+	bool stream_terminated;
+	const uint8_t* data;   // DMX slot values, after the start code
+	uint32_t data_size;
+} dmx_packet_t;
+
+/** Called with each assembled frame, strip-major, at the pixel size the universe map was compiled for. */
+typedef void (*dmx_commit_fn)(uint8_t* frame_data, uint32_t frame_data_size, void* context);
+
+#define DMX_SLOT_WORDS ((DMX_MAX_MAPPED_UNIVERSES + 63) / 64)
+
+typedef struct {
+	const char* log_prefix;
+	const dmx_universe_map_t* map;
+
+	uint8_t* frame_data;
+	uint32_t frame_data_size;
+
+	dmx_commit_fn commit;
+	void* commit_context;
+
+	uint64_t active_slots[DMX_SLOT_WORDS];   // universes seen within DMX_UNIVERSE_TIMEOUT_USEC
+	uint64_t received_slots[DMX_SLOT_WORDS]; // universes in the pending frame
+	uint32_t received_count;
+	struct timeval slot_seen_tv[DMX_MAX_MAPPED_UNIVERSES];
+	int16_t last_sequence[DMX_MAX_MAPPED_UNIVERSES]; // -1 until the first sequenced packet
+
+	struct timeval frame_start_tv; // when the first universe of the pending frame arrived
+	uint16_t sync_address;         // non-zero if the pending frame waits for a sync packet
+	bool sync_lost;                // sync packets stopped arriving; treat synchronized data as unsynchronized
+
+	uint32_t packets_coalesced;    // packets overwritten by a newer one before their frame was committed
+	uint32_t frames_incomplete;    // frames committed by deadline with universes missing
+} dmx_assembler_t;
+
+/**
+ * \param frame_data_size size of the whole output frame, which the map's targets index into
+ */
+extern void dmx_assembler_init(
+	dmx_assembler_t* assembler,
+	const char* log_prefix,
+	const dmx_universe_map_t* map,
+	uint32_t frame_data_size,
+	dmx_commit_fn commit,
+	void* commit_context
+);
+
+extern void dmx_assembler_free(dmx_assembler_t* assembler);
+
+/**
+ * Feed one received packet to the assembler. May commit the pending frame, either because the packet completed or
+ * released it, or because it belongs to the next frame.
+ */
+extern void dmx_assembler_add_packet(dmx_assembler_t* assembler, const dmx_packet_t* packet, const struct timeval* now_tv);
+
+/** Commit the pending frame if its deadline has passed. */
+extern void dmx_assembler_check_deadline(dmx_assembler_t* assembler, const struct timeval* now_tv);
+
+/**
+ * Milliseconds until the pending frame's deadline, rounded up, for use as a poll() timeout; -1 if nothing is pending.
+ */
+extern int dmx_assembler_deadline_timeout_ms(const dmx_assembler_t* assembler, const struct timeval* now_tv);
+
+#endif
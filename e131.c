@@ -0,0 +1,53 @@
+/** \file
+ * E1.31 (sACN) packet parsing.
+ */
+#include <string.h>
+#include "e131.h"
+
+#define E131_VECTOR_ROOT_DATA 0x00000004
+#define E131_VECTOR_ROOT_EXTENDED 0x00000008
+#define E131_VECTOR_DATA_PACKET 0x00000002
+#define E131_VECTOR_EXTENDED_SYNCHRONIZATION 0x00000001
+
+static inline uint16_t read_u16(const uint8_t* data) {
+	return (uint16_t) (data[0] << 8 | data[1]);
+}
+
+static inline uint32_t read_u32(const uint8_t* data) {
+	return (uint32_t) data[0] << 24 | (uint32_t) data[1] << 16 | (uint32_t) data[2] << 8 | data[3];
+}
+
+dmx_packet_type_t e131_parse_packet(const uint8_t* packet, uint32_t packet_size, dmx_packet_t* out_packet) {
+	memset(out_packet, 0, sizeof(*out_packet));
+
+	// Universe synchronization: an extended root layer with the synchronization framing vector
+	if (packet_size >= E131_SYNC_PACKET_SIZE
+		&& read_u32(packet + 18) == E131_VECTOR_ROOT_EXTENDED
+		&& read_u32(packet + 40) == E131_VECTOR_EXTENDED_SYNCHRONIZATION
+	) {
+		out_packet->type = DMX_PACKET_SYNC;
+		out_packet->universe = read_u16(packet + 45);
+		return out_packet->type;
+	}
+
+	// Otherwise it must be a data packet (which rules out universe discovery, for one) carrying regular DMX (start code
+	// 0) that isn't a preview
+	if (packet_size < E131_DATA_HEADER_SIZE
+		|| read_u32(packet + 18) != E131_VECTOR_ROOT_DATA
+		|| read_u32(packet + 40) != E131_VECTOR_DATA_PACKET
+		|| packet[125] != 0
+		|| (packet[112] & E131_OPTION_PREVIEW_DATA)
+	) {
+		out_packet->type = DMX_PACKET_NONE;
+		return out_packet->type;
+	}
+
+	out_packet->type = DMX_PACKET_DATA;
+	out_packet->sync_address = read_u16(packet + 109);
+	out_packet->sequence = packet[111];
+	out_packet->stream_terminated = (packet[112] & E131_OPTION_STREAM_TERMINATED) != 0;
+	out_packet->universe = read_u16(packet + 113);
+	out_packet->data = packet + E131_DATA_HEADER_SIZE;
+	out_packet->data_size = packet_size - E131_DATA_HEADER_SIZE;
+	return out_packet->type;
+}
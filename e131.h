@@ -0,0 +1,26 @@
+/** \file
+ * E1.31 (sACN) packet parsing.
+ */
+#ifndef _e131_h_
+#define _e131_h_
+
+#include <stdint.h>
+#include "dmx.h"
+
+/** Size of the root, framing and DMP layer headers in front of the DMX data, including the start code. */
+#define E131_DATA_HEADER_SIZE 126
+
+/** Size of a universe synchronization packet. */
+#define E131_SYNC_PACKET_SIZE 49
+
+// Frame data option flags
+#define E131_OPTION_PREVIEW_DATA 0x80
+#define E131_OPTION_STREAM_TERMINATED 0x40
+
+/**
+ * Decode a received packet for the DMX assembler. Packets other than data and synchronization (such as universe
+ * discovery), preview data and data with a non-zero (non-DMX) start code are reported as DMX_PACKET_NONE.
+ */
+extern dmx_packet_type_t e131_parse_packet(const uint8_t* packet, uint32_t packet_size, dmx_packet_t* out_packet);
+
+#endif
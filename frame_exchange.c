@@ -0,0 +1,330 @@
+/** \file
+ * Lock-free handoff of input frames from the network threads to the render thread.
+ */
+#include <stdlib.h>
+#include <string.h>
+#include "util.h"
+#include "ledscape.h"
+#include "frame_exchange.h"
+
+#define FRAME_EXCHANGE_INDEX_MASK 0xFF
+
+static inline unsigned atomic_exchange_uint(volatile unsigned* ptr, unsigned value) {
+	// __sync_bool_compare_and_swap is a full barrier, so slot contents written before the exchange are visible to
+	// whoever receives the index
+	unsigned old;
+	do {
+		old = *ptr;
+	} while (!__sync_bool_compare_and_swap(ptr, old, value));
+	return old;
+}
+
+void frame_exchange_resize(frame_exchange_t* fx, const strip_layout_t* layout, bool is_16bit) {
+	const uint32_t pixel_count = layout->pixel_count;
+
+	pthread_mutex_lock(&fx->producer_mutex);
+
+	for (unsigned i=0; i<FRAME_EXCHANGE_SLOT_COUNT; i++) {
+		free(fx->slots[i].data);
+		fx->slots[i].data = calloc(pixel_count, render_input_pixel_size(is_16bit));
+		if (!fx->slots[i].data)
+			die("calloc failed: %s", strerror(errno));
+
+		gettimeofday(&fx->slots[i].tv, NULL);
+	}
+
+	fx->layout = *layout;
+	fx->pixel_count = pixel_count;
+	fx->is_16bit = is_16bit;
+	fx->frame_data_size = pixel_count * render_input_pixel_size(is_16bit);
+	fx->write_index = 0;
+	fx->published_index = 1;
+	fx->ready = 1;
+	fx->current_index = 2;
+	fx->previous_index = 3;
+	fx->has_current_frame = false;
+	fx->has_prev_frame = false;
+
+	pthread_mutex_unlock(&fx->producer_mutex);
+}
+
+////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+// Producer side
+
+void* frame_exchange_begin_write(frame_exchange_t* fx) {
+	pthread_mutex_lock(&fx->producer_mutex);
+	return fx->slots[fx->write_index].data;
+}
+
+void frame_exchange_load_published(frame_exchange_t* fx) {
+	// The published slot can't be recycled as a write slot before the next commit, which needs the producer lock we
+	// hold, and the renderer only ever reads it
+	memcpy(
+		fx->slots[fx->write_index].data,
+		fx->slots[fx->published_index].data,
+		fx->frame_data_size
+	);
+}
+
+void frame_exchange_commit(frame_exchange_t* fx, bool is_remote) {
+	frame_slot_t* slot = &fx->slots[fx->write_index];
+	gettimeofday(&slot->tv, NULL);
+
+	if (is_remote) {
+		fx->last_remote_data_tv = slot->tv;
+	}
+
+	// Publish our slot and take back whichever one was waiting; it was either never taken or handed back by the
+	// renderer, so nobody else references it.
+	fx->published_index = fx->write_index;
+	const unsigned previous_ready = atomic_exchange_uint(&fx->ready, fx->write_index | FRAME_EXCHANGE_FRESH);
+	fx->write_index = previous_ready & FRAME_EXCHANGE_INDEX_MASK;
+
+	pthread_mutex_unlock(&fx->producer_mutex);
+}
+
+void frame_exchange_cancel(frame_exchange_t* fx) {
+	pthread_mutex_unlock(&fx->producer_mutex);
+}
+
+void frame_exchange_last_remote_data_tv(frame_exchange_t* fx, struct timeval* out_tv) {
+	pthread_mutex_lock(&fx->producer_mutex);
+	*out_tv = fx->last_remote_data_tv;
+	pthread_mutex_unlock(&fx->producer_mutex);
+}
+
+////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+// Renderer side
+
+bool frame_exchange_take(frame_exchange_t* fx) {
+	// Only the renderer clears the fresh flag, so once it is seen it stays set until the exchange below
+	if (!(fx->ready & FRAME_EXCHANGE_FRESH)) {
+		return false;
+	}
+
+	// Hand back the previous frame, which is no longer needed, in exchange for the new one
+	const unsigned fresh = atomic_exchange_uint(&fx->ready, fx->previous_index);
+
+	fx->previous_index = fx->current_index;
+	fx->current_index = fresh & FRAME_EXCHANGE_INDEX_MASK;
+
+	fx->has_prev_frame = fx->has_current_frame;
+	fx->has_current_frame = true;
+
+	// Update the delta time stamp
+	if (fx->has_prev_frame) {
+		timersub(
+			&fx->slots[fx->current_index].tv,
+			&fx->slots[fx->previous_index].tv,
+			&fx->prev_current_delta_tv
+		);
+	}
+
+	return true;
+}
+
+////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+// Self-check
+
+typedef struct {
+	frame_exchange_t* fx;
+	uint8_t producer_id;
+	uint16_t frame_count;
+	uint64_t max_publish_usec;
+} self_check_producer_t;
+
+static volatile unsigned g_self_check_producers_running;
+
+static void* self_check_producer_thread(void* threadarg) {
+	self_check_producer_t* producer = threadarg;
+	struct timeval start_tv, stop_tv, delta_tv;
+
+	for (uint16_t sequence=1; sequence<=producer->frame_count; sequence++) {
+		gettimeofday(&start_tv, NULL);
+
+		buffer_pixel_t* data = frame_exchange_begin_write(producer->fx);
+		for (uint32_t i=0; i<producer->fx->pixel_count; i++) {
+			data[i].r = producer->producer_id;
+			data[i].g = (uint8_t) sequence;
+			data[i].b = (uint8_t) (sequence >> 8);
+		}
+		frame_exchange_commit(producer->fx, true);
+
+		gettimeofday(&stop_tv, NULL);
+		timersub(&stop_tv, &start_tv, &delta_tv);
+		uint64_t publish_usec = delta_tv.tv_sec * 1000000ULL + delta_tv.tv_usec;
+		if (publish_usec > producer->max_publish_usec) {
+			producer->max_publish_usec = publish_usec;
+		}
+
+		// Bursts of frames, spread out over enough output frames for the consumer to take a few hundred of them
+		if (sequence % 32 == 0) {
+			usleep(1000);
+		}
+	}
+
+	__sync_fetch_and_sub(&g_self_check_producers_running, 1);
+	pthread_exit(NULL);
+}
+
+// The self-check only ever uses 8-bit frames
+static inline const buffer_pixel_t* self_check_current(const frame_exchange_t* fx) {
+	return frame_exchange_current(fx);
+}
+
+static inline const buffer_pixel_t* self_check_previous(const frame_exchange_t* fx) {
+	return frame_exchange_previous(fx);
+}
+
+static bool self_check_frame_uniform(const buffer_pixel_t* data, uint32_t pixel_count) {
+	for (uint32_t i=1; i<pixel_count; i++) {
+		if (memcmp(&data[i], &data[0], sizeof(buffer_pixel_t)) != 0) {
+			return false;
+		}
+	}
+	return true;
+}
+
+int frame_exchange_self_check(FILE* out) {
+	enum { PRODUCER_COUNT = 3 };
+	const uint16_t frames_per_producer = 20000;
+
+	strip_layout_t layout;
+	strip_layout_init(&layout, NULL, 0, 86);
+	const uint32_t pixel_count = layout.pixel_count;
+
+	frame_exchange_t fx = FRAME_EXCHANGE_INITIALIZER;
+	frame_exchange_resize(&fx, &layout, false);
+
+	self_check_producer_t producers[PRODUCER_COUNT];
+	pthread_t handles[PRODUCER_COUNT];
+	uint16_t last_sequence[PRODUCER_COUNT + 1] = { 0 };
+
+	g_self_check_producers_running = PRODUCER_COUNT;
+	for (unsigned i=0; i<PRODUCER_COUNT; i++) {
+		producers[i] = (self_check_producer_t) {
+			.fx = &fx,
+			.producer_id = (uint8_t) (i + 1),
+			.frame_count = frames_per_producer,
+			.max_publish_usec = 0
+		};
+		pthread_create(&handles[i], NULL, self_check_producer_thread, &producers[i]);
+	}
+
+	// The consumer sends each frame it takes to the memory output backend, which answers after as long as ws281x strips
+	// of the layout would take to clock it out, so that it holds on to its frames the way the render thread does
+	ledscape_t* leds = ledscape_init_with_backend(
+		LEDSCAPE_BACKEND_MEMORY,
+		layout.max_length,
+		"pru/bin/ws281x-original-ledscape-pru0.bin",
+		"pru/bin/ws281x-original-ledscape-pru1.bin",
+		0
+	);
+	unsigned buffer_index = 0;
+
+	unsigned frames_taken = 0;
+	int problem_count = 0;
+
+	while (g_self_check_producers_running > 0 || (fx.ready & FRAME_EXCHANGE_FRESH)) {
+		if (!frame_exchange_take(&fx)) {
+			usleep(50);
+			continue;
+		}
+		frames_taken++;
+
+		const buffer_pixel_t current = self_check_current(&fx)[0];
+		const buffer_pixel_t previous = self_check_previous(&fx)[0];
+
+		if (!self_check_frame_uniform(self_check_current(&fx), pixel_count)) {
+			if (out != NULL) fprintf(out, "[self-check] frame exchange: torn frame taken\n");
+			problem_count++;
+		}
+
+		const uint16_t sequence = (uint16_t) (current.g | (current.b << 8));
+		if (current.r >= 1 && current.r <= PRODUCER_COUNT) {
+			if (sequence <= last_sequence[current.r]) {
+				if (out != NULL) fprintf(out, "[self-check] frame exchange: producer %d frame %d taken after frame %d\n",
+					current.r, sequence, last_sequence[current.r]);
+				problem_count++;
+			}
+			last_sequence[current.r] = sequence;
+		} else {
+			if (out != NULL) fprintf(out, "[self-check] frame exchange: frame from unknown producer %d\n", current.r);
+			problem_count++;
+		}
+
+		// Draw the frame into the buffer that isn't being sent, wait for the last one to go out and send this one, then
+		// make sure no producer wrote to either of the renderer's slots meanwhile
+		ledscape_frame_t* const frame = ledscape_frame(leds, buffer_index);
+		for (uint32_t pixel=0; pixel<layout.max_length; pixel++) {
+			for (uint8_t strip=0; strip<LEDSCAPE_NUM_STRIPS; strip++) {
+				ledscape_set_color(frame, COLOR_ORDER_RGB, strip, (uint16_t) pixel, current.r, current.g, current.b);
+			}
+		}
+
+		if (ledscape_wait_timeout(leds, 1000) < 0) {
+			if (out != NULL) fprintf(out, "[self-check] frame exchange: output backend stopped responding\n");
+			problem_count++;
+			break;
+		}
+
+		ledscape_draw_strips(leds, buffer_index, LEDSCAPE_ALL_STRIPS, layout.max_length);
+		buffer_index = (buffer_index + 1) % 2;
+
+		if (!self_check_frame_uniform(self_check_current(&fx), pixel_count) ||
+			!self_check_frame_uniform(self_check_previous(&fx), pixel_count) ||
+			memcmp(&self_check_current(&fx)[0], &current, sizeof(current)) != 0 ||
+			memcmp(&self_check_previous(&fx)[0], &previous, sizeof(previous)) != 0) {
+			if (out != NULL) fprintf(out, "[self-check] frame exchange: producer wrote to a frame owned by the renderer\n");
+			problem_count++;
+		}
+	}
+
+	ledscape_wait_timeout(leds, 1000);
+	ledscape_close(leds);
+
+	uint64_t max_publish_usec = 0;
+	for (unsigned i=0; i<PRODUCER_COUNT; i++) {
+		pthread_join(handles[i], NULL);
+		if (producers[i].max_publish_usec > max_publish_usec) {
+			max_publish_usec = producers[i].max_publish_usec;
+		}
+	}
+
+	// Whichever producer finished last published the final frame, and the renderer must have ended up with it
+	const buffer_pixel_t last_taken = self_check_current(&fx)[0];
+	if ((uint16_t) (last_taken.g | (last_taken.b << 8)) != frames_per_producer) {
+		if (out != NULL) fprintf(out, "[self-check] frame exchange: final frame was never taken\n");
+		problem_count++;
+	}
+
+	// A partial update starts from the frame that was just taken and changes only what it writes
+	buffer_pixel_t* update = frame_exchange_begin_write(&fx);
+	frame_exchange_load_published(&fx);
+	update[0] = (buffer_pixel_t) { .r = 0, .g = 0, .b = 0 };
+	frame_exchange_commit(&fx, true);
+	frame_exchange_take(&fx);
+
+	if (self_check_current(&fx)[0].r != 0 ||
+		!self_check_frame_uniform(self_check_current(&fx) + 1, pixel_count - 1) ||
+		memcmp(&self_check_current(&fx)[1], &last_taken, sizeof(last_taken)) != 0) {
+		if (out != NULL) fprintf(out, "[self-check] frame exchange: partial update did not start from the published frame\n");
+		problem_count++;
+	}
+
+	if (out != NULL) {
+		fprintf(out, "[self-check] frame exchange: %u frames published by %d producers, %u taken, %d problems, max publish time %llu usec\n",
+			(unsigned) frames_per_producer * PRODUCER_COUNT,
+			PRODUCER_COUNT,
+			frames_taken,
+			problem_count,
+			(unsigned long long) max_publish_usec
+		);
+	}
+
+	for (unsigned i=0; i<FRAME_EXCHANGE_SLOT_COUNT; i++) {
+		free(fx.slots[i].data);
+	}
+
+	return problem_count;
+}
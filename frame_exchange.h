@@ -0,0 +1,122 @@
+/** \file
+ * Lock-free handoff of input frames from the network threads to the render thread.
+ *
+ * A triple buffer extended with one extra slot, because the renderer interpolates between two frames: at any time one
+ * slot belongs to the producers, one holds the most recently published frame and two (current and previous) belong to
+ * the renderer. Publishing and taking a frame are single atomic exchanges of the "ready" slot index, so the renderer
+ * never blocks a producer and a producer never blocks the renderer.
+ *
+ * Producers are serialized among themselves by producer_mutex, which the renderer never takes.
+ */
+#ifndef _frame_exchange_h_
+#define _frame_exchange_h_
+
+#include <stdio.h>
+#include <stdint.h>
+#include <stdbool.h>
+#include <pthread.h>
+#include <sys/time.h>
+#include "render.h"
+
+#define FRAME_EXCHANGE_SLOT_COUNT 4
+
+typedef struct {
+	void* data; // buffer_pixel16_t if the exchange is_16bit, otherwise buffer_pixel_t
+	struct timeval tv; // when the frame was published
+} frame_slot_t;
+
+typedef struct {
+	frame_slot_t slots[FRAME_EXCHANGE_SLOT_COUNT];
+	strip_layout_t layout;
+	uint32_t pixel_count; // layout.pixel_count
+	bool is_16bit;
+	uint32_t frame_data_size; // bytes in each slot
+
+	// Producer side, guarded by producer_mutex
+	pthread_mutex_t producer_mutex;
+	unsigned write_index;
+	unsigned published_index; // the most recently published slot, whether or not the renderer has taken it
+	struct timeval last_remote_data_tv;
+
+	// Index of the most recently published slot, or'd with FRAME_EXCHANGE_FRESH until the renderer takes it
+	volatile unsigned ready;
+
+	// Renderer side
+	unsigned current_index;
+	unsigned previous_index;
+	bool has_current_frame;
+	bool has_prev_frame;
+	struct timeval prev_current_delta_tv;
+} frame_exchange_t;
+
+#define FRAME_EXCHANGE_FRESH 0x100
+
+#define FRAME_EXCHANGE_INITIALIZER { \
+	.pixel_count = 0, \
+	.producer_mutex = PTHREAD_MUTEX_INITIALIZER, \
+	.write_index = 0, \
+	.published_index = 1, \
+	.ready = 1, \
+	.current_index = 2, \
+	.previous_index = 3 \
+}
+
+/**
+ * (Re)allocate the slots for frames in the given strip layout and depth, dropping any frames in flight. Must not race
+ * with the renderer; producers are locked out for the duration, so they see the layout change along with the slots.
+ */
+extern void frame_exchange_resize(frame_exchange_t* fx, const strip_layout_t* layout, bool is_16bit);
+
+////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+// Producer side
+
+/**
+ * Lock the producer side and return the slot to write the next frame into. Its contents are stale. Every call must be
+ * followed by frame_exchange_commit() or frame_exchange_cancel().
+ */
+extern void* frame_exchange_begin_write(frame_exchange_t* fx);
+
+/**
+ * Overwrite the slot returned by frame_exchange_begin_write() with the most recently published frame, for producers
+ * that only update part of it.
+ */
+extern void frame_exchange_load_published(frame_exchange_t* fx);
+
+/** Publish the slot returned by frame_exchange_begin_write() and unlock the producer side. */
+extern void frame_exchange_commit(frame_exchange_t* fx, bool is_remote);
+
+/** Unlock the producer side without publishing anything. */
+extern void frame_exchange_cancel(frame_exchange_t* fx);
+
+/** When a remote (network) frame was last published. */
+extern void frame_exchange_last_remote_data_tv(frame_exchange_t* fx, struct timeval* out_tv);
+
+////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+// Renderer side
+
+/**
+ * If a new frame has been published, make it current and the old current frame previous.
+ * \returns true if the frames rotated.
+ */
+extern bool frame_exchange_take(frame_exchange_t* fx);
+
+static inline const void* frame_exchange_current(const frame_exchange_t* fx) {
+	return fx->slots[fx->current_index].data;
+}
+
+static inline const void* frame_exchange_previous(const frame_exchange_t* fx) {
+	return fx->slots[fx->previous_index].data;
+}
+
+static inline const struct timeval* frame_exchange_current_tv(const frame_exchange_t* fx) {
+	return &fx->slots[fx->current_index].tv;
+}
+
+/**
+ * Stress the exchange with several producer threads and a consumer that sends each frame it takes to the memory output
+ * backend, checking that the consumer never sees a torn frame or a frame older than one it has already rendered.
+ * \returns the number of problems found.
+ */
+extern int frame_exchange_self_check(FILE* out);
+
+#endif
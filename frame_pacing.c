@@ -0,0 +1,176 @@
+/** \file
+ * Frame pacing monitor; see frame_pacing.h.
+ */
+#include <stdlib.h>
+#include "util.h"
+#include "frame_pacing.h"
+
+#define min(a, b) ((a) < (b) ? (a) : (b))
+#define max(a, b) ((a) > (b) ? (a) : (b))
+
+static uint64_t frame_pacing_ewma(uint64_t average_scaled, uint64_t sample, bool seed) {
+	if (seed) {
+		return sample << FRAME_PACING_EWMA_SHIFT;
+	}
+
+	// average += (sample - average) / 2^shift, kept scaled
+	return average_scaled - (average_scaled >> FRAME_PACING_EWMA_SHIFT) + sample;
+}
+
+frame_pacing_stats_t frame_pacing_update(frame_pacing_t* pacing, uint64_t render_usec, uint64_t output_usec) {
+	const bool seed = pacing->stats.frames == 0;
+
+	// Only the render thread writes, so the averages themselves don't need the lock
+	pacing->render_usec_scaled = frame_pacing_ewma(pacing->render_usec_scaled, min(render_usec, FRAME_PACING_MAX_SAMPLE_USEC), seed);
+	pacing->output_usec_scaled = frame_pacing_ewma(pacing->output_usec_scaled, min(output_usec, FRAME_PACING_MAX_SAMPLE_USEC), seed);
+
+	frame_pacing_stats_t stats = pacing->stats;
+	stats.frames++;
+	stats.render_usec = (uint32_t) (pacing->render_usec_scaled >> FRAME_PACING_EWMA_SHIFT);
+	stats.output_usec = (uint32_t) (pacing->output_usec_scaled >> FRAME_PACING_EWMA_SHIFT);
+	stats.frame_usec = stats.render_usec + stats.output_usec;
+
+	if (stats.frame_usec < FRAME_PACING_DITHER_ON_USEC) {
+		stats.dithering_enabled = true;
+	} else if (stats.frame_usec > FRAME_PACING_DITHER_OFF_USEC) {
+		stats.dithering_enabled = false;
+	}
+
+	stats.max_dither_frames = FRAME_PACING_DITHER_PERIOD_USEC / max(stats.frame_usec, 1);
+
+	pthread_mutex_lock(&pacing->mutex);
+	pacing->stats = stats;
+	pthread_mutex_unlock(&pacing->mutex);
+
+	return stats;
+}
+
+frame_pacing_stats_t frame_pacing_stats(frame_pacing_t* pacing) {
+	pthread_mutex_lock(&pacing->mutex);
+	frame_pacing_stats_t stats = pacing->stats;
+	pthread_mutex_unlock(&pacing->mutex);
+
+	return stats;
+}
+
+int frame_pacing_stats_to_json(const frame_pacing_stats_t* stats, char* buffer, size_t buffer_size) {
+	return snprintf(buffer, buffer_size,
+		"{"
+			"\"frames\": %llu, "
+			"\"renderUsec\": %u, "
+			"\"outputUsec\": %u, "
+			"\"frameUsec\": %u, "
+			"\"ditheringEnabled\": %s, "
+			"\"maxDitherFrames\": %u"
+		"}",
+		(unsigned long long) stats->frames,
+		stats->render_usec,
+		stats->output_usec,
+		stats->frame_usec,
+		stats->dithering_enabled ? "true" : "false",
+		stats->max_dither_frames
+	);
+}
+
+////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+// Self-check
+
+typedef struct {
+	const char* name;
+	uint32_t render_usec;
+	uint32_t output_usec;
+	uint32_t jitter_usec; // added to and taken from alternate frames
+	unsigned frames;
+
+	bool dithering_enabled; // expected at the end of the step
+	unsigned max_toggles; // times dithering may switch during the step
+} frame_pacing_self_check_step_t;
+
+int frame_pacing_self_check(FILE* out) {
+	const frame_pacing_self_check_step_t steps[] = {
+		{ "fast", 2000, 1000, 0, 200, true, 0 },
+		{ "just over the on threshold", 9000, 1500, 0, 200, true, 0 },
+		{ "slow", 10000, 2500, 0, 200, false, 1 },
+		{ "just under the off threshold", 9000, 1500, 0, 200, false, 0 },
+		{ "jittering around the on threshold", 8000, 2000, 3000, 400, true, 1 },
+		{ "fast again", 2000, 1000, 0, 200, true, 0 },
+		// A single stalled frame shouldn't stop dithering for a stream that's otherwise fast
+		{ "a long stall", 2000000, 1000, 0, 1, true, 0 },
+		{ "after the stall", 2000, 1000, 0, 200, true, 0 }
+	};
+
+	frame_pacing_t pacing = FRAME_PACING_INITIALIZER;
+	int failure_count = 0;
+
+	// Whole seconds count too
+	const struct timeval tv = { .tv_sec = 2, .tv_usec = 500 };
+	if (frame_pacing_tv_usec(&tv) != 2000500) {
+		if (out != NULL) {
+			fprintf(out, "[self-check] MISMATCH frame pacing: 2.000500s read as %llu usec\n",
+				(unsigned long long) frame_pacing_tv_usec(&tv)
+			);
+		}
+		failure_count++;
+	}
+
+	// The first frame seeds the averages rather than being averaged in with zero
+	frame_pacing_stats_t stats = frame_pacing_update(&pacing, 4000, 1000);
+	if (stats.frame_usec != 5000 || !stats.dithering_enabled || stats.max_dither_frames != 3) {
+		if (out != NULL) {
+			fprintf(out, "[self-check] MISMATCH frame pacing: first frame averaged to %u usec\n", stats.frame_usec);
+		}
+		failure_count++;
+	}
+
+	for (unsigned s=0; s<sizeof(steps)/sizeof(steps[0]); s++) {
+		const frame_pacing_self_check_step_t* step = &steps[s];
+		unsigned toggles = 0;
+
+		for (unsigned f=0; f<step->frames; f++) {
+			const uint32_t render_usec = (f % 2) ? step->render_usec - step->jitter_usec : step->render_usec + step->jitter_usec;
+			const bool was_enabled = stats.dithering_enabled;
+
+			stats = frame_pacing_update(&pacing, render_usec, step->output_usec);
+			toggles += stats.dithering_enabled != was_enabled;
+		}
+
+		// Once a step has run long enough the averages must have settled on its mean, give or take the ripple of any jitter
+		const uint32_t expected_usec = step->render_usec + step->output_usec;
+		const uint32_t error_usec = stats.frame_usec > expected_usec ? stats.frame_usec - expected_usec : expected_usec - stats.frame_usec;
+		const bool settled = step->frames < 200 || error_usec <= step->jitter_usec / 8 + 2;
+		const bool limit_matches = stats.max_dither_frames == FRAME_PACING_DITHER_PERIOD_USEC / max(stats.frame_usec, 1);
+
+		if (!settled || !limit_matches || stats.dithering_enabled != step->dithering_enabled || toggles > step->max_toggles) {
+			if (out != NULL) {
+				fprintf(out,
+					"[self-check] MISMATCH frame pacing %s: frame_usec=%u (expected %u) dithering=%d toggles=%u max_dither_frames=%u\n",
+					step->name,
+					stats.frame_usec,
+					expected_usec,
+					stats.dithering_enabled,
+					toggles,
+					stats.max_dither_frames
+				);
+			}
+			failure_count++;
+		}
+	}
+
+	const frame_pacing_stats_t snapshot = frame_pacing_stats(&pacing);
+	if (snapshot.frames != stats.frames || snapshot.frame_usec != stats.frame_usec ||
+		snapshot.dithering_enabled != stats.dithering_enabled || snapshot.max_dither_frames != stats.max_dither_frames) {
+		if (out != NULL) {
+			fprintf(out, "[self-check] MISMATCH frame pacing: stats snapshot differs from the last update\n");
+		}
+		failure_count++;
+	}
+
+	if (out != NULL) {
+		fprintf(out, "[self-check] frame pacing: %u load steps checked, %d problems\n",
+			(unsigned) (sizeof(steps)/sizeof(steps[0])),
+			failure_count
+		);
+	}
+
+	return failure_count;
+}
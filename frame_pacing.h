@@ -0,0 +1,85 @@
+/** \file
+ * Frame pacing monitor for the render thread.
+ *
+ * Keeps exponentially weighted averages of how long each frame takes to render and to hand to the output, updated
+ * every frame, and derives from them whether dithering can run fast enough not to be seen and how many frames it may
+ * take to show a value. The render thread is the only writer; anyone may read a snapshot with frame_pacing_stats().
+ */
+#ifndef _frame_pacing_h_
+#define _frame_pacing_h_
+
+#include <stdio.h>
+#include <stdint.h>
+#include <stdbool.h>
+#include <pthread.h>
+#include <sys/time.h>
+
+/** Each frame moves the averages 1/2^FRAME_PACING_EWMA_SHIFT of the way towards its own time. */
+#define FRAME_PACING_EWMA_SHIFT 4
+
+/** Longer frames are counted as this long: a stall says little about the frame rate that follows it. */
+#define FRAME_PACING_MAX_SAMPLE_USEC 100000
+
+/** Dithering is switched on below this average frame time (100fps)... */
+#define FRAME_PACING_DITHER_ON_USEC 10000
+
+/** ...and back off only above this one, so a frame rate hovering around the limit doesn't toggle it every frame. */
+#define FRAME_PACING_DITHER_OFF_USEC 11000
+
+/** Dithering must show a value within this long (60fps), which bounds the dither frame limit. */
+#define FRAME_PACING_DITHER_PERIOD_USEC 16667
+
+/** What the monitor currently knows, as returned by frame_pacing_stats(). Times are averages in microseconds. */
+typedef struct {
+	uint64_t frames; // frames measured since startup
+	uint32_t render_usec;
+	uint32_t output_usec; // waiting for the previous frame to go out and handing this one over
+	uint32_t frame_usec; // render_usec + output_usec
+	bool dithering_enabled;
+	uint32_t max_dither_frames;
+} frame_pacing_stats_t;
+
+typedef struct {
+	pthread_mutex_t mutex; // guards the snapshot against readers; held only briefly by the render thread
+
+	// Averages scaled by 2^FRAME_PACING_EWMA_SHIFT, so that they don't lose their fraction
+	uint64_t render_usec_scaled;
+	uint64_t output_usec_scaled;
+
+	frame_pacing_stats_t stats;
+} frame_pacing_t;
+
+#define FRAME_PACING_INITIALIZER { \
+	.mutex = PTHREAD_MUTEX_INITIALIZER, \
+	.render_usec_scaled = 0, \
+	.output_usec_scaled = 0, \
+	.stats = { .frames = 0, .dithering_enabled = false, .max_dither_frames = 0 } \
+}
+
+/** Microseconds in a timeval, whole seconds included. */
+static inline uint64_t frame_pacing_tv_usec(const struct timeval* tv) {
+	return (uint64_t) tv->tv_sec * 1000000ULL + (uint64_t) tv->tv_usec;
+}
+
+/**
+ * Add one frame's render and output times and update the dithering decision. The first frame seeds the averages.
+ *
+ * \returns the updated stats
+ */
+extern frame_pacing_stats_t frame_pacing_update(frame_pacing_t* pacing, uint64_t render_usec, uint64_t output_usec);
+
+/** A consistent snapshot of the monitor's stats; safe to call from any thread. */
+extern frame_pacing_stats_t frame_pacing_stats(frame_pacing_t* pacing);
+
+/** Write a snapshot of the stats as a JSON object into buffer. \returns what snprintf() does. */
+extern int frame_pacing_stats_to_json(const frame_pacing_stats_t* stats, char* buffer, size_t buffer_size);
+
+/**
+ * Feed synthetic frame times through a monitor and check that its averages converge, that dithering turns on and off
+ * with hysteresis and that the dither frame limit follows the frame rate.
+ *
+ * \returns the number of problems found
+ */
+extern int frame_pacing_self_check(FILE* out);
+
+#endif
@@ -9,6 +9,10 @@
 #include <inttypes.h>
 #include <errno.h>
 #include <unistd.h>
+#include <time.h>
+#include <pthread.h>
+#include <poll.h>
+#include <sys/eventfd.h>
 #include "ledscape.h"
 
 
@@ -44,20 +48,25 @@ static const uint8_t gpios3[] = {
 
 #define ARRAY_COUNT(a) ((sizeof(a) / sizeof(*a)))
 
+/** How long a PRU program may take to start, or to pick up a new command */
+#define LEDSCAPE_PRU_TIMEOUT_MS 1000
+
 
 /** Command structure shared with the PRU.
  *
  * This is mapped into the PRU data RAM and points to the
  * frame buffer in the shared DDR segment.
  *
- * Changing this requires changes in ws281x.p
+ * Changing this requires changes in pru/templates/common.p.h and the
+ * templates.  The PRU programs keep their own per-frame state in the data
+ * RAM right after it.
  */
 typedef struct ws281x_command
 {
 	// in the DDR shared with the PRU
 	uintptr_t pixels_dma;
 
-	// Length in pixels of the longest LED strip.
+	// Length in pixels to clock out of each strip this frame
 	unsigned num_pixels;
 
 	// write 1 to start, 0xFF to abort. will be cleared when started
@@ -65,9 +74,145 @@ typedef struct ws281x_command
 
 	// will have a non-zero response written when done
 	volatile unsigned response;
+
+	// Strips to clock out this frame, bit n for strip n of the whole frame;
+	// the rest are left idle.  Only the ws281x and apa102 programs use it.
+	uint32_t active_strips[2];
 } __attribute__((__packed__)) ws281x_command_t;
 
 
+/** Where the bit-plane programs report the pin of each of their channels
+ * in PRU data RAM, one (bank << 5) | bit byte per channel.  Must match
+ * CHANNEL_MAP_OFFSET in pru/templates/common.p.h.
+ */
+#define LEDSCAPE_CHANNEL_MAP_OFFSET 0xC0
+
+/** Strips driven by each PRU, and bit-plane lookup tables per PRU */
+#define LEDSCAPE_STRIPS_PER_PRU (LEDSCAPE_NUM_STRIPS / 2)
+#define LEDSCAPE_BITPLANE_GROUPS (LEDSCAPE_STRIPS_PER_PRU / 8)
+
+
+/** Host stand-in for the two PRUs, used by the memory and null backends.
+ *
+ * The command structures live in the heap instead of PRU data RAM; the memory
+ * backend's thread plays the part of the PRU programs on both of them.
+ */
+struct ledscape_emulator
+{
+	ws281x_command_t commands[2];
+
+	pthread_t thread;
+	pthread_mutex_t mutex;
+
+	// Signalled by ledscape_draw when a command is written
+	pthread_cond_t command_cond;
+
+	// Signalled by the emulator thread when a command is acknowledged or a frame has been clocked out
+	pthread_cond_t interrupt_cond;
+
+	// eventfds standing in for the PRU_EVTOUT_n interrupts; written with each response
+	int event_fds[2];
+};
+
+
+/** Set ts to the CLOCK_MONOTONIC time usec from now. */
+static void
+ledscape_deadline(
+	struct timespec * const ts,
+	unsigned long usec
+)
+{
+	clock_gettime(CLOCK_MONOTONIC, ts);
+	ts->tv_sec += usec / 1000000;
+	ts->tv_nsec += (long) (usec % 1000000) * 1000;
+	if (ts->tv_nsec >= 1000000000)
+	{
+		ts->tv_sec++;
+		ts->tv_nsec -= 1000000000;
+	}
+}
+
+
+/** Milliseconds left until a deadline, rounded up; 0 once it has passed. */
+static int
+ledscape_remaining_ms(
+	const struct timespec * const deadline
+)
+{
+	struct timespec now;
+	clock_gettime(CLOCK_MONOTONIC, &now);
+
+	const int64_t ns = (int64_t) (deadline->tv_sec - now.tv_sec) * 1000000000
+		+ (deadline->tv_nsec - now.tv_nsec);
+
+	return ns <= 0 ? 0 : (int) ((ns + 999999) / 1000000);
+}
+
+
+/** Wait until a PRU has acknowledged its command (or, if response is set,
+ * written its response), sleeping on its interrupt until the deadline.
+ *
+ * The programs raise their interrupt just before checking for a command and
+ * acknowledge one a few instructions later, so spin briefly after each
+ * interrupt instead of sleeping through the acknowledgement.
+ *
+ * \returns 1 once it has, 0 on timeout.
+ */
+static int
+ledscape_pru_wait_for(
+	pru_t * const pru,
+	const ws281x_command_t * const cmd,
+	const int response,
+	const struct timespec * const deadline
+)
+{
+	while (1)
+	{
+		for (unsigned spin = 0 ; spin < 1000 ; spin++)
+			if (response ? cmd->response != 0 : cmd->command == 0)
+				return 1;
+
+		const int remaining_ms = ledscape_remaining_ms(deadline);
+		if (remaining_ms == 0)
+			return 0;
+
+		pru_wait_interrupt(pru, remaining_ms);
+	}
+}
+
+
+/** Wait on the emulator's interrupt_cond, with its mutex held, until the deadline (forever if NULL).
+ * \returns 0 when signalled, ETIMEDOUT once the deadline has passed.
+ */
+static int
+ledscape_emulator_wait(
+	ledscape_emulator_t * const emulator,
+	const struct timespec * const deadline
+)
+{
+	if (deadline == NULL)
+		return pthread_cond_wait(&emulator->interrupt_cond, &emulator->mutex);
+
+	return pthread_cond_timedwait(&emulator->interrupt_cond, &emulator->mutex, deadline);
+}
+
+
+ledscape_frame_format_t
+ledscape_frame_format_for_program(
+	const char * const program_filename
+)
+{
+	const char * const name = strrchr(program_filename, '/');
+
+	if (strstr(name ? name + 1 : program_filename, "-packed-"))
+		return LEDSCAPE_FRAME_FORMAT_PACKED;
+	if (strstr(name ? name + 1 : program_filename, "-bitplane-"))
+		return LEDSCAPE_FRAME_FORMAT_BITPLANE;
+
+	return LEDSCAPE_FRAME_FORMAT_PADDED;
+}
+
+
 /** Retrieve one of the two frame buffers. */
 ledscape_frame_t *
 ledscape_frame(
@@ -78,7 +223,191 @@ ledscape_frame(
 	if (frame >= 2)
 		return NULL;
 
-	return (ledscape_frame_t*)((uint8_t*) leds->pru0->ddr + leds->frame_size * frame);
+	if (leds->staging_frames)
+		return (ledscape_frame_t*)(leds->staging_frames + leds->frame_size * frame);
+
+	return (ledscape_frame_t*)(leds->frames + leds->frame_size * frame);
+}
+
+
+void
+ledscape_set_staging(
+	ledscape_t * const leds,
+	int enabled
+)
+{
+	// Packed and bit-plane frames are only ever written by publishing staged ones
+	if (!enabled && leds->frame_format != LEDSCAPE_FRAME_FORMAT_PADDED)
+		return;
+
+	if (!enabled)
+	{
+		free(leds->staging_frames);
+		leds->staging_frames = NULL;
+		return;
+	}
+
+	if (leds->staging_frames)
+		return;
+
+	leds->staging_frames = malloc(2 * leds->frame_size);
+	if (!leds->staging_frames)
+		die("unable to allocate staging frames\n");
+
+	// There is nothing to copy back out of a packed or bit-plane frame
+	if (leds->frame_format != LEDSCAPE_FRAME_FORMAT_PADDED)
+		memset(leds->staging_frames, 0, 2 * leds->frame_size);
+	else
+		memcpy(leds->staging_frames, leds->frames, 2 * leds->frame_size);
+}
+
+
+/** Copy the first num_pixels rows of a frame out to a packed one, a row at
+ * a time through a cached buffer so that the uncached DDR only sees whole
+ * rows being written.
+ */
+static void
+ledscape_pack_frame(
+	uint8_t * const out,
+	const ledscape_frame_t * const frame,
+	unsigned num_pixels
+)
+{
+	uint8_t row[LEDSCAPE_NUM_STRIPS * LEDSCAPE_PACKED_PIXEL_SIZE];
+
+	for (unsigned i = 0 ; i < num_pixels ; i++)
+	{
+		uint8_t * p = row;
+		for (unsigned strip = 0 ; strip < LEDSCAPE_NUM_STRIPS ; strip++)
+		{
+			const ledscape_pixel_t * const pixel = &frame[i].strip[strip];
+			*p++ = pixel->a;
+			*p++ = pixel->b;
+			*p++ = pixel->c;
+		}
+
+		memcpy(out + i * sizeof(row), row, sizeof(row));
+	}
+}
+
+
+/** Transpose an 8x8 matrix of bits, with bit j of byte i becoming bit i of
+ * byte j.  Three rounds of swapping ever larger blocks.
+ */
+static inline uint64_t
+ledscape_transpose8(
+	uint64_t x
+)
+{
+	uint64_t t;
+	t = (x ^ (x >> 7)) & UINT64_C(0x00AA00AA00AA00AA);
+	x ^= t ^ (t << 7);
+	t = (x ^ (x >> 14)) & UINT64_C(0x0000CCCC0000CCCC);
+	x ^= t ^ (t << 14);
+	t = (x ^ (x >> 28)) & UINT64_C(0x00000000F0F0F0F0);
+	x ^= t ^ (t << 28);
+	return x;
+}
+
+
+/** Build the lookup tables for ledscape_bitplane_frame from a channel map.
+ *
+ * For each PRU, group of 8 channels and byte with a bit per channel of the
+ * group, the table holds the four GPIO bank masks of the pins of the
+ * channels whose bit is 0.
+ */
+static uint32_t *
+ledscape_bitplane_masks(
+	const uint8_t * const channel_map
+)
+{
+	uint32_t * const masks = calloc(2 * LEDSCAPE_BITPLANE_GROUPS * 256 * 4, sizeof(*masks));
+	if (!masks)
+		die("unable to allocate bit-plane tables\n");
+
+	for (unsigned pru = 0 ; pru < 2 ; pru++)
+	{
+		for (unsigned group = 0 ; group < LEDSCAPE_BITPLANE_GROUPS ; group++)
+		{
+			uint32_t * const group_masks = masks + (pru * LEDSCAPE_BITPLANE_GROUPS + group) * 256 * 4;
+
+			for (unsigned bits = 0 ; bits < 256 ; bits++)
+			{
+				for (unsigned i = 0 ; i < 8 ; i++)
+				{
+					if (bits & (1 << i))
+						continue;
+
+					const uint8_t pin = channel_map[pru * LEDSCAPE_STRIPS_PER_PRU + group * 8 + i];
+					group_masks[bits * 4 + (pin >> 5)] |= UINT32_C(1) << (pin & 31);
+				}
+			}
+		}
+	}
+
+	return masks;
+}
+
+
+/** Convert the first num_pixels rows of a frame to bit planes.
+ *
+ * Each group of 8 strips is transposed a colour byte at a time into bytes
+ * with a bit per strip, and the bank masks of each bit are the OR of one
+ * table entry per group.  Rows are built in a cached buffer and written out
+ * whole, as in ledscape_pack_frame.
+ */
+static void
+ledscape_bitplane_frame(
+	uint8_t * const out,
+	const ledscape_frame_t * const frame,
+	unsigned num_pixels,
+	const uint32_t * const masks
+)
+{
+	uint32_t row[24][2][4];
+	uint8_t planes[LEDSCAPE_BITPLANE_GROUPS][24];
+
+	for (unsigned i = 0 ; i < num_pixels ; i++)
+	{
+		for (unsigned pru = 0 ; pru < 2 ; pru++)
+		{
+			for (unsigned group = 0 ; group < LEDSCAPE_BITPLANE_GROUPS ; group++)
+			{
+				const ledscape_pixel_t * const pixels = &frame[i].strip[pru * LEDSCAPE_STRIPS_PER_PRU + group * 8];
+				uint64_t a = 0, b = 0, c = 0;
+
+				for (unsigned strip = 0 ; strip < 8 ; strip++)
+				{
+					a |= (uint64_t) pixels[strip].a << (strip * 8);
+					b |= (uint64_t) pixels[strip].b << (strip * 8);
+					c |= (uint64_t) pixels[strip].c << (strip * 8);
+				}
+
+				// Bits 0-7 of the 24 sent for each pixel are in a, 8-15 in b and 16-23 in c
+				a = ledscape_transpose8(a);
+				b = ledscape_transpose8(b);
+				c = ledscape_transpose8(c);
+				memcpy(&planes[group][0], &a, 8);
+				memcpy(&planes[group][8], &b, 8);
+				memcpy(&planes[group][16], &c, 8);
+			}
+
+			const uint32_t * const pru_masks = masks + pru * LEDSCAPE_BITPLANE_GROUPS * 256 * 4;
+
+			// The bits are sent from 23 down to 0
+			for (unsigned bit = 0 ; bit < 24 ; bit++)
+			{
+				const uint32_t * const m0 = pru_masks + planes[0][bit] * 4;
+				const uint32_t * const m1 = pru_masks + (256 + planes[1][bit]) * 4;
+				const uint32_t * const m2 = pru_masks + (512 + planes[2][bit]) * 4;
+
+				for (unsigned bank = 0 ; bank < 4 ; bank++)
+					row[23 - bit][pru][bank] = m0[bank] | m1[bank] | m2[bank];
+			}
+		}
+
+		memcpy(out + i * sizeof(row), row, sizeof(row));
+	}
 }
 
 
@@ -89,12 +418,115 @@ ledscape_draw(
 	unsigned int frame
 )
 {
+	ledscape_draw_strips(leds, frame, LEDSCAPE_ALL_STRIPS, leds->num_pixels);
+}
+
+
+void
+ledscape_set_strip_lengths(
+	ledscape_t * const leds,
+	const uint32_t * lengths
+)
+{
+	for (unsigned strip = 0 ; strip < LEDSCAPE_NUM_STRIPS ; strip++)
+		leds->strip_lengths[strip] = lengths[strip] < leds->num_pixels
+			? lengths[strip]
+			: leds->num_pixels;
+}
+
+
+void
+ledscape_draw_strips(
+	ledscape_t * const leds,
+	unsigned int frame,
+	uint64_t active_strips,
+	unsigned num_pixels
+)
+{
+	if (leds->backend == LEDSCAPE_BACKEND_NULL)
+		return;
+
+	// Strips without pixels are never sent, and no strip is clocked out past
+	// the end of the longest one that is
+	unsigned longest_strip = 0;
+	for (unsigned strip = 0 ; strip < LEDSCAPE_NUM_STRIPS ; strip++)
+	{
+		if (leds->strip_lengths[strip] == 0)
+			active_strips &= ~(UINT64_C(1) << strip);
+		else if (active_strips & (UINT64_C(1) << strip) && leds->strip_lengths[strip] > longest_strip)
+			longest_strip = leds->strip_lengths[strip];
+	}
+
+	if (num_pixels > longest_strip)
+		num_pixels = longest_strip;
+
+	// Wait for any current command to have been acknowledged, which the
+	// outputs do as soon as they have finished clocking out the frame before
+	struct timespec deadline;
+	ledscape_deadline(&deadline, LEDSCAPE_PRU_TIMEOUT_MS * 1000UL);
+
+	int acked = 1;
+	if (leds->backend == LEDSCAPE_BACKEND_MEMORY)
+	{
+		pthread_mutex_lock(&leds->emulator->mutex);
+		while (acked && (leds->ws281x_0->command || leds->ws281x_1->command))
+			acked = ledscape_emulator_wait(leds->emulator, &deadline) != ETIMEDOUT;
+		pthread_mutex_unlock(&leds->emulator->mutex);
+	} else {
+		acked = ledscape_pru_wait_for(leds->pru0, leds->ws281x_0, 0, &deadline)
+			&& ledscape_pru_wait_for(leds->pru1, leds->ws281x_1, 0, &deadline);
+	}
+
+	if (!acked)
+	{
+		fprintf(stderr, "Outputs did not acknowledge the last frame within %d ms; dropping frame %u\n",
+			LEDSCAPE_PRU_TIMEOUT_MS,
+			frame
+		);
+		return;
+	}
 
-	leds->ws281x_0->pixels_dma = leds->pru0->ddr_addr + leds->frame_size * frame;
-	leds->ws281x_1->pixels_dma = leds->pru0->ddr_addr + leds->frame_size * frame;
+	// Nothing has changed; leave the responses set so that ledscape_wait
+	// returns straight away, without a round trip through the PRUs
+	if (active_strips == 0 || num_pixels == 0)
+		return;
 
-	// Wait for any current command to have been acknowledged
-	while (leds->ws281x_0->command || leds->ws281x_1->command);
+	// Publish the staged pixels, every strip as deep as this frame goes, with
+	// one sequential copy; the outputs finished reading this frame two draws ago
+	if (leds->staging_frames)
+	{
+		struct timespec start_ts, stop_ts;
+		clock_gettime(CLOCK_MONOTONIC, &start_ts);
+
+		uint8_t * const out = leds->frames + leds->output_frame_size * frame;
+		const ledscape_frame_t * const staged = (const ledscape_frame_t *)(leds->staging_frames + leds->frame_size * frame);
+
+		switch (leds->frame_format)
+		{
+		case LEDSCAPE_FRAME_FORMAT_PACKED:
+			ledscape_pack_frame(out, staged, num_pixels);
+			break;
+		case LEDSCAPE_FRAME_FORMAT_BITPLANE:
+			ledscape_bitplane_frame(out, staged, num_pixels, leds->bitplane_masks);
+			break;
+		default:
+			memcpy(out, staged, num_pixels * sizeof(ledscape_frame_t));
+			break;
+		}
+
+		clock_gettime(CLOCK_MONOTONIC, &stop_ts);
+		leds->publish_usec += (uint64_t) (stop_ts.tv_sec - start_ts.tv_sec) * 1000000
+			+ (stop_ts.tv_nsec - start_ts.tv_nsec) / 1000;
+		leds->publish_count++;
+	}
+
+	leds->ws281x_0->pixels_dma = leds->frames_dma + leds->output_frame_size * frame;
+	leds->ws281x_1->pixels_dma = leds->frames_dma + leds->output_frame_size * frame;
+
+	leds->ws281x_0->num_pixels = leds->ws281x_1->num_pixels = num_pixels;
+
+	leds->ws281x_0->active_strips[0] = leds->ws281x_1->active_strips[0] = (uint32_t) active_strips;
+	leds->ws281x_0->active_strips[1] = leds->ws281x_1->active_strips[1] = (uint32_t) (active_strips >> 32);
 
 	// Zero the responses so we can wait for them
 	leds->ws281x_0->response = leds->ws281x_1->response = 0;
@@ -102,74 +534,241 @@ ledscape_draw(
 	// Send the start command
 	leds->ws281x_0->command = 1;
 	leds->ws281x_1->command = 1;
+
+	if (leds->backend == LEDSCAPE_BACKEND_MEMORY)
+	{
+		pthread_mutex_lock(&leds->emulator->mutex);
+		pthread_cond_signal(&leds->emulator->command_cond);
+		pthread_mutex_unlock(&leds->emulator->mutex);
+	}
+}
+
+
+int
+ledscape_event_fd(
+	ledscape_t * const leds,
+	unsigned pru_num
+)
+{
+	if (pru_num >= 2)
+		return -1;
+
+	switch (leds->backend)
+	{
+		case LEDSCAPE_BACKEND_PRU: return (pru_num == 0 ? leds->pru0 : leds->pru1)->event_fd;
+		case LEDSCAPE_BACKEND_MEMORY: return leds->emulator->event_fds[pru_num];
+		default: return -1;
+	}
+}
+
+
+/** Memory backend half of ledscape_wait_timeout */
+static int
+ledscape_emulator_wait_timeout(
+	ledscape_t * const leds,
+	int timeout_ms
+)
+{
+	ledscape_emulator_t * const emulator = leds->emulator;
+
+	struct timespec deadline;
+	if (timeout_ms >= 0)
+		ledscape_deadline(&deadline, timeout_ms * 1000UL);
+
+	pthread_mutex_lock(&emulator->mutex);
+
+	int timed_out = 0;
+	while (!timed_out && (!leds->ws281x_0->response || !leds->ws281x_1->response))
+		timed_out = ledscape_emulator_wait(emulator, timeout_ms >= 0 ? &deadline : NULL) == ETIMEDOUT;
+
+	if (leds->ws281x_0->response && leds->ws281x_1->response)
+	{
+		// Drain the stand-in interrupts, as pru_clear_interrupt does
+		for (unsigned i = 0 ; i < 2 ; i++)
+		{
+			uint64_t count;
+			if (read(emulator->event_fds[i], &count, sizeof(count)) < 0 && errno != EAGAIN)
+				die("read of output backend events failed: %s\n", strerror(errno));
+		}
+		timed_out = 0;
+	}
+
+	pthread_mutex_unlock(&emulator->mutex);
+
+	if (timed_out)
+	{
+		errno = ETIMEDOUT;
+		return -1;
+	}
+
+	return 0;
+}
+
+
+int
+ledscape_wait_timeout(
+	ledscape_t * const leds,
+	int timeout_ms
+)
+{
+	if (leds->backend == LEDSCAPE_BACKEND_NULL)
+		return 0;
+
+	if (leds->backend == LEDSCAPE_BACKEND_MEMORY)
+		return ledscape_emulator_wait_timeout(leds, timeout_ms);
+
+	struct timespec deadline;
+	if (timeout_ms >= 0)
+		ledscape_deadline(&deadline, timeout_ms * 1000UL);
+
+	while (1)
+	{
+		// Only watch the PRUs still clocking out; one that has finished
+		// keeps raising its interrupt until it is given the next command
+		struct pollfd pfds[2];
+		pru_t * prus[2];
+		unsigned num_fds = 0;
+
+		if (!leds->ws281x_0->response)
+		{
+			pfds[num_fds] = (struct pollfd) { .fd = leds->pru0->event_fd, .events = POLLIN };
+			prus[num_fds++] = leds->pru0;
+		}
+		if (!leds->ws281x_1->response)
+		{
+			pfds[num_fds] = (struct pollfd) { .fd = leds->pru1->event_fd, .events = POLLIN };
+			prus[num_fds++] = leds->pru1;
+		}
+
+		if (num_fds == 0)
+			return 0;
+
+		const int ret = poll(pfds, num_fds, timeout_ms < 0 ? -1 : ledscape_remaining_ms(&deadline));
+		if (ret < 0)
+		{
+			if (errno == EINTR)
+				continue;
+			return -1;
+		}
+
+		if (ret == 0)
+		{
+			// The response may have landed just before the deadline
+			if (leds->ws281x_0->response && leds->ws281x_1->response)
+				return 0;
+
+			errno = ETIMEDOUT;
+			return -1;
+		}
+
+		for (unsigned i = 0 ; i < num_fds ; i++)
+			if (pfds[i].revents & POLLIN)
+				pru_clear_interrupt(prus[i]);
+	}
 }
 
 
-/** Wait for the current frame to finish transfering to the strips.
- * \returns a token indicating the response code.
- */
 void
 ledscape_wait(
 	ledscape_t * const leds
 )
 {
+	ledscape_wait_timeout(leds, -1);
+}
+
+
+/** Raise the memory backend's stand-in interrupts; called with the emulator mutex held. */
+static void
+ledscape_emulator_interrupt(
+	ledscape_emulator_t * const emulator
+)
+{
+	const uint64_t one = 1;
+
+	for (unsigned i = 0 ; i < 2 ; i++)
+		if (write(emulator->event_fds[i], &one, sizeof(one)) < 0 && errno != EAGAIN)
+			die("write of output backend events failed: %s\n", strerror(errno));
+
+	pthread_cond_broadcast(&emulator->interrupt_cond);
+}
+
+
+/** Memory backend stand-in for the PRU programs.
+ *
+ * Acknowledges each start command as soon as both are written, then holds the
+ * response back for frame_usec from that point, so the render loop sees the
+ * same draw/wait timing it would against real strips.  Partial frames take
+ * the same fraction of frame_usec as the fraction of the pixels they send.
+ */
+static void *
+ledscape_emulator_thread(
+	void * const arg
+)
+{
+	ledscape_t * const leds = arg;
+	ledscape_emulator_t * const emulator = leds->emulator;
+
+	pthread_mutex_lock(&emulator->mutex);
+
+	// Signal a proper startup, as the PRU programs do
+	leds->ws281x_0->response = leds->ws281x_1->response = 1;
+	ledscape_emulator_interrupt(emulator);
+
 	while (1)
 	{
-		pru_wait_interrupt();
+		while (!leds->ws281x_0->command || !leds->ws281x_1->command)
+			pthread_cond_wait(&emulator->command_cond, &emulator->mutex);
 
-		// printf("pru0: (%d,%d), pru1: (%d,%d)\n",
-		// 	leds->ws281x_0->command, leds->ws281x_0->response,
-		// 	leds->ws281x_1->command, leds->ws281x_1->response
-		// );
+		if (leds->ws281x_0->command == 0xFF || leds->ws281x_1->command == 0xFF)
+			break;
 
-		if (leds->ws281x_0->response && leds->ws281x_1->response) return;
-	}
-}
+		struct timespec done_ts;
+		ledscape_deadline(&done_ts, (uint64_t) leds->frame_usec * leds->ws281x_0->num_pixels / leds->num_pixels);
 
+		leds->ws281x_0->command = leds->ws281x_1->command = 0;
+		pthread_cond_broadcast(&emulator->interrupt_cond);
+		pthread_mutex_unlock(&emulator->mutex);
 
-ledscape_t * ledscape_init( unsigned num_pixels ) {
-	return ledscape_init_with_programs(
-		num_pixels,
-		"pru/bin/ws281x-original-ledscape-pru0.bin",
-		"pru/bin/ws281x-original-ledscape-pru1.bin"
-	);
+		// Clock out the frame
+		while (clock_nanosleep(CLOCK_MONOTONIC, TIMER_ABSTIME, &done_ts, NULL) == EINTR);
+
+		pthread_mutex_lock(&emulator->mutex);
+		leds->ws281x_0->response = leds->ws281x_1->response = 1;
+		ledscape_emulator_interrupt(emulator);
+	}
+
+	pthread_mutex_unlock(&emulator->mutex);
+	return NULL;
 }
 
-ledscape_t * ledscape_init_with_programs(
-	unsigned num_pixels,
-	const char* pru0_program_filename,
-	const char* pru1_program_filename
+
+static void
+ledscape_init_pru(
+	ledscape_t * const leds
 )
 {
 	pru_t * const pru0 = pru_init(0);
 	pru_t * const pru1 = pru_init(1);
 
-	const size_t frame_size = num_pixels * LEDSCAPE_NUM_STRIPS * 4;
-
-	if (2*frame_size > pru0->ddr_size)
+	if (2*leds->output_frame_size > pru0->ddr_size)
 		die("Pixel data needs at least 2 * %zu, only %zu in DDR\n",
-			frame_size,
+			leds->output_frame_size,
 			pru0->ddr_size
 		);
 
-	ledscape_t * const leds = calloc(1, sizeof(*leds));
-
-	*leds = (ledscape_t) {
-		.pru0		= pru0,
-		.pru1		= pru1,
-		.num_pixels	= num_pixels,
-		.frame_size	= frame_size,
-		.pru0_program_filename  = pru0_program_filename,
-		.pru1_program_filename  = pru1_program_filename,
-		.ws281x_0	= pru0->data_ram,
-		.ws281x_1	= pru1->data_ram
-	};
+	leds->pru0 = pru0;
+	leds->pru1 = pru1;
+	leds->frames = pru0->ddr;
+	leds->frames_dma = pru0->ddr_addr;
+	leds->ws281x_0 = pru0->data_ram;
+	leds->ws281x_1 = pru1->data_ram;
 
 	*(leds->ws281x_0) = *(leds->ws281x_1) = (ws281x_command_t) {
 		.pixels_dma	= 0, // will be set in draw routine
 		.command	= 0,
 		.response	= 0,
 		.num_pixels	= leds->num_pixels,
+		.active_strips	= { UINT32_MAX, UINT32_MAX },
 	};
 
 	// Configure all of our output pins.
@@ -182,25 +781,172 @@ ledscape_t * ledscape_init_with_programs(
 	for (unsigned i = 0 ; i < ARRAY_COUNT(gpios3) ; i++)
 		pru_gpio(3, gpios3[i], 1, 0);
 
+	struct timespec deadline;
+
 	// Initiate the PRU0 program
-	pru_exec(pru0, pru0_program_filename);
+	pru_exec(pru0, leds->pru0_program_filename);
 
 	// Watch for a done response that indicates a proper startup
-	// \todo timeout if it fails
-	fprintf(stdout, "String PRU0 with %s... ", pru0_program_filename);
-	while (!leds->ws281x_0->response);
+	fprintf(stdout, "String PRU0 with %s... ", leds->pru0_program_filename);
+	fflush(stdout);
+	ledscape_deadline(&deadline, LEDSCAPE_PRU_TIMEOUT_MS * 1000UL);
+	if (!ledscape_pru_wait_for(pru0, leds->ws281x_0, 1, &deadline))
+		die("PRU0 did not start within %d ms\n", LEDSCAPE_PRU_TIMEOUT_MS);
 	printf("OK\n");
 
 
 	// Initiate the PRU1 program
-	pru_exec(pru1, pru1_program_filename);
+	pru_exec(pru1, leds->pru1_program_filename);
 
 	// Watch for a done response that indicates a proper startup
-	// \todo timeout if it fails
-	fprintf(stdout, "String PRU1 with %s... ", pru1_program_filename);
-	while (!leds->ws281x_1->response);
+	fprintf(stdout, "String PRU1 with %s... ", leds->pru1_program_filename);
+	fflush(stdout);
+	ledscape_deadline(&deadline, LEDSCAPE_PRU_TIMEOUT_MS * 1000UL);
+	if (!ledscape_pru_wait_for(pru1, leds->ws281x_1, 1, &deadline))
+		die("PRU1 did not start within %d ms\n", LEDSCAPE_PRU_TIMEOUT_MS);
 	printf("OK\n");
 
+	// The bit-plane programs have reported their pins by the time they start
+	if (leds->frame_format == LEDSCAPE_FRAME_FORMAT_BITPLANE)
+	{
+		memcpy(leds->channel_map,
+			(const uint8_t *) pru0->data_ram + LEDSCAPE_CHANNEL_MAP_OFFSET,
+			LEDSCAPE_STRIPS_PER_PRU);
+		memcpy(leds->channel_map + LEDSCAPE_STRIPS_PER_PRU,
+			(const uint8_t *) pru1->data_ram + LEDSCAPE_CHANNEL_MAP_OFFSET,
+			LEDSCAPE_STRIPS_PER_PRU);
+	}
+}
+
+
+static void
+ledscape_init_emulator(
+	ledscape_t * const leds
+)
+{
+	ledscape_emulator_t * const emulator = calloc(1, sizeof(*emulator));
+	uint8_t * const frames = calloc(2, leds->output_frame_size);
+
+	if (emulator == NULL || frames == NULL)
+		die("Unable to allocate %zu bytes of pixel data\n", 2 * leds->output_frame_size);
+
+	// Nothing is clocked out, so any pins will do for bit-plane frames;
+	// give each PRU's channels the bits of bank 0 in order
+	for (unsigned strip = 0 ; strip < LEDSCAPE_NUM_STRIPS ; strip++)
+		leds->channel_map[strip] = strip % LEDSCAPE_STRIPS_PER_PRU;
+
+	leds->emulator = emulator;
+	leds->frames = frames;
+	leds->frames_dma = (uintptr_t) frames;
+	leds->ws281x_0 = &emulator->commands[0];
+	leds->ws281x_1 = &emulator->commands[1];
+
+	*(leds->ws281x_0) = *(leds->ws281x_1) = (ws281x_command_t) {
+		.pixels_dma	= 0, // will be set in draw routine
+		.command	= 0,
+		.response	= 0,
+		.num_pixels	= leds->num_pixels,
+		.active_strips	= { UINT32_MAX, UINT32_MAX },
+	};
+
+	if (leds->backend != LEDSCAPE_BACKEND_MEMORY)
+	{
+		printf("Using %s output backend; frames will not be clocked out\n", ledscape_backend_to_string(leds->backend));
+		return;
+	}
+
+	emulator->event_fds[0] = eventfd(0, EFD_NONBLOCK | EFD_CLOEXEC);
+	emulator->event_fds[1] = eventfd(0, EFD_NONBLOCK | EFD_CLOEXEC);
+	if (emulator->event_fds[0] < 0 || emulator->event_fds[1] < 0)
+		die("Unable to create output backend events: %s\n", strerror(errno));
+
+	// Timed waits for the outputs are measured against CLOCK_MONOTONIC
+	pthread_condattr_t condattr;
+	pthread_condattr_init(&condattr);
+	pthread_condattr_setclock(&condattr, CLOCK_MONOTONIC);
+
+	pthread_mutex_init(&emulator->mutex, NULL);
+	pthread_cond_init(&emulator->command_cond, NULL);
+	pthread_cond_init(&emulator->interrupt_cond, &condattr);
+	pthread_condattr_destroy(&condattr);
+
+	fprintf(stdout, "Starting memory output backend with %u usec per frame... ", leds->frame_usec);
+
+	const int err = pthread_create(&emulator->thread, NULL, ledscape_emulator_thread, leds);
+	if (err != 0)
+		die("Unable to start output backend thread: %s\n", strerror(err));
+
+	// Wait for the same startup response the PRU programs give
+	ledscape_wait(leds);
+	printf("OK\n");
+}
+
+
+ledscape_t * ledscape_init( unsigned num_pixels ) {
+	return ledscape_init_with_programs(
+		num_pixels,
+		"pru/bin/ws281x-original-ledscape-pru0.bin",
+		"pru/bin/ws281x-original-ledscape-pru1.bin"
+	);
+}
+
+ledscape_t * ledscape_init_with_programs(
+	unsigned num_pixels,
+	const char* pru0_program_filename,
+	const char* pru1_program_filename
+)
+{
+	return ledscape_init_with_backend(
+		LEDSCAPE_BACKEND_PRU,
+		num_pixels,
+		pru0_program_filename,
+		pru1_program_filename,
+		0
+	);
+}
+
+ledscape_t * ledscape_init_with_backend(
+	ledscape_backend_t backend,
+	unsigned num_pixels,
+	const char* pru0_program_filename,
+	const char* pru1_program_filename,
+	unsigned frame_usec
+)
+{
+	ledscape_t * const leds = calloc(1, sizeof(*leds));
+
+	*leds = (ledscape_t) {
+		.backend	= backend,
+		.frame_format	= ledscape_frame_format_for_program(pru0_program_filename),
+		.num_pixels	= num_pixels,
+		.frame_size	= num_pixels * LEDSCAPE_NUM_STRIPS * 4,
+		.output_frame_size	= num_pixels * LEDSCAPE_NUM_STRIPS * 4,
+		.frame_usec	= frame_usec != 0
+			? frame_usec
+			: num_pixels * LEDSCAPE_WS281X_PIXEL_USEC + LEDSCAPE_WS281X_RESET_USEC,
+		.pru0_program_filename  = pru0_program_filename,
+		.pru1_program_filename  = pru1_program_filename
+	};
+
+	for (unsigned strip = 0 ; strip < LEDSCAPE_NUM_STRIPS ; strip++)
+		leds->strip_lengths[strip] = num_pixels;
+
+	if (leds->frame_format == LEDSCAPE_FRAME_FORMAT_PACKED)
+		leds->output_frame_size = num_pixels * LEDSCAPE_NUM_STRIPS * LEDSCAPE_PACKED_PIXEL_SIZE;
+	else if (leds->frame_format == LEDSCAPE_FRAME_FORMAT_BITPLANE)
+		leds->output_frame_size = num_pixels * LEDSCAPE_BITPLANE_ROW_SIZE;
+
+	if (backend == LEDSCAPE_BACKEND_PRU)
+		ledscape_init_pru(leds);
+	else
+		ledscape_init_emulator(leds);
+
+	if (leds->frame_format == LEDSCAPE_FRAME_FORMAT_BITPLANE)
+		leds->bitplane_masks = ledscape_bitplane_masks(leds->channel_map);
+
+	if (leds->frame_format != LEDSCAPE_FRAME_FORMAT_PADDED)
+		ledscape_set_staging(leds, 1);
+
 	return leds;
 }
 
@@ -241,14 +987,163 @@ color_channel_order_t color_channel_order_from_string(const char* str) {
 	}
 }
 
+const char* ledscape_backend_to_string(ledscape_backend_t backend) {
+	switch (backend) {
+		case LEDSCAPE_BACKEND_PRU: return "pru";
+		case LEDSCAPE_BACKEND_MEMORY: return "memory";
+		case LEDSCAPE_BACKEND_NULL: return "null";
+		default: return "<invalid ledscape_backend>";
+	}
+}
+
+ledscape_backend_t ledscape_backend_from_string(const char* str) {
+	if (strcasecmp(str, "pru") == 0) {
+		return LEDSCAPE_BACKEND_PRU;
+	}
+	else if (strcasecmp(str, "memory") == 0) {
+		return LEDSCAPE_BACKEND_MEMORY;
+	}
+	else if (strcasecmp(str, "null") == 0) {
+		return LEDSCAPE_BACKEND_NULL;
+	}
+	else {
+		return -1;
+	}
+}
+
 void
 ledscape_close(
 	ledscape_t * const leds
 )
 {
+	free(leds->staging_frames);
+	leds->staging_frames = NULL;
+	free(leds->bitplane_masks);
+	leds->bitplane_masks = NULL;
+
+	if (leds->backend != LEDSCAPE_BACKEND_PRU)
+	{
+		ledscape_emulator_t * const emulator = leds->emulator;
+
+		if (leds->backend == LEDSCAPE_BACKEND_MEMORY)
+		{
+			pthread_mutex_lock(&emulator->mutex);
+			leds->ws281x_0->command = 0xFF;
+			leds->ws281x_1->command = 0xFF;
+			pthread_cond_signal(&emulator->command_cond);
+			pthread_mutex_unlock(&emulator->mutex);
+
+			pthread_join(emulator->thread, NULL);
+			pthread_cond_destroy(&emulator->interrupt_cond);
+			pthread_cond_destroy(&emulator->command_cond);
+			pthread_mutex_destroy(&emulator->mutex);
+			close(emulator->event_fds[0]);
+			close(emulator->event_fds[1]);
+		}
+
+		free(leds->frames);
+		free(emulator);
+		free(leds);
+		return;
+	}
+
 	// Signal a halt command
 	leds->ws281x_0->command = 0xFF;
 	leds->ws281x_1->command = 0xFF;
 	pru_close(leds->pru0);
 	pru_close(leds->pru1);
+	free(leds);
+}
+
+
+/** Small PRNG for ledscape_self_check */
+static uint32_t
+ledscape_self_check_random(
+	uint32_t * const state
+)
+{
+	*state = *state * 1103515245 + 12345;
+	return *state >> 8;
+}
+
+
+int
+ledscape_self_check(
+	FILE * const out
+)
+{
+	const unsigned num_pixels = 37;
+	const unsigned maps = 8;
+	const size_t out_size = num_pixels * LEDSCAPE_BITPLANE_ROW_SIZE;
+
+	ledscape_frame_t * const frame = malloc(num_pixels * sizeof(*frame));
+	uint8_t * const planes = malloc(out_size);
+	uint32_t * const reference = malloc(out_size);
+	if (!frame || !planes || !reference)
+		die("unable to allocate self-check frames\n");
+
+	uint32_t rng = 0x4c454473;
+	unsigned mismatches = 0;
+
+	for (unsigned map = 0 ; map < maps ; map++)
+	{
+		// Give each PRU's channels distinct pins, spread over all four banks
+		uint8_t channel_map[LEDSCAPE_NUM_STRIPS];
+		for (unsigned pru = 0 ; pru < 2 ; pru++)
+		{
+			uint8_t pins[128];
+			for (unsigned pin = 0 ; pin < 128 ; pin++)
+				pins[pin] = pin;
+
+			for (unsigned i = 0 ; i < LEDSCAPE_STRIPS_PER_PRU ; i++)
+			{
+				const unsigned j = i + ledscape_self_check_random(&rng) % (128 - i);
+				const uint8_t pin = pins[j];
+				pins[j] = pins[i];
+				channel_map[pru * LEDSCAPE_STRIPS_PER_PRU + i] = pin;
+			}
+		}
+
+		uint8_t * const bytes = (uint8_t *) frame;
+		for (size_t i = 0 ; i < num_pixels * sizeof(*frame) ; i++)
+			bytes[i] = (uint8_t) ledscape_self_check_random(&rng);
+
+		uint32_t * const masks = ledscape_bitplane_masks(channel_map);
+		ledscape_bitplane_frame(planes, frame, num_pixels, masks);
+		free(masks);
+
+		// One bit at a time: the pins of the strips sending a 0 for each bit
+		memset(reference, 0, out_size);
+		for (unsigned i = 0 ; i < num_pixels ; i++)
+		{
+			for (unsigned strip = 0 ; strip < LEDSCAPE_NUM_STRIPS ; strip++)
+			{
+				const ledscape_pixel_t * const pixel = &frame[i].strip[strip];
+				const uint32_t value = pixel->a | (pixel->b << 8) | (pixel->c << 16);
+				const unsigned pru = strip / LEDSCAPE_STRIPS_PER_PRU;
+				const uint8_t pin = channel_map[strip];
+
+				for (unsigned bit = 0 ; bit < 24 ; bit++)
+				{
+					if (value & (1 << bit))
+						continue;
+
+					reference[((i * 24 + 23 - bit) * 2 + pru) * 4 + (pin >> 5)] |= UINT32_C(1) << (pin & 31);
+				}
+			}
+		}
+
+		if (memcmp(planes, reference, out_size) != 0)
+			mismatches++;
+	}
+
+	fprintf(out, "[self-check] bit-plane frames vs a bit at a time: %u channel maps checked, %u mismatches\n",
+		maps,
+		mismatches
+	);
+
+	free(frame);
+	free(planes);
+	free(reference);
+	return mismatches;
 }
@@ -8,6 +8,7 @@
 #ifndef _ledscape_h_
 #define _ledscape_h_
 
+#include <stdio.h>
 #include <stdint.h>
 #include "pru.h"
 
@@ -18,6 +19,9 @@
  */
 #define LEDSCAPE_NUM_STRIPS 48
 
+/** Strip mask for ledscape_draw_strips with every strip set */
+#define LEDSCAPE_ALL_STRIPS ((UINT64_C(1) << LEDSCAPE_NUM_STRIPS) - 1)
+
 
 /**
  * An LEDscape "pixel" consists of three channels of output and an unused fourth channel. The color mapping of these
@@ -42,16 +46,82 @@ typedef struct {
 	ledscape_pixel_t strip[LEDSCAPE_NUM_STRIPS];
 } __attribute__((__packed__)) ledscape_frame_t;
 
+/** How the outputs expect frames to be laid out in DDR.
+ *
+ * Frames are always rendered as ledscape_frame_t.  Programs built from a
+ * "-packed" template, such as ws281x-packed, read them without the unused
+ * fourth byte, LEDSCAPE_PACKED_PIXEL_SIZE bytes per strip per pixel, which
+ * takes a quarter off the DDR written by the ARM and far more off what the
+ * PRU reads.
+ *
+ * Programs built from a "-bitplane" template read each pixel already split
+ * into its 24 bits: for every bit, in the order they are sent, each PRU's
+ * four GPIO bank masks of the pins to lower early, those of the strips
+ * sending a 0.  The PRU writes them straight out without testing any bits,
+ * at the cost of frames four times the size.  The programs report the pin
+ * of each of their channels when they start, which the masks are built
+ * from.
+ *
+ * ledscape converts the pixels as it publishes the staged frame, so staging
+ * is always on for anything but padded frames.
+ */
+typedef enum {
+	LEDSCAPE_FRAME_FORMAT_PADDED = 0,
+	LEDSCAPE_FRAME_FORMAT_PACKED = 1,
+	LEDSCAPE_FRAME_FORMAT_BITPLANE = 2
+} ledscape_frame_format_t;
+
+/** Bytes per strip per pixel in a packed frame */
+#define LEDSCAPE_PACKED_PIXEL_SIZE 3
+
+/** Bytes per pixel row in a bit-plane frame: 24 bits, 2 PRUs, 4 GPIO banks */
+#define LEDSCAPE_BITPLANE_ROW_SIZE (24 * 2 * 4 * sizeof(uint32_t))
+
 typedef struct ws281x_command ws281x_command_t;
 
+/** Where frames passed to ledscape_draw go.
+ *
+ * The memory and null backends stand in for the PRUs so the rest of the
+ * pipeline can run on a workstation without /dev/mem or UIO.  The memory
+ * backend runs the ws281x command/response handshake against a thread that
+ * takes as long to acknowledge each frame as the strips would take to clock
+ * it out; the null backend finishes every frame as soon as it is drawn.
+ */
+typedef enum {
+	LEDSCAPE_BACKEND_PRU = 0,
+	LEDSCAPE_BACKEND_MEMORY = 1,
+	LEDSCAPE_BACKEND_NULL = 2
+} ledscape_backend_t;
+
+/** Time taken by ws281x strips to clock out each pixel (24 bits at 800kHz) */
+#define LEDSCAPE_WS281X_PIXEL_USEC 30
+
+/** Time ws281x strips need to latch a frame once the last pixel is sent */
+#define LEDSCAPE_WS281X_RESET_USEC 50
+
+typedef struct ledscape_emulator ledscape_emulator_t;
+
 typedef struct {
+	ledscape_backend_t backend;
 	ws281x_command_t * ws281x_0;
 	ws281x_command_t * ws281x_1;
 	pru_t * pru0;
 	pru_t * pru1;
+	ledscape_emulator_t * emulator;
+	ledscape_frame_format_t frame_format;
+	uint8_t * frames;
+	uintptr_t frames_dma;
+	size_t output_frame_size; // the size of each frame in DDR, in frame_format
+	uint8_t channel_map[LEDSCAPE_NUM_STRIPS]; // (bank << 5) | bit of each strip's pin, for bit-plane frames
+	uint32_t * bitplane_masks; // lookup tables built from channel_map, for bit-plane frames
+	uint8_t * staging_frames; // cached copies of frames to render into, or NULL
+	uint64_t publish_usec; // time spent copying staged frames out, summed
+	unsigned publish_count;
 	const char* pru0_program_filename;
 	const char* pru1_program_filename;
 	unsigned num_pixels;
+	unsigned strip_lengths[LEDSCAPE_NUM_STRIPS];
+	unsigned frame_usec;
 	size_t frame_size;
 } ledscape_t;
 
@@ -76,6 +146,35 @@ extern ledscape_t * ledscape_init_with_programs(
 	const char* pru1_program_filename
 );
 
+/** Start LEDscape on the given backend.
+ *
+ * frame_usec sets how long the memory backend takes to clock out each frame;
+ * 0 uses the time ws281x strips of num_pixels would take.  The PRU and null
+ * backends ignore it.
+ */
+extern ledscape_t * ledscape_init_with_backend(
+	ledscape_backend_t backend,
+	unsigned num_pixels,
+	const char* pru0_program_filename,
+	const char* pru1_program_filename,
+	unsigned frame_usec
+);
+
+
+/** The frame format a PRU program reads, from its file name */
+extern ledscape_frame_format_t
+ledscape_frame_format_for_program(
+	const char * const program_filename
+);
+
+/** Check the conversion of frames to bit planes against a bit at a time
+ * reference, printing a summary to out.  Returns the number of problems.
+ */
+extern int
+ledscape_self_check(
+	FILE * const out
+);
+
 
 extern ledscape_frame_t *
 ledscape_frame(
@@ -83,12 +182,57 @@ ledscape_frame(
 	unsigned frame
 );
 
+/** Render into cached staging buffers instead of the frames themselves.
+ *
+ * The PRU frames live in DDR that is mapped uncached, so every store to
+ * them goes straight out to memory and reading them back is slower still.
+ * With staging on, ledscape_frame returns an ordinary buffer, and
+ * ledscape_draw_strips copies the pixels it is about to send out to the
+ * real frame in one go, adding the time taken to publish_usec.  Turning it
+ * on starts the staging buffers off as copies of the frames.  Programs that
+ * read packed or bit-plane frames always stage, and ignore requests to turn
+ * it off.
+ */
+extern void
+ledscape_set_staging(
+	ledscape_t * const leds,
+	int enabled
+);
+
 extern void
 ledscape_draw(
 	ledscape_t * const leds,
 	unsigned frame
 );
 
+/** Like ledscape_draw, but only clock out the first num_pixels pixels of the
+ * strips set in active_strips (bit n for strip n), and no more than the
+ * longest of them has (see ledscape_set_strip_lengths).
+ *
+ * The other strips are left idle and keep showing the last frame they were
+ * sent, and a frame with no strips or pixels is not sent at all.  Only the
+ * ws281x and apa102 programs can skip strips; the rest clock out num_pixels
+ * of every strip.
+ */
+extern void
+ledscape_draw_strips(
+	ledscape_t * const leds,
+	unsigned frame,
+	uint64_t active_strips,
+	unsigned num_pixels
+);
+
+/** Set how many pixels each strip really has, for strips shorter than
+ * num_pixels.  Frames are still laid out num_pixels deep, but no frame is
+ * clocked out further than the longest strip it sends, and strips of length
+ * zero are left idle.  Every strip is num_pixels long until this is called.
+ */
+extern void
+ledscape_set_strip_lengths(
+	ledscape_t * const leds,
+	const uint32_t * lengths
+);
+
 inline void ledscape_pixel_set_color(
 	ledscape_pixel_t * const out_pixel,
 	color_channel_order_t color_channel_order,
@@ -153,12 +297,40 @@ inline void ledscape_set_color(
 	);
 }
 
+/** Wait for the current frame to finish transfering to the strips. */
 extern void
 ledscape_wait(
 	ledscape_t * const leds
 );
 
+/** Wait up to timeout_ms (forever if negative) for the current frame to finish.
+ *
+ * \returns 0 once both outputs have responded, or -1 with errno set to
+ * ETIMEDOUT if they have not, which means a PRU has stopped responding.
+ */
+extern int
+ledscape_wait_timeout(
+	ledscape_t * const leds,
+	int timeout_ms
+);
+
+/** Pollable fd that becomes readable when an output raises its interrupt.
+ *
+ * For event loops that want to wait on a frame alongside other fds; once it
+ * polls readable, call ledscape_wait_timeout(leds, 0) to consume the event.
+ * The PRU programs keep raising their interrupt while idle, so only watch it
+ * while a frame is in flight.
+ *
+ * \returns -1 for the null backend, which has no interrupts.
+ */
+extern int
+ledscape_event_fd(
+	ledscape_t * const leds,
+	unsigned pru_num
+);
+
 
+/** Stop the outputs and free leds, which must not be used again. */
 extern void
 ledscape_close(
 	ledscape_t * const leds
@@ -173,4 +345,12 @@ extern color_channel_order_t color_channel_order_from_string(
 	const char* str
 );
 
+extern const char* ledscape_backend_to_string(
+	ledscape_backend_t backend
+);
+
+extern ledscape_backend_t ledscape_backend_from_string(
+	const char* str
+);
+
 #endif
@@ -0,0 +1,28 @@
+/** \file
+*  Runs the self-checks of the LEDscape modules, linked in directly: the frame handoff under concurrent producers, the
+*  tiled render pool, lookup table rebuilds and handoff, the bit-plane frame conversion, dithering and frame pacing.
+*
+*  Built and run by `make check`. Each check prints a summary line, and a line for each mismatch it finds; the exit
+*  status is non-zero if any of them found a problem. The render kernel check stays in `opc-server --self-check`, so
+*  that it can be run against the kernel of the machine the server runs on.
+*/
+#include <stdio.h>
+#include <stdlib.h>
+#include "ledscape.h"
+#include "render.h"
+#include "dither.h"
+#include "frame_exchange.h"
+#include "frame_pacing.h"
+
+int main(void) {
+	int problem_count = frame_exchange_self_check(stdout);
+	problem_count += render_pool_self_check(stdout);
+	problem_count += render_lut_self_check(stdout);
+	problem_count += ledscape_self_check(stdout);
+	problem_count += dither_self_check(stdout);
+	problem_count += frame_pacing_self_check(stdout);
+
+	printf("[check] %s: %d problems\n", problem_count == 0 ? "OK" : "FAILED", problem_count);
+
+	return problem_count == 0 ? EXIT_SUCCESS : EXIT_FAILURE;
+}
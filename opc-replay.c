@@ -0,0 +1,649 @@
+/** \file
+*  Replays captured OPC, E1.31 and Art-Net traffic at an opc-server over loopback.
+*
+*  Reads a pcap capture (as written by tcpdump -w) and resends every UDP datagram and TCP stream payload in it to the
+*  same port on the target host, keeping the captured timing (or running as fast as possible). Useful for reproducing
+*  a controller's traffic and comparing the server's rx_info, reactor_info and fps_info output between changes.
+*/
+#define _GNU_SOURCE
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdbool.h>
+#include <unistd.h>
+#include <string.h>
+#include <errno.h>
+#include <getopt.h>
+#include <time.h>
+#include <sys/time.h>
+#include <sys/socket.h>
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+#include <arpa/inet.h>
+#include "util.h"
+
+////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+// DEFINES, CONSTANTS and UTILS
+
+#define PCAP_MAGIC_USEC 0xA1B2C3D4
+#define PCAP_MAGIC_NSEC 0xA1B23C4D
+
+#define LINKTYPE_NULL 0
+#define LINKTYPE_ETHERNET 1
+#define LINKTYPE_RAW 101
+#define LINKTYPE_LINUX_SLL 113
+#define LINKTYPE_LINUX_SLL2 276
+
+#define IP_PROTOCOL_TCP 6
+#define IP_PROTOCOL_UDP 17
+
+#define MAX_PORT_MAPPINGS 8
+#define MAX_TCP_FLOWS 16
+#define MAX_IP_FRAGMENT_BUFFERS 4
+#define MAX_REPORTED_PORTS 16
+
+static inline uint16_t read_u16_be(const uint8_t* data) {
+	return (uint16_t) (data[0] << 8 | data[1]);
+}
+
+static inline uint32_t read_u32(const uint8_t* data, bool swapped) {
+	uint32_t value;
+	memcpy(&value, data, sizeof(value));
+	return swapped ? __builtin_bswap32(value) : value;
+}
+
+////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+// TYPES
+
+typedef struct {
+	uint16_t from;
+	uint16_t to;
+} port_mapping_t;
+
+typedef struct {
+	char host[256];
+	double speed; // 1 replays at the captured rate, 0 as fast as possible
+	uint32_t loops;
+	port_mapping_t port_mappings[MAX_PORT_MAPPINGS];
+	uint32_t port_mapping_count;
+	const char* capture_filename;
+} replay_config_t;
+
+/** One captured TCP connection, replayed over a connection of its own. */
+typedef struct {
+	bool in_use;
+	uint8_t src_addr[16];
+	uint16_t src_port;
+	uint16_t dst_port;
+	int sock;
+} tcp_flow_t;
+
+/** Reassembly of a fragmented IPv4 datagram. */
+typedef struct {
+	bool in_use;
+	uint8_t src_addr[4];
+	uint8_t dst_addr[4];
+	uint16_t id;
+	uint8_t protocol;
+	uint32_t bytes_received;
+	uint32_t total_size; // zero until the last fragment arrives
+	uint8_t data[65536];
+} ip_fragment_buffer_t;
+
+typedef struct {
+	uint16_t port;
+	uint64_t packets;
+	uint64_t bytes;
+} port_stats_t;
+
+static replay_config_t g_config = {
+	.host = "127.0.0.1",
+	.speed = 1,
+	.loops = 1,
+	.port_mapping_count = 0,
+	.capture_filename = NULL
+};
+
+static struct {
+	struct sockaddr_storage target_addr;
+	socklen_t target_addr_len;
+	int udp_sock;
+
+	tcp_flow_t tcp_flows[MAX_TCP_FLOWS];
+	ip_fragment_buffer_t* fragment_buffers;
+
+	port_stats_t port_stats[MAX_REPORTED_PORTS];
+	uint32_t port_stats_count;
+	uint64_t skipped_packets;
+} g_replay;
+
+////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+// Sending
+
+static uint16_t map_port(uint16_t port) {
+	for (uint32_t i=0; i<g_config.port_mapping_count; i++) {
+		if (g_config.port_mappings[i].from == port) return g_config.port_mappings[i].to;
+	}
+	return port;
+}
+
+static void count_payload(uint16_t port, size_t size) {
+	for (uint32_t i=0; i<g_replay.port_stats_count; i++) {
+		if (g_replay.port_stats[i].port == port) {
+			g_replay.port_stats[i].packets++;
+			g_replay.port_stats[i].bytes += size;
+			return;
+		}
+	}
+
+	if (g_replay.port_stats_count < MAX_REPORTED_PORTS) {
+		g_replay.port_stats[g_replay.port_stats_count++] = (port_stats_t) { .port = port, .packets = 1, .bytes = size };
+	}
+}
+
+static struct sockaddr* target_addr_for_port(uint16_t port) {
+	struct sockaddr* addr = (struct sockaddr*) &g_replay.target_addr;
+
+	if (addr->sa_family == AF_INET) {
+		((struct sockaddr_in*) addr)->sin_port = htons(port);
+	} else {
+		((struct sockaddr_in6*) addr)->sin6_port = htons(port);
+	}
+
+	return addr;
+}
+
+static void send_udp(uint16_t dst_port, const uint8_t* payload, size_t payload_size) {
+	const uint16_t port = map_port(dst_port);
+
+	if (sendto(g_replay.udp_sock, payload, payload_size, 0, target_addr_for_port(port), g_replay.target_addr_len) < 0) {
+		warn("sendto port %d failed: %s\n", port, strerror(errno));
+		return;
+	}
+
+	count_payload(port, payload_size);
+}
+
+static tcp_flow_t* find_tcp_flow(const uint8_t* src_addr, uint16_t src_port, uint16_t dst_port) {
+	for (int i=0; i<MAX_TCP_FLOWS; i++) {
+		tcp_flow_t* flow = &g_replay.tcp_flows[i];
+		if (flow->in_use && flow->src_port == src_port && flow->dst_port == dst_port && memcmp(flow->src_addr, src_addr, 16) == 0) {
+			return flow;
+		}
+	}
+	return NULL;
+}
+
+static void close_tcp_flow(tcp_flow_t* flow) {
+	close(flow->sock);
+	flow->in_use = false;
+}
+
+static void send_tcp(
+	const uint8_t* src_addr,
+	uint16_t src_port,
+	uint16_t dst_port,
+	uint8_t flags,
+	const uint8_t* payload,
+	size_t payload_size
+) {
+	tcp_flow_t* flow = find_tcp_flow(src_addr, src_port, dst_port);
+
+	// A new connection from the same client port replaces the old one
+	if (flow != NULL && (flags & TH_SYN)) {
+		close_tcp_flow(flow);
+		flow = NULL;
+	}
+
+	if (flow == NULL && payload_size > 0) {
+		for (int i=0; i<MAX_TCP_FLOWS && flow == NULL; i++) {
+			if (!g_replay.tcp_flows[i].in_use) flow = &g_replay.tcp_flows[i];
+		}
+
+		if (flow == NULL) {
+			g_replay.skipped_packets++;
+			return;
+		}
+
+		const uint16_t port = map_port(dst_port);
+		const struct sockaddr* addr = target_addr_for_port(port);
+
+		flow->sock = socket(addr->sa_family, SOCK_STREAM, 0);
+		if (flow->sock < 0)
+			die("socket failed: %s\n", strerror(errno));
+
+		if (connect(flow->sock, addr, g_replay.target_addr_len) < 0) {
+			warn("connect to port %d failed: %s\n", port, strerror(errno));
+			close(flow->sock);
+			g_replay.skipped_packets++;
+			return;
+		}
+
+		const int on = 1;
+		setsockopt(flow->sock, IPPROTO_TCP, TCP_NODELAY, &on, sizeof(on));
+
+		flow->in_use = true;
+		memcpy(flow->src_addr, src_addr, 16);
+		flow->src_port = src_port;
+		flow->dst_port = dst_port;
+	}
+
+	if (flow == NULL) {
+		return;
+	}
+
+	if (payload_size > 0) {
+		if (write_all(flow->sock, payload, payload_size) < 0) {
+			warn("write to port %d failed: %s\n", map_port(dst_port), strerror(errno));
+			close_tcp_flow(flow);
+			return;
+		}
+
+		count_payload(map_port(dst_port), payload_size);
+	}
+
+	if (flags & (TH_FIN | TH_RST)) {
+		close_tcp_flow(flow);
+	}
+}
+
+////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+// Packet decoding
+
+static void handle_transport(
+	uint8_t protocol,
+	const uint8_t* src_addr, // 16 bytes; IPv4 addresses are zero padded
+	const uint8_t* segment,
+	size_t segment_size
+) {
+	if (protocol == IP_PROTOCOL_UDP && segment_size >= 8) {
+		const uint16_t udp_size = read_u16_be(segment + 4);
+		if (udp_size < 8 || udp_size > segment_size) {
+			g_replay.skipped_packets++;
+			return;
+		}
+
+		send_udp(read_u16_be(segment + 2), segment + 8, udp_size - 8);
+	} else if (protocol == IP_PROTOCOL_TCP && segment_size >= 20) {
+		const size_t header_size = (segment[12] >> 4) * 4;
+		if (header_size < 20 || header_size > segment_size) {
+			g_replay.skipped_packets++;
+			return;
+		}
+
+		send_tcp(
+			src_addr,
+			read_u16_be(segment),
+			read_u16_be(segment + 2),
+			segment[13],
+			segment + header_size,
+			segment_size - header_size
+		);
+	}
+}
+
+/**
+* Add a fragment of an IPv4 datagram. Fragments are assumed not to overlap, which holds for anything a sender's own
+* stack produces.
+*/
+static void handle_ipv4_fragment(const uint8_t* header, const uint8_t* payload, size_t payload_size) {
+	const uint16_t id = read_u16_be(header + 4);
+	const uint16_t fragment_field = read_u16_be(header + 6);
+	const uint32_t offset = (fragment_field & 0x1FFF) * 8;
+	const bool more_fragments = (fragment_field & 0x2000) != 0;
+
+	ip_fragment_buffer_t* buffer = NULL;
+	for (int i=0; i<MAX_IP_FRAGMENT_BUFFERS && buffer == NULL; i++) {
+		ip_fragment_buffer_t* candidate = &g_replay.fragment_buffers[i];
+		if (candidate->in_use && candidate->id == id && candidate->protocol == header[9]
+			&& memcmp(candidate->src_addr, header + 12, 4) == 0 && memcmp(candidate->dst_addr, header + 16, 4) == 0
+		) {
+			buffer = candidate;
+		}
+	}
+
+	if (buffer == NULL) {
+		// Take a free buffer, or give up on the oldest incomplete datagram
+		static unsigned next_victim = 0;
+		for (int i=0; i<MAX_IP_FRAGMENT_BUFFERS && buffer == NULL; i++) {
+			if (!g_replay.fragment_buffers[i].in_use) buffer = &g_replay.fragment_buffers[i];
+		}
+		if (buffer == NULL) {
+			buffer = &g_replay.fragment_buffers[next_victim++ % MAX_IP_FRAGMENT_BUFFERS];
+			g_replay.skipped_packets++;
+		}
+
+		buffer->in_use = true;
+		memcpy(buffer->src_addr, header + 12, 4);
+		memcpy(buffer->dst_addr, header + 16, 4);
+		buffer->id = id;
+		buffer->protocol = header[9];
+		buffer->bytes_received = 0;
+		buffer->total_size = 0;
+	}
+
+	if (offset + payload_size > sizeof(buffer->data)) {
+		buffer->in_use = false;
+		g_replay.skipped_packets++;
+		return;
+	}
+
+	memcpy(buffer->data + offset, payload, payload_size);
+	buffer->bytes_received += payload_size;
+	if (!more_fragments) {
+		buffer->total_size = offset + payload_size;
+	}
+
+	if (buffer->total_size != 0 && buffer->bytes_received == buffer->total_size) {
+		uint8_t src_addr[16] = {0};
+		memcpy(src_addr, buffer->src_addr, 4);
+
+		handle_transport(buffer->protocol, src_addr, buffer->data, buffer->total_size);
+		buffer->in_use = false;
+	}
+}
+
+static void handle_ip(const uint8_t* packet, size_t packet_size) {
+	if (packet_size < 1) return;
+
+	const uint8_t version = packet[0] >> 4;
+	uint8_t src_addr[16] = {0};
+
+	if (version == 4 && packet_size >= 20) {
+		const size_t header_size = (packet[0] & 0x0F) * 4;
+		const size_t total_size = read_u16_be(packet + 2);
+		if (header_size < 20 || total_size < header_size || total_size > packet_size) {
+			g_replay.skipped_packets++;
+			return;
+		}
+
+		if (read_u16_be(packet + 6) & 0x3FFF) {
+			handle_ipv4_fragment(packet, packet + header_size, total_size - header_size);
+			return;
+		}
+
+		memcpy(src_addr, packet + 12, 4);
+		handle_transport(packet[9], src_addr, packet + header_size, total_size - header_size);
+	} else if (version == 6 && packet_size >= 40) {
+		// Extension headers are not followed; OPC, E1.31 and Art-Net senders don't use them
+		const size_t payload_size = read_u16_be(packet + 4);
+		if (40 + payload_size > packet_size) {
+			g_replay.skipped_packets++;
+			return;
+		}
+
+		memcpy(src_addr, packet + 8, 16);
+		handle_transport(packet[6], src_addr, packet + 40, payload_size);
+	}
+}
+
+static void handle_frame(uint32_t linktype, const uint8_t* frame, size_t frame_size) {
+	size_t offset;
+	uint16_t ethertype;
+
+	switch (linktype) {
+		case LINKTYPE_ETHERNET:
+			if (frame_size < 14) return;
+			offset = 14;
+			ethertype = read_u16_be(frame + 12);
+			if (ethertype == 0x8100 && frame_size >= 18) {
+				ethertype = read_u16_be(frame + 16);
+				offset = 18;
+			}
+			if (ethertype != 0x0800 && ethertype != 0x86DD) return;
+			break;
+
+		case LINKTYPE_LINUX_SLL:
+			if (frame_size < 16) return;
+			offset = 16;
+			break;
+
+		case LINKTYPE_LINUX_SLL2:
+			if (frame_size < 20) return;
+			offset = 20;
+			break;
+
+		case LINKTYPE_NULL:
+			if (frame_size < 4) return;
+			offset = 4;
+			break;
+
+		case LINKTYPE_RAW:
+		default:
+			offset = 0;
+			break;
+	}
+
+	handle_ip(frame + offset, frame_size - offset);
+}
+
+////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+// Replay
+
+static uint64_t now_usec() {
+	struct timespec ts;
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return (uint64_t) ts.tv_sec * 1000000 + ts.tv_nsec / 1000;
+}
+
+/**
+* Replay the capture once.
+* \returns the number of captured packets read
+*/
+static uint64_t replay_capture(FILE* capture) {
+	uint8_t global_header[24];
+	if (fread(global_header, 1, sizeof(global_header), capture) != sizeof(global_header))
+		die("%s: not a pcap file\n", g_config.capture_filename);
+
+	bool swapped;
+	bool nanoseconds;
+	const uint32_t magic = read_u32(global_header, false);
+
+	if (magic == PCAP_MAGIC_USEC || magic == PCAP_MAGIC_NSEC) {
+		swapped = false;
+		nanoseconds = magic == PCAP_MAGIC_NSEC;
+	} else if (__builtin_bswap32(magic) == PCAP_MAGIC_USEC || __builtin_bswap32(magic) == PCAP_MAGIC_NSEC) {
+		swapped = true;
+		nanoseconds = __builtin_bswap32(magic) == PCAP_MAGIC_NSEC;
+	} else {
+		die("%s: not a pcap file (pcapng captures can be converted with editcap -F pcap)\n", g_config.capture_filename);
+	}
+
+	const uint32_t linktype = read_u32(global_header + 20, swapped) & 0xFFFF;
+	const uint32_t snaplen = read_u32(global_header + 16, swapped);
+
+	uint8_t* frame = malloc(snaplen > 65536 ? snaplen : 65536);
+	if (frame == NULL)
+		die("malloc failed: %s\n", strerror(errno));
+
+	uint64_t packet_count = 0;
+	uint64_t first_capture_usec = 0;
+	const uint64_t start_usec = now_usec();
+
+	uint8_t record_header[16];
+	while (fread(record_header, 1, sizeof(record_header), capture) == sizeof(record_header)) {
+		const uint64_t capture_usec = (uint64_t) read_u32(record_header, swapped) * 1000000
+			+ read_u32(record_header + 4, swapped) / (nanoseconds ? 1000 : 1);
+		const uint32_t captured_size = read_u32(record_header + 8, swapped);
+
+		if (captured_size > (snaplen > 65536 ? snaplen : 65536)) {
+			die("%s: corrupt record after %" PRIu64 " packets\n", g_config.capture_filename, packet_count);
+		}
+
+		if (fread(frame, 1, captured_size, capture) != captured_size) {
+			warn("%s: truncated record after %" PRIu64 " packets\n", g_config.capture_filename, packet_count);
+			break;
+		}
+
+		if (packet_count == 0) {
+			first_capture_usec = capture_usec;
+		}
+
+		// Keep the captured spacing, scaled by the speed
+		if (g_config.speed > 0 && capture_usec > first_capture_usec) {
+			const uint64_t due_usec = start_usec + (uint64_t) ((capture_usec - first_capture_usec) / g_config.speed);
+			const uint64_t current_usec = now_usec();
+			if (due_usec > current_usec) {
+				usleep(due_usec - current_usec);
+			}
+		}
+
+		handle_frame(linktype, frame, captured_size);
+		packet_count++;
+	}
+
+	free(frame);
+	return packet_count;
+}
+
+static void resolve_target() {
+	struct sockaddr_in* addr4 = (struct sockaddr_in*) &g_replay.target_addr;
+	struct sockaddr_in6* addr6 = (struct sockaddr_in6*) &g_replay.target_addr;
+
+	memset(&g_replay.target_addr, 0, sizeof(g_replay.target_addr));
+
+	if (inet_pton(AF_INET, g_config.host, &addr4->sin_addr) == 1) {
+		addr4->sin_family = AF_INET;
+		g_replay.target_addr_len = sizeof(*addr4);
+	} else if (inet_pton(AF_INET6, g_config.host, &addr6->sin6_addr) == 1) {
+		addr6->sin6_family = AF_INET6;
+		g_replay.target_addr_len = sizeof(*addr6);
+	} else {
+		die("Invalid host address: %s\n", g_config.host);
+	}
+
+	g_replay.udp_sock = socket(addr4->sin_family, SOCK_DGRAM, 0);
+	if (g_replay.udp_sock < 0)
+		die("socket failed: %s\n", strerror(errno));
+
+	// Captured bursts can outrun the default buffer
+	const int send_buffer_size = 4 * 1024 * 1024;
+	setsockopt(g_replay.udp_sock, SOL_SOCKET, SO_SNDBUF, &send_buffer_size, sizeof(send_buffer_size));
+}
+
+////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+// main()
+static struct option long_options[] =
+	{
+		{"host", required_argument, NULL, 'H'},
+		{"speed", required_argument, NULL, 's'},
+		{"loop", required_argument, NULL, 'l'},
+		{"port", required_argument, NULL, 'p'},
+		{"help", no_argument, NULL, 'h'},
+		{NULL, 0, NULL, 0}
+	};
+
+static void print_usage(char ** argv) {
+	printf("Usage: %s [options] capture.pcap\n", argv[0]);
+	printf("\n");
+	printf("--host <addr>, -H <addr>\n\tThe address to replay to (default 127.0.0.1)\n");
+	printf("--speed <factor>, -s <factor>\n\tReplay speed relative to the capture; 0 sends as fast as possible (default 1)\n");
+	printf("--loop <count>, -l <count>\n\tThe number of times to replay the capture (default 1)\n");
+	printf("--port <from>:<to>, -p <from>:<to>\n\tSends traffic captured on port <from> to port <to> instead; may be repeated\n");
+	printf("--help, -h\n\tDisplays this help message\n");
+}
+
+void handle_args(int argc, char ** argv) {
+	extern char *optarg;
+
+	int opt;
+	while ((opt = getopt_long(argc, argv, "H:s:l:p:h", long_options, NULL)) != -1)
+	{
+		switch (opt)
+		{
+			case 'H': {
+				strlcpy(g_config.host, optarg, sizeof(g_config.host));
+			} break;
+
+			case 's': {
+				g_config.speed = atof(optarg);
+			} break;
+
+			case 'l': {
+				g_config.loops = (uint32_t) atoi(optarg);
+			} break;
+
+			case 'p': {
+				unsigned from, to;
+
+				if (sscanf(optarg, "%u:%u", &from, &to) != 2 || from > 65535 || to > 65535) {
+					printf("Invalid argument for --port; expected <from>:<to>; actual: %s\n", optarg);
+					exit(EXIT_FAILURE);
+				}
+
+				if (g_config.port_mapping_count == MAX_PORT_MAPPINGS) {
+					printf("At most %d port mappings are supported\n", MAX_PORT_MAPPINGS);
+					exit(EXIT_FAILURE);
+				}
+
+				g_config.port_mappings[g_config.port_mapping_count++] = (port_mapping_t) { .from = from, .to = to };
+			} break;
+
+			case 'h': {
+				print_usage(argv);
+				exit(EXIT_SUCCESS);
+			}
+
+			default:
+				print_usage(argv);
+				exit(EXIT_FAILURE);
+		}
+	}
+
+	if (optind != argc - 1) {
+		print_usage(argv);
+		exit(EXIT_FAILURE);
+	}
+
+	g_config.capture_filename = argv[optind];
+}
+
+int main(int argc, char ** argv)
+{
+	handle_args(argc, argv);
+	resolve_target();
+
+	g_replay.fragment_buffers = calloc(MAX_IP_FRAGMENT_BUFFERS, sizeof(ip_fragment_buffer_t));
+	if (g_replay.fragment_buffers == NULL)
+		die("calloc failed: %s\n", strerror(errno));
+
+	FILE* capture = fopen(g_config.capture_filename, "rb");
+	if (capture == NULL)
+		die("Failed to open %s: %s\n", g_config.capture_filename, strerror(errno));
+
+	const uint64_t start_usec = now_usec();
+	uint64_t packet_count = 0;
+
+	for (uint32_t loop=0; loop<g_config.loops; loop++) {
+		rewind(capture);
+		packet_count += replay_capture(capture);
+	}
+
+	for (int i=0; i<MAX_TCP_FLOWS; i++) {
+		if (g_replay.tcp_flows[i].in_use) close_tcp_flow(&g_replay.tcp_flows[i]);
+	}
+
+	fclose(capture);
+
+	const double elapsed_seconds = (now_usec() - start_usec) / 1e6;
+
+	printf("[replay] Replayed %" PRIu64 " captured packets to %s in %.2f s (%" PRIu64 " skipped)\n",
+		packet_count,
+		g_config.host,
+		elapsed_seconds,
+		g_replay.skipped_packets
+	);
+
+	for (uint32_t i=0; i<g_replay.port_stats_count; i++) {
+		const port_stats_t* stats = &g_replay.port_stats[i];
+
+		printf("[replay] port %d: %" PRIu64 " payloads, %" PRIu64 " bytes, %.1f payloads/s\n",
+			stats->port,
+			stats->packets,
+			stats->bytes,
+			elapsed_seconds > 0 ? stats->packets / elapsed_seconds : 0
+		);
+	}
+
+	return EXIT_SUCCESS;
+}
@@ -1,6 +1,12 @@
 /** \file
 *  OPC image packet receiver.
 */
+#define _GNU_SOURCE // recvmmsg
+
+// net_skeleton.h sets feature test macros of its own, so it has to come before any system header
+#include "lib/cesanta/net_skeleton.h"
+#include "lib/cesanta/frozen.h"
+
 #include <stdio.h>
 #include <stdlib.h>
 #include <unistd.h>
@@ -11,8 +17,13 @@
 #include <ctype.h>
 #include <sys/types.h>
 #include <sys/stat.h>
+#include <sys/socket.h>
+#include <sys/uio.h>
+#include <poll.h>
+#include <sys/epoll.h>
 #include <netinet/in.h>
 #include <inttypes.h>
+#include <stdarg.h>
 #include <errno.h>
 #include <string.h>
 #include <math.h>
@@ -22,9 +33,12 @@
 #include <sys/mman.h>
 #include "util.h"
 #include "ledscape.h"
-
-#include "lib/cesanta/net_skeleton.h"
-#include "lib/cesanta/frozen.h"
+#include "render.h"
+#include "frame_exchange.h"
+#include "frame_pacing.h"
+#include "dmx.h"
+#include "e131.h"
+#include "artnet.h"
 
 #include <pthread.h>
 #include <stdbool.h>
@@ -52,6 +66,9 @@
 
 static const int MAX_CONFIG_FILE_LENGTH_BYTES = 1024*1024*10;
 
+// Room for the config JSON, including a full dmxUniverses table
+#define SERVER_CONFIG_JSON_MAX_LENGTH 65536
+
 ////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////
 // TYPES
 
@@ -65,25 +82,55 @@ typedef enum {
     DEMO_MODE_POWER = 4
 } demo_mode_t;
 
+typedef enum {
+	NETWORK_MODE_REACTOR = 0,
+	NETWORK_MODE_THREADS = 1
+} network_mode_t;
+
 typedef struct {
 	char output_mode_name[512];
 	char output_mapping_name[512];
 
+	ledscape_backend_t output_backend;
+	uint32_t output_frame_usec;
+
 	demo_mode_t demo_mode;
 
 	uint16_t tcp_port;
 	uint16_t udp_port;
 	uint16_t e131_port;
+	uint16_t artnet_port;
+
+	network_mode_t network_mode;
 
 	uint32_t leds_per_strip;
 	uint32_t used_strip_count;
 
+	// Pixels on each strip, for strips shorter than leds_per_strip; strips past strip_length_count have leds_per_strip
+	uint32_t strip_lengths[LEDSCAPE_NUM_STRIPS];
+	uint32_t strip_length_count;
+
 	color_channel_order_t color_channel_order;
 
 	uint8_t interpolation_enabled;
 	uint8_t dithering_enabled;
 	uint8_t lut_enabled;
 
+	// Resolution of the luminance lookup tables
+	render_lut_mode_t lut_mode;
+
+	// Render into cached buffers and copy each frame out to the PRUs' uncached DDR in one go
+	uint8_t output_staging_enabled;
+
+	uint32_t render_threads;
+
+	// Bits per color channel of the input frame buffers, 8 or 16. E1.31 and Art-Net pixels are the same depth.
+	uint32_t input_bit_depth;
+
+	// E1.31 and Art-Net universe to strip mapping; empty for the default of universe N driving strip N-1
+	dmx_universe_mapping_t dmx_universes[DMX_MAX_MAPPED_UNIVERSES];
+	uint32_t dmx_universe_count;
+
 	struct {
 		float red;
 		float green;
@@ -105,18 +152,22 @@ void ensure_server_setup();
 
 // Frame Manipulation
 void ensure_frame_data();
-void set_next_frame_data(uint8_t* frame_data, uint32_t data_size, uint8_t is_remote);
-void rotate_frames(uint8_t lock_frame_data);
+void set_next_frame_data(const uint8_t* frame_data, uint32_t data_size, bool data_is_16bit, uint8_t is_remote);
+void commit_next_frame_data(void* next_frame_data, uint32_t data_size, uint32_t bytes_copied, uint8_t is_remote);
 
 // Threads
 void* render_thread(void* threadarg);
 void* udp_server_thread(void* threadarg);
 void* tcp_server_thread(void* threadarg);
 void* e131_server_thread(void* threadarg);
+void* artnet_server_thread(void* threadarg);
+void* network_reactor_thread(void* threadarg);
 void* demo_thread(void* threadarg);
+void* lookup_table_builder_thread(void* threadarg);
 
 // Config Methods
 void build_lookup_tables();
+void build_lookup_tables_async();
 int validate_server_config(
 	server_config_t* input_config,
 	char * result_json_buffer,
@@ -131,6 +182,9 @@ int server_config_from_json(
 
 void server_config_to_json(char* dest_string, size_t dest_string_size, server_config_t* input_config) ;
 
+void server_config_strip_layout(const server_config_t* config, strip_layout_t* out_layout);
+uint32_t server_config_input_pixel_size(const server_config_t* config);
+
 const char* demo_mode_to_string(demo_mode_t mode) {
 	switch (mode) {
 		case DEMO_MODE_NONE: return "none";
@@ -158,6 +212,24 @@ demo_mode_t demo_mode_from_string(const char* str) {
 	}
 }
 
+const char* network_mode_to_string(network_mode_t mode) {
+	switch (mode) {
+		case NETWORK_MODE_REACTOR: return "reactor";
+		case NETWORK_MODE_THREADS: return "threads";
+		default: return "<invalid network_mode>";
+	}
+}
+
+network_mode_t network_mode_from_string(const char* str) {
+	if (strcasecmp(str, "reactor") == 0) {
+		return NETWORK_MODE_REACTOR;
+	} else if (strcasecmp(str, "threads") == 0) {
+		return NETWORK_MODE_THREADS;
+	} else {
+		return -1;
+	}
+}
+
 ////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////
 // Error Handling
 
@@ -186,7 +258,7 @@ const char* opc_server_strerr(
 	}
 }
 
-inline int opc_server_set_error(
+int opc_server_set_error(
 	opc_error_code_t error_code,
 	const char* extra_info,
 	...
@@ -201,18 +273,21 @@ inline int opc_server_set_error(
 		);
 	} else {
 		char extra_info_out[2048];
-		snprintf(
+		va_list args;
+		va_start(args, extra_info);
+		vsnprintf(
 			extra_info_out,
 			sizeof(extra_info_out),
 			extra_info,
-			__builtin_va_arg_pack()
+			args
 		);
+		va_end(args);
 		snprintf(
-			extra_info_out,
+			g_error_info_str,
 			sizeof(g_error_info_str),
 			"%s: %s",
 			opc_server_strerr(error_code),
-			extra_info
+			extra_info_out
 		);
 	}
 
@@ -226,98 +301,104 @@ server_config_t g_server_config = {
 	.output_mode_name = "ws281x",
 	.output_mapping_name = "original-ledscape",
 
+	.output_backend = LEDSCAPE_BACKEND_PRU,
+	.output_frame_usec = 0,
+
 	.demo_mode = DEMO_MODE_FADE,
 
 	.tcp_port = 7890,
 	.udp_port = 7890,
 
 	.e131_port = 5568,
+	.artnet_port = ARTNET_DEFAULT_PORT,
+
+	.network_mode = NETWORK_MODE_REACTOR,
 
 	.leds_per_strip = 176,
 	.used_strip_count = LEDSCAPE_NUM_STRIPS,
+	.strip_length_count = 0,
 	.color_channel_order = COLOR_ORDER_BRG,
 
 	.interpolation_enabled = TRUE,
 	.dithering_enabled = TRUE,
 	.lut_enabled = TRUE,
+	.lut_mode = RENDER_LUT_INTERPOLATED,
+	.output_staging_enabled = TRUE,
+
+	.render_threads = 1,
+	.input_bit_depth = 8,
+
+	.dmx_universe_count = 0,
 
 	.white_point = { .9, 1, 1},
 	.lum_power = 2,
 	.mutex = PTHREAD_MUTEX_INITIALIZER
 };
 
-typedef struct {
-	uint8_t r;
-	uint8_t g;
-	uint8_t b;
-} __attribute__((__packed__)) buffer_pixel_t;
-
-// Pixel Delta
-typedef struct {
-	int8_t r;
-	int8_t g;
-	int8_t b;
-
-	int8_t last_effect_frame_r;
-	int8_t last_effect_frame_g;
-	int8_t last_effect_frame_b;
-} __attribute__((__packed__)) pixel_delta_t;
-
-
 // Global runtime data
 static struct
 {
-	buffer_pixel_t* previous_frame_data;
-	buffer_pixel_t* current_frame_data;
-	buffer_pixel_t* next_frame_data;
-
-	pixel_delta_t* frame_dithering_overflow;
-
-	uint8_t has_prev_frame;
-	uint8_t has_current_frame;
-	uint8_t has_next_frame;
+	dither_state_t* frame_dither_states;
 
 	uint32_t frame_size;
 	uint32_t leds_per_strip;
 
 	volatile uint32_t frame_counter;
 
-	struct timeval previous_frame_tv;
-	struct timeval current_frame_tv;
-	struct timeval next_frame_tv;
-
-	struct timeval prev_current_delta_tv;
-
 	ledscape_t * leds;
+	ledscape_backend_t output_backend;
+	uint32_t output_frame_usec;
 
 	char pru0_program_filename[4096];
 	char pru1_program_filename[4096];
 
-	uint32_t red_lookup[257];
-	uint32_t green_lookup[257];
-	uint32_t blue_lookup[257];
-
-	struct timeval last_remote_data_tv;
-
 	pthread_mutex_t mutex;
 } g_runtime_state = {
-	.previous_frame_data = (buffer_pixel_t*)NULL,
-	.current_frame_data = (buffer_pixel_t*)NULL,
-	.next_frame_data = (buffer_pixel_t*)NULL,
-	.has_prev_frame = FALSE,
-	.has_current_frame = FALSE,
-	.has_next_frame = FALSE,
-	.frame_dithering_overflow = (pixel_delta_t*)NULL,
+	.frame_dither_states = (dither_state_t*)NULL,
 	.frame_size = 0,
 	.leds_per_strip = 0,
 	.mutex = PTHREAD_MUTEX_INITIALIZER,
-	.last_remote_data_tv = {
-		.tv_sec = 0,
-		.tv_usec = 0
-	},
 	.leds = NULL
 };
 
+// Lookup tables, built by build_lookup_tables() without holding any lock the render thread needs and handed over
+// through g_lut_slot. The render thread takes them at the start of its next frame.
+static struct
+{
+	pthread_mutex_t mutex; // serializes builds
+	render_lut_t* latest; // the builder's reference to the newest tables, to rebuild from
+
+	// Rebuilds asked of the builder thread by build_lookup_tables_async(); held only to set or clear the flag
+	pthread_mutex_t request_mutex;
+	pthread_cond_t request_cond;
+	bool rebuild_requested;
+} g_lut_builder = {
+	.mutex = PTHREAD_MUTEX_INITIALIZER,
+	.latest = NULL,
+	.request_mutex = PTHREAD_MUTEX_INITIALIZER,
+	.request_cond = PTHREAD_COND_INITIALIZER,
+	.rebuild_requested = false
+};
+
+static render_lut_t* volatile g_lut_slot = NULL;
+
+// Input frames, handed from the network and demo threads to the render thread. Resized only while holding
+// g_runtime_state.mutex, which keeps the render thread out.
+static frame_exchange_t g_frame_exchange = FRAME_EXCHANGE_INITIALIZER;
+
+// Render and output times, measured by the render thread every frame; decides whether and how far to dither
+static frame_pacing_t g_frame_pacing = FRAME_PACING_INITIALIZER;
+
+// Input path statistics, updated atomically by the producers and reported (and reset) by the render thread
+static struct
+{
+	volatile uint64_t frames;
+	volatile uint64_t bytes_copied; // payload bytes copied in user space on the way into a frame slot
+} g_input_stats = {
+	.frames = 0,
+	.bytes_copied = 0
+};
+
 // Global thread handles
 typedef struct {
 	pthread_t handle;
@@ -331,7 +412,10 @@ static struct
 	thread_state_lt tcp_server_thread;
 	thread_state_lt udp_server_thread;
 	thread_state_lt e131_server_thread;
+	thread_state_lt artnet_server_thread;
+	thread_state_lt network_reactor_thread;
 	thread_state_lt demo_thread;
+	thread_state_lt lookup_table_builder_thread;
 } g_threads;
 
 
@@ -343,9 +427,13 @@ static struct option long_options[] =
 		{"udp-port", required_argument, NULL, 'P'},
 
 		{"e131-port", required_argument, NULL, 'e'},
+		{"artnet-port", required_argument, NULL, 'a'},
+
+		{"network-mode", required_argument, NULL, 'n'},
 
 		{"count", required_argument, NULL, 'c'},
 		{"strip-count", required_argument, NULL, 's'},
+		{"strip-lengths", required_argument, NULL, 'T'},
 		{"dimensions", required_argument, NULL, 'd'},
 
 		{"channel-order", required_argument, NULL, 'o'},
@@ -355,6 +443,11 @@ static struct option long_options[] =
 		{"no-interpolation", no_argument, NULL, 'i'},
 		{"no-dithering", no_argument, NULL, 't'},
 		{"no-lut", no_argument, NULL, 'l'},
+		{"lut-mode", required_argument, NULL, 'k'},
+		{"no-output-staging", no_argument, NULL, 'u'},
+
+		{"render-threads", required_argument, NULL, 'R'},
+		{"input-bit-depth", required_argument, NULL, 'I'},
 
 		{"help", no_argument, NULL, 'h'},
 
@@ -370,8 +463,14 @@ static struct option long_options[] =
 		{"mode", required_argument, NULL, 'm'},
 		{"mapping", required_argument, NULL, 'M'},
 
+		{"output-backend", required_argument, NULL, 'B'},
+		{"output-frame-usec", required_argument, NULL, 'F'},
+
 		{"config", required_argument, NULL, 'C'},
 
+		{"self-check", no_argument, NULL, 'S'},
+		{"lut-benchmark", no_argument, NULL, 'K'},
+
 		{NULL, 0, NULL, 0}
 	};
 
@@ -493,7 +592,7 @@ int write_config_file(
 		);
 	}
 
-	char json_buffer[4096] = {0};
+	char json_buffer[SERVER_CONFIG_JSON_MAX_LENGTH] = {0};
 	server_config_to_json(json_buffer, sizeof(json_buffer), config);
 	fputs(json_buffer, fd);
 
@@ -504,7 +603,7 @@ void handle_args(int argc, char ** argv) {
 	extern char *optarg;
 
 	int opt;
-	while ((opt = getopt_long(argc, argv, "p:P:c:s:d:D:o:ithlL:r:g:b:0:1:m:M:", long_options, NULL)) != -1)
+	while ((opt = getopt_long(argc, argv, "p:P:a:n:c:s:T:d:D:o:ithlk:uR:I:L:r:g:b:0:1:m:M:B:F:SK", long_options, NULL)) != -1)
 	{
 		switch (opt)
 		{
@@ -520,6 +619,14 @@ void handle_args(int argc, char ** argv) {
 				g_server_config.e131_port = (uint16_t) atoi(optarg);
 			} break;
 
+			case 'a': {
+				g_server_config.artnet_port = (uint16_t) atoi(optarg);
+			} break;
+
+			case 'n': {
+				g_server_config.network_mode = network_mode_from_string(optarg);
+			} break;
+
 			case 'c': {
 				g_server_config.leds_per_strip = (uint32_t) atoi(optarg);
 			} break;
@@ -528,6 +635,20 @@ void handle_args(int argc, char ** argv) {
 				g_server_config.used_strip_count = (uint32_t) atoi(optarg);
 			} break;
 
+			case 'T': {
+				char lengths[4096];
+				strlcpy(lengths, optarg, sizeof(lengths));
+
+				// Too many entries are left for validation to reject
+				g_server_config.strip_length_count = 0;
+				for (char* token = strtok(lengths, ","); token != NULL; token = strtok(NULL, ",")) {
+					if (g_server_config.strip_length_count < LEDSCAPE_NUM_STRIPS) {
+						g_server_config.strip_lengths[g_server_config.strip_length_count] = (uint32_t) atoi(token);
+					}
+					g_server_config.strip_length_count++;
+				}
+			} break;
+
 			case 'd': {
 				int width=0, height=0;
 
@@ -560,6 +681,22 @@ void handle_args(int argc, char ** argv) {
 				g_server_config.lut_enabled = FALSE;
 			} break;
 
+			case 'k': {
+				g_server_config.lut_mode = render_lut_mode_from_string(optarg);
+			} break;
+
+			case 'u': {
+				g_server_config.output_staging_enabled = FALSE;
+			} break;
+
+			case 'R': {
+				g_server_config.render_threads = (uint32_t) atoi(optarg);
+			} break;
+
+			case 'I': {
+				g_server_config.input_bit_depth = (uint32_t) atoi(optarg);
+			} break;
+
 			case 'L': {
 				g_server_config.lum_power = (float) atof(optarg);
 			} break;
@@ -592,6 +729,14 @@ void handle_args(int argc, char ** argv) {
 				strlcpy(g_server_config.output_mapping_name, optarg, sizeof(g_server_config.output_mapping_name));
 			} break;
 
+			case 'B': {
+				g_server_config.output_backend = ledscape_backend_from_string(optarg);
+			} break;
+
+			case 'F': {
+				g_server_config.output_frame_usec = (uint32_t) atoi(optarg);
+			} break;
+
 			case 'C': {
 				strlcpy(g_config_filename, optarg, sizeof(g_config_filename));
 
@@ -602,6 +747,16 @@ void handle_args(int argc, char ** argv) {
 				}
 			} break;
 
+			case 'S': {
+				int problem_count = render_self_check(stdout);
+				exit(problem_count == 0 ? EXIT_SUCCESS : EXIT_FAILURE);
+			}
+
+			case 'K': {
+				render_lut_benchmark(stdout);
+				exit(EXIT_SUCCESS);
+			}
+
 			case 'h': {
 				print_usage(argv);
 
@@ -623,8 +778,15 @@ void handle_args(int argc, char ** argv) {
 							case 'p': printf("The TCP port to listen for OPC data on"); break;
 							case 'P': printf("The UDP port to listen for OPC data on"); break;
 							case 'e': printf("The UDP port to listen for e131 data on"); break;
+							case 'a': printf("The UDP port to listen for Art-Net data on (default 6454)"); break;
+							case 'n':
+								printf("Selects how network input is received:\n");
+						        printf("\t- reactor  One thread serves every protocol, waking only when sockets have data (default)\n");
+						        printf("\t- threads  A blocking thread per protocol");
+						        break;
 							case 'c': printf("The number of pixels connected to each output channel"); break;
 							case 's': printf("The number of used output channels (improves performance by not interpolating/dithering unused channels)"); break;
+							case 'T': printf("Comma separated pixel counts of the first strips, for strips shorter than --count; input data for each strip follows straight on from the one before"); break;
 							case 'd': printf("Alternative to --count; specifies pixel count as a dimension, e.g. 16x16 (256 pixels)"); break;
 							case 'D':
 								printf("Configures the idle (demo) mode which activates when no data arrives for more than 5 seconds. Modes:\n");
@@ -639,6 +801,15 @@ void handle_args(int argc, char ** argv) {
 							case 'i': printf("Disables interpolation between frames (choppier output but improves performance)"); break;
 							case 't': printf("Disables dithering (choppier output but improves performance)"); break;
 							case 'l': printf("Disables luminance correction (lower color values appear brighter than they should)"); break;
+							case 'k':
+								printf("Selects the resolution of the luminance correction tables:\n");
+						        printf("\t- interpolated  257 entries per channel, interpolated between (default)\n");
+						        printf("\t- 4k            4096 entries per channel (48KB in all), interpolated between; fits in the L2 cache\n");
+						        printf("\t- 64k           An entry for every 16-bit value (384KB in all); exact, but larger than the L2 cache");
+						        break;
+							case 'u': printf("Renders straight into the uncached PRU memory instead of a cached buffer that is copied out in one go (slower, and every frame is sent in full). Packed and bit-plane modes always use the buffer"); break;
+							case 'R': printf("The number of threads used to render frames; strips are split evenly between them (default 1)"); break;
+							case 'I': printf("Bits per color channel of the input frames, 8 or 16 (default 8). At 16, OPC command 2 pixels are kept at full precision and E1.31/Art-Net pixels take 6 channels, coarse then fine"); break;
 							case 'L': printf("Sets the exponent of the luminance power function to the given floating point value (default 2)"); break;
 							case 'r': printf("Sets the red balance to the given floating point number (0-1, default .9)"); break;
 							case 'g': printf("Sets the red balance to the given floating point number (0-1, default 1)"); break;
@@ -649,6 +820,8 @@ void handle_args(int argc, char ** argv) {
 								printf("Sets the output mode:\n");
 						        printf("\t- nop      Disable output; can be useful for debugging\n");
 						        printf("\t- ws281x   WS2811/WS2812 output format\n");
+						        printf("\t- ws281x-packed   WS2811/WS2812 output from frames packed without the unused fourth byte of each pixel; less DDR traffic\n");
+						        printf("\t- ws281x-bitplane   WS2811/WS2812 output from frames split into bit planes of GPIO masks, so the PRUs test no bits\n");
 						        printf("\t- ws2801   WS2801-compatible 8-bit SPI output. Supports 24 channels of output with pins in a DATA/CLOCK configuration.\n");
 						        printf("\t- dmx      DMX compatible output (does not support RDM)\n");
 						        break;
@@ -657,11 +830,20 @@ void handle_args(int argc, char ** argv) {
 						        printf("\toriginal-ledscape: Original LEDscape pinmapping. Used on older RGB-123 capes.\n");
 						        printf("\trgb-123-v2: RGB-123 mapping for new capes\n");
 						        break;
+							case 'B':
+								printf("Selects where rendered frames are sent:\n");
+						        printf("\t- pru     The PRUs, driving the strips (default)\n");
+						        printf("\t- memory  A thread that emulates the PRUs, taking as long as the strips would to clock out each frame\n");
+						        printf("\t- null    Nowhere; every frame completes immediately");
+						        break;
+							case 'F': printf("Clock-out time per frame for the memory output backend in microseconds (default 0: the ws281x time for --count pixels)"); break;
 							case 'C':
 								printf("Specifies a configuration file to use and creates it if it does not already exist.\n");
 						        printf("\tIf used with other options, options are parsed in order. Options before --config are overwritten\n");
 						        printf("\tby the config file, and options afterwards will be saved to the config file.\n");
 						        break;
+							case 'S': printf("Verifies that the %s render kernel matches the scalar reference bit for bit, then exits", render_kernel_name()); break;
+							case 'K': printf("Measures the accuracy and render throughput of each --lut-mode on this machine, then exits"); break;
 							case 'h': printf("Displays this help message"); break;
 							default: printf("Undocumented option: %c\n", option_info.val);
 						}
@@ -718,9 +900,17 @@ int main(int argc, char ** argv)
 
 	bzero(&g_threads, sizeof(g_threads));
 	pthread_create(&g_threads.render_thread.handle, NULL, render_thread, NULL);
-	pthread_create(&g_threads.udp_server_thread.handle, NULL, udp_server_thread, NULL);
-	pthread_create(&g_threads.tcp_server_thread.handle, NULL, tcp_server_thread, NULL);
-	pthread_create(&g_threads.e131_server_thread.handle, NULL, e131_server_thread, NULL);
+	pthread_create(&g_threads.lookup_table_builder_thread.handle, NULL, lookup_table_builder_thread, NULL);
+
+	if (g_server_config.network_mode == NETWORK_MODE_THREADS) {
+		printf("[main] Receiving network input on one thread per protocol\n");
+		pthread_create(&g_threads.udp_server_thread.handle, NULL, udp_server_thread, NULL);
+		pthread_create(&g_threads.tcp_server_thread.handle, NULL, tcp_server_thread, NULL);
+		pthread_create(&g_threads.e131_server_thread.handle, NULL, e131_server_thread, NULL);
+		pthread_create(&g_threads.artnet_server_thread.handle, NULL, artnet_server_thread, NULL);
+	} else {
+		pthread_create(&g_threads.network_reactor_thread.handle, NULL, network_reactor_thread, NULL);
+	}
 
 	if (g_server_config.demo_mode != DEMO_MODE_NONE) {
 		printf("[main] Demo Mode Enabled\n");
@@ -773,7 +963,8 @@ void ensure_server_setup() {
 	else if (g_runtime_state.leds_per_strip != g_server_config.leds_per_strip) {
 		ledscape_init_needed = true;
 	}
-	else if (g_runtime_state.pru1_program_filename == NULL || g_runtime_state.pru0_program_filename == NULL) {
+	else if (g_runtime_state.output_backend != g_server_config.output_backend ||
+		g_runtime_state.output_frame_usec != g_server_config.output_frame_usec) {
 		ledscape_init_needed = true;
 	}
 	else {
@@ -812,7 +1003,8 @@ void ensure_server_setup() {
 
 		// Init LEDscape
 		printf("[main] Starting LEDscape...");
-		g_runtime_state.leds = ledscape_init_with_programs(
+		g_runtime_state.leds = ledscape_init_with_backend(
+			g_server_config.output_backend,
 			g_server_config.leds_per_strip,
 			build_pruN_program_name(
 				g_server_config.output_mode_name,
@@ -828,16 +1020,21 @@ void ensure_server_setup() {
 				1,
 				g_runtime_state.pru1_program_filename,
 				sizeof(g_runtime_state.pru1_program_filename)
-			)
+			),
+			g_server_config.output_frame_usec
 		);
 		g_runtime_state.leds_per_strip = g_server_config.leds_per_strip;
+		g_runtime_state.output_backend = g_server_config.output_backend;
+		g_runtime_state.output_frame_usec = g_server_config.output_frame_usec;
 	}
 
+	ledscape_set_staging(g_runtime_state.leds, g_server_config.output_staging_enabled);
+
 	pthread_mutex_unlock(&g_server_config.mutex);
 	pthread_mutex_unlock(&g_runtime_state.mutex);
 
 	// Display server config as JSON
-	char json_buffer[4096] = { 0 };
+	char json_buffer[SERVER_CONFIG_JSON_MAX_LENGTH] = { 0 };
 	server_config_to_json(json_buffer, sizeof(json_buffer), &g_server_config);
 	fputs(json_buffer, stderr);
 }
@@ -926,6 +1123,12 @@ int validate_server_config(
 		}
 	}
 
+	// outputBackend
+	assert_enum_valid("Output Backend", input_config->output_backend);
+
+	// outputFrameUsec
+	assert_int_range_inclusive("Output Frame Time (usec)", 0, 1000000, input_config->output_frame_usec);
+
 	// demoMode
 	assert_enum_valid("Demo Mode", input_config->demo_mode);
 
@@ -935,9 +1138,39 @@ int validate_server_config(
 	// usedStripCount
 	assert_int_range_inclusive("Strip/Channel Count", 1, 48, input_config->used_strip_count);
 
+	{ // stripLengths
+		strip_layout_t layout;
+		server_config_strip_layout(input_config, &layout);
+
+		assert_int_range_inclusive("Strip Length Count", 0, LEDSCAPE_NUM_STRIPS, input_config->strip_length_count);
+
+		for (uint32_t i=0; i<min(input_config->strip_length_count, LEDSCAPE_NUM_STRIPS); i++) {
+			snprintf(path_temp, sizeof(path_temp), "Strip %u Length", i);
+			assert_int_range_inclusive(path_temp, 0, input_config->leds_per_strip, input_config->strip_lengths[i]);
+		}
+
+		if (layout.pixel_count == 0) {
+			add_error("\n\t\t\"" "Every strip has a length of zero" "\",");
+		}
+	}
+
+	// renderThreads
+	assert_int_range_inclusive("Render Thread Count", 1, 16, input_config->render_threads);
+
+	// inputBitDepth
+	if (input_config->input_bit_depth != 8 && input_config->input_bit_depth != 16) {
+		add_error(
+			"\n\t\t\"" "Given Input Bit Depth (%u) is neither 8 nor 16" "\",",
+			input_config->input_bit_depth
+		);
+	}
+
 	// colorChannelOrder
 	assert_enum_valid("Color Channel Order", input_config->color_channel_order);
 
+	// lutMode
+	assert_enum_valid("LUT Mode", input_config->lut_mode);
+
 	// opcTcpPort
 	assert_int_range_inclusive("OPC TCP Port", 1, 65535, input_config->tcp_port);
 
@@ -947,6 +1180,34 @@ int validate_server_config(
 	// e131Port
 	assert_int_range_inclusive("e131 UDP Port", 1, 65535, input_config->e131_port);
 
+	// artnetPort
+	assert_int_range_inclusive("Art-Net UDP Port", 0, 65535, input_config->artnet_port);
+
+	// networkMode
+	assert_enum_valid("Network Mode", input_config->network_mode);
+
+	{ // dmxUniverses
+		dmx_universe_map_t universe_map;
+		strip_layout_t layout;
+		char map_error[256];
+
+		server_config_strip_layout(input_config, &layout);
+
+		if (dmx_universe_map_compile(
+			&universe_map,
+			input_config->dmx_universes,
+			input_config->dmx_universe_count,
+			&layout,
+			server_config_input_pixel_size(input_config),
+			map_error,
+			sizeof(map_error)
+		) < 0) {
+			add_error("\n\t\t\"" "%s" "\",", map_error);
+		} else {
+			dmx_universe_map_free(&universe_map);
+		}
+	}
+
 	// lumCurvePower
 	assert_double_range_inclusive("Luminance Curve Power", 0, 10, input_config->lum_power);
 
@@ -998,7 +1259,7 @@ int server_config_from_json(
 	// Tokenize json string, fill in tokens array
 	json_tokens = parse_json2(json, json_size);
 
-	printf("tokens: %d: %s\n", json_size, json);
+	printf("tokens: %zu: %s\n", json_size, json);
 
 	if (json_tokens == NULL) {
 		// Invalid JSON...
@@ -1018,6 +1279,16 @@ int server_config_from_json(
 		strlcpy(output_config->output_mapping_name, token->ptr, min(sizeof(g_server_config.output_mode_name), token->len + 1));
 	}
 
+	if ((token = find_json_token(json_tokens, "outputBackend"))) {
+		strlcpy(token_value, token->ptr, min(sizeof(token_value), token->len + 1));
+		output_config->output_backend = ledscape_backend_from_string(token_value);
+	}
+
+	if ((token = find_json_token(json_tokens, "outputFrameUsec"))) {
+		strlcpy(token_value, token->ptr, min(sizeof(token_value), token->len + 1));
+		output_config->output_frame_usec = (uint32_t) atoi(token_value);
+	}
+
 	if ((token = find_json_token(json_tokens, "demoMode"))) {
 		strlcpy(token_value, token->ptr, min(sizeof(token_value), token->len + 1));
 		output_config->demo_mode = demo_mode_from_string(token_value);
@@ -1033,6 +1304,26 @@ int server_config_from_json(
 		output_config->used_strip_count = (uint32_t) atoi(token_value);
 	}
 
+	if (find_json_token(json_tokens, "stripLengths")) {
+		uint32_t length_count = 0;
+		char path[64];
+
+		for (;; length_count++) {
+			snprintf(path, sizeof(path), "stripLengths[%u]", length_count);
+			if (find_json_token(json_tokens, path) == NULL) break;
+		}
+
+		// Too many entries are left for validation to reject
+		output_config->strip_length_count = length_count;
+
+		for (uint32_t i=0; i<min(length_count, LEDSCAPE_NUM_STRIPS); i++) {
+			snprintf(path, sizeof(path), "stripLengths[%u]", i);
+			token = find_json_token(json_tokens, path);
+			strlcpy(token_value, token->ptr, min(sizeof(token_value), token->len + 1));
+			output_config->strip_lengths[i] = (uint32_t) atoi(token_value);
+		}
+	}
+
 	if ((token = find_json_token(json_tokens, "colorChannelOrder"))) {
 		strlcpy(token_value, token->ptr, min(sizeof(token_value), token->len + 1));
 		output_config->color_channel_order = color_channel_order_from_string(token_value);
@@ -1048,6 +1339,21 @@ int server_config_from_json(
 		output_config->udp_port = (uint16_t) atoi(token_value);
 	}
 
+	if ((token = find_json_token(json_tokens, "e131Port"))) {
+		strlcpy(token_value, token->ptr, min(sizeof(token_value), token->len + 1));
+		output_config->e131_port = (uint16_t) atoi(token_value);
+	}
+
+	if ((token = find_json_token(json_tokens, "artnetPort"))) {
+		strlcpy(token_value, token->ptr, min(sizeof(token_value), token->len + 1));
+		output_config->artnet_port = (uint16_t) atoi(token_value);
+	}
+
+	if ((token = find_json_token(json_tokens, "networkMode"))) {
+		strlcpy(token_value, token->ptr, min(sizeof(token_value), token->len + 1));
+		output_config->network_mode = network_mode_from_string(token_value);
+	}
+
 	if ((token = find_json_token(json_tokens, "enableInterpolation"))) {
 		strlcpy(token_value, token->ptr, min(sizeof(token_value), token->len + 1));
 		output_config->interpolation_enabled = strcasecmp(token_value, "true") == 0 ? TRUE : FALSE;
@@ -1063,6 +1369,68 @@ int server_config_from_json(
 		output_config->lut_enabled = strcasecmp(token_value, "true") == 0 ? TRUE : FALSE;
 	}
 
+	if ((token = find_json_token(json_tokens, "lutMode"))) {
+		strlcpy(token_value, token->ptr, min(sizeof(token_value), token->len + 1));
+		output_config->lut_mode = render_lut_mode_from_string(token_value);
+	}
+
+	if ((token = find_json_token(json_tokens, "enableOutputStaging"))) {
+		strlcpy(token_value, token->ptr, min(sizeof(token_value), token->len + 1));
+		output_config->output_staging_enabled = strcasecmp(token_value, "true") == 0 ? TRUE : FALSE;
+	}
+
+	if ((token = find_json_token(json_tokens, "renderThreads"))) {
+		strlcpy(token_value, token->ptr, min(sizeof(token_value), token->len + 1));
+		output_config->render_threads = (uint32_t) atoi(token_value);
+	}
+
+	if ((token = find_json_token(json_tokens, "inputBitDepth"))) {
+		strlcpy(token_value, token->ptr, min(sizeof(token_value), token->len + 1));
+		output_config->input_bit_depth = (uint32_t) atoi(token_value);
+	}
+
+	if (find_json_token(json_tokens, "dmxUniverses")) {
+		uint32_t universe_count = 0;
+		char path[64];
+
+		for (;; universe_count++) {
+			snprintf(path, sizeof(path), "dmxUniverses[%u]", universe_count);
+			if (find_json_token(json_tokens, path) == NULL) break;
+		}
+
+		// Too many entries are left for validation to reject
+		output_config->dmx_universe_count = universe_count;
+
+		for (uint32_t i=0; i<min(universe_count, DMX_MAX_MAPPED_UNIVERSES); i++) {
+			dmx_universe_mapping_t* mapping = &output_config->dmx_universes[i];
+			bzero(mapping, sizeof(*mapping));
+
+			snprintf(path, sizeof(path), "dmxUniverses[%u].universe", i);
+			if ((token = find_json_token(json_tokens, path))) {
+				strlcpy(token_value, token->ptr, min(sizeof(token_value), token->len + 1));
+				mapping->universe = atoi(token_value);
+			}
+
+			snprintf(path, sizeof(path), "dmxUniverses[%u].strip", i);
+			if ((token = find_json_token(json_tokens, path))) {
+				strlcpy(token_value, token->ptr, min(sizeof(token_value), token->len + 1));
+				mapping->strip = atoi(token_value);
+			}
+
+			snprintf(path, sizeof(path), "dmxUniverses[%u].startPixel", i);
+			if ((token = find_json_token(json_tokens, path))) {
+				strlcpy(token_value, token->ptr, min(sizeof(token_value), token->len + 1));
+				mapping->start_pixel = atoi(token_value);
+			}
+
+			snprintf(path, sizeof(path), "dmxUniverses[%u].channelCount", i);
+			if ((token = find_json_token(json_tokens, path))) {
+				strlcpy(token_value, token->ptr, min(sizeof(token_value), token->len + 1));
+				mapping->channel_count = atoi(token_value);
+			}
+		}
+	}
+
 	if ((token = find_json_token(json_tokens, "lumCurvePower"))) {
 		strlcpy(token_value, token->ptr, min(sizeof(token_value), token->len + 1));
 		output_config->lum_power = atof(token_value);
@@ -1090,6 +1458,34 @@ int server_config_from_json(
 }
 
 void server_config_to_json(char* dest_string, size_t dest_string_size, server_config_t* input_config) {
+	// Build the stripLengths list
+	char strip_lengths_json[LEDSCAPE_NUM_STRIPS * 12] = { 0 };
+	for (uint32_t i=0; i<min(input_config->strip_length_count, LEDSCAPE_NUM_STRIPS); i++) {
+		snprintf(
+			strip_lengths_json + strlen(strip_lengths_json),
+			sizeof(strip_lengths_json) - strlen(strip_lengths_json),
+			i == 0 ? "%u" : ", %u",
+			input_config->strip_lengths[i]
+		);
+	}
+
+	// Build the dmxUniverses table
+	char dmx_universes_json[DMX_MAX_MAPPED_UNIVERSES * 96] = { 0 };
+	for (uint32_t i=0; i<min(input_config->dmx_universe_count, DMX_MAX_MAPPED_UNIVERSES); i++) {
+		const dmx_universe_mapping_t* mapping = &input_config->dmx_universes[i];
+
+		snprintf(
+			dmx_universes_json + strlen(dmx_universes_json),
+			sizeof(dmx_universes_json) - strlen(dmx_universes_json),
+			"%s" "\n\t\t" "{ \"universe\": %d, \"strip\": %d, \"startPixel\": %d, \"channelCount\": %d }",
+			i == 0 ? "" : ",",
+			mapping->universe,
+			mapping->strip,
+			mapping->start_pixel,
+			mapping->channel_count
+		);
+	}
+
 	// Build config JSON
 	snprintf(
 		dest_string,
@@ -1098,18 +1494,31 @@ void server_config_to_json(char* dest_string, size_t dest_string_size, server_co
 		"{\n"
 			"\t" "\"outputMode\": \"%s\"," "\n"
 			"\t" "\"outputMapping\": \"%s\"," "\n"
+			"\t" "\"outputBackend\": \"%s\"," "\n"
+			"\t" "\"outputFrameUsec\": %d," "\n"
 			"\t" "\"demoMode\": \"%s\"," "\n"
 
 			"\t" "\"ledsPerStrip\": %d," "\n"
 			"\t" "\"usedStripCount\": %d," "\n"
+			"\t" "\"stripLengths\": [%s]," "\n"
 			"\t" "\"colorChannelOrder\": \"%s\"," "\n"
 
 			"\t" "\"opcTcpPort\": %d," "\n"
 			"\t" "\"opcUdpPort\": %d," "\n"
+			"\t" "\"e131Port\": %d," "\n"
+			"\t" "\"artnetPort\": %d," "\n"
+			"\t" "\"networkMode\": \"%s\"," "\n"
 
 			"\t" "\"enableInterpolation\": %s," "\n"
 			"\t" "\"enableDithering\": %s," "\n"
 			"\t" "\"enableLookupTable\": %s," "\n"
+			"\t" "\"lutMode\": \"%s\"," "\n"
+			"\t" "\"enableOutputStaging\": %s," "\n"
+
+			"\t" "\"renderThreads\": %d," "\n"
+			"\t" "\"inputBitDepth\": %d," "\n"
+
+			"\t" "\"dmxUniverses\": [%s%s]," "\n"
 
 			"\t" "\"lumCurvePower\": %.4f," "\n"
 			"\t" "\"whitePoint\": {" "\n"
@@ -1122,19 +1531,34 @@ void server_config_to_json(char* dest_string, size_t dest_string_size, server_co
 		input_config->output_mode_name,
 		input_config->output_mapping_name,
 
+		ledscape_backend_to_string(input_config->output_backend),
+		input_config->output_frame_usec,
+
 		demo_mode_to_string(input_config->demo_mode),
 
 		input_config->leds_per_strip,
 		input_config->used_strip_count,
+		strip_lengths_json,
 
 		color_channel_order_to_string(input_config->color_channel_order),
 
 		input_config->tcp_port,
 		input_config->udp_port,
+		input_config->e131_port,
+		input_config->artnet_port,
+		network_mode_to_string(input_config->network_mode),
 
 		input_config->interpolation_enabled ? "true" : "false",
 		input_config->dithering_enabled ? "true" : "false",
 		input_config->lut_enabled ? "true" : "false",
+		render_lut_mode_to_string(input_config->lut_mode),
+		input_config->output_staging_enabled ? "true" : "false",
+
+		input_config->render_threads,
+		input_config->input_bit_depth,
+
+		dmx_universes_json,
+		input_config->dmx_universe_count > 0 ? "\n\t" : "",
 
 		(double)input_config->lum_power,
 		(double)input_config->white_point.red,
@@ -1144,170 +1568,256 @@ void server_config_to_json(char* dest_string, size_t dest_string_size, server_co
 }
 
 void build_lookup_tables() {
-	pthread_mutex_lock(&g_runtime_state.mutex);
 	pthread_mutex_lock(&g_server_config.mutex);
 
-	float white_points[] = {
+	const render_lut_mode_t lut_mode = g_server_config.lut_mode;
+	const double lum_power = g_server_config.lum_power;
+	const double white_points[] = {
 		g_server_config.white_point.red,
 		g_server_config.white_point.green,
 		g_server_config.white_point.blue
 	};
 
-	uint32_t* lookup_tables[] = {
-		g_runtime_state.red_lookup,
-		g_runtime_state.green_lookup,
-		g_runtime_state.blue_lookup
-	};
+	pthread_mutex_unlock(&g_server_config.mutex);
+
+	pthread_mutex_lock(&g_lut_builder.mutex);
+
+	if (!render_lut_matches(g_lut_builder.latest, lut_mode, white_points, lum_power)) {
+		render_lut_t* lut = render_lut_create(lut_mode, white_points, lum_power, g_lut_builder.latest);
 
-	for (uint16_t c=0; c<3; c++) {
-		for (uint16_t i=0; i<257; i++) {
-			double normalI = (double)i / 256;
-			normalI *= white_points[c];
+		render_lut_release(g_lut_builder.latest);
+		g_lut_builder.latest = lut;
 
-			double output = pow(normalI, g_server_config.lum_power);
-			int64_t longOutput = (int64_t) ((output * 0xFFFF) + 0.5);
-			int32_t clampedOutput = (int32_t) max(0, min(0xFFFF, longOutput));
+		render_lut_publish(&g_lut_slot, render_lut_retain(lut));
+	}
+
+	pthread_mutex_unlock(&g_lut_builder.mutex);
+}
+
+void* lookup_table_builder_thread(void* unused_data) {
+	unused_data=unused_data; // Suppress Warnings
+
+	pthread_mutex_lock(&g_lut_builder.request_mutex);
 
-			lookup_tables[c][i] = (uint32_t) clampedOutput;
+	for (;;) {
+		while (!g_lut_builder.rebuild_requested) {
+			pthread_cond_wait(&g_lut_builder.request_cond, &g_lut_builder.request_mutex);
 		}
+
+		// Requests made during the build are merged into one more, which reads the config as it is by then
+		g_lut_builder.rebuild_requested = false;
+		pthread_mutex_unlock(&g_lut_builder.request_mutex);
+
+		build_lookup_tables();
+
+		pthread_mutex_lock(&g_lut_builder.request_mutex);
 	}
 
-	pthread_mutex_unlock(&g_server_config.mutex);
-	pthread_mutex_unlock(&g_runtime_state.mutex);
+	pthread_exit(NULL);
+}
+
+/**
+* Rebuild the lookup tables after a live config change on the builder thread, so that neither the thread that made
+* the change nor the render thread waits for them.
+*/
+void build_lookup_tables_async() {
+	pthread_mutex_lock(&g_lut_builder.request_mutex);
+	g_lut_builder.rebuild_requested = true;
+	pthread_cond_signal(&g_lut_builder.request_cond);
+	pthread_mutex_unlock(&g_lut_builder.request_mutex);
+}
+
+/**
+* Lay out the configured strips as they arrive in input frames: each one straight after the one before, only as long as
+* its entry in stripLengths (or ledsPerStrip, for strips it doesn't list).
+*/
+void server_config_strip_layout(const server_config_t* config, strip_layout_t* out_layout) {
+	strip_layout_init(
+		out_layout,
+		config->strip_lengths,
+		min(config->strip_length_count, LEDSCAPE_NUM_STRIPS),
+		config->leds_per_strip
+	);
+}
+
+/**
+* Bytes per pixel of the input frame buffers, and channels per pixel of E1.31 and Art-Net input.
+*/
+uint32_t server_config_input_pixel_size(const server_config_t* config) {
+	return render_input_pixel_size(config->input_bit_depth == 16);
 }
 
 /**
 * Ensure that the frame buffers are allocated to the correct values.
 */
 void ensure_frame_data() {
+	strip_layout_t layout;
+
 	pthread_mutex_lock(&g_server_config.mutex);
-	uint32_t led_count = (uint32_t)(g_server_config.leds_per_strip) * LEDSCAPE_NUM_STRIPS;
+	server_config_strip_layout(&g_server_config, &layout);
+	bool input_16bit = g_server_config.input_bit_depth == 16;
 	pthread_mutex_unlock(&g_server_config.mutex);
 
+	uint32_t led_count = layout.pixel_count;
+
 	pthread_mutex_lock(&g_runtime_state.mutex);
-	if (g_runtime_state.frame_size != led_count) {
-		fprintf(stderr, "Allocating buffers for %d pixels (%ju bytes)\n", led_count, (uintmax_t)(led_count * 3 /*channels*/ * 4 /*buffers*/ * sizeof(uint16_t)));
-
-		if (g_runtime_state.previous_frame_data != NULL) {
-			free(g_runtime_state.previous_frame_data);
-			free(g_runtime_state.current_frame_data);
-			free(g_runtime_state.next_frame_data);
-			free(g_runtime_state.frame_dithering_overflow);
+	if (g_runtime_state.frame_size != led_count
+		|| g_frame_exchange.is_16bit != input_16bit
+		|| memcmp(&g_frame_exchange.layout, &layout, sizeof(layout)) != 0) {
+		fprintf(stderr, "Allocating buffers for %d %d-bit pixels (%ju bytes)\n",
+			led_count,
+			input_16bit ? 16 : 8,
+			(uintmax_t)(led_count * render_input_pixel_size(input_16bit) * FRAME_EXCHANGE_SLOT_COUNT)
+		);
+
+		if (g_runtime_state.frame_dither_states != NULL) {
+			free(g_runtime_state.frame_dither_states);
 		}
 
 		g_runtime_state.frame_size = led_count;
-		g_runtime_state.previous_frame_data = malloc(led_count * sizeof(buffer_pixel_t));
-		g_runtime_state.current_frame_data = malloc(led_count * sizeof(buffer_pixel_t));
-		g_runtime_state.next_frame_data = malloc(led_count * sizeof(buffer_pixel_t));
-		g_runtime_state.frame_dithering_overflow = malloc(led_count * sizeof(pixel_delta_t));
-		g_runtime_state.has_next_frame = FALSE;
+		g_runtime_state.frame_dither_states = calloc(led_count, sizeof(dither_state_t));
 		printf("frame_size1=%u\n", g_runtime_state.frame_size);
 
-		// Init timestamps
-		gettimeofday(&g_runtime_state.previous_frame_tv, NULL);
-		gettimeofday(&g_runtime_state.current_frame_tv, NULL);
-		gettimeofday(&g_runtime_state.next_frame_tv, NULL);
+		// Reallocates the frame slots and resets their timestamps
+		frame_exchange_resize(&g_frame_exchange, &layout, input_16bit);
 	}
 	pthread_mutex_unlock(&g_runtime_state.mutex);
 }
 
 /**
-* Set the next frame of data to the given 8-bit RGB buffer after rotating the buffers.
+* Copy channel_count channels of input data, either 8-bit or big-endian 16-bit as they arrive from the network, into
+* frame data of the given depth. The frame data may be the input data itself, which is then converted in place.
+* \returns the number of bytes of frame data written
 */
-void set_next_frame_data(
-	uint8_t* frame_data,
-	uint32_t data_size,
-	uint8_t is_remote
+uint32_t copy_input_channels(
+	void* frame_data,
+	bool frame_is_16bit,
+	const uint8_t* data,
+	bool data_is_16bit,
+	uint32_t channel_count
 ) {
-	pthread_mutex_lock(&g_runtime_state.mutex);
+	if (frame_is_16bit) {
+		uint16_t* out = frame_data;
 
-	rotate_frames(FALSE);
+		if (data_is_16bit) {
+			for (uint32_t i=0; i<channel_count; i++) {
+				out[i] = (uint16_t) (data[i*2] << 8 | data[i*2 + 1]);
+			}
+		} else {
+			// Widen from the end, so that converting in place never overwrites data that hasn't been read yet
+			for (uint32_t i=channel_count; i-- > 0; ) {
+				out[i] = (uint16_t) (data[i] * 257);
+			}
+		}
 
-	// Prevent buffer overruns
-	data_size = min(data_size, g_runtime_state.frame_size * 3);
+		return channel_count * sizeof(uint16_t);
+	} else {
+		uint8_t* out = frame_data;
 
-	// Copy in new data
-	memcpy(g_runtime_state.next_frame_data, frame_data, data_size);
+		if (data_is_16bit) {
+			for (uint32_t i=0; i<channel_count; i++) {
+				out[i] = (uint8_t) (((data[i*2] << 8 | data[i*2 + 1]) * 255 + 0x8000) >> 16);
+			}
+		} else if (out != data) {
+			memcpy(out, data, channel_count);
+		}
 
-	// Zero out any pixels not set by the new frame
-	memset((uint8_t*) g_runtime_state.next_frame_data + data_size, 0, (g_runtime_state.frame_size*3 - data_size));
+		return channel_count;
+	}
+}
 
-	// Update the timestamp & count
-	gettimeofday(&g_runtime_state.next_frame_tv, NULL);
+/**
+* Publish the given RGB buffer, 8-bit or big-endian 16-bit, as the next frame. Never waits for the render thread.
+*/
+void set_next_frame_data(
+	const uint8_t* frame_data,
+	uint32_t data_size,
+	bool data_is_16bit,
+	uint8_t is_remote
+) {
+	void* next_frame_data = frame_exchange_begin_write(&g_frame_exchange);
+	uint32_t frame_size = g_frame_exchange.pixel_count;
 
-	// Update remote data timestamp if applicable
-	if (is_remote) {
-		gettimeofday(&g_runtime_state.last_remote_data_tv, NULL);
+	// Nowhere to put the data until the server is set up
+	if (frame_size == 0) {
+		frame_exchange_cancel(&g_frame_exchange);
+		return;
 	}
 
-	g_runtime_state.has_next_frame = TRUE;
+	// Prevent buffer overruns
+	const uint32_t channel_count = min(data_size / (data_is_16bit ? 2 : 1), frame_size * 3);
+
+	// Copy in new data at the frame buffers' depth
+	data_size = copy_input_channels(next_frame_data, g_frame_exchange.is_16bit, frame_data, data_is_16bit, channel_count);
 
-	pthread_mutex_unlock(&g_runtime_state.mutex);
+	commit_next_frame_data(next_frame_data, data_size, data_size, is_remote);
 }
 
 /**
-* Rotate the buffers, dropping the previous frame and loading in the new one
-*  
-* if (has_current) previous <-> current;
-* if (has_next) current <-> next    
-* 
+* Publish a frame slot obtained with frame_exchange_begin_write() whose first data_size bytes have been filled in,
+* zeroing the rest. bytes_copied is what it cost to fill it, for the input statistics.
 */
-void rotate_frames(uint8_t lock_frame_data) {
-	if (lock_frame_data) pthread_mutex_lock(&g_runtime_state.mutex);
-
-	buffer_pixel_t* temp = NULL;
+void commit_next_frame_data(
+	void* next_frame_data,
+	uint32_t data_size,
+	uint32_t bytes_copied,
+	uint8_t is_remote
+) {
+	// Zero out any pixels not set by the new frame
+	memset((uint8_t*) next_frame_data + data_size, 0, g_frame_exchange.frame_data_size - data_size);
 
-	g_runtime_state.has_prev_frame = FALSE;
+	__sync_fetch_and_add(&g_input_stats.frames, 1);
+	__sync_fetch_and_add(&g_input_stats.bytes_copied, bytes_copied);
 
-	if (g_runtime_state.has_current_frame) {
-		g_runtime_state.previous_frame_tv = g_runtime_state.current_frame_tv;
+	// Publish it, updating the timestamps
+	frame_exchange_commit(&g_frame_exchange, is_remote);
+}
 
-		temp = g_runtime_state.previous_frame_data;
-		g_runtime_state.previous_frame_data = g_runtime_state.current_frame_data;
-		g_runtime_state.current_frame_data = temp;
+// How long the render thread waits for the outputs to finish a frame before deciding they are stuck
+#define RENDER_OUTPUT_TIMEOUT_MS 1000
 
-		g_runtime_state.has_prev_frame = TRUE;
-		g_runtime_state.has_current_frame = FALSE;
-	}
+// Frames that only change some strips are sent as partial frames, but every strip is still refreshed this often so
+// that one which picked up a glitch doesn't keep showing it
+#define RENDER_FULL_FRAME_INTERVAL_USEC 1000000
 
-	if (g_runtime_state.has_next_frame) {
-		g_runtime_state.current_frame_tv = g_runtime_state.next_frame_tv;
+/**
+ * Compares a rendered frame with the last one sent, returning a mask of the strips that changed. changed_pixel_count
+ * is set to one past the last pixel that changed on any strip, which is as far as a partial frame has to clock out.
+ */
+static uint64_t render_changed_strips(
+	const ledscape_frame_t* frame,
+	const ledscape_frame_t* last_frame,
+	uint32_t leds_per_strip,
+	uint32_t strip_count,
+	uint32_t* changed_pixel_count
+) {
+	uint64_t changed_strips = 0;
+	*changed_pixel_count = 0;
 
-		temp = g_runtime_state.current_frame_data;
-		g_runtime_state.current_frame_data = g_runtime_state.next_frame_data;
-		g_runtime_state.next_frame_data = temp;
+	for (uint32_t pixel = 0; pixel < leds_per_strip; pixel++) {
+		if (memcmp(frame[pixel].strip, last_frame[pixel].strip, strip_count * sizeof(ledscape_pixel_t)) == 0) {
+			continue;
+		}
 
-		g_runtime_state.has_current_frame = TRUE;
-		g_runtime_state.has_next_frame = FALSE;
-	}
+		for (uint32_t strip = 0; strip < strip_count; strip++) {
+			if (memcmp(&frame[pixel].strip[strip], &last_frame[pixel].strip[strip], sizeof(ledscape_pixel_t)) != 0) {
+				changed_strips |= UINT64_C(1) << strip;
+			}
+		}
 
-	// Update the delta time stamp
-	if (g_runtime_state.has_current_frame && g_runtime_state.has_prev_frame) {
-		timersub(
-			&g_runtime_state.current_frame_tv,
-			&g_runtime_state.previous_frame_tv,
-			&g_runtime_state.prev_current_delta_tv
-		);
+		*changed_pixel_count = pixel + 1;
 	}
 
-	if (lock_frame_data) pthread_mutex_unlock(&g_runtime_state.mutex);
+	return changed_strips;
 }
 
-inline uint32_t lutInterpolate(uint32_t value, uint32_t* lut) {
-	// Inspired by FadeCandy: https://github.com/scanlime/fadecandy/blob/master/firmware/fc_pixel_lut.cpp
+void* render_thread(void* unused_data)
+{
+	unused_data=unused_data; // Suppress Warnings
 
-	uint32_t index = value >> 8; // Range [0, 0xFF]
-	uint32_t alpha = value & 0xFF; // Range [0, 0xFF]
-	uint32_t invAlpha = 0x100 - alpha; // Range [1, 0x100]
-
-	// Result in range [0, 0xFFFF]
-	return (lut[index] * invAlpha + lut[index + 1] * alpha) >> 8;
-}
-
-void* render_thread(void* unused_data)
-{
-	unused_data=unused_data; // Suppress Warnings
-	fprintf(stderr, "[render] Starting render thread for %u total pixels\n", g_server_config.leds_per_strip * LEDSCAPE_NUM_STRIPS);
+	strip_layout_t startup_layout;
+	server_config_strip_layout(&g_server_config, &startup_layout);
+	fprintf(stderr, "[render] Starting %s render thread for %u total pixels\n", render_kernel_name(), startup_layout.pixel_count);
 
 	// Timing Variables
 	struct timeval frame_progress_tv, now_tv;
@@ -1317,10 +1827,37 @@ void* render_thread(void* unused_data)
 	uint64_t last_report = 0;
 	uint64_t frame_duration_sum_usec = 0;
 	uint32_t frames_since_last_fps_report = 0;
-	uint64_t frame_duration_avg_usec = 2000;
+
+	// Nothing is known about the frame rate until the first frame has been measured
+	frame_pacing_stats_t pacing = frame_pacing_stats(&g_frame_pacing);
 
 	uint8_t buffer_index = 0;
-	int8_t ditheringFrame = 0;
+	uint8_t ditheringFrame = 0;
+	bool dithering_was_enabled = false;
+
+	// The strip layout LEDscape was last set up for
+	const ledscape_t* layout_leds = NULL;
+	strip_layout_t layout_leds_layout;
+	unsigned buffers_to_clear = 0;
+
+	// What was last sent, to decide whether the next frame can be sent as a partial one
+	const ledscape_t* last_drawn_leds = NULL;
+	strip_layout_t last_drawn_layout;
+	uint32_t last_drawn_strip_count = 0;
+	struct timeval last_full_frame_tv = { 0, 0 };
+	uint32_t partial_frames_since_last_fps_report = 0;
+
+	// Time spent rendering, and copying staged frames out to the outputs, since the last report
+	uint64_t render_duration_sum_usec = 0;
+	uint64_t publish_duration_sum_usec = 0;
+	uint32_t publishes_since_last_fps_report = 0;
+
+	const char* render_variant_name = "none";
+	render_pool_t* render_pool = NULL;
+
+	// The lookup tables this thread (and its pool) renders with; replaced only between frames
+	render_lut_t* lut = NULL;
+
 	for(;;) {
 		pthread_mutex_lock(&g_runtime_state.mutex);
 
@@ -1336,18 +1873,18 @@ void* render_thread(void* unused_data)
 		}
         
         bool interpolation_enabled = g_server_config.interpolation_enabled;
+
+        // Pick up the newest published frame, if any; the old current frame becomes the previous one. When interpolating,
+        // that waits until the fade into the current frame is complete (below), so a new frame doesn't cut it short.
+        if (!interpolation_enabled || !g_frame_exchange.has_prev_frame || !g_frame_exchange.has_current_frame) {
+            frame_exchange_take(&g_frame_exchange);
+        }
         
         // If interpolation not enabled, then we only care about the current frame and want to fully display it immediately
                 
         if (!interpolation_enabled) {
             
-            if (g_runtime_state.has_next_frame) {        
-                
-                // Make the next frame the current frame
-                rotate_frames(FALSE);
-            }
-            
-            if (!g_runtime_state.has_current_frame) {
+            if (!g_frame_exchange.has_current_frame) {
                 pthread_mutex_unlock(&g_runtime_state.mutex);
                 usleep(10e3 /* 10ms */);
                 continue;
@@ -1356,7 +1893,7 @@ void* render_thread(void* unused_data)
         } else {
             
             // Skip frames if there isn't enough data
-            if (!g_runtime_state.has_prev_frame || !g_runtime_state.has_current_frame) {
+            if (!g_frame_exchange.has_prev_frame || !g_frame_exchange.has_current_frame) {
                 pthread_mutex_unlock(&g_runtime_state.mutex);
                 usleep(10e3 /* 10ms */);
                 continue;
@@ -1364,28 +1901,25 @@ void* render_thread(void* unused_data)
             
             // Calculate the time delta and current percentage (as a 16-bit value)
             gettimeofday(&now_tv, NULL);
-            timersub(&now_tv, &g_runtime_state.next_frame_tv, &frame_progress_tv);
+            timersub(&now_tv, frame_exchange_current_tv(&g_frame_exchange), &frame_progress_tv);
 
             // Calculate current frame and previous frame time
             uint64_t frame_progress_us = (uint64_t) (frame_progress_tv.tv_sec*1e6 + frame_progress_tv.tv_usec);
-            uint64_t last_frame_time_us = (uint64_t) (g_runtime_state.prev_current_delta_tv.tv_sec*1e6 + g_runtime_state.prev_current_delta_tv.tv_usec);
+            uint64_t last_frame_time_us = (uint64_t) (g_frame_exchange.prev_current_delta_tv.tv_sec*1e6 + g_frame_exchange.prev_current_delta_tv.tv_usec);
 
             // Check for current frame exhaustion
-            if (frame_progress_us > last_frame_time_us) {
-                uint8_t has_next_frame = g_runtime_state.has_next_frame;
+            if (frame_progress_us >= last_frame_time_us) {
+                if (frame_exchange_take(&g_frame_exchange)) {
+                    // Start fading into the new frame from the top of the loop
+                    pthread_mutex_unlock(&g_runtime_state.mutex);
+                    continue;
+                }
+
                 pthread_mutex_unlock(&g_runtime_state.mutex);
 
-                // This should only happen in a final frame case -- to avoid early switching (and some nasty resulting
-                // artifacts) we only force frame rotation if the next frame is really late.
-                if (has_next_frame && frame_progress_us > last_frame_time_us*2) {
-                    // If we have more data, rotate it in.
-                    printf("Need data: rotating in; frame_progress_us=%llu; last_frame_time_us=%llu\n", frame_progress_us, last_frame_time_us);
-                    rotate_frames(TRUE);
-                } else {
-                    // Otherwise sleep for a moment and wait for more data
-                    printf("Need data: none available; frame_progress_us=%llu; last_frame_time_us=%llu\n", frame_progress_us, last_frame_time_us);
-                    usleep(1e3);
-                }
+                // Otherwise sleep for a moment and wait for more data
+                printf("Need data: none available; frame_progress_us=%llu; last_frame_time_us=%llu\n", (unsigned long long) frame_progress_us, (unsigned long long) last_frame_time_us);
+                usleep(1e3);
 
                 continue;
             }
@@ -1404,7 +1938,7 @@ void* render_thread(void* unused_data)
 
 		// printf("%d of %d (%d)\n",
 		// 	(frame_progress_tv.tv_sec*1000000 + frame_progress_tv.tv_usec) ,
-		// 	(g_runtime_state.prev_current_delta_tv.tv_sec*1000000 + g_runtime_state.prev_current_delta_tv.tv_usec),
+		// 	(g_frame_exchange.prev_current_delta_tv.tv_sec*1000000 + g_frame_exchange.prev_current_delta_tv.tv_usec),
 		// 	frame_progress16
 		// );
 
@@ -1413,10 +1947,23 @@ void* render_thread(void* unused_data)
 
 		ledscape_frame_t * const frame = ledscape_frame(g_runtime_state.leds, buffer_index);
 
-		// Build the render frame
-		uint32_t led_count = g_runtime_state.frame_size;
-		uint32_t leds_per_strip = led_count / LEDSCAPE_NUM_STRIPS;
-		uint32_t data_index = 0;
+		// Build the render frame. The input frames can't be resized while we hold the runtime state lock.
+		const strip_layout_t* layout = &g_frame_exchange.layout;
+
+		// Pixels past the end of a strip are never rendered. Stop LEDscape clocking them out, and clear out whatever an
+		// earlier, longer layout left there in each buffer as it comes up; the other one may still be being sent.
+		if (layout_leds != g_runtime_state.leds || memcmp(&layout_leds_layout, layout, sizeof(*layout)) != 0) {
+			ledscape_set_strip_lengths(g_runtime_state.leds, layout->lengths);
+
+			layout_leds = g_runtime_state.leds;
+			layout_leds_layout = *layout;
+			buffers_to_clear = 2;
+		}
+
+		if (buffers_to_clear > 0) {
+			memset(frame, 0, g_runtime_state.leds->frame_size);
+			buffers_to_clear--;
+		}
 
 		// Update the dithering frame counter
 		ditheringFrame ++;
@@ -1433,139 +1980,207 @@ void* render_thread(void* unused_data)
 		// Use the strip count from configs. This can save time that would be used dithering
 		used_strip_count = min(g_server_config.used_strip_count, LEDSCAPE_NUM_STRIPS);
 
-		// Only enable dithering if we're better than 100fps
-		bool dithering_enabled = (frame_duration_avg_usec < 10000) && g_server_config.dithering_enabled;
+		// Only dither while frames keep coming fast enough for it not to be seen; see frame_pacing.h
+		bool dithering_enabled = pacing.dithering_enabled && g_server_config.dithering_enabled;
 		
 		bool lut_enabled = g_server_config.lut_enabled;
 
 		color_channel_order_t color_channel_order = g_server_config.color_channel_order;
 
-		pthread_mutex_unlock(&g_server_config.mutex);
-
-		// Only allow dithering to take effect if it blinks faster than 60fps
-		uint32_t maxDitherFrames = 16667 / frame_duration_avg_usec;
+		unsigned render_thread_count = g_server_config.render_threads;
 
-		for (uint32_t strip_index=0; strip_index<used_strip_count; strip_index++) {
-			for (uint32_t led_index=0; led_index<leds_per_strip; led_index++, data_index++) {
-				buffer_pixel_t* pixel_in_prev = &g_runtime_state.previous_frame_data[data_index];
-				buffer_pixel_t* pixel_in_current = &g_runtime_state.current_frame_data[data_index];
-				pixel_delta_t* pixel_in_overflow = &g_runtime_state.frame_dithering_overflow[data_index];
+		// Only the ws281x and apa102 programs can leave strips idle
+		bool partial_frames_supported = strcasecmp(g_server_config.output_mode_name, "ws281x") == 0
+			|| strcasecmp(g_server_config.output_mode_name, "ws281x-packed") == 0
+			|| strcasecmp(g_server_config.output_mode_name, "ws281x-bitplane") == 0
+			|| strcasecmp(g_server_config.output_mode_name, "apa102") == 0;
 
-				ledscape_pixel_t* const pixel_out = & frame[led_index].strip[strip_index];
+		pthread_mutex_unlock(&g_server_config.mutex);
 
-				int32_t interpolatedR;
-				int32_t interpolatedG;
-				int32_t interpolatedB;
+		// (Re)create the worker pool if the configured thread count changed
+		if (render_pool == NULL || render_pool_thread_count(render_pool) != render_thread_count) {
+			if (render_pool != NULL) {
+				render_pool_destroy(render_pool);
+			}
 
-				// Interpolate
-				if (interpolation_enabled) {
-					interpolatedR = (pixel_in_prev->r*inv_frame_progress16 + pixel_in_current->r*frame_progress16) >> 8;
-					interpolatedG = (pixel_in_prev->g*inv_frame_progress16 + pixel_in_current->g*frame_progress16) >> 8;
-					interpolatedB = (pixel_in_prev->b*inv_frame_progress16 + pixel_in_current->b*frame_progress16) >> 8;
-				} else {
-					interpolatedR = pixel_in_current->r << 8;
-					interpolatedG = pixel_in_current->g << 8;
-					interpolatedB = pixel_in_current->b << 8;
-				}
+			printf("[render] Rendering with %u thread(s)\n", render_thread_count);
+			render_pool = render_pool_create(render_thread_count);
+		}
 
-				// Apply LUT
-				if (lut_enabled) {
-					interpolatedR = lutInterpolate((uint32_t) interpolatedR, g_runtime_state.red_lookup);
-					interpolatedG = lutInterpolate((uint32_t) interpolatedG, g_runtime_state.green_lookup);
-					interpolatedB = lutInterpolate((uint32_t) interpolatedB, g_runtime_state.blue_lookup);
-				}
+		// Pick up lookup tables built since the last frame
+		render_lut_t* next_lut = render_lut_take(&g_lut_slot);
+		if (next_lut != NULL) {
+			printf("[render] Switching to new %s lookup tables\n", render_lut_mode_to_string(next_lut->mode));
+			render_lut_release(lut);
+			lut = next_lut;
+		}
 
-				// Reset dithering for this pixel if it's been too long since it actually changed anything. This serves to prevent
-				// visible blinking pixels.
-				if (abs(abs(pixel_in_overflow->last_effect_frame_r) - abs(ditheringFrame)) > maxDitherFrames) {
-					pixel_in_overflow->r = 0;
-					pixel_in_overflow->last_effect_frame_r = ditheringFrame;
-				}
+		// Only allow dithering to take effect if it blinks faster than 60fps
+		uint32_t maxDitherFrames = pacing.max_dither_frames;
 
-				if (abs(abs(pixel_in_overflow->last_effect_frame_g) - abs(ditheringFrame)) > maxDitherFrames) {
-					pixel_in_overflow->g = 0;
-					pixel_in_overflow->last_effect_frame_g = ditheringFrame;
-				}
+		// Errors left over from before dithering was switched off no longer match what is being shown
+		if (dithering_enabled && !dithering_was_enabled) {
+			dither_state_reset(g_runtime_state.frame_dither_states, g_runtime_state.frame_size);
+		}
+		dithering_was_enabled = dithering_enabled;
+
+		render_params_t render_params = {
+			.input_16bit = g_frame_exchange.is_16bit,
+			.interpolation_enabled = interpolation_enabled,
+			.lut_enabled = lut_enabled && lut != NULL,
+			.dithering_enabled = dithering_enabled,
+			.color_channel_order = color_channel_order,
+			.frame_progress16 = frame_progress16,
+			.inv_frame_progress16 = inv_frame_progress16,
+			.dithering_frame = ditheringFrame,
+			.max_dither_frames = maxDitherFrames
+		};
+
+		if (lut != NULL) {
+			render_lut_apply(lut, &render_params);
+		}
 
-				if (abs(abs(pixel_in_overflow->last_effect_frame_b) - abs(ditheringFrame)) > maxDitherFrames) {
-					pixel_in_overflow->b = 0;
-					pixel_in_overflow->last_effect_frame_b = ditheringFrame;
-				}
+		// Pick the kernel specialized for this frame's options once, rather than testing them for every pixel
+		const render_variant_t* render_variant = render_select_variant(&render_params);
+
+		render_job_t render_job = {
+			.variant = render_variant,
+			.params = &render_params,
+			.previous_data = frame_exchange_previous(&g_frame_exchange),
+			.current_data = frame_exchange_current(&g_frame_exchange),
+			.dither_states = g_runtime_state.frame_dither_states,
+			.frame = frame,
+			.layout = layout,
+			.strip_count = used_strip_count
+		};
+
+		// Returns once every worker's slice is rendered, so the frame is complete before it is handed to the PRU
+		struct timeval render_start_tv;
+		gettimeofday(&render_start_tv, NULL);
+
+		render_pool_run(render_pool, &render_job);
+		render_variant_name = render_variant->name;
+
+		struct timeval render_stop_tv;
+		gettimeofday(&render_stop_tv, NULL);
+		timersub(&render_stop_tv, &render_start_tv, &delta_tv);
+		render_duration_sum_usec += frame_pacing_tv_usec(&delta_tv);
+
+		// Send only the strips that changed since the last frame, as far as the last changed pixel. The other buffer
+		// holds the last frame sent, so this is only valid while nothing else has touched the strips since. Without
+		// staging the buffers are the uncached output memory, and reading both back would cost more than it saves.
+		uint64_t active_strips = LEDSCAPE_ALL_STRIPS;
+		uint32_t active_pixels = layout->max_length;
+		timersub(&start_tv, &last_full_frame_tv, &delta_tv);
+
+		bool partial_frame = partial_frames_supported
+			&& g_runtime_state.leds->staging_frames != NULL
+			&& last_drawn_leds == g_runtime_state.leds
+			&& memcmp(&last_drawn_layout, layout, sizeof(*layout)) == 0
+			&& last_drawn_strip_count == used_strip_count
+			&& (uint64_t) (delta_tv.tv_sec*1e6 + delta_tv.tv_usec) < RENDER_FULL_FRAME_INTERVAL_USEC;
+
+		if (partial_frame) {
+			active_strips = render_changed_strips(
+				frame,
+				ledscape_frame(g_runtime_state.leds, (buffer_index+1)%2),
+				layout->max_length,
+				used_strip_count,
+				&active_pixels
+			);
+			partial_frames_since_last_fps_report++;
+		} else {
+			last_full_frame_tv = start_tv;
+		}
 
-				// Apply dithering overflow
-				int32_t	ditheredR = interpolatedR;
-				int32_t	ditheredG = interpolatedG;
-				int32_t	ditheredB = interpolatedB;
+        // Wait for previous send to complete if still in progress
+		if (ledscape_wait_timeout(g_runtime_state.leds, RENDER_OUTPUT_TIMEOUT_MS) < 0) {
+			// A hung PRU shouldn't wedge the server; drop this frame and try again with the next
+			fprintf(stderr, "[render] Output did not finish a frame within %d ms; dropping buffer %u\n",
+				RENDER_OUTPUT_TIMEOUT_MS,
+				buffer_index
+			);
 
-				if (dithering_enabled) {
-					ditheredR += pixel_in_overflow->r;
-					ditheredG += pixel_in_overflow->g;
-					ditheredB += pixel_in_overflow->b;
-				}
+			// The strips may not be showing what the other buffer holds, so send all of the next one
+			last_drawn_leds = NULL;
+		} else {
+			// Send the frame to the PRU
+			ledscape_draw_strips(g_runtime_state.leds, buffer_index, active_strips, active_pixels);
 
-				// Calculate and assign output values
-				uint8_t r = (uint8_t) min((ditheredR+0x80) >> 8, 255);
-				uint8_t g = (uint8_t) min((ditheredG+0x80) >> 8, 255);
-				uint8_t b = (uint8_t) min((ditheredB+0x80) >> 8, 255);
-
-				ledscape_pixel_set_color(
-					pixel_out,
-					color_channel_order,
-					r,
-					g,
-					b
-				);
+			publish_duration_sum_usec += g_runtime_state.leds->publish_usec;
+			publishes_since_last_fps_report += g_runtime_state.leds->publish_count;
+			g_runtime_state.leds->publish_usec = 0;
+			g_runtime_state.leds->publish_count = 0;
 
-//				if (led_index == 0 && strip_index == 3) {
-//					printf("channel %d: %03d %03d %03d\n", strip_index, r, g, b);
-//				}
-
-				// Check for interpolation effect
-				if (r != (interpolatedR+0x80)>>8) pixel_in_overflow->last_effect_frame_r = ditheringFrame;
-				if (g != (interpolatedG+0x80)>>8) pixel_in_overflow->last_effect_frame_g = ditheringFrame;
-				if (b != (interpolatedB+0x80)>>8) pixel_in_overflow->last_effect_frame_b = ditheringFrame;
-
-				// Recalculate Overflow
-				// NOTE: For some strange reason, reading the values from pixel_out causes strange memory corruption. As such
-				// we use temporary variables, r, g, and b. It probably has to do with things being loaded into the CPU cache
-				// when read, as such, don't read pixel_out from here.
-				if (dithering_enabled) {
-					pixel_in_overflow->r = (uint8_t) ((int16_t)ditheredR - (r * 257));
-					pixel_in_overflow->g = (uint8_t) ((int16_t)ditheredG - (g * 257));
-					pixel_in_overflow->b = (uint8_t) ((int16_t)ditheredB - (b * 257));
-				}
-			}
+			last_drawn_leds = g_runtime_state.leds;
+			last_drawn_layout = *layout;
+			last_drawn_strip_count = used_strip_count;
 		}
 
-        // Wait for previous send to complete if still in progress
-		ledscape_wait(g_runtime_state.leds);
-		// Send the frame to the PRU
-		ledscape_draw(g_runtime_state.leds, buffer_index);
-
 		pthread_mutex_unlock(&g_runtime_state.mutex);
 
 		// Output Timing Info
 		gettimeofday(&stop_tv, NULL);
+
+		struct timeval output_delta_tv;
+		timersub(&render_stop_tv, &start_tv, &delta_tv);
+		timersub(&stop_tv, &render_stop_tv, &output_delta_tv);
+		pacing = frame_pacing_update(&g_frame_pacing, frame_pacing_tv_usec(&delta_tv), frame_pacing_tv_usec(&output_delta_tv));
+
 		timersub(&stop_tv, &start_tv, &delta_tv);
 
 		frames_since_last_fps_report++;
-		frame_duration_sum_usec += delta_tv.tv_usec;
+		frame_duration_sum_usec += frame_pacing_tv_usec(&delta_tv);
 		if (stop_tv.tv_sec - last_report >= fps_report_interval_seconds) {
 			last_report = stop_tv.tv_sec;
 
-			frame_duration_avg_usec = frame_duration_sum_usec / frames_since_last_fps_report;
-			printf("[render] fps_info={frame_avg_usec: %qu, possible_fps: %.2f, actual_fps: %.2f, sample_frames: %u}\n",
-				frame_duration_avg_usec,
+			const uint64_t frame_duration_avg_usec = max(frame_duration_sum_usec / frames_since_last_fps_report, 1);
+
+			uint64_t worker_avg_usec[16];
+			unsigned worker_count = render_pool_take_timings(render_pool, worker_avg_usec, 16);
+			char worker_info[256] = { 0 };
+			for (unsigned i=0; i<worker_count; i++) {
+				snprintf(
+					worker_info + strlen(worker_info),
+					sizeof(worker_info) - strlen(worker_info),
+					i == 0 ? "%llu" : ", %llu",
+					(unsigned long long) worker_avg_usec[i]
+				);
+			}
+
+			uint64_t input_frames = __sync_fetch_and_and(&g_input_stats.frames, 0);
+			uint64_t input_bytes_copied = __sync_fetch_and_and(&g_input_stats.bytes_copied, 0);
+
+			char pacing_info[256];
+			frame_pacing_stats_to_json(&pacing, pacing_info, sizeof(pacing_info));
+
+			printf("[render] fps_info={frame_avg_usec: %llu, possible_fps: %.2f, actual_fps: %.2f, sample_frames: %u, partial_frames: %u, variant: %s-%s, render_avg_usec: %llu, worker_avg_usec: [%s], publish_avg_usec: %llu, publishes: %u, input_frames: %llu, input_bytes_copied_per_frame: %llu, pacing: %s}\n",
+				(unsigned long long) frame_duration_avg_usec,
 				(1.0e6 / frame_duration_avg_usec),
 				frames_since_last_fps_report * 1.0 / fps_report_interval_seconds,
-				frames_since_last_fps_report
+				frames_since_last_fps_report,
+				partial_frames_since_last_fps_report,
+				render_kernel_name(),
+				render_variant_name,
+				(unsigned long long) (render_duration_sum_usec / frames_since_last_fps_report),
+				worker_info,
+				(unsigned long long) (publishes_since_last_fps_report > 0 ? publish_duration_sum_usec / publishes_since_last_fps_report : 0),
+				publishes_since_last_fps_report,
+				(unsigned long long) input_frames,
+				(unsigned long long) (input_frames > 0 ? input_bytes_copied / input_frames : 0),
+				pacing_info
 			);
 
 			frames_since_last_fps_report = 0;
+			partial_frames_since_last_fps_report = 0;
 			frame_duration_sum_usec = 0;
+			render_duration_sum_usec = 0;
+			publish_duration_sum_usec = 0;
+			publishes_since_last_fps_report = 0;
 		}
 	}
 
+	render_lut_release(lut);
 	ledscape_close(g_runtime_state.leds);
 	pthread_exit(NULL);
 }
@@ -1581,6 +2196,13 @@ typedef struct
 	uint8_t len_lo;
 } opc_cmd_t;
 
+typedef enum
+{
+	OPC_CMD_SET_PIXELS = 0,
+	OPC_CMD_SET_PIXELS_16BIT = 2, // big-endian 16-bit channels
+	OPC_CMD_SYSTEM = 255
+} opc_command_t;
+
 typedef enum
 {
 	OPC_SYSID_FADECANDY = 1,
@@ -1591,9 +2213,18 @@ typedef enum
 
 typedef enum
 {
-	OPC_LEDSCAPE_CMD_GET_CONFIG = 1
+	OPC_LEDSCAPE_CMD_GET_CONFIG = 1,
+	OPC_LEDSCAPE_CMD_GET_STATS = 2
 } opc_ledscape_cmd_id_t;
 
+typedef enum
+{
+	OPC_FADECANDY_CMD_SET_COLOR_CORRECTION = 1
+} opc_fadecandy_cmd_id_t;
+
+// Longest system command payload read from a UDP packet
+#define OPC_SYSTEM_PAYLOAD_MAX_LENGTH 1024
+
 ////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////
 // Demo Data Thread
 //
@@ -1670,14 +2301,17 @@ void* demo_thread(void* unused_data)
 #pragma clang diagnostic ignored "-Wmissing-noreturn"
 	for (uint16_t frame_index = 0; /*ever*/; frame_index +=3) {
 		// Calculate time since last remote data
-		pthread_mutex_lock(&g_runtime_state.mutex);
+		struct timeval last_remote_data_tv;
+		frame_exchange_last_remote_data_tv(&g_frame_exchange, &last_remote_data_tv);
 		gettimeofday(&now_tv, NULL);
-		timersub(&now_tv, &g_runtime_state.last_remote_data_tv, &delta_tv);
-		pthread_mutex_unlock(&g_runtime_state.mutex);
+		timersub(&now_tv, &last_remote_data_tv, &delta_tv);
+
+		strip_layout_t layout;
 
 		pthread_mutex_lock(&g_server_config.mutex);
 		uint32_t leds_per_strip = g_server_config.leds_per_strip;
-		uint32_t channel_count = g_server_config.leds_per_strip*3*LEDSCAPE_NUM_STRIPS;
+		server_config_strip_layout(&g_server_config, &layout);
+		uint32_t channel_count = layout.pixel_count*3;
 		demo_mode_t demo_mode = g_server_config.demo_mode;
 		pthread_mutex_unlock(&g_server_config.mutex);
 
@@ -1705,7 +2339,7 @@ void* demo_thread(void* unused_data)
 
 			for (uint32_t strip = 0, data_index = 0 ; strip < LEDSCAPE_NUM_STRIPS ; strip++)
 			{
-				for (uint16_t p = 0 ; p < leds_per_strip; p++, data_index+=3)
+				for (uint16_t p = 0 ; p < layout.lengths[strip]; p++, data_index+=3)
 				{
 					switch (demo_mode) {
 						case DEMO_MODE_NONE: {
@@ -1746,7 +2380,7 @@ void* demo_thread(void* unused_data)
 				}
 			}
 
-			set_next_frame_data(buffer, buffer_size, FALSE);
+			set_next_frame_data(buffer, buffer_size, false, FALSE);
 		}
 
 		usleep(1e6/30);
@@ -1758,7 +2392,103 @@ void* demo_thread(void* unused_data)
 
 
 ////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////
-// e131 Server
+// UDP Receive Batching
+//
+
+// Number of datagrams drained per recvmmsg call
+#define OPC_UDP_BATCH_SIZE 8
+#define DMX_BATCH_SIZE LEDSCAPE_NUM_STRIPS
+
+typedef struct {
+	const char* log_prefix;
+	uint64_t last_report;
+	uint32_t syscalls;
+	uint32_t packets;
+	uint32_t packets_coalesced;
+} udp_rx_stats_t;
+
+/**
+* Account for one batch of received packets, of which packets_coalesced were superseded by a newer packet in the same
+* batch, and log the totals every few seconds.
+*/
+void udp_rx_stats_add_batch(
+	udp_rx_stats_t* stats,
+	uint32_t packets,
+	uint32_t packets_coalesced
+) {
+	const unsigned rx_report_interval_seconds = 10;
+
+	stats->syscalls++;
+	stats->packets += packets;
+	stats->packets_coalesced += packets_coalesced;
+
+	struct timeval now_tv;
+	gettimeofday(&now_tv, NULL);
+	if (now_tv.tv_sec - stats->last_report >= rx_report_interval_seconds) {
+		stats->last_report = now_tv.tv_sec;
+
+		printf("%s rx_info={packets: %u, packets_per_syscall: %.2f, packets_coalesced: %u}\n",
+			stats->log_prefix,
+			stats->packets,
+			stats->packets * 1.0 / stats->syscalls,
+			stats->packets_coalesced
+		);
+
+		stats->syscalls = 0;
+		stats->packets = 0;
+		stats->packets_coalesced = 0;
+	}
+}
+
+/**
+* Copy up to dest_size bytes, starting offset bytes into the data described by the given iovecs, into dest. Bytes past
+* the end of the data are zeroed.
+*/
+void iov_gather(
+	uint8_t* dest,
+	size_t dest_size,
+	const struct iovec* iov,
+	size_t iov_count,
+	size_t offset
+) {
+	for (size_t i=0; i<iov_count && dest_size > 0; i++) {
+		if (offset >= iov[i].iov_len) {
+			offset -= iov[i].iov_len;
+			continue;
+		}
+
+		size_t chunk_size = min(iov[i].iov_len - offset, dest_size);
+		memcpy(dest, (uint8_t*) iov[i].iov_base + offset, chunk_size);
+		dest += chunk_size;
+		dest_size -= chunk_size;
+		offset = 0;
+	}
+
+	memset(dest, 0, dest_size);
+}
+
+/**
+* Block until the socket has data to read, without holding anything, or until timeout_ms passes (-1 to wait forever).
+* \returns true if there is data to read.
+*/
+bool wait_for_readable(int sock, int timeout_ms) {
+	struct pollfd poll_fd = {
+		.fd = sock,
+		.events = POLLIN,
+		.revents = 0
+	};
+
+	const int rc = poll(&poll_fd, 1, timeout_ms);
+	if (rc < 0 && errno != EINTR) {
+		fprintf(stderr, "poll failed: %s\n", strerror(errno));
+		usleep(1e3);
+	}
+
+	return rc > 0;
+}
+
+////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+// e131 and Art-Net Servers
 //
 
 // From http://atastypixel-blog-content.s3.amazonaws.com/blog/wp-content/uploads/2010/05/multicast_sample.c
@@ -1815,269 +2545,828 @@ int join_multicast_group_on_all_ifaces(
 	return joined_count;
 }
 
-void* e131_server_thread(void* unused_data)
-{
-	unused_data=unused_data; // Suppress Warnings
+/**
+* Decodes a packet for the DMX assembler; context is the protocol's own state.
+*/
+typedef dmx_packet_type_t (*dmx_parse_fn)(const uint8_t* packet, uint32_t packet_size, dmx_packet_t* out_packet, void* context);
 
-	// Disable if given port 0
-	if (g_server_config.e131_port == 0) {
-		fprintf(stderr, "[e131] Not starting e131 server; Port is zero.\n");
-		pthread_exit(NULL);
-		return NULL;
-	}
+/**
+* A bound DMX socket together with the universe map and assembler fed from it. Used by exactly one thread, either
+* the server's own or the network reactor.
+*/
+typedef struct {
+	int sock;
+	const char* log_prefix;
+	uint32_t min_packet_size; // smaller packets are reported as too small; zero to drop them silently
+	dmx_parse_fn parse;
+	void* parse_context;
+
+	dmx_universe_map_t universe_map;
+	dmx_assembler_t assembler;
+	strip_layout_t assembler_layout;
+	uint32_t assembler_pixel_size; // channels per pixel; 6 for 16-bit pixels
+
+	// One packet buffer per message in a batch, each big enough for the largest mapped universe after the header
+	uint8_t* packet_buffers;
+	uint32_t packet_buffer_size;
+
+	udp_rx_stats_t rx_stats;
+} dmx_server_t;
+
+static void dmx_commit_frame(uint8_t* frame_data, uint32_t frame_data_size, void* context) {
+	const dmx_server_t* server = context;
+	set_next_frame_data(frame_data, frame_data_size, server->assembler_pixel_size == sizeof(buffer_pixel16_t), TRUE);
+}
 
-	fprintf(stderr, "[e131] Starting UDP server on port %d\n", g_server_config.e131_port);
-	uint8_t packet_buffer[65536]; // e131 packet buffer
+/**
+* (Re)build the universe map, assembler and packet buffers if the strip lengths or input depth have changed since they
+* were built.
+*/
+static void dmx_server_ensure_assembler(dmx_server_t* server) {
+	strip_layout_t layout;
 
-	const int sock = socket(AF_INET6, SOCK_DGRAM, 0);
+	pthread_mutex_lock(&g_server_config.mutex);
+	server_config_strip_layout(&g_server_config, &layout);
+	const uint32_t pixel_size = server_config_input_pixel_size(&g_server_config);
+	pthread_mutex_unlock(&g_server_config.mutex);
 
-	if (sock < 0)
-		die("[e131] socket failed: %s\n", strerror(errno));
+	if (server->assembler.frame_data != NULL
+		&& server->assembler_pixel_size == pixel_size
+		&& memcmp(&server->assembler_layout, &layout, sizeof(layout)) == 0) {
+		return;
+	}
 
-	struct sockaddr_in6 addr;
-	bzero(&addr, sizeof(addr));
-	addr.sin6_family = AF_INET6;
-	addr.sin6_addr = in6addr_any;
-	addr.sin6_port = htons(g_server_config.e131_port);
+	if (server->assembler.frame_data != NULL) {
+		dmx_assembler_free(&server->assembler);
+		dmx_universe_map_free(&server->universe_map);
+	}
 
-	if (bind(sock, (const struct sockaddr*) &addr, sizeof(addr)) < 0) {
-		fprintf(stderr, "[e131] bind port %d failed: %s\n", g_server_config.e131_port, strerror(errno));
-		pthread_exit(NULL);
-		return NULL;
+	char map_error[256];
+	pthread_mutex_lock(&g_server_config.mutex);
+	int map_result = dmx_universe_map_compile(
+		&server->universe_map,
+		g_server_config.dmx_universes,
+		g_server_config.dmx_universe_count,
+		&layout,
+		pixel_size,
+		map_error,
+		sizeof(map_error)
+	);
+	pthread_mutex_unlock(&g_server_config.mutex);
+
+	if (map_result < 0) {
+		// Validated at startup, so this shouldn't happen
+		fprintf(stderr, "%s %s; falling back to the default universe mapping\n", server->log_prefix, map_error);
+		dmx_universe_map_compile(&server->universe_map, NULL, 0, &layout, pixel_size, NULL, 0);
 	}
 
-	int32_t last_seq_num = -1;
+	dmx_assembler_init(
+		&server->assembler,
+		server->log_prefix,
+		&server->universe_map,
+		layout.pixel_count * pixel_size,
+		dmx_commit_frame,
+		server
+	);
+	server->assembler_layout = layout;
+	server->assembler_pixel_size = pixel_size;
 
-	// Bind to multicast
-	if (join_multicast_group_on_all_ifaces(sock, "239.255.0.0") < 0) {
-		fprintf(stderr, "[e131] failed to bind to multicast addresses\n");
+	uint32_t max_channel_count = 0;
+	for (uint32_t slot=0; slot<server->universe_map.slot_count; slot++) {
+		max_channel_count = max(max_channel_count, server->universe_map.targets[slot].channel_count);
 	}
 
-	uint8_t* dmx_buffer = NULL;
-	uint32_t dmx_buffer_size = 0;
+	if (server->packet_buffers != NULL) free(server->packet_buffers);
+	server->packet_buffer_size = E131_DATA_HEADER_SIZE + max(max_channel_count, 512);
+	server->packet_buffers = malloc(DMX_BATCH_SIZE * server->packet_buffer_size);
+	if (server->packet_buffers == NULL)
+		die("%s malloc failed: %s\n", server->log_prefix, strerror(errno));
+}
 
-	uint32_t packets_since_update = 0;
-	uint32_t frame_counter_at_last_update = g_runtime_state.frame_counter;
+void dmx_server_init(
+	dmx_server_t* server,
+	const int sock,
+	const char* log_prefix,
+	uint32_t min_packet_size,
+	dmx_parse_fn parse,
+	void* parse_context
+) {
+	memset(server, 0, sizeof(*server));
 
-	while (1)
-	{
-		const ssize_t received_packet_size = recv(sock, packet_buffer, sizeof(packet_buffer), 0);
-		if (received_packet_size < 0) {
-			fprintf(stderr, "[e131] recv failed: %s\n", strerror(errno));
-			continue;
-		}
+	server->sock = sock;
+	server->log_prefix = log_prefix;
+	server->min_packet_size = min_packet_size;
+	server->parse = parse;
+	server->parse_context = parse_context;
+	server->rx_stats.log_prefix = log_prefix;
 
-		// Ensure the buffer
-		pthread_mutex_lock(&g_server_config.mutex);
-		uint32_t leds_per_strip = g_server_config.leds_per_strip;
-		uint32_t led_count = g_server_config.leds_per_strip * LEDSCAPE_NUM_STRIPS;
-		pthread_mutex_unlock(&g_server_config.mutex);
+	dmx_server_ensure_assembler(server);
+}
+
+/**
+* Receive and assemble everything queued on the socket, one batch at a time, until it is empty.
+*/
+void dmx_server_drain(dmx_server_t* server) {
+	struct mmsghdr msgs[DMX_BATCH_SIZE];
+	struct iovec iovs[DMX_BATCH_SIZE];
+
+	dmx_server_ensure_assembler(server);
+
+	for (int i=0; i<DMX_BATCH_SIZE; i++) {
+		iovs[i].iov_base = server->packet_buffers + i * server->packet_buffer_size;
+		iovs[i].iov_len = server->packet_buffer_size;
 
-		if (dmx_buffer == NULL || dmx_buffer_size != led_count) {
-			if (dmx_buffer != NULL) free(dmx_buffer);
-			dmx_buffer_size = led_count * sizeof(buffer_pixel_t);
-			dmx_buffer = malloc(dmx_buffer_size);
+		bzero(&msgs[i], sizeof(msgs[i]));
+		msgs[i].msg_hdr.msg_iov = &iovs[i];
+		msgs[i].msg_hdr.msg_iovlen = 1;
+	}
+
+	struct timeval now_tv;
+	int received_packet_count;
+
+	do {
+		received_packet_count = recvmmsg(server->sock, msgs, DMX_BATCH_SIZE, MSG_DONTWAIT, NULL);
+		if (received_packet_count < 0) {
+			if (errno != EAGAIN && errno != EWOULDBLOCK) {
+				fprintf(stderr, "%s recvmmsg failed: %s\n", server->log_prefix, strerror(errno));
+			}
+			break;
 		}
 
-		// Packet should be at least 126 bytes for the header
-		if (received_packet_size >= 126) {
-			int32_t current_seq_num = packet_buffer[111];
-
-			if (last_seq_num == -1 || current_seq_num >= last_seq_num || (last_seq_num - current_seq_num) > 64) {
-				last_seq_num = current_seq_num;
-
-				// 1-based DMX universe
-				uint16_t dmx_universe_num = ((uint16_t)packet_buffer[113] << 8) | packet_buffer[114];
-
-				if (dmx_universe_num >= 1 && dmx_universe_num <= 48) {
-					uint16_t ledscape_channel_num = dmx_universe_num - 1;
-					// Data OK
-//					set_next_frame_single_channel_data(
-//						ledscape_channel_num,
-//						packet_buffer + 126,
-//						received_packet_size - 126,
-//						TRUE
-//					);
-
-					memcpy(
-						dmx_buffer + ledscape_channel_num * leds_per_strip * sizeof(buffer_pixel_t),
-						packet_buffer + 126,
-						min((uint)(received_packet_size - 126), led_count * sizeof(buffer_pixel_t))
-					);
-
-					set_next_frame_data(
-						dmx_buffer,
-						dmx_buffer_size * sizeof(buffer_pixel_t),
-						TRUE
-					);
-				} else {
-					fprintf(
-						stderr,
-						"[e131] DMX universe %d out of bounds [1,48] \n",
-						dmx_universe_num
-					);
+		gettimeofday(&now_tv, NULL);
+		const uint32_t packets_coalesced_before = server->assembler.packets_coalesced;
+
+		for (int i=0; i<received_packet_count; i++) {
+			dmx_packet_t packet;
+
+			if (server->parse(iovs[i].iov_base, msgs[i].msg_len, &packet, server->parse_context) == DMX_PACKET_NONE) {
+				if (msgs[i].msg_len < server->min_packet_size) {
+					fprintf(stderr, "%s packet too small: %d < %d \n", server->log_prefix, msgs[i].msg_len, server->min_packet_size);
 				}
-			} else {
-				// Out of order sequence packet
-				fprintf(stderr, "[e131] out of order packet; current %d, old %d \n", current_seq_num, last_seq_num);
+				continue;
 			}
-		} else {
-			fprintf(stderr, "[e131] packet too small: %d < 126 \n", received_packet_size);
-		}
 
-		// Increment counter
-		packets_since_update ++;
-		if (g_runtime_state.frame_counter != frame_counter_at_last_update) {
-			packets_since_update = 0;
-			frame_counter_at_last_update = g_runtime_state.frame_counter;
+			dmx_assembler_add_packet(&server->assembler, &packet, &now_tv);
 		}
 
-		if (packets_since_update >= LEDSCAPE_NUM_STRIPS) {
-			// Force an update here
-			while (g_runtime_state.frame_counter == frame_counter_at_last_update)
-				usleep(1e3 /* 1ms */);
-		}
-	}
+		udp_rx_stats_add_batch(&server->rx_stats, received_packet_count, server->assembler.packets_coalesced - packets_coalesced_before);
 
-	pthread_exit(NULL);
+		// A short batch means the socket is empty
+	} while (received_packet_count == DMX_BATCH_SIZE);
+
+	gettimeofday(&now_tv, NULL);
+	dmx_assembler_check_deadline(&server->assembler, &now_tv);
 }
 
-////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////
-// UDP Server
-//
+/**
+* \returns how long until the pending frame's deadline in milliseconds, or -1 if no frame is pending.
+*/
+int dmx_server_timeout_ms(const dmx_server_t* server, const struct timeval* now_tv) {
+	return dmx_assembler_deadline_timeout_ms(&server->assembler, now_tv);
+}
 
-void* udp_server_thread(void* unused_data)
-{
-	unused_data=unused_data; // Suppress Warnings
+/**
+* Publish the pending frame if its deadline has passed.
+*/
+void dmx_server_check_deadline(dmx_server_t* server) {
+	struct timeval now_tv;
+	gettimeofday(&now_tv, NULL);
+	dmx_assembler_check_deadline(&server->assembler, &now_tv);
+}
 
-	// Disable if given port 0
-	if (g_server_config.udp_port == 0) {
-		fprintf(stderr, "[udp] Not starting UDP server; Port is zero.\n");
-		pthread_exit(NULL);
-		return NULL;
-	}
+/**
+* Serve the DMX socket from the calling thread. Never returns.
+*/
+void dmx_server_run(dmx_server_t* server) {
+	while (1) {
+		// Wait for packets, but no longer than the pending frame's deadline
+		struct timeval now_tv;
+		gettimeofday(&now_tv, NULL);
 
-	uint32_t required_packet_size = g_server_config.used_strip_count * g_server_config.leds_per_strip * 3 + sizeof(opc_cmd_t);
-	if (required_packet_size > 65507) {
-		fprintf(stderr,
-			"[udp] OPC command for %d LEDs cannot fit in UDP packet. Use --count or --strip-count to reduce the number of required LEDs, or disable UDP server with --udp-port 0\n",
-			g_server_config.used_strip_count * g_server_config.leds_per_strip
-		);
-		pthread_exit(NULL);
-		return NULL;
+		if (wait_for_readable(server->sock, dmx_server_timeout_ms(server, &now_tv))) {
+			dmx_server_drain(server);
+		} else {
+			dmx_server_check_deadline(server);
+		}
 	}
+}
 
-	fprintf(stderr, "[udp] Starting UDP server on port %d\n", g_server_config.udp_port);
-	uint8_t buf[65536];
-
+/**
+* Bind a UDP socket for one of the DMX servers, or return -1 after logging why not.
+*/
+int dmx_server_bind(const char* log_prefix, uint16_t port) {
 	const int sock = socket(AF_INET6, SOCK_DGRAM, 0);
 
 	if (sock < 0)
-		die("[udp] socket failed: %s\n", strerror(errno));
+		die("%s socket failed: %s\n", log_prefix, strerror(errno));
 
 	struct sockaddr_in6 addr;
 	bzero(&addr, sizeof(addr));
 	addr.sin6_family = AF_INET6;
 	addr.sin6_addr = in6addr_any;
-	addr.sin6_port = htons(g_server_config.udp_port);
+	addr.sin6_port = htons(port);
 
-	if (bind(sock, (const struct sockaddr*) &addr, sizeof(addr)) < 0)
-		die("[udp] bind port %d failed: %s\n", g_server_config.udp_port, strerror(errno));
+	if (bind(sock, (const struct sockaddr*) &addr, sizeof(addr)) < 0) {
+		fprintf(stderr, "%s bind port %d failed: %s\n", log_prefix, port, strerror(errno));
+		close(sock);
+		return -1;
+	}
 
-	while (1)
-	{
-		const ssize_t rc = recv(sock, buf, sizeof(buf), 0);
-		if (rc < 0) {
-			fprintf(stderr, "[udp] recv failed: %s\n", strerror(errno));
-			continue;
-		}
+	return sock;
+}
 
-		// Enough data for an OPC command header?
-		if (rc >= (int)sizeof(opc_cmd_t)) {
-			opc_cmd_t* cmd = (opc_cmd_t*) buf;
-			const size_t cmd_len = cmd->len_hi << 8 | cmd->len_lo;
+typedef struct {
+	dmx_server_t dmx;
+	uint16_t joined_sync_address;
+} e131_server_t;
 
-			uint8_t* opc_cmd_payload = ((uint8_t*)buf) + sizeof(opc_cmd_t);
+static dmx_packet_type_t e131_parse(const uint8_t* packet, uint32_t packet_size, dmx_packet_t* out_packet, void* context) {
+	e131_server_t* server = context;
+	const dmx_packet_type_t type = e131_parse_packet(packet, packet_size, out_packet);
 
-			// Enough data for the entire command?
-			if (rc >= (int)(sizeof(opc_cmd_t) + cmd_len)) {
-				if (cmd->command == 0) {
-					set_next_frame_data(opc_cmd_payload, cmd_len, TRUE);
-				} else if (cmd->command == 255) {
-					// System specific commands
-					const uint16_t system_id = opc_cmd_payload[0] << 8 | opc_cmd_payload[1];
-
-					if (system_id == OPC_SYSID_LEDSCAPE) {
-						const opc_ledscape_cmd_id_t ledscape_cmd_id = opc_cmd_payload[2];
-
-						if (ledscape_cmd_id == OPC_LEDSCAPE_CMD_GET_CONFIG) {
-							warn("[udp] WARN: Config request request received but not supported on UDP.\n");
-						} else {
-							warn("[udp] WARN: Received command for unsupported LEDscape Command: %d\n", (int)ledscape_cmd_id);
-						}
-					} else {
-						warn("[udp] WARN: Received command for unsupported system-id: %d\n", (int)system_id);
-					}
-				}
-			}
-		}
+	// Sync packets are multicast to the synchronization address' own universe
+	if (type == DMX_PACKET_DATA && out_packet->sync_address != 0 && out_packet->sync_address != server->joined_sync_address) {
+		char group_ip[INET_ADDRSTRLEN];
+		snprintf(group_ip, sizeof(group_ip), "239.255.%d.%d", out_packet->sync_address >> 8, out_packet->sync_address & 0xFF);
+		join_multicast_group_on_all_ifaces(server->dmx.sock, group_ip);
+		server->joined_sync_address = out_packet->sync_address;
 	}
 
-	pthread_exit(NULL);
+	return type;
 }
 
-////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////
-// TCP Server
-static void event_handler(struct ns_connection *conn, enum ns_event ev, void *event_param) {
-	struct iobuf *io = &conn->recv_iobuf; // IO buffer that holds received message
-	(void)(event_param);
-	switch (ev) {
-		case NS_RECV: {
-			// Enough data for an OPC command header?
-			if (io->len >= sizeof(opc_cmd_t)) {
-				opc_cmd_t* cmd = (opc_cmd_t*) io->buf;
-				const size_t cmd_len = cmd->len_hi << 8 | cmd->len_lo;
-
-				uint8_t* opc_cmd_payload = ((uint8_t*)io->buf) + sizeof(opc_cmd_t);
-
-				// Enough data for the entire command?
-				if (io->len >= sizeof(opc_cmd_t) + cmd_len) {
-					if (cmd->command == 0) {
-						set_next_frame_data(opc_cmd_payload, cmd_len, TRUE);
-					} else if (cmd->command == 255) {
-						// System specific commands
-						const uint16_t system_id = opc_cmd_payload[0] << 8 | opc_cmd_payload[1];
-
-						if (system_id == OPC_SYSID_LEDSCAPE) {
-							const opc_ledscape_cmd_id_t ledscape_cmd_id = opc_cmd_payload[2];
-
-							if (ledscape_cmd_id == OPC_LEDSCAPE_CMD_GET_CONFIG) {
-								warn("[tcp] Responding to config request\n");
-								ns_send(conn, g_server_config.json, strlen(g_server_config.json)+1);
-							} else {
-								warn("[tcp] WARN: Received command for unsupported LEDscape Command: %d\n", (int)ledscape_cmd_id);
-							}
-						} else {
-							warn("[tcp] WARN: Received command for unsupported system-id: %d\n", (int)system_id);
-						}
-					}
+/**
+* Bind the e131 socket and join the multicast groups.
+* \returns false, after logging why, if the server is disabled or can't bind
+*/
+bool e131_server_open(e131_server_t* server) {
+	// Disable if given port 0
+	if (g_server_config.e131_port == 0) {
+		fprintf(stderr, "[e131] Not starting e131 server; Port is zero.\n");
+		return false;
+	}
 
-					// Removed the processed command from the buffer
-					iobuf_remove(io, sizeof(opc_cmd_t) + cmd_len);
-				}
-			}
+	fprintf(stderr, "[e131] Starting UDP server on port %d\n", g_server_config.e131_port);
 
-			// Fallback to handle misformed data. Clear the io buffer if we have more
-			// than 100k waiting.
-			if (io->len > 1e5) {
-				iobuf_remove(io, io->len);
-			}
-		} break;
+	const int sock = dmx_server_bind("[e131]", g_server_config.e131_port);
+	if (sock < 0) {
+		return false;
+	}
 
-		case NS_ACCEPT: {
-			char buffer[INET6_ADDRSTRLEN];
-			ns_sock_to_str(conn->sock, buffer, sizeof(buffer), 1);
-			printf("[tcp] Connection from %s\n", buffer);
+	// Bind to multicast
+	if (join_multicast_group_on_all_ifaces(sock, "239.255.0.0") < 0) {
+		fprintf(stderr, "[e131] failed to bind to multicast addresses\n");
+	}
+
+	dmx_server_init(&server->dmx, sock, "[e131]", E131_DATA_HEADER_SIZE, e131_parse, server);
+	server->joined_sync_address = 0;
+	return true;
+}
+
+void* e131_server_thread(void* unused_data)
+{
+	unused_data=unused_data; // Suppress Warnings
+
+	e131_server_t server;
+	if (!e131_server_open(&server)) {
+		pthread_exit(NULL);
+		return NULL;
+	}
+
+	dmx_server_run(&server.dmx);
+
+	pthread_exit(NULL);
+}
+
+////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+// Art-Net Server
+//
+
+typedef struct {
+	dmx_server_t dmx;
+	bool sync_active; // once a controller sends ArtSync, its ArtDmx data waits for the next one
+} artnet_server_t;
+
+static dmx_packet_type_t artnet_parse(const uint8_t* packet, uint32_t packet_size, dmx_packet_t* out_packet, void* context) {
+	artnet_server_t* server = context;
+	const dmx_packet_type_t type = artnet_parse_packet(packet, packet_size, server->sync_active, out_packet);
+
+	if (type == DMX_PACKET_SYNC) {
+		server->sync_active = true;
+	}
+
+	return type;
+}
+
+/**
+* Bind the Art-Net socket.
+* \returns false, after logging why, if the server is disabled or can't bind
+*/
+bool artnet_server_open(artnet_server_t* server) {
+	// Disable if given port 0
+	if (g_server_config.artnet_port == 0) {
+		fprintf(stderr, "[artnet] Not starting Art-Net server; Port is zero.\n");
+		return false;
+	}
+
+	fprintf(stderr, "[artnet] Starting UDP server on port %d\n", g_server_config.artnet_port);
+
+	const int sock = dmx_server_bind("[artnet]", g_server_config.artnet_port);
+	if (sock < 0) {
+		return false;
+	}
+
+	// Art-Net has plenty of short non-DMX packets (ArtPoll and friends), so small packets aren't worth a warning
+	dmx_server_init(&server->dmx, sock, "[artnet]", 0, artnet_parse, server);
+	server->sync_active = false;
+	return true;
+}
+
+void* artnet_server_thread(void* unused_data)
+{
+	unused_data=unused_data; // Suppress Warnings
+
+	artnet_server_t server;
+	if (!artnet_server_open(&server)) {
+		pthread_exit(NULL);
+		return NULL;
+	}
+
+	dmx_server_run(&server.dmx);
+
+	pthread_exit(NULL);
+}
+
+////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+// OPC Commands
+//
+
+/**
+* Sends a response to an OPC client; context identifies the client.
+*/
+typedef void (*opc_reply_fn)(const void* data, size_t data_size, void* context);
+
+/**
+* Apply a Fadecandy global color correction, e.g. { "gamma": 2.2, "whitepoint": [0.9, 1, 1] }, to the running server.
+* The new lookup tables take effect at the start of a frame once they are built; rendering carries on meanwhile.
+*/
+void opc_set_color_correction(const char* log_prefix, const char* json, size_t json_size) {
+	struct json_token* json_tokens = parse_json2(json, (int) json_size);
+	const struct json_token* token;
+	char token_value[64];
+	char path[32];
+
+	if (json_tokens == NULL) {
+		warn("%s WARN: Ignoring color correction with invalid JSON\n", log_prefix);
+		return;
+	}
+
+	pthread_mutex_lock(&g_server_config.mutex);
+
+	float lum_power = g_server_config.lum_power;
+	float white_points[] = {
+		g_server_config.white_point.red,
+		g_server_config.white_point.green,
+		g_server_config.white_point.blue
+	};
+
+	if ((token = find_json_token(json_tokens, "gamma"))) {
+		strlcpy(token_value, token->ptr, min(sizeof(token_value), token->len + 1));
+		lum_power = (float) atof(token_value);
+	}
+
+	for (unsigned c=0; c<3; c++) {
+		snprintf(path, sizeof(path), "whitepoint[%u]", c);
+		if ((token = find_json_token(json_tokens, path))) {
+			strlcpy(token_value, token->ptr, min(sizeof(token_value), token->len + 1));
+			white_points[c] = (float) atof(token_value);
+		}
+	}
+
+	// The same limits as validate_server_config()
+	bool valid = lum_power >= 0 && lum_power <= 10;
+	for (unsigned c=0; c<3; c++) {
+		valid = valid && white_points[c] >= 0 && white_points[c] <= 1;
+	}
+
+	if (valid) {
+		g_server_config.lum_power = lum_power;
+		g_server_config.white_point.red = white_points[0];
+		g_server_config.white_point.green = white_points[1];
+		g_server_config.white_point.blue = white_points[2];
+	}
+
+	pthread_mutex_unlock(&g_server_config.mutex);
+	free(json_tokens);
+
+	if (valid) {
+		printf("%s Color correction: gamma %.3f, white point %.3f %.3f %.3f\n",
+			log_prefix,
+			(double) lum_power,
+			(double) white_points[0],
+			(double) white_points[1],
+			(double) white_points[2]
+		);
+		build_lookup_tables_async();
+	} else {
+		warn("%s WARN: Ignoring out of range color correction\n", log_prefix);
+	}
+}
+
+/**
+* Handle a system specific (255) OPC command. The reply function is NULL for transports that can't respond.
+*/
+void opc_handle_system_command(
+	const char* log_prefix,
+	const uint8_t* opc_cmd_payload,
+	size_t cmd_len,
+	opc_reply_fn reply,
+	void* reply_context
+) {
+	uint8_t payload[3] = {0};
+	memcpy(payload, opc_cmd_payload, min(cmd_len, sizeof(payload)));
+
+	const uint16_t system_id = payload[0] << 8 | payload[1];
+
+	if (system_id == OPC_SYSID_LEDSCAPE) {
+		const opc_ledscape_cmd_id_t ledscape_cmd_id = payload[2];
+
+		if (ledscape_cmd_id == OPC_LEDSCAPE_CMD_GET_CONFIG) {
+			if (reply != NULL) {
+				warn("%s Responding to config request\n", log_prefix);
+				reply(g_server_config.json, strlen(g_server_config.json)+1, reply_context);
+			} else {
+				warn("%s WARN: Config request request received but not supported on this transport.\n", log_prefix);
+			}
+		} else if (ledscape_cmd_id == OPC_LEDSCAPE_CMD_GET_STATS) {
+			if (reply != NULL) {
+				const frame_pacing_stats_t stats = frame_pacing_stats(&g_frame_pacing);
+				char stats_json[256];
+				frame_pacing_stats_to_json(&stats, stats_json, sizeof(stats_json));
+				reply(stats_json, strlen(stats_json)+1, reply_context);
+			} else {
+				warn("%s WARN: Stats request received but not supported on this transport.\n", log_prefix);
+			}
+		} else {
+			warn("%s WARN: Received command for unsupported LEDscape Command: %d\n", log_prefix, (int)ledscape_cmd_id);
+		}
+	} else if (system_id == OPC_SYSID_FADECANDY && cmd_len >= sizeof(payload)) {
+		const opc_fadecandy_cmd_id_t fadecandy_cmd_id = payload[2];
+
+		if (fadecandy_cmd_id == OPC_FADECANDY_CMD_SET_COLOR_CORRECTION) {
+			opc_set_color_correction(
+				log_prefix,
+				(const char*) opc_cmd_payload + sizeof(payload),
+				cmd_len - sizeof(payload)
+			);
+		} else {
+			warn("%s WARN: Received command for unsupported Fadecandy Command: %d\n", log_prefix, (int)fadecandy_cmd_id);
+		}
+	} else {
+		warn("%s WARN: Received command for unsupported system-id: %d\n", log_prefix, (int)system_id);
+	}
+}
+
+/**
+* The newest set-pixels data for each OPC channel among a run of commands. Channel 0 addresses the whole frame and
+* channel N strip N-1, so several clients can each drive their own strips.
+*/
+typedef struct {
+	const uint8_t* data[LEDSCAPE_NUM_STRIPS + 1];
+	uint32_t data_size[LEDSCAPE_NUM_STRIPS + 1];
+	bool is_16bit[LEDSCAPE_NUM_STRIPS + 1]; // sent with OPC_CMD_SET_PIXELS_16BIT
+	uint32_t superseded_count; // updates replaced by a newer one before being applied
+	bool pending;
+} opc_pixel_updates_t;
+
+void opc_pixel_updates_add(
+	opc_pixel_updates_t* updates,
+	const char* log_prefix,
+	uint8_t channel,
+	const uint8_t* data,
+	uint32_t data_size,
+	bool is_16bit
+) {
+	if (channel > LEDSCAPE_NUM_STRIPS) {
+		warn_once("%s WARN: Ignoring pixels for OPC channel %d; channels 1-%d address single strips\n", log_prefix, channel, LEDSCAPE_NUM_STRIPS);
+		return;
+	}
+
+	// Whole-frame data replaces any strip data before it
+	const uint8_t last_replaced_channel = channel == 0 ? LEDSCAPE_NUM_STRIPS : channel;
+	for (uint8_t replaced_channel=channel; replaced_channel<=last_replaced_channel; replaced_channel++) {
+		if (updates->data[replaced_channel] != NULL) {
+			updates->data[replaced_channel] = NULL;
+			updates->superseded_count++;
+		}
+	}
+
+	updates->data[channel] = data;
+	updates->data_size[channel] = data_size;
+	updates->is_16bit[channel] = is_16bit;
+	updates->pending = true;
+}
+
+/**
+* Write the updates into the slot returned by frame_exchange_begin_write() and publish it, or cancel if there are none.
+* Whole-frame data that was received straight into the slot isn't copied again, only converted in place if it isn't
+* at the slot's depth.
+*/
+void commit_opc_pixel_updates(void* next_frame_data, const opc_pixel_updates_t* updates) {
+	const strip_layout_t* layout = &g_frame_exchange.layout;
+	const bool frame_is_16bit = g_frame_exchange.is_16bit;
+	const uint32_t frame_data_size = g_frame_exchange.frame_data_size;
+	const uint32_t frame_pixel_size = render_input_pixel_size(frame_is_16bit);
+	uint8_t* frame_data = next_frame_data;
+	uint32_t bytes_copied = 0;
+
+	// Nowhere to put the data until the server is set up
+	if (!updates->pending || frame_data_size == 0) {
+		frame_exchange_cancel(&g_frame_exchange);
+		return;
+	}
+
+	if (updates->data[0] != NULL) {
+		// Whole-frame data turns off any pixels it doesn't set
+		const bool data_is_16bit = updates->is_16bit[0];
+		const uint32_t channel_count = min(updates->data_size[0] / (data_is_16bit ? 2 : 1), g_frame_exchange.pixel_count * 3);
+		const uint32_t data_size = copy_input_channels(frame_data, frame_is_16bit, updates->data[0], data_is_16bit, channel_count);
+
+		if (updates->data[0] != frame_data || data_is_16bit || frame_is_16bit) {
+			bytes_copied += data_size;
+		}
+
+		memset(frame_data + data_size, 0, frame_data_size - data_size);
+	} else {
+		// Strip data leaves the other strips as they were
+		frame_exchange_load_published(&g_frame_exchange);
+	}
+
+	for (uint32_t channel=1; channel<=LEDSCAPE_NUM_STRIPS; channel++) {
+		if (updates->data[channel] == NULL) continue;
+
+		const uint32_t strip = channel - 1;
+		const bool data_is_16bit = updates->is_16bit[channel];
+		const uint32_t channel_count = min(updates->data_size[channel] / (data_is_16bit ? 2 : 1), layout->lengths[strip] * 3);
+		bytes_copied += copy_input_channels(
+			frame_data + layout->offsets[strip] * frame_pixel_size,
+			frame_is_16bit,
+			updates->data[channel],
+			data_is_16bit,
+			channel_count
+		);
+	}
+
+	__sync_fetch_and_add(&g_input_stats.frames, 1);
+	__sync_fetch_and_add(&g_input_stats.bytes_copied, bytes_copied);
+
+	frame_exchange_commit(&g_frame_exchange, TRUE);
+}
+
+/**
+* Handle every complete OPC command at the start of a TCP stream buffer. Set-pixels commands are merged into a single
+* frame, in which only the newest data for each channel is applied; the rest would be replaced before it was ever
+* rendered.
+* \returns the number of bytes consumed
+*/
+size_t opc_process_stream(
+	const char* log_prefix,
+	const uint8_t* buffer,
+	size_t buffer_len,
+	opc_reply_fn reply,
+	void* reply_context
+) {
+	opc_pixel_updates_t updates = { .pending = false };
+	size_t offset = 0;
+
+	// Enough data for an OPC command header?
+	while (buffer_len - offset >= sizeof(opc_cmd_t)) {
+		const opc_cmd_t* cmd = (const opc_cmd_t*) (buffer + offset);
+		const size_t cmd_len = cmd->len_hi << 8 | cmd->len_lo;
+		const uint8_t* opc_cmd_payload = buffer + offset + sizeof(opc_cmd_t);
+
+		// Enough data for the entire command?
+		if (buffer_len - offset < sizeof(opc_cmd_t) + cmd_len) {
+			break;
+		}
+
+		if (cmd->command == OPC_CMD_SET_PIXELS || cmd->command == OPC_CMD_SET_PIXELS_16BIT) {
+			opc_pixel_updates_add(&updates, log_prefix, cmd->channel, opc_cmd_payload, cmd_len, cmd->command == OPC_CMD_SET_PIXELS_16BIT);
+		} else if (cmd->command == OPC_CMD_SYSTEM) {
+			opc_handle_system_command(log_prefix, opc_cmd_payload, cmd_len, reply, reply_context);
+		}
+
+		offset += sizeof(opc_cmd_t) + cmd_len;
+	}
+
+	if (updates.pending) {
+		commit_opc_pixel_updates(frame_exchange_begin_write(&g_frame_exchange), &updates);
+	}
+
+	return offset;
+}
+
+////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+// UDP Server
+//
+
+typedef struct {
+	int sock;
+	uint8_t* packet_buffers;
+	udp_rx_stats_t rx_stats;
+} opc_udp_server_t;
+
+// One maximum-size datagram per message in a batch
+#define OPC_UDP_PACKET_BUFFER_SIZE 65536
+
+/**
+* Bind the OPC UDP socket.
+* \returns false, after logging why, if the server is disabled or frames can't fit in a datagram
+*/
+bool opc_udp_server_open(opc_udp_server_t* server) {
+	// Disable if given port 0
+	if (g_server_config.udp_port == 0) {
+		fprintf(stderr, "[udp] Not starting UDP server; Port is zero.\n");
+		return false;
+	}
+
+	// Whole frames only need to cover the strips in use, packed back to back
+	strip_layout_t layout;
+	server_config_strip_layout(&g_server_config, &layout);
+
+	const uint32_t last_used_strip = min(g_server_config.used_strip_count, LEDSCAPE_NUM_STRIPS) - 1;
+	const uint32_t used_pixel_count = layout.offsets[last_used_strip] + layout.lengths[last_used_strip];
+
+	uint32_t required_packet_size = used_pixel_count * 3 + sizeof(opc_cmd_t);
+	if (required_packet_size > 65507) {
+		fprintf(stderr,
+			"[udp] OPC command for %d LEDs cannot fit in UDP packet. Use --count, --strip-lengths or --strip-count to reduce the number of required LEDs, or disable UDP server with --udp-port 0\n",
+			used_pixel_count
+		);
+		return false;
+	}
+
+	fprintf(stderr, "[udp] Starting UDP server on port %d\n", g_server_config.udp_port);
+
+	server->packet_buffers = malloc(OPC_UDP_BATCH_SIZE * OPC_UDP_PACKET_BUFFER_SIZE);
+	if (server->packet_buffers == NULL)
+		die("[udp] malloc failed: %s\n", strerror(errno));
+
+	server->rx_stats = (udp_rx_stats_t) { .log_prefix = "[udp]" };
+
+	server->sock = socket(AF_INET6, SOCK_DGRAM, 0);
+
+	if (server->sock < 0)
+		die("[udp] socket failed: %s\n", strerror(errno));
+
+	struct sockaddr_in6 addr;
+	bzero(&addr, sizeof(addr));
+	addr.sin6_family = AF_INET6;
+	addr.sin6_addr = in6addr_any;
+	addr.sin6_port = htons(g_server_config.udp_port);
+
+	if (bind(server->sock, (const struct sockaddr*) &addr, sizeof(addr)) < 0)
+		die("[udp] bind port %d failed: %s\n", g_server_config.udp_port, strerror(errno));
+
+	return true;
+}
+
+/**
+* Receive and apply everything queued on the socket, one batch at a time, until it is empty. The frame slot is only
+* held while a batch is being received, so an idle UDP server never locks out the other producers.
+*/
+void opc_udp_server_drain(opc_udp_server_t* server) {
+	opc_cmd_t headers[OPC_UDP_BATCH_SIZE];
+	struct iovec iovs[OPC_UDP_BATCH_SIZE][3];
+	struct mmsghdr msgs[OPC_UDP_BATCH_SIZE];
+
+	int received_packet_count;
+
+	do {
+		void* next_frame_data = frame_exchange_begin_write(&g_frame_exchange);
+		const uint32_t frame_data_size = g_frame_exchange.frame_data_size;
+
+		// The first message's payload goes straight into the frame slot, its buffer only takes whatever doesn't fit
+		// there.
+		for (int i=0; i<OPC_UDP_BATCH_SIZE; i++) {
+			struct iovec* iov = iovs[i];
+			uint8_t* packet_buffer = server->packet_buffers + i * OPC_UDP_PACKET_BUFFER_SIZE;
+
+			iov[0] = (struct iovec) { .iov_base = &headers[i], .iov_len = sizeof(opc_cmd_t) };
+			if (i == 0) {
+				iov[1] = (struct iovec) { .iov_base = next_frame_data, .iov_len = frame_data_size };
+				iov[2] = (struct iovec) { .iov_base = packet_buffer, .iov_len = OPC_UDP_PACKET_BUFFER_SIZE };
+			} else {
+				iov[1] = (struct iovec) { .iov_base = packet_buffer, .iov_len = OPC_UDP_PACKET_BUFFER_SIZE };
+			}
+
+			bzero(&msgs[i], sizeof(msgs[i]));
+			msgs[i].msg_hdr.msg_iov = iov;
+			msgs[i].msg_hdr.msg_iovlen = i == 0 ? 3 : 2;
+		}
+
+		received_packet_count = recvmmsg(server->sock, msgs, OPC_UDP_BATCH_SIZE, MSG_DONTWAIT, NULL);
+		if (received_packet_count <= 0) {
+			frame_exchange_cancel(&g_frame_exchange);
+
+			if (received_packet_count < 0 && errno != EAGAIN && errno != EWOULDBLOCK) {
+				fprintf(stderr, "[udp] recvmmsg failed: %s\n", strerror(errno));
+			}
+			break;
+		}
+
+		// The set-pixels commands in the batch are merged into one frame, keeping the newest data for each channel
+		opc_pixel_updates_t updates = { .pending = false };
+
+		for (int i=0; i<received_packet_count; i++) {
+			// Enough data for an OPC command header?
+			if (msgs[i].msg_len < sizeof(opc_cmd_t)) continue;
+
+			const opc_cmd_t* cmd = &headers[i];
+			const size_t cmd_len = cmd->len_hi << 8 | cmd->len_lo;
+
+			// Enough data for the entire command?
+			if (msgs[i].msg_len < sizeof(opc_cmd_t) + cmd_len) continue;
+
+			if (cmd->command == OPC_CMD_SET_PIXELS || cmd->command == OPC_CMD_SET_PIXELS_16BIT) {
+				const uint8_t* data = iovs[i][1].iov_base;
+
+				if (i == 0 && (cmd->channel != 0 || cmd_len > frame_data_size)) {
+					// Strip data can't stay at the start of the frame slot, which is about to be overwritten with the
+					// published frame, and data longer than the slot (16-bit pixels for 8-bit frames) has run on into
+					// the message's own buffer. Either way, put it back together in the message's own buffer.
+					uint8_t* packet_buffer = iovs[0][2].iov_base;
+					const uint32_t slot_data_size = min(cmd_len, frame_data_size);
+					memmove(packet_buffer + slot_data_size, packet_buffer, cmd_len - slot_data_size);
+					memcpy(packet_buffer, data, slot_data_size);
+					data = packet_buffer;
+				}
+
+				opc_pixel_updates_add(&updates, "[udp]", cmd->channel, data, cmd_len, cmd->command == OPC_CMD_SET_PIXELS_16BIT);
+			} else if (cmd->command == OPC_CMD_SYSTEM) {
+				// System specific commands; the first message's payload may be split between the frame slot and its
+				// packet buffer
+				uint8_t opc_cmd_payload[OPC_SYSTEM_PAYLOAD_MAX_LENGTH];
+				iov_gather(opc_cmd_payload, sizeof(opc_cmd_payload), &iovs[i][1], msgs[i].msg_hdr.msg_iovlen - 1, 0);
+
+				opc_handle_system_command("[udp]", opc_cmd_payload, min(cmd_len, sizeof(opc_cmd_payload)), NULL, NULL);
+			}
+		}
+
+		// Commit at most one frame per batch. Whole-frame data in the first message is already in place; anything else
+		// costs one copy out of its packet buffer.
+		commit_opc_pixel_updates(next_frame_data, &updates);
+
+		udp_rx_stats_add_batch(&server->rx_stats, received_packet_count, updates.superseded_count);
+
+		// A short batch means the socket is empty
+	} while (received_packet_count == OPC_UDP_BATCH_SIZE);
+}
+
+void* udp_server_thread(void* unused_data)
+{
+	unused_data=unused_data; // Suppress Warnings
+
+	opc_udp_server_t server;
+	if (!opc_udp_server_open(&server)) {
+		pthread_exit(NULL);
+		return NULL;
+	}
+
+	while (1)
+	{
+		wait_for_readable(server.sock, -1);
+		opc_udp_server_drain(&server);
+	}
+
+	pthread_exit(NULL);
+}
+
+////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+// TCP Server
+static void ns_connection_reply(const void* data, size_t data_size, void* context) {
+	ns_send((struct ns_connection*) context, data, (int) data_size);
+}
+
+static void event_handler(struct ns_connection *conn, enum ns_event ev, void *event_param) {
+	struct iobuf *io = &conn->recv_iobuf; // IO buffer that holds received message
+	(void)(event_param);
+	switch (ev) {
+		case NS_RECV: {
+			// Removed the processed commands from the buffer
+			iobuf_remove(io, opc_process_stream("[tcp]", (const uint8_t*) io->buf, io->len, ns_connection_reply, conn));
+
+			// Fallback to handle misformed data. Clear the io buffer if we have more
+			// than 100k waiting.
+			if (io->len > 1e5) {
+				iobuf_remove(io, io->len);
+			}
+		} break;
+
+		case NS_ACCEPT: {
+			char buffer[INET6_ADDRSTRLEN];
+			ns_sock_to_str(conn->sock, buffer, sizeof(buffer), 1);
+			printf("[tcp] Connection from %s\n", buffer);
 		} break;
 
 		default:
@@ -2119,5 +3408,297 @@ void* tcp_server_thread(void* unused_data)
 	pthread_exit(NULL);
 }
 
+////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+// Network Reactor
+//
+// Serves every protocol from one thread: all sockets are registered edge-triggered with a single epoll instance and
+// each readable socket is drained until it is empty, so a burst costs one wakeup rather than one per packet.
+//
+
+#define REACTOR_MAX_EVENTS 16
+
+// Big enough for the largest OPC command (4 + 65535 bytes), so a full buffer always starts with a complete command
+#define REACTOR_TCP_BUFFER_SIZE (128*1024)
+
+typedef enum {
+	REACTOR_SOURCE_OPC_UDP,
+	REACTOR_SOURCE_DMX,
+	REACTOR_SOURCE_TCP_LISTENER,
+	REACTOR_SOURCE_TCP_CONNECTION
+} reactor_source_type_t;
+
+/**
+* What an epoll event refers to: a socket and the handler that owns it.
+*/
+typedef struct {
+	reactor_source_type_t type;
+	int sock;
+	void* handler;
+} reactor_source_t;
+
+typedef struct {
+	reactor_source_t source; // first, so events for the connection can be cast back to it
+	uint8_t* buffer;
+	size_t buffer_len;
+} reactor_tcp_connection_t;
+
+static void reactor_add_source(
+	const int epoll_fd,
+	reactor_source_t* source,
+	reactor_source_type_t type,
+	const int sock,
+	void* handler
+) {
+	source->type = type;
+	source->sock = sock;
+	source->handler = handler;
+
+	struct epoll_event event = {
+		.events = EPOLLIN | EPOLLET,
+		.data.ptr = source
+	};
+
+	if (epoll_ctl(epoll_fd, EPOLL_CTL_ADD, sock, &event) < 0)
+		die("[reactor] epoll_ctl failed: %s\n", strerror(errno));
+}
+
+/**
+* Open the non-blocking OPC TCP listening socket, or exit if the port can't be bound.
+* \returns the socket, or -1 if the TCP server is disabled
+*/
+static int reactor_tcp_listen() {
+	// Disable if given port 0
+	if (g_server_config.tcp_port == 0) {
+		fprintf(stderr, "[tcp] Not starting TCP server; Port is zero.\n");
+		return -1;
+	}
+
+	const int sock = socket(AF_INET6, SOCK_STREAM | SOCK_NONBLOCK | SOCK_CLOEXEC, 0);
+	if (sock < 0)
+		die("[tcp] socket failed: %s\n", strerror(errno));
+
+	const int on = 1;
+	setsockopt(sock, SOL_SOCKET, SO_REUSEADDR, &on, sizeof(on));
+
+	struct sockaddr_in6 addr;
+	bzero(&addr, sizeof(addr));
+	addr.sin6_family = AF_INET6;
+	addr.sin6_addr = in6addr_any;
+	addr.sin6_port = htons(g_server_config.tcp_port);
+
+	if (bind(sock, (const struct sockaddr*) &addr, sizeof(addr)) < 0 || listen(sock, SOMAXCONN) < 0) {
+		printf("[tcp] Failed to bind to port %d: %s\n", g_server_config.tcp_port, strerror(errno));
+		exit(-1);
+	}
+
+	printf("[tcp] Starting TCP server on %d\n", g_server_config.tcp_port);
+	return sock;
+}
+
+static void reactor_tcp_accept(const int epoll_fd, const int listen_sock) {
+	while (1) {
+		const int sock = accept4(listen_sock, NULL, NULL, SOCK_NONBLOCK | SOCK_CLOEXEC);
+		if (sock < 0) {
+			if (errno == EINTR || errno == ECONNABORTED) continue;
+			if (errno != EAGAIN && errno != EWOULDBLOCK) {
+				fprintf(stderr, "[tcp] accept failed: %s\n", strerror(errno));
+			}
+			return;
+		}
+
+		reactor_tcp_connection_t* connection = calloc(1, sizeof(reactor_tcp_connection_t));
+		if (connection == NULL || (connection->buffer = malloc(REACTOR_TCP_BUFFER_SIZE)) == NULL)
+			die("[tcp] malloc failed: %s\n", strerror(errno));
+
+		reactor_add_source(epoll_fd, &connection->source, REACTOR_SOURCE_TCP_CONNECTION, sock, connection);
+
+		char buffer[INET6_ADDRSTRLEN];
+		ns_sock_to_str(sock, buffer, sizeof(buffer), 1);
+		printf("[tcp] Connection from %s\n", buffer);
+	}
+}
+
+static void reactor_tcp_close(reactor_tcp_connection_t* connection) {
+	// Closing the socket also removes it from the epoll set
+	close(connection->source.sock);
+	free(connection->buffer);
+	free(connection);
+}
+
+static void reactor_tcp_reply(const void* data, size_t data_size, void* context) {
+	reactor_tcp_connection_t* connection = context;
+
+	// Replies are small and rare, so they go straight into the socket buffer rather than being queued
+	if (send(connection->source.sock, data, data_size, MSG_NOSIGNAL) != (ssize_t) data_size) {
+		fprintf(stderr, "[tcp] Failed to send reply: %s\n", strerror(errno));
+	}
+}
+
+/**
+* Read everything the client has sent and handle the complete commands.
+* \returns false once the connection is closed
+*/
+static bool reactor_tcp_read(reactor_tcp_connection_t* connection) {
+	bool open = true;
+
+	while (1) {
+		const ssize_t received = recv(
+			connection->source.sock,
+			connection->buffer + connection->buffer_len,
+			REACTOR_TCP_BUFFER_SIZE - connection->buffer_len,
+			0
+		);
+
+		if (received > 0) {
+			connection->buffer_len += received;
+
+			// Keep reading while there is room, so a backlog of frames collapses into the newest
+			if (connection->buffer_len < REACTOR_TCP_BUFFER_SIZE) continue;
+		} else if (received == 0) {
+			open = false;
+		} else if (errno == EINTR) {
+			continue;
+		} else if (errno != EAGAIN && errno != EWOULDBLOCK) {
+			fprintf(stderr, "[tcp] recv failed: %s\n", strerror(errno));
+			open = false;
+		}
+
+		const size_t consumed = opc_process_stream(
+			"[tcp]",
+			connection->buffer,
+			connection->buffer_len,
+			reactor_tcp_reply,
+			connection
+		);
+
+		memmove(connection->buffer, connection->buffer + consumed, connection->buffer_len - consumed);
+		connection->buffer_len -= consumed;
+
+		if (received <= 0) return open;
+	}
+}
+
+void* network_reactor_thread(void* unused_data)
+{
+	unused_data=unused_data; // Suppress Warnings
+
+	const int epoll_fd = epoll_create1(EPOLL_CLOEXEC);
+	if (epoll_fd < 0)
+		die("[reactor] epoll_create1 failed: %s\n", strerror(errno));
+
+	opc_udp_server_t udp_server;
+	e131_server_t e131_server;
+	artnet_server_t artnet_server;
+
+	reactor_source_t sources[4];
+	uint32_t source_count = 0;
+
+	dmx_server_t* dmx_servers[2];
+	uint32_t dmx_server_count = 0;
+
+	const bool udp_server_open = opc_udp_server_open(&udp_server);
+	if (udp_server_open) {
+		reactor_add_source(epoll_fd, &sources[source_count++], REACTOR_SOURCE_OPC_UDP, udp_server.sock, &udp_server);
+	}
+
+	if (e131_server_open(&e131_server)) {
+		dmx_servers[dmx_server_count++] = &e131_server.dmx;
+		reactor_add_source(epoll_fd, &sources[source_count++], REACTOR_SOURCE_DMX, e131_server.dmx.sock, &e131_server.dmx);
+	}
+
+	if (artnet_server_open(&artnet_server)) {
+		dmx_servers[dmx_server_count++] = &artnet_server.dmx;
+		reactor_add_source(epoll_fd, &sources[source_count++], REACTOR_SOURCE_DMX, artnet_server.dmx.sock, &artnet_server.dmx);
+	}
+
+	const int tcp_listen_sock = reactor_tcp_listen();
+	if (tcp_listen_sock >= 0) {
+		reactor_add_source(epoll_fd, &sources[source_count++], REACTOR_SOURCE_TCP_LISTENER, tcp_listen_sock, NULL);
+	}
+
+	// Anything queued before registration raised no edge
+	if (udp_server_open) {
+		opc_udp_server_drain(&udp_server);
+	}
+	for (uint32_t i=0; i<dmx_server_count; i++) {
+		dmx_server_drain(dmx_servers[i]);
+	}
+
+	printf("[reactor] Serving %u sockets from one thread\n", source_count);
+
+	struct epoll_event events[REACTOR_MAX_EVENTS];
+	uint64_t last_report = 0;
+	uint32_t wakeups = 0;
+	uint32_t event_total = 0;
+
+	while (1)
+	{
+		// Sleep until a socket becomes readable or the earliest pending DMX frame is due
+		struct timeval now_tv;
+		gettimeofday(&now_tv, NULL);
+
+		int timeout_ms = -1;
+		for (uint32_t i=0; i<dmx_server_count; i++) {
+			const int server_timeout_ms = dmx_server_timeout_ms(dmx_servers[i], &now_tv);
+			if (server_timeout_ms >= 0 && (timeout_ms < 0 || server_timeout_ms < timeout_ms)) {
+				timeout_ms = server_timeout_ms;
+			}
+		}
+
+		const int event_count = epoll_wait(epoll_fd, events, REACTOR_MAX_EVENTS, timeout_ms);
+		if (event_count < 0 && errno != EINTR) {
+			fprintf(stderr, "[reactor] epoll_wait failed: %s\n", strerror(errno));
+			usleep(1e3);
+		}
+
+		for (int i=0; i<event_count; i++) {
+			reactor_source_t* source = events[i].data.ptr;
+
+			switch (source->type) {
+				case REACTOR_SOURCE_OPC_UDP:
+					opc_udp_server_drain(source->handler);
+					break;
+
+				case REACTOR_SOURCE_DMX:
+					dmx_server_drain(source->handler);
+					break;
+
+				case REACTOR_SOURCE_TCP_LISTENER:
+					reactor_tcp_accept(epoll_fd, source->sock);
+					break;
+
+				case REACTOR_SOURCE_TCP_CONNECTION:
+					if (!reactor_tcp_read(source->handler)) {
+						reactor_tcp_close(source->handler);
+					}
+					break;
+			}
+		}
+
+		for (uint32_t i=0; i<dmx_server_count; i++) {
+			dmx_server_check_deadline(dmx_servers[i]);
+		}
+
+		if (event_count > 0) {
+			wakeups++;
+			event_total += event_count;
+		}
+
+		gettimeofday(&now_tv, NULL);
+		if (now_tv.tv_sec - last_report >= 10) {
+			last_report = now_tv.tv_sec;
+
+			if (wakeups > 0) {
+				printf("[reactor] reactor_info={wakeups: %u, events_per_wakeup: %.2f}\n", wakeups, event_total * 1.0 / wakeups);
+			}
+
+			wakeups = 0;
+			event_total = 0;
+		}
+	}
+
+	pthread_exit(NULL);
+}
+
 #pragma clang diagnostic pop
 #pragma clang diagnostic pop
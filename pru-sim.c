@@ -0,0 +1,993 @@
+/** \file
+*  Cycle-approximate interpreter for the PRU programs in pru/bin.
+*
+*  Runs one program assembled by pasm against a model of a single PRU: its data RAM with the ws281x command block at
+*  the start of it, the control registers' cycle counter, a frame of pixels in DDR and the set/clear registers of the
+*  four GPIO banks. The simulator plays the part of ledscape_draw/ledscape_wait for the requested number of frames,
+*  then reports the timing each driven GPIO pin achieved and optionally writes the pin waveforms as a VCD trace. This
+*  lets the timing of every template/mapping be measured without a board and a scope. Programs built from a -packed
+*  template are given the same pixels packed 3 bytes per strip, and those built from a -bitplane template the same
+*  pixels split into bit planes for the pins they report, and the bytes read from DDR are counted so that the frame
+*  formats can be compared.
+*
+*  Only the instructions the templates use are implemented; anything else stops the simulation with an error. Every
+*  instruction takes one 5ns cycle, plus an approximate latency for each memory access.
+*/
+#define _GNU_SOURCE
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdbool.h>
+#include <stdint.h>
+#include <inttypes.h>
+#include <string.h>
+#include <errno.h>
+#include <getopt.h>
+#include "util.h"
+
+////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+// DEFINES, CONSTANTS and UTILS
+
+#define PRU_NS_PER_CYCLE 5
+
+#define PRU_IRAM_SIZE 0x2000
+#define PRU_DRAM_SIZE 0x2000
+#define PRU_SHARED_RAM_SIZE 0x3000
+
+// PRU-local addresses
+#define PRU_DRAM_ADDR 0x00000
+#define PRU_OTHER_DRAM_ADDR 0x02000
+#define PRU_SHARED_RAM_ADDR 0x10000
+#define PRU0_CONTROL_ADDR 0x22000
+#define PRU1_CONTROL_ADDR 0x24000
+#define PRU_CONTROL_SIZE 0x400
+#define PRU_CFG_ADDR 0x26000
+#define PRU_CFG_SIZE 0x2000
+
+// Control register word offsets
+#define PRU_CONTROL_CONTROL 0
+#define PRU_CONTROL_CYCLE 3
+#define PRU_CONTROL_CTBIR0 8
+#define PRU_CONTROL_CTPPR0 10
+#define PRU_CONTROL_CTPPR1 11
+#define PRU_CONTROL_COUNTER_ENABLE (1 << 3)
+
+#define GPIO_BANK_COUNT 4
+#define GPIO_BANK_SIZE 0x1000
+#define GPIO_DATAOUT 0x13C
+#define GPIO_CLEARDATAOUT 0x190
+#define GPIO_SETDATAOUT 0x194
+
+static const uint32_t GPIO_BANK_ADDRS[GPIO_BANK_COUNT] = { 0x44E07000, 0x4804C000, 0x481AC000, 0x481AE000 };
+
+// Where the frame is placed in DDR; the programs only ever see it through pixels_dma
+#define DDR_FRAME_ADDR 0x80000000
+
+// Approximate extra cycles taken by memory accesses, on top of one cycle per instruction and one per 32-bit word
+#define PRU_LOCAL_ACCESS_CYCLES 2
+#define PRU_OCP_READ_CYCLES 30
+#define PRU_DEFAULT_DDR_READ_CYCLES 40
+
+// ws281x_command_t as seen from the PRU
+#define COMMAND_PIXELS_DMA_OFFSET 0
+#define COMMAND_NUM_PIXELS_OFFSET 4
+#define COMMAND_COMMAND_OFFSET 8
+#define COMMAND_RESPONSE_OFFSET 12
+#define COMMAND_ACTIVE_STRIPS_OFFSET 16
+
+#define FRAME_STRIP_COUNT 48
+
+// Bytes per strip per pixel in the frames most programs read, and in the packed frames of the -packed templates
+#define FRAME_PIXEL_SIZE 4
+#define PACKED_FRAME_PIXEL_SIZE 3
+
+// Bit-plane frames: for each of the 24 bits of a pixel, four GPIO bank masks for each PRU
+#define BITPLANE_ROW_SIZE (24 * 2 * GPIO_BANK_COUNT * 4)
+#define BITPLANE_CHANNELS_PER_PRU 24
+
+// Where the bit-plane programs report the pin of each channel in PRU DRAM
+#define CHANNEL_MAP_OFFSET 0xC0
+
+// Rising edge intervals longer than this many bit periods are reported as gaps
+#define GAP_PERIOD_FACTOR 1.5
+
+static inline double cycles_to_ns(uint64_t cycles) {
+	return (double) cycles * PRU_NS_PER_CYCLE;
+}
+
+////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+// TYPES
+
+typedef enum {
+	PATTERN_RANDOM = 0,
+	PATTERN_ZEROS = 1,
+	PATTERN_ONES = 2
+} pattern_t;
+
+typedef struct {
+	const char* program_filename;
+	const char* vcd_filename;
+	uint32_t num_pixels;
+	uint32_t frames;
+	uint64_t active_strips;
+	pattern_t pattern;
+	uint32_t ddr_read_cycles;
+	uint64_t max_cycles;
+} sim_config_t;
+
+/** One change of a GPIO pin; pins are numbered bank * 32 + bit. */
+typedef struct {
+	uint64_t cycle;
+	uint8_t pin;
+	uint8_t value;
+} pin_edge_t;
+
+typedef struct {
+	uint64_t command_cycle;
+	uint64_t response_cycle;
+	uint64_t first_edge_cycle;
+	uint64_t last_edge_cycle;
+	bool has_edges;
+} frame_timing_t;
+
+typedef enum {
+	HOST_AWAITING_STARTUP,
+	HOST_AWAITING_FRAME,
+	HOST_AWAITING_EXIT
+} host_state_t;
+
+typedef struct {
+	// Core
+	uint32_t iram[PRU_IRAM_SIZE / 4];
+	uint32_t instruction_count;
+	uint32_t regs[32];
+	uint32_t pc;
+	bool carry;
+	bool halted;
+	uint64_t cycle;
+	uint64_t instructions_executed;
+	uint64_t arm_interrupts;
+
+	// Memories and registers
+	uint8_t dram[PRU_DRAM_SIZE];
+	uint8_t other_dram[PRU_DRAM_SIZE];
+	uint8_t shared_ram[PRU_SHARED_RAM_SIZE];
+	uint32_t control[PRU_CONTROL_SIZE / 4];
+	uint8_t cfg[PRU_CFG_SIZE];
+	uint8_t* ddr;
+	uint32_t ddr_size;
+	uint64_t ddr_read_bytes;
+	uint64_t ddr_reads;
+	uint8_t* pixels; // the frame of 4-byte pixels, kept for building bit planes once the program has started
+	uint32_t gpio_out[GPIO_BANK_COUNT];
+
+	// Waveform
+	pin_edge_t* edges;
+	size_t edge_count;
+	size_t edge_capacity;
+	uint32_t pins_driven[GPIO_BANK_COUNT];
+
+	// The ARM side
+	host_state_t host_state;
+	uint32_t frames_started;
+	frame_timing_t* frame_timings;
+} pru_sim_t;
+
+////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+// GLOBALS
+
+static sim_config_t g_config = {
+	.num_pixels = 16,
+	.frames = 1,
+	.active_strips = (1ULL << FRAME_STRIP_COUNT) - 1,
+	.pattern = PATTERN_RANDOM,
+	.ddr_read_cycles = PRU_DEFAULT_DDR_READ_CYCLES,
+	.max_cycles = 1000000000ULL
+};
+
+////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+// Registers
+
+/** Register field selects, as encoded by pasm: .b0-.b3, .w0-.w2 and the whole register */
+static const uint8_t FIELD_SHIFT[8] = { 0, 8, 16, 24, 0, 8, 16, 0 };
+static const uint32_t FIELD_MASK[8] = { 0xFF, 0xFF, 0xFF, 0xFF, 0xFFFF, 0xFFFF, 0xFFFF, 0xFFFFFFFF };
+static const uint8_t FIELD_WIDTH[8] = { 8, 8, 8, 8, 16, 16, 16, 32 };
+
+static inline uint32_t reg_read(const pru_sim_t* sim, uint32_t reg, uint32_t field) {
+	return (sim->regs[reg] >> FIELD_SHIFT[field]) & FIELD_MASK[field];
+}
+
+static void raise_event(pru_sim_t* sim, uint32_t r31_value);
+
+static inline void reg_write(pru_sim_t* sim, uint32_t reg, uint32_t field, uint32_t value) {
+	const uint32_t mask = FIELD_MASK[field] << FIELD_SHIFT[field];
+	sim->regs[reg] = (sim->regs[reg] & ~mask) | ((value << FIELD_SHIFT[field]) & mask);
+
+	if (reg == 31) {
+		raise_event(sim, sim->regs[31]);
+		sim->regs[31] = 0;
+	}
+}
+
+/** The second operand of ALU and branch instructions: an 8-bit immediate or a register field */
+static inline uint32_t read_op2(const pru_sim_t* sim, uint32_t word) {
+	return (word >> 24) & 1
+		? (word >> 16) & 0xFF
+		: reg_read(sim, (word >> 16) & 0x1F, (word >> 21) & 7);
+}
+
+////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+// GPIO and events
+
+static void record_edges(pru_sim_t* sim, uint32_t bank, uint32_t changed, uint32_t value) {
+	while (changed) {
+		const uint32_t bit = (uint32_t) __builtin_ctz(changed);
+		changed &= changed - 1;
+
+		if (sim->edge_count == sim->edge_capacity) {
+			sim->edge_capacity = sim->edge_capacity ? sim->edge_capacity * 2 : 65536;
+			sim->edges = realloc(sim->edges, sim->edge_capacity * sizeof(pin_edge_t));
+			if (sim->edges == NULL)
+				die("realloc failed: %s\n", strerror(errno));
+		}
+
+		sim->edges[sim->edge_count++] = (pin_edge_t) {
+			.cycle = sim->cycle,
+			.pin = (uint8_t) (bank * 32 + bit),
+			.value = (uint8_t) value
+		};
+	}
+
+	if (sim->frames_started > 0 && sim->host_state == HOST_AWAITING_FRAME) {
+		frame_timing_t* timing = &sim->frame_timings[sim->frames_started - 1];
+		if (!timing->has_edges) {
+			timing->first_edge_cycle = sim->cycle;
+			timing->has_edges = true;
+		}
+		timing->last_edge_cycle = sim->cycle;
+	}
+}
+
+static void gpio_write(pru_sim_t* sim, uint32_t bank, uint32_t offset, uint32_t value) {
+	uint32_t changed = 0;
+
+	if (offset == GPIO_SETDATAOUT) {
+		changed = value & ~sim->gpio_out[bank];
+		sim->gpio_out[bank] |= value;
+	} else if (offset == GPIO_CLEARDATAOUT) {
+		changed = value & sim->gpio_out[bank];
+		sim->gpio_out[bank] &= ~value;
+	} else if (offset == GPIO_DATAOUT) {
+		changed = value ^ sim->gpio_out[bank];
+		sim->gpio_out[bank] = value;
+	}
+
+	sim->pins_driven[bank] |= value;
+
+	if (changed) {
+		record_edges(sim, bank, changed & sim->gpio_out[bank], 1);
+		record_edges(sim, bank, changed & ~sim->gpio_out[bank], 0);
+	}
+}
+
+/** Writes to R31 with bit 5 set raise system event (value & 0xF) + 16; 19 and 20 interrupt the ARM */
+static void raise_event(pru_sim_t* sim, uint32_t r31_value) {
+	if (r31_value & (1 << 5)) {
+		const uint32_t event = (r31_value & 0xF) + 16;
+		if (event == 19 || event == 20) {
+			sim->arm_interrupts++;
+		}
+	}
+}
+
+////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+// Memory
+
+static uint32_t constant_table_address(const pru_sim_t* sim, uint32_t index, bool* ok) {
+	*ok = true;
+	switch (index) {
+		case 4: return PRU_CFG_ADDR;
+		case 24: return (sim->control[PRU_CONTROL_CTBIR0] & 0xFF) << 8;
+		case 25: return PRU_OTHER_DRAM_ADDR | (((sim->control[PRU_CONTROL_CTBIR0] >> 16) & 0xFF) << 8);
+		case 28: return (sim->control[PRU_CONTROL_CTPPR0] & 0xFFFF) << 8;
+		case 31: return 0x80000000 | (((sim->control[PRU_CONTROL_CTPPR1] >> 16) & 0xFFFF) << 8);
+		default:
+			*ok = false;
+			return 0;
+	}
+}
+
+static inline bool in_range(uint32_t address, uint32_t len, uint32_t base, uint32_t size) {
+	return address >= base && (uint64_t) address + len <= (uint64_t) base + size;
+}
+
+/**
+ * Copies a burst between the register file and PRU address space, adding the access time to *cycles. Returns false
+ * if the burst falls outside of the modelled memory.
+ */
+static bool mem_access(pru_sim_t* sim, uint32_t address, uint8_t* reg_bytes, uint32_t len, bool is_store, uint32_t* cycles) {
+	uint8_t* local = NULL;
+	const uint32_t words = (len + 3) / 4;
+
+	if (in_range(address, len, PRU_DRAM_ADDR, PRU_DRAM_SIZE)) {
+		local = sim->dram + (address - PRU_DRAM_ADDR);
+	} else if (in_range(address, len, PRU_OTHER_DRAM_ADDR, PRU_DRAM_SIZE)) {
+		local = sim->other_dram + (address - PRU_OTHER_DRAM_ADDR);
+	} else if (in_range(address, len, PRU_SHARED_RAM_ADDR, PRU_SHARED_RAM_SIZE)) {
+		local = sim->shared_ram + (address - PRU_SHARED_RAM_ADDR);
+	} else if (in_range(address, len, PRU0_CONTROL_ADDR, PRU_CONTROL_SIZE)) {
+		// Each program only touches its own PRU's control registers, so both blocks map to the simulated core
+		local = (uint8_t*) sim->control + (address - PRU0_CONTROL_ADDR);
+	} else if (in_range(address, len, PRU1_CONTROL_ADDR, PRU_CONTROL_SIZE)) {
+		local = (uint8_t*) sim->control + (address - PRU1_CONTROL_ADDR);
+	} else if (in_range(address, len, PRU_CFG_ADDR, PRU_CFG_SIZE)) {
+		local = sim->cfg + (address - PRU_CFG_ADDR);
+	}
+
+	if (local != NULL) {
+		if (is_store) {
+			memcpy(local, reg_bytes, len);
+		} else {
+			memcpy(reg_bytes, local, len);
+		}
+		*cycles += PRU_LOCAL_ACCESS_CYCLES + words;
+		return true;
+	}
+
+	if (in_range(address, len, DDR_FRAME_ADDR, sim->ddr_size)) {
+		uint8_t* ddr = sim->ddr + (address - DDR_FRAME_ADDR);
+		if (is_store) {
+			memcpy(ddr, reg_bytes, len);
+			*cycles += words;
+		} else {
+			memcpy(reg_bytes, ddr, len);
+			*cycles += g_config.ddr_read_cycles + words;
+			sim->ddr_read_bytes += len;
+			sim->ddr_reads++;
+		}
+		return true;
+	}
+
+	for (uint32_t bank=0; bank<GPIO_BANK_COUNT; bank++) {
+		if (!in_range(address, len, GPIO_BANK_ADDRS[bank], GPIO_BANK_SIZE)) {
+			continue;
+		}
+
+		// Writes are posted; only the data out registers are modelled
+		for (uint32_t i=0; i<len; i+=4) {
+			const uint32_t offset = address - GPIO_BANK_ADDRS[bank] + i;
+			uint32_t value = 0;
+
+			if (is_store) {
+				memcpy(&value, reg_bytes + i, len - i < 4 ? len - i : 4);
+				gpio_write(sim, bank, offset, value);
+			} else {
+				value = offset == GPIO_DATAOUT ? sim->gpio_out[bank] : 0;
+				memcpy(reg_bytes + i, &value, len - i < 4 ? len - i : 4);
+			}
+		}
+
+		*cycles += is_store ? words : PRU_OCP_READ_CYCLES + words;
+		return true;
+	}
+
+	return false;
+}
+
+static inline uint32_t dram_read_u32(const pru_sim_t* sim, uint32_t offset) {
+	uint32_t value;
+	memcpy(&value, sim->dram + offset, sizeof(value));
+	return value;
+}
+
+static inline void dram_write_u32(pru_sim_t* sim, uint32_t offset, uint32_t value) {
+	memcpy(sim->dram + offset, &value, sizeof(value));
+}
+
+////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+// The ARM side
+
+/**
+ * Splits the pixels into the bit planes of a bit-plane frame, one bit at a time, using the pins the program reported.
+ * The simulator only has the one PRU's pins, so the strips of the other PRU are given the same pins; whichever PRU the
+ * program was built for then reads its own strips' pixels.
+ */
+static void build_bitplane_frame(pru_sim_t* sim) {
+	for (uint32_t i=0; i<g_config.num_pixels; i++) {
+		for (uint32_t strip=0; strip<FRAME_STRIP_COUNT; strip++) {
+			const uint8_t* pixel = sim->pixels + (i * FRAME_STRIP_COUNT + strip) * FRAME_PIXEL_SIZE;
+			const uint32_t value = pixel[0] | (pixel[1] << 8) | (pixel[2] << 16);
+			const uint32_t pru = strip / BITPLANE_CHANNELS_PER_PRU;
+			const uint8_t pin = sim->dram[CHANNEL_MAP_OFFSET + strip % BITPLANE_CHANNELS_PER_PRU];
+
+			for (uint32_t bit=0; bit<24; bit++) {
+				if (value & (1U << bit)) continue;
+
+				// Each pixel's bits are sent from 23 down to 0
+				const uint32_t offset = i * BITPLANE_ROW_SIZE + (((23 - bit) * 2 + pru) * GPIO_BANK_COUNT + (pin >> 5)) * 4;
+				uint32_t mask;
+				memcpy(&mask, sim->ddr + offset, sizeof(mask));
+				mask |= 1U << (pin & 31);
+				memcpy(sim->ddr + offset, &mask, sizeof(mask));
+			}
+		}
+	}
+}
+
+/** Same sequence as ledscape_draw: point at the frame, zero the response and set the command. */
+static void host_start_frame(pru_sim_t* sim) {
+	dram_write_u32(sim, COMMAND_PIXELS_DMA_OFFSET, DDR_FRAME_ADDR);
+	dram_write_u32(sim, COMMAND_NUM_PIXELS_OFFSET, g_config.num_pixels);
+	dram_write_u32(sim, COMMAND_ACTIVE_STRIPS_OFFSET, (uint32_t) g_config.active_strips);
+	dram_write_u32(sim, COMMAND_ACTIVE_STRIPS_OFFSET + 4, (uint32_t) (g_config.active_strips >> 32));
+	dram_write_u32(sim, COMMAND_RESPONSE_OFFSET, 0);
+	dram_write_u32(sim, COMMAND_COMMAND_OFFSET, 1);
+
+	sim->frame_timings[sim->frames_started] = (frame_timing_t) { .command_cycle = sim->cycle };
+	sim->frames_started++;
+	sim->host_state = HOST_AWAITING_FRAME;
+}
+
+/** Reacts to the program as soon as it writes a response, which is as fast as the real ARM could. */
+static void host_poll(pru_sim_t* sim) {
+	if (dram_read_u32(sim, COMMAND_RESPONSE_OFFSET) == 0) {
+		return;
+	}
+
+	switch (sim->host_state) {
+		case HOST_AWAITING_STARTUP:
+			if (sim->pixels != NULL) {
+				build_bitplane_frame(sim);
+			}
+			host_start_frame(sim);
+		break;
+
+		case HOST_AWAITING_FRAME:
+			sim->frame_timings[sim->frames_started - 1].response_cycle = sim->cycle;
+
+			if (sim->frames_started < g_config.frames) {
+				host_start_frame(sim);
+			} else {
+				dram_write_u32(sim, COMMAND_RESPONSE_OFFSET, 0);
+				dram_write_u32(sim, COMMAND_COMMAND_OFFSET, 0xFF);
+				sim->host_state = HOST_AWAITING_EXIT;
+			}
+		break;
+
+		case HOST_AWAITING_EXIT:
+		break;
+	}
+}
+
+////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+// Interpreter
+
+static void fault(const pru_sim_t* sim, uint32_t word, const char* problem) {
+	die("[pru-sim] %s at pc %u (instruction 0x%08x, cycle %" PRIu64 ")\n", problem, sim->pc, word, sim->cycle);
+}
+
+static void exec_alu(pru_sim_t* sim, uint32_t word) {
+	const uint32_t op = (word >> 25) & 0xF;
+	const uint32_t rd = word & 0x1F, rd_field = (word >> 5) & 7;
+	const uint32_t a = reg_read(sim, (word >> 8) & 0x1F, (word >> 13) & 7);
+	const uint32_t b = read_op2(sim, word);
+	const uint8_t width = FIELD_WIDTH[rd_field];
+	uint64_t result;
+
+	switch (op) {
+		case 0x0: result = (uint64_t) a + b; sim->carry = (result >> width) & 1; break; // ADD
+		case 0x1: result = (uint64_t) a + b + sim->carry; sim->carry = (result >> width) & 1; break; // ADC
+		case 0x2: result = (uint64_t) a - b; sim->carry = a < b; break; // SUB
+		case 0x3: result = (uint64_t) a - b - sim->carry; sim->carry = (uint64_t) a < (uint64_t) b + sim->carry; break; // SUC
+		case 0x4: result = (uint64_t) a << (b & 0x1F); break; // LSL
+		case 0x5: result = a >> (b & 0x1F); break; // LSR
+		case 0x6: result = (uint64_t) b - a; sim->carry = b < a; break; // RSB
+		case 0x7: result = (uint64_t) b - a - sim->carry; sim->carry = (uint64_t) b < (uint64_t) a + sim->carry; break; // RSC
+		case 0x8: result = a & b; break; // AND
+		case 0x9: result = a | b; break; // OR
+		case 0xA: result = a ^ b; break; // XOR
+		case 0xB: result = ~a; break; // NOT
+		case 0xC: result = a < b ? a : b; break; // MIN
+		case 0xD: result = a > b ? a : b; break; // MAX
+		case 0xE: result = a & ~(1U << (b & 0x1F)); break; // CLR
+		default: result = a | (1U << (b & 0x1F)); break; // SET
+	}
+
+	reg_write(sim, rd, rd_field, (uint32_t) result);
+}
+
+/** LBBO, SBBO, LBCO and SBCO */
+static uint32_t exec_burst(pru_sim_t* sim, uint32_t word, bool is_constant) {
+	const bool is_load = (word >> 28) & 1;
+	const uint32_t reg_byte = (word & 0x1F) * 4 + ((word >> 5) & 3);
+	const uint32_t len_code = ((word >> 25) & 7) << 4 | ((word >> 13) & 7) << 1 | ((word >> 7) & 1);
+	const uint32_t len = len_code < 124 ? len_code + 1 : reg_read(sim, 0, len_code - 124);
+	uint32_t base;
+
+	if (is_constant) {
+		bool ok;
+		base = constant_table_address(sim, (word >> 8) & 0x1F, &ok);
+		if (!ok) fault(sim, word, "Unsupported constant table entry");
+	} else {
+		base = sim->regs[(word >> 8) & 0x1F];
+	}
+
+	const uint32_t address = base + read_op2(sim, word);
+
+	if (len == 0 || reg_byte + len > sizeof(sim->regs)) {
+		fault(sim, word, "Burst runs past the register file");
+	}
+
+	uint32_t cycles = 0;
+	if (!mem_access(sim, address, (uint8_t*) sim->regs + reg_byte, len, !is_load, &cycles)) {
+		char problem[64];
+		snprintf(problem, sizeof(problem), "Access to unmodelled address 0x%08x", address);
+		fault(sim, word, problem);
+	}
+
+	if (!is_load && in_range(address, len, PRU_DRAM_ADDR, PRU_DRAM_SIZE)) {
+		host_poll(sim);
+	}
+
+	return cycles;
+}
+
+/** Executes one instruction, returning the cycles it took */
+static uint32_t step(pru_sim_t* sim) {
+	if (sim->pc >= sim->instruction_count) {
+		fault(sim, 0, "Program counter outside of the program");
+	}
+
+	const uint32_t word = sim->iram[sim->pc];
+	uint32_t next_pc = sim->pc + 1;
+	uint32_t cycles = 1;
+
+	switch (word >> 29) {
+		case 0: // ALU
+			exec_alu(sim, word);
+		break;
+
+		case 1: { // Jumps, LDI, LMBD, HALT
+			const uint32_t rd = word & 0x1F, rd_field = (word >> 5) & 7;
+
+			switch ((word >> 25) & 0xF) {
+				case 0x0: // JMP
+				case 0x1: // JAL
+					if (((word >> 25) & 0xF) == 0x1) reg_write(sim, rd, rd_field, sim->pc + 1);
+					next_pc = (word >> 24) & 1
+						? (word >> 8) & 0xFFFF
+						: reg_read(sim, (word >> 16) & 0x1F, (word >> 21) & 7);
+				break;
+
+				case 0x2: // LDI
+					reg_write(sim, rd, rd_field, (word >> 8) & 0xFFFF);
+				break;
+
+				case 0x3: { // LMBD
+					const uint32_t a = reg_read(sim, (word >> 8) & 0x1F, (word >> 13) & 7);
+					const uint32_t bits = read_op2(sim, word) & 1 ? a : ~a;
+					reg_write(sim, rd, rd_field, bits ? 31 - (uint32_t) __builtin_clz(bits) : 32);
+				} break;
+
+				case 0x5: // HALT
+					sim->halted = true;
+				break;
+
+				default:
+					fault(sim, word, "Unsupported instruction");
+			}
+		} break;
+
+		case 2:
+		case 3: { // QBGT, QBLT, QBEQ, QBGE, QBLE, QBNE, QBA
+			const uint32_t condition = (word >> 27) & 7;
+			const uint32_t rn = reg_read(sim, (word >> 8) & 0x1F, (word >> 13) & 7);
+			const uint32_t op2 = read_op2(sim, word);
+
+			if (((condition & 4) && op2 > rn) || ((condition & 2) && op2 == rn) || ((condition & 1) && op2 < rn)) {
+				const int32_t offset = (int32_t) (((word & 0xFF) | ((word >> 25) & 3) << 8) << 22) >> 22;
+				next_pc = sim->pc + (uint32_t) offset;
+			}
+		} break;
+
+		case 4: // LBCO, SBCO
+			cycles += exec_burst(sim, word, true);
+		break;
+
+		case 6: { // QBBS, QBBC
+			const uint32_t rn = reg_read(sim, (word >> 8) & 0x1F, (word >> 13) & 7);
+			const bool bit_set = (rn >> (read_op2(sim, word) & 0x1F)) & 1;
+			const uint32_t condition = (word >> 27) & 3;
+
+			if ((condition == 2 && bit_set) || (condition == 1 && !bit_set)) {
+				const int32_t offset = (int32_t) (((word & 0xFF) | ((word >> 25) & 3) << 8) << 22) >> 22;
+				next_pc = sim->pc + (uint32_t) offset;
+			} else if (condition != 1 && condition != 2) {
+				fault(sim, word, "Unsupported instruction");
+			}
+		} break;
+
+		case 7: // LBBO, SBBO
+			cycles += exec_burst(sim, word, false);
+		break;
+
+		default:
+			fault(sim, word, "Unsupported instruction");
+	}
+
+	sim->pc = next_pc;
+	return cycles;
+}
+
+static void run(pru_sim_t* sim) {
+	while (!sim->halted) {
+		if (sim->cycle >= g_config.max_cycles) {
+			die("[pru-sim] Program still running after %" PRIu64 " cycles; %u of %u frames started\n",
+				sim->cycle,
+				sim->frames_started,
+				g_config.frames
+			);
+		}
+
+		const uint32_t cycles = step(sim);
+
+		sim->cycle += cycles;
+		sim->instructions_executed++;
+
+		if (sim->control[PRU_CONTROL_CONTROL] & PRU_CONTROL_COUNTER_ENABLE) {
+			sim->control[PRU_CONTROL_CYCLE] += cycles;
+		}
+	}
+
+	if (sim->host_state != HOST_AWAITING_EXIT) {
+		die("[pru-sim] Program halted after %u of %u frames\n", sim->frames_started, g_config.frames);
+	}
+}
+
+////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+// Setup
+
+static void load_program(pru_sim_t* sim, const char* filename) {
+	FILE* file = fopen(filename, "rb");
+	if (file == NULL)
+		die("Failed to open %s: %s\n", filename, strerror(errno));
+
+	const size_t word_count = fread(sim->iram, sizeof(uint32_t), PRU_IRAM_SIZE / 4, file);
+	if (word_count == 0 || (!feof(file) && fgetc(file) != EOF))
+		die("%s is empty or larger than the %d bytes of PRU instruction RAM\n", filename, PRU_IRAM_SIZE);
+
+	fclose(file);
+	sim->instruction_count = (uint32_t) word_count;
+}
+
+/** Programs built from a -packed or -bitplane template read frames in their own format, as ledscape works out */
+static bool is_program_of_format(const char* filename, const char* format) {
+	const char* name = strrchr(filename, '/');
+	return strstr(name ? name + 1 : filename, format) != NULL;
+}
+
+static void fill_frame(pru_sim_t* sim) {
+	sim->ddr_size = g_config.num_pixels * FRAME_STRIP_COUNT * FRAME_PIXEL_SIZE;
+	sim->ddr = malloc(sim->ddr_size);
+	if (sim->ddr == NULL)
+		die("malloc failed: %s\n", strerror(errno));
+
+	// A fixed seed keeps runs comparable
+	uint32_t state = 0x12345678;
+	for (uint32_t i=0; i<sim->ddr_size; i++) {
+		switch (g_config.pattern) {
+			case PATTERN_ZEROS: sim->ddr[i] = 0; break;
+			case PATTERN_ONES: sim->ddr[i] = 0xFF; break;
+			default:
+				state = state * 1103515245 + 12345;
+				sim->ddr[i] = (uint8_t) (state >> 16);
+		}
+	}
+
+	// Bit-plane frames need the pins the program reports when it starts; see build_bitplane_frame
+	if (is_program_of_format(g_config.program_filename, "-bitplane-")) {
+		sim->pixels = sim->ddr;
+		sim->ddr_size = g_config.num_pixels * BITPLANE_ROW_SIZE;
+		sim->ddr = calloc(1, sim->ddr_size);
+		if (sim->ddr == NULL)
+			die("calloc failed: %s\n", strerror(errno));
+	}
+
+	// Packed programs get the same pixels with the fourth bytes left out, so both clock out the same bits
+	if (is_program_of_format(g_config.program_filename, "-packed-")) {
+		const uint32_t pixel_count = g_config.num_pixels * FRAME_STRIP_COUNT;
+		for (uint32_t i=0; i<pixel_count; i++) {
+			memmove(sim->ddr + i * PACKED_FRAME_PIXEL_SIZE, sim->ddr + i * FRAME_PIXEL_SIZE, PACKED_FRAME_PIXEL_SIZE);
+		}
+		sim->ddr_size = pixel_count * PACKED_FRAME_PIXEL_SIZE;
+	}
+}
+
+////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+// Reporting
+
+static void pin_name(uint32_t pin, char* name, size_t name_size) {
+	snprintf(name, name_size, "gpio%u_%u", pin / 32, pin % 32);
+}
+
+static int compare_u64(const void* a, const void* b) {
+	const uint64_t x = *(const uint64_t*) a, y = *(const uint64_t*) b;
+	return x < y ? -1 : x > y;
+}
+
+static void report_pin(const pru_sim_t* sim, uint32_t pin, uint64_t* scratch) {
+	uint64_t last_rise = 0, rise_count = 0, interval_count = 0;
+	uint64_t high_min = UINT64_MAX, high_max = 0;
+	bool high = false, has_rise = false;
+
+	for (size_t i=0; i<sim->edge_count; i++) {
+		const pin_edge_t* edge = &sim->edges[i];
+		if (edge->pin != pin) continue;
+
+		if (edge->value) {
+			if (has_rise) scratch[interval_count++] = edge->cycle - last_rise;
+			last_rise = edge->cycle;
+			has_rise = true;
+			high = true;
+			rise_count++;
+		} else if (high) {
+			const uint64_t high_cycles = edge->cycle - last_rise;
+			if (high_cycles < high_min) high_min = high_cycles;
+			if (high_cycles > high_max) high_max = high_cycles;
+			high = false;
+		}
+	}
+
+	char name[16];
+	pin_name(pin, name, sizeof(name));
+
+	if (interval_count == 0) {
+		printf("[pru-sim] %s: %" PRIu64 " pulses\n", name, rise_count);
+		return;
+	}
+
+	// Rising edge to rising edge is one bit; much longer intervals are gaps between pixels, bytes or frames
+	qsort(scratch, interval_count, sizeof(uint64_t), compare_u64);
+	const uint64_t median = scratch[interval_count / 2];
+
+	uint64_t period_min = UINT64_MAX, period_max = 0, period_sum = 0, period_count = 0;
+	uint64_t gap_count = 0, gap_max = 0;
+
+	for (uint64_t i=0; i<interval_count; i++) {
+		if (scratch[i] > median * GAP_PERIOD_FACTOR) {
+			gap_count++;
+			if (scratch[i] > gap_max) gap_max = scratch[i];
+		} else {
+			if (scratch[i] < period_min) period_min = scratch[i];
+			if (scratch[i] > period_max) period_max = scratch[i];
+			period_sum += scratch[i];
+			period_count++;
+		}
+	}
+
+	printf("[pru-sim] %s: %" PRIu64 " pulses, bit period %.0f/%.0f/%.0f ns (min/avg/max), high %.0f-%.0f ns, %" PRIu64 " gaps (longest %.0f ns)\n",
+		name,
+		rise_count,
+		cycles_to_ns(period_min),
+		cycles_to_ns(period_sum) / period_count,
+		cycles_to_ns(period_max),
+		cycles_to_ns(high_min == UINT64_MAX ? 0 : high_min),
+		cycles_to_ns(high_max),
+		gap_count,
+		cycles_to_ns(gap_max)
+	);
+}
+
+static void report(const pru_sim_t* sim) {
+	printf("[pru-sim] %s: %u frame(s) of %u pixels in %" PRIu64 " cycles (%.3f ms), %" PRIu64 " instructions, %" PRIu64 " ARM interrupts\n",
+		g_config.program_filename,
+		g_config.frames,
+		g_config.num_pixels,
+		sim->cycle,
+		cycles_to_ns(sim->cycle) / 1e6,
+		sim->instructions_executed,
+		sim->arm_interrupts
+	);
+
+	printf("[pru-sim] DDR: %" PRIu64 " bytes in %" PRIu64 " reads, %.1f bytes per pixel\n",
+		sim->ddr_read_bytes,
+		sim->ddr_reads,
+		(double) sim->ddr_read_bytes / ((uint64_t) g_config.frames * g_config.num_pixels)
+	);
+
+	for (uint32_t i=0; i<sim->frames_started; i++) {
+		const frame_timing_t* timing = &sim->frame_timings[i];
+
+		printf("[pru-sim] frame %u: clock-out %.2f us, command to response %.2f us\n",
+			i,
+			timing->has_edges ? cycles_to_ns(timing->last_edge_cycle - timing->first_edge_cycle) / 1e3 : 0,
+			cycles_to_ns(timing->response_cycle - timing->command_cycle) / 1e3
+		);
+	}
+
+	uint64_t* scratch = malloc((sim->edge_count + 1) * sizeof(uint64_t));
+	if (scratch == NULL)
+		die("malloc failed: %s\n", strerror(errno));
+
+	for (uint32_t pin=0; pin<GPIO_BANK_COUNT * 32; pin++) {
+		if ((sim->pins_driven[pin / 32] >> (pin % 32)) & 1) {
+			report_pin(sim, pin, scratch);
+		}
+	}
+
+	free(scratch);
+}
+
+/** VCD identifiers are strings of printable characters; two cover all 128 pins */
+static void vcd_identifier(uint32_t pin, char* id) {
+	id[0] = (char) ('!' + pin % 94);
+	id[1] = pin >= 94 ? (char) ('!' + pin / 94) : 0;
+	id[2] = 0;
+}
+
+static void write_vcd(const pru_sim_t* sim, const char* filename) {
+	FILE* vcd = fopen(filename, "w");
+	if (vcd == NULL)
+		die("Failed to open %s for writing: %s\n", filename, strerror(errno));
+
+	char id[3], name[16];
+
+	fprintf(vcd, "$version pru-sim %s $end\n", g_config.program_filename);
+	fprintf(vcd, "$comment %d ns per PRU cycle $end\n", PRU_NS_PER_CYCLE);
+	fprintf(vcd, "$timescale 1 ns $end\n");
+	fprintf(vcd, "$scope module pru $end\n");
+
+	for (uint32_t pin=0; pin<GPIO_BANK_COUNT * 32; pin++) {
+		if ((sim->pins_driven[pin / 32] >> (pin % 32)) & 1) {
+			vcd_identifier(pin, id);
+			pin_name(pin, name, sizeof(name));
+			fprintf(vcd, "$var wire 1 %s %s $end\n", id, name);
+		}
+	}
+
+	fprintf(vcd, "$upscope $end\n$enddefinitions $end\n#0\n$dumpvars\n");
+	for (uint32_t pin=0; pin<GPIO_BANK_COUNT * 32; pin++) {
+		if ((sim->pins_driven[pin / 32] >> (pin % 32)) & 1) {
+			vcd_identifier(pin, id);
+			fprintf(vcd, "0%s\n", id);
+		}
+	}
+	fprintf(vcd, "$end\n");
+
+	uint64_t last_cycle = 0;
+	for (size_t i=0; i<sim->edge_count; i++) {
+		const pin_edge_t* edge = &sim->edges[i];
+
+		if (edge->cycle != last_cycle) {
+			fprintf(vcd, "#%" PRIu64 "\n", edge->cycle * PRU_NS_PER_CYCLE);
+			last_cycle = edge->cycle;
+		}
+
+		vcd_identifier(edge->pin, id);
+		fprintf(vcd, "%d%s\n", edge->value, id);
+	}
+
+	fprintf(vcd, "#%" PRIu64 "\n", sim->cycle * PRU_NS_PER_CYCLE);
+	fclose(vcd);
+}
+
+////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+// main()
+static struct option long_options[] =
+	{
+		{"pixels", required_argument, NULL, 'n'},
+		{"frames", required_argument, NULL, 'f'},
+		{"active-strips", required_argument, NULL, 's'},
+		{"pattern", required_argument, NULL, 'p'},
+		{"vcd", required_argument, NULL, 'o'},
+		{"ddr-read-cycles", required_argument, NULL, 'd'},
+		{"max-cycles", required_argument, NULL, 'm'},
+		{"help", no_argument, NULL, 'h'},
+		{NULL, 0, NULL, 0}
+	};
+
+static void print_usage(char ** argv) {
+	printf("Usage: %s [options] pru/bin/<mode>-<mapping>-pru<n>.bin\n", argv[0]);
+	printf("\n");
+	printf("--pixels <count>, -n <count>\n\tThe number of pixels per strip to clock out (default 16)\n");
+	printf("--frames <count>, -f <count>\n\tThe number of frames to clock out (default 1)\n");
+	printf("--active-strips <mask>, -s <mask>\n\tBitmask of the strips to clock out, bit n for strip n (default all 48)\n");
+	printf("--pattern <name>, -p <name>\n\tThe pixel data: random, zeros or ones (default random)\n");
+	printf("--vcd <file>, -o <file>\n\tWrites the waveform of every driven GPIO pin to <file> as a VCD trace\n");
+	printf("--ddr-read-cycles <cycles>, -d <cycles>\n\tThe latency of a read from DDR in PRU cycles (default %d)\n", PRU_DEFAULT_DDR_READ_CYCLES);
+	printf("--max-cycles <cycles>, -m <cycles>\n\tGives up if the program runs for longer than this (default 1000000000)\n");
+	printf("--help, -h\n\tDisplays this help message\n");
+}
+
+void handle_args(int argc, char ** argv) {
+	extern char *optarg;
+
+	int opt;
+	while ((opt = getopt_long(argc, argv, "n:f:s:p:o:d:m:h", long_options, NULL)) != -1)
+	{
+		switch (opt)
+		{
+			case 'n': {
+				g_config.num_pixels = (uint32_t) atoi(optarg);
+			} break;
+
+			case 'f': {
+				g_config.frames = (uint32_t) atoi(optarg);
+			} break;
+
+			case 's': {
+				g_config.active_strips = strtoull(optarg, NULL, 0);
+			} break;
+
+			case 'p': {
+				if (strcasecmp(optarg, "random") == 0) {
+					g_config.pattern = PATTERN_RANDOM;
+				} else if (strcasecmp(optarg, "zeros") == 0) {
+					g_config.pattern = PATTERN_ZEROS;
+				} else if (strcasecmp(optarg, "ones") == 0) {
+					g_config.pattern = PATTERN_ONES;
+				} else {
+					printf("Invalid argument for --pattern; expected random, zeros or ones; actual: %s\n", optarg);
+					exit(EXIT_FAILURE);
+				}
+			} break;
+
+			case 'o': {
+				g_config.vcd_filename = optarg;
+			} break;
+
+			case 'd': {
+				g_config.ddr_read_cycles = (uint32_t) atoi(optarg);
+			} break;
+
+			case 'm': {
+				g_config.max_cycles = strtoull(optarg, NULL, 10);
+			} break;
+
+			case 'h': {
+				print_usage(argv);
+				exit(EXIT_SUCCESS);
+			}
+
+			default:
+				print_usage(argv);
+				exit(EXIT_FAILURE);
+		}
+	}
+
+	if (optind != argc - 1 || g_config.num_pixels == 0 || g_config.frames == 0) {
+		print_usage(argv);
+		exit(EXIT_FAILURE);
+	}
+
+	g_config.program_filename = argv[optind];
+}
+
+int main(int argc, char ** argv)
+{
+	handle_args(argc, argv);
+
+	pru_sim_t* sim = calloc(1, sizeof(*sim));
+	if (sim == NULL)
+		die("calloc failed: %s\n", strerror(errno));
+
+	sim->frame_timings = calloc(g_config.frames, sizeof(frame_timing_t));
+	if (sim->frame_timings == NULL)
+		die("calloc failed: %s\n", strerror(errno));
+
+	load_program(sim, g_config.program_filename);
+	fill_frame(sim);
+
+	// ledscape_init zeroes the command block before starting the program
+	dram_write_u32(sim, COMMAND_NUM_PIXELS_OFFSET, g_config.num_pixels);
+	sim->host_state = HOST_AWAITING_STARTUP;
+
+	run(sim);
+	report(sim);
+
+	if (g_config.vcd_filename != NULL) {
+		write_vcd(sim, g_config.vcd_filename);
+	}
+
+	return EXIT_SUCCESS;
+}
@@ -12,6 +12,7 @@
 #include <fcntl.h>
 #include <errno.h>
 #include <unistd.h>
+#include <poll.h>
 #include "am335x/app_loader/include/prussdrv.h"
 #include "am335x/app_loader/include/pruss_intc_mapping.h"
 #include "pru.h"
@@ -32,19 +33,29 @@ proc_read(
 }
 
 
+// prussdrv is shared by both PRUs; it is set up by the first pru_init and torn down by the last pru_close
+static unsigned pru_open_count;
+
+
 pru_t *
 pru_init(
 	const unsigned short pru_num
 )
 {
-	prussdrv_init();
+	if (pru_open_count++ == 0)
+	{
+		prussdrv_init();
+
+		// PRUSS_INTC_INITDATA routes each PRU's ARM interrupt to its own host
+		// interrupt, so open both to be able to tell them apart
+		if (prussdrv_open(PRU_EVTOUT_0) || prussdrv_open(PRU_EVTOUT_1))
+			die("prussdrv_open open failed\n");
 
-	int ret = prussdrv_open(PRU_EVTOUT_0);
-	if (ret)
-		die("prussdrv_open open failed\n");
+		tpruss_intc_initdata pruss_intc_initdata = PRUSS_INTC_INITDATA;
+		prussdrv_pruintc_init(&pruss_intc_initdata);
+	}
 
-	tpruss_intc_initdata pruss_intc_initdata = PRUSS_INTC_INITDATA;
-	prussdrv_pruintc_init(&pruss_intc_initdata);
+	const unsigned host_interrupt = pru_num == 0 ? PRU_EVTOUT_0 : PRU_EVTOUT_1;
 
 	void * pru_data_mem;
 	prussdrv_map_prumem(
@@ -87,6 +98,8 @@ pru_init(
 
 	*pru = (pru_t) {
 		.pru_num	= pru_num,
+		.host_interrupt	= host_interrupt,
+		.event_fd	= prussdrv_pru_event_fd(host_interrupt),
 		.data_ram	= pru_data_mem,
 		.data_ram_size	= 8192, // how to determine?
 		.ddr_addr	= ddr_addr,
@@ -120,11 +133,36 @@ pru_exec(
 }
 
 void
-pru_wait_interrupt() {
-	prussdrv_pru_wait_event(PRU_EVTOUT_0);
-	// Handle event
-	prussdrv_pru_clear_event(PRU_EVTOUT_0, PRU0_ARM_INTERRUPT);
-	prussdrv_pru_clear_event(PRU_EVTOUT_1, PRU1_ARM_INTERRUPT);
+pru_clear_interrupt(
+	pru_t * const pru
+)
+{
+	// Consume the event count, then clear the system event and re-enable the host interrupt
+	prussdrv_pru_wait_event(pru->host_interrupt);
+	prussdrv_pru_clear_event(
+		pru->host_interrupt,
+		pru->pru_num == 0 ? PRU0_ARM_INTERRUPT : PRU1_ARM_INTERRUPT
+	);
+}
+
+int
+pru_wait_interrupt(
+	pru_t * const pru,
+	int timeout_ms
+)
+{
+	struct pollfd pfd = { .fd = pru->event_fd, .events = POLLIN };
+
+	int ret;
+	while ((ret = poll(&pfd, 1, timeout_ms)) < 0 && errno == EINTR);
+
+	if (ret < 0)
+		die("poll on PRU%u events failed: %s\n", pru->pru_num, strerror(errno));
+	if (ret == 0)
+		return 0;
+
+	pru_clear_interrupt(pru);
+	return 1;
 }
 
 void
@@ -133,9 +171,14 @@ pru_close(
 )
 {
 	// \todo unmap memory
-	pru_wait_interrupt();
-	prussdrv_pru_disable(pru->pru_num); 
-	prussdrv_exit();
+	// Give the program a moment to acknowledge the halt command, but don't hang on one that has stopped responding
+	if (!pru_wait_interrupt(pru, 1000))
+		fprintf(stderr, "PRU%u did not acknowledge the halt command\n", pru->pru_num);
+
+	prussdrv_pru_disable(pru->pru_num);
+
+	if (--pru_open_count == 0)
+		prussdrv_exit();
 }
 
 
@@ -19,6 +19,9 @@ typedef struct
 {
 	unsigned pru_num;
 
+	unsigned host_interrupt; // PRU_EVTOUT_n that this PRU's ARM interrupt arrives on
+	int event_fd; // readable while an interrupt from this PRU is pending
+
 	void * data_ram; // PRU data ram in ARM space
 	size_t data_ram_size; // size in bytes of the PRU's data RAM
 
@@ -47,11 +50,24 @@ pru_close(
 
 
 /**
-* Await an interrupt from one of the PRUs. Note that as far as I can tell, we have not way of telling
-* which PRU an interrupt comes from; we only receive them on the EVTOUT_NUM passed to prussdrv_open()
+* Await an interrupt from this PRU for up to timeout_ms (forever if negative) and clear it.
+* \returns 1 if the interrupt arrived, 0 on timeout.
+*/
+extern int
+pru_wait_interrupt(
+	pru_t * const pru,
+	int timeout_ms
+);
+
+
+/**
+* Acknowledge the interrupt that made pru->event_fd readable, so that the
+* next one can arrive.  Only call this once the fd has polled readable.
 */
 extern void
-	pru_wait_interrupt();
+pru_clear_interrupt(
+	pru_t * const pru
+);
 
 /** Configure a GPIO pin.
  *
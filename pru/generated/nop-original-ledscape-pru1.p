@@ -0,0 +1,3 @@
+#define PRU_NUM 1
+#include "mapping-original-ledscape-p.h"
+#include "../templates/nop.p"
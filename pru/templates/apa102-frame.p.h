@@ -0,0 +1,188 @@
+// The frame loop of the APA102 template, expanded twice: with FRAME_MASKED set to 0 for frames that drive every strip,
+// with the pin masks as immediates, and set to 1 for frames that leave some strips out, with the masks worked out at
+// the start of the frame. Falls through once the frame has been clocked out.
+
+#if FRAME_MASKED
+	#define FRAME_LABEL(name) CONCAT2(name,_masked)
+	#define FRAME_BIT_LABEL_SUFFIX _masked
+	#define FRAME_PREP_GPIO_MASK(maskName) PREP_GPIO_MASK_ACTIVE(maskName)
+
+	// The even mask is still loaded from clearing the data lines
+	#define FRAME_MASK_ONES() AND r_gpio0_ones, r_gpio0_ones, r_gpio0_mask; \
+	                          AND r_gpio1_ones, r_gpio1_ones, r_gpio1_mask; \
+	                          AND r_gpio2_ones, r_gpio2_ones, r_gpio2_mask; \
+	                          AND r_gpio3_ones, r_gpio3_ones, r_gpio3_mask;
+#else
+	#define FRAME_LABEL(name) name
+	#define FRAME_BIT_LABEL_SUFFIX
+	#define FRAME_PREP_GPIO_MASK(maskName) PREP_GPIO_MASK_NAMED(maskName)
+	#define FRAME_MASK_ONES()
+#endif
+
+#undef BIT_LABEL_SUFFIX
+#define BIT_LABEL_SUFFIX FRAME_BIT_LABEL_SUFFIX
+
+	// Reset the sleep timer
+	RESET_COUNTER
+
+// send the start frame
+FRAME_LABEL(l_start_frame):
+	MOV r_bit_num, 32
+	
+	// store number of leds in r29
+	MOV r29, r_data_len
+
+	RESET_GPIO_ONES()
+
+	// 32 bits of 0
+	FRAME_LABEL(l_start_bit_loop):
+
+		DECREMENT r_bit_num
+
+		// Clocks HIGH
+		PREP_GPIO_ADDRS_FOR_SET()
+		FRAME_PREP_GPIO_MASK(odd)
+		GPIO_APPLY_MASK_TO_ADDR()
+			
+		// lower clock and data
+		PREP_GPIO_ADDRS_FOR_CLEAR()
+		FRAME_PREP_GPIO_MASK(all)
+		GPIO_APPLY_MASK_TO_ADDR()
+		
+		QBNE FRAME_LABEL(l_start_bit_loop), r_bit_num, #0
+
+
+FRAME_LABEL(l_word_loop):
+	// first 8 bits will be 0xFF (global brightness always at maximum)
+	MOV r_bit_num, 8
+
+	RESET_GPIO_ONES()
+
+	FRAME_LABEL(l_header_bit_loop):
+		DECREMENT r_bit_num
+
+		// Clocks HIGH
+		PREP_GPIO_ADDRS_FOR_SET()
+		FRAME_PREP_GPIO_MASK(odd)
+		GPIO_APPLY_MASK_TO_ADDR()
+		
+		// lower clock and raise data
+		PREP_GPIO_ADDRS_FOR_SET()
+		FRAME_PREP_GPIO_MASK(even)
+		GPIO_APPLY_MASK_TO_ADDR()
+
+		PREP_GPIO_ADDRS_FOR_CLEAR()
+		FRAME_PREP_GPIO_MASK(odd)
+		GPIO_APPLY_MASK_TO_ADDR()
+		
+		QBNE FRAME_LABEL(l_header_bit_loop), r_bit_num, #0
+
+
+	// for bit in 24 to 0
+	MOV r_bit_num, 24
+
+	FRAME_LABEL(l_bit_loop):
+		DECREMENT r_bit_num
+
+		// Zero out the registers
+		RESET_GPIO_ONES()
+
+		///////////////////////////////////////////////////////////////////////
+		// Load 12 registers of data into r10-r21
+
+		LOAD_CHANNEL_DATA(12, 0, 12)
+
+		// Test for ones
+		TEST_BIT_ONE(r_data0,  0)
+		TEST_BIT_ONE(r_data1,  2)
+		TEST_BIT_ONE(r_data2,  4)
+		TEST_BIT_ONE(r_data3,  6)
+		TEST_BIT_ONE(r_data4,  8)
+		TEST_BIT_ONE(r_data5,  10)
+		TEST_BIT_ONE(r_data6,  12)
+		TEST_BIT_ONE(r_data7,  14)
+		TEST_BIT_ONE(r_data8,  16)
+		TEST_BIT_ONE(r_data9,  18)
+		TEST_BIT_ONE(r_data10, 20)
+		TEST_BIT_ONE(r_data11, 22)
+
+		// Data loaded
+		///////////////////////////////////////////////////////////////////////
+
+		///////////////////////////////////////////////////////////////////////
+		// Send the bits
+		
+		// Clocks HIGH
+		PREP_GPIO_ADDRS_FOR_SET()
+		FRAME_PREP_GPIO_MASK(odd)
+		GPIO_APPLY_MASK_TO_ADDR()
+
+		// set all data LOW
+		PREP_GPIO_ADDRS_FOR_CLEAR()
+		FRAME_PREP_GPIO_MASK(even)
+		GPIO_APPLY_MASK_TO_ADDR()
+
+		// Data 1s HIGH, on the active strips only
+		FRAME_MASK_ONES()
+		PREP_GPIO_ADDRS_FOR_SET()
+		GPIO_APPLY_ONES_TO_ADDR()
+
+		// Clocks LOW
+		PREP_GPIO_ADDRS_FOR_CLEAR()
+		FRAME_PREP_GPIO_MASK(odd)
+		GPIO_APPLY_MASK_TO_ADDR()
+
+		// Bits sent
+		///////////////////////////////////////////////////////////////////////
+
+		QBNE FRAME_LABEL(l_bit_loop), r_bit_num, #0
+	//end FRAME_LABEL(l_bit_loop)
+
+	// The RGB streams have been clocked out
+	// Move to the next pixel on each row
+	ADD r_data_addr, r_data_addr, 48 * 4
+	DECREMENT r_data_len
+	QBNE FRAME_LABEL(l_word_loop), r_data_len, #0
+	
+
+FRAME_LABEL(l_end_frame):
+	// send end frame bits
+	MOV r_bit_num, r29
+	LSR r_bit_num, r_bit_num, 1
+	ADD r_bit_num, r_bit_num, 1
+
+	RESET_GPIO_ONES()
+
+	// numleds / 2 bits of 1
+	
+
+	FRAME_LABEL(l_end_bit_loop):
+		DECREMENT r_bit_num
+
+		// Clocks HIGH
+		PREP_GPIO_ADDRS_FOR_SET()
+		FRAME_PREP_GPIO_MASK(odd)
+		GPIO_APPLY_MASK_TO_ADDR()
+	
+		// raise data
+	        PREP_GPIO_ADDRS_FOR_SET()
+        	FRAME_PREP_GPIO_MASK(even)
+	        GPIO_APPLY_MASK_TO_ADDR()
+		
+		// Clocks LOW
+		PREP_GPIO_ADDRS_FOR_CLEAR()
+		FRAME_PREP_GPIO_MASK(odd)
+		GPIO_APPLY_MASK_TO_ADDR()
+
+		QBNE FRAME_LABEL(l_end_bit_loop), r_bit_num, #0
+	
+	PREP_GPIO_ADDRS_FOR_CLEAR()
+	PREP_GPIO_MASK_NAMED(all)
+	GPIO_APPLY_MASK_TO_ADDR()
+
+#undef FRAME_LABEL
+#undef FRAME_PREP_GPIO_MASK
+#undef FRAME_MASK_ONES
+#undef FRAME_BIT_LABEL_SUFFIX
+#undef BIT_LABEL_SUFFIX
+#define BIT_LABEL_SUFFIX
@@ -6,6 +6,9 @@
 //
 // To stop, the ARM can write a 0xFF to the command, which will cause the PRU code to exit.
 //
+// Only the strips set in the command's active strip mask are clocked; the others keep showing the last frame they
+// were sent. If none of this PRU's strips are active the frame is answered straight away.
+//
 // Implementation does not try and stick to any specific clock speed, just pushes out data as fast as it can (about 1.6mhz).
 // 
 // [ start frame ][   LED1   ][   LED2   ]...[   LEDN   ][ end frame ]
@@ -66,9 +69,6 @@ _LOOP:
 	// Wait for a non-zero command
 	QBEQ _LOOP, r2, #0
 
-	// Reset the sleep timer
-	RESET_COUNTER
-
 	// Zero out the start command so that they know we have received it
 	// This allows maximum speed frame drawing since they know that they
 	// can now swap the frame buffer pointer and write a new start command.
@@ -78,161 +78,64 @@ _LOOP:
 	// Command of 0xFF is the signal to exit
 	QBEQ EXIT, r2, #0xFF
 
-// send the start frame
-l_start_frame:
-	MOV r_bit_num, 32
-	
-	// store number of leds in r29
-	MOV r29, r_data_len
-
-	RESET_GPIO_ONES()
-
-	// 32 bits of 0
-	l_start_bit_loop:
-
-		DECREMENT r_bit_num
-
-		// Clocks HIGH
-		PREP_GPIO_ADDRS_FOR_SET()
-		PREP_GPIO_MASK_NAMED(odd)
-		GPIO_APPLY_MASK_TO_ADDR()
-			
-		// lower clock and data
-		PREP_GPIO_ADDRS_FOR_CLEAR()
-		PREP_GPIO_MASK_NAMED(all)
-		GPIO_APPLY_MASK_TO_ADDR()
-		
-		QBNE l_start_bit_loop, r_bit_num, #0
-
-
-l_word_loop:
-	// first 8 bits will be 0xFF (global brightness always at maximum)
-	MOV r_bit_num, 8
-
-	RESET_GPIO_ONES()
-
-	l_header_bit_loop:
-		DECREMENT r_bit_num
-
-		// Clocks HIGH
-		PREP_GPIO_ADDRS_FOR_SET()
-		PREP_GPIO_MASK_NAMED(odd)
-		GPIO_APPLY_MASK_TO_ADDR()
-		
-		// lower clock and raise data
-		PREP_GPIO_ADDRS_FOR_SET()
-		PREP_GPIO_MASK_NAMED(even)
-		GPIO_APPLY_MASK_TO_ADDR()
-
-		PREP_GPIO_ADDRS_FOR_CLEAR()
-		PREP_GPIO_MASK_NAMED(odd)
-		GPIO_APPLY_MASK_TO_ADDR()
-		
-		QBNE l_header_bit_loop, r_bit_num, #0
-
-
-	// for bit in 24 to 0
-	MOV r_bit_num, 24
-
-	l_bit_loop:
-		DECREMENT r_bit_num
-
-		// Zero out the registers
-		RESET_GPIO_ONES()
-
-		///////////////////////////////////////////////////////////////////////
-		// Load 12 registers of data into r10-r21
-
-		LOAD_CHANNEL_DATA(12, 0, 12)
-
-		// Test for ones
-		TEST_BIT_ONE(r_data0,  0)
-		TEST_BIT_ONE(r_data1,  2)
-		TEST_BIT_ONE(r_data2,  4)
-		TEST_BIT_ONE(r_data3,  6)
-		TEST_BIT_ONE(r_data4,  8)
-		TEST_BIT_ONE(r_data5,  10)
-		TEST_BIT_ONE(r_data6,  12)
-		TEST_BIT_ONE(r_data7,  14)
-		TEST_BIT_ONE(r_data8,  16)
-		TEST_BIT_ONE(r_data9,  18)
-		TEST_BIT_ONE(r_data10, 20)
-		TEST_BIT_ONE(r_data11, 22)
-
-		// Data loaded
-		///////////////////////////////////////////////////////////////////////
-
-		///////////////////////////////////////////////////////////////////////
-		// Send the bits
-		
-		// Clocks HIGH
-		PREP_GPIO_ADDRS_FOR_SET()
-		PREP_GPIO_MASK_NAMED(odd)
-		GPIO_APPLY_MASK_TO_ADDR()
-
-		// set all data LOW
-		PREP_GPIO_ADDRS_FOR_CLEAR()
-		PREP_GPIO_MASK_NAMED(even)
-		GPIO_APPLY_MASK_TO_ADDR()
-
-		// Data 1s HIGH
-		PREP_GPIO_ADDRS_FOR_SET()
-		GPIO_APPLY_ONES_TO_ADDR()
-
-		// Clocks LOW
-		PREP_GPIO_ADDRS_FOR_CLEAR()
-		PREP_GPIO_MASK_NAMED(odd)
-		GPIO_APPLY_MASK_TO_ADDR()
-
-		// Bits sent
-		///////////////////////////////////////////////////////////////////////
-
-		QBNE l_bit_loop, r_bit_num, #0
-	//end l_bit_loop
-
-	// The RGB streams have been clocked out
-	// Move to the next pixel on each row
-	ADD r_data_addr, r_data_addr, 48 * 4
-	DECREMENT r_data_len
-	QBNE l_word_loop, r_data_len, #0
-	
-
-l_end_frame:
-	// send end frame bits
-	MOV r_bit_num, r29
-	LSR r_bit_num, r_bit_num, 1
-	ADD r_bit_num, r_bit_num, 1
-
-	RESET_GPIO_ONES()
-
-	// numleds / 2 bits of 1
-	
-
-	l_end_bit_loop:
-		DECREMENT r_bit_num
-
-		// Clocks HIGH
-		PREP_GPIO_ADDRS_FOR_SET()
-		PREP_GPIO_MASK_NAMED(odd)
-		GPIO_APPLY_MASK_TO_ADDR()
-	
-		// raise data
-	        PREP_GPIO_ADDRS_FOR_SET()
-        	PREP_GPIO_MASK_NAMED(even)
-	        GPIO_APPLY_MASK_TO_ADDR()
-		
-		// Clocks LOW
-		PREP_GPIO_ADDRS_FOR_CLEAR()
-		PREP_GPIO_MASK_NAMED(odd)
-		GPIO_APPLY_MASK_TO_ADDR()
-
-		QBNE l_end_bit_loop, r_bit_num, #0
-	
-	PREP_GPIO_ADDRS_FOR_CLEAR()
-	PREP_GPIO_MASK_NAMED(all)
-	GPIO_APPLY_MASK_TO_ADDR()
-
-
+	// Work out which pins to drive this frame; strip n has its data on channel 2n and its clock on channel 2n+1,
+	// and strips that aren't active get neither
+	LOAD_ACTIVE_STRIPS(12)
+
+	RESET_GPIO_MASKS()
+	TEST_CHANNEL_ACTIVE(0, 0, even)
+	TEST_CHANNEL_ACTIVE(1, 2, even)
+	TEST_CHANNEL_ACTIVE(2, 4, even)
+	TEST_CHANNEL_ACTIVE(3, 6, even)
+	TEST_CHANNEL_ACTIVE(4, 8, even)
+	TEST_CHANNEL_ACTIVE(5, 10, even)
+	TEST_CHANNEL_ACTIVE(6, 12, even)
+	TEST_CHANNEL_ACTIVE(7, 14, even)
+	TEST_CHANNEL_ACTIVE(8, 16, even)
+	TEST_CHANNEL_ACTIVE(9, 18, even)
+	TEST_CHANNEL_ACTIVE(10, 20, even)
+	TEST_CHANNEL_ACTIVE(11, 22, even)
+	STORE_GPIO_MASK_ACTIVE(even)
+
+	RESET_GPIO_MASKS()
+	TEST_CHANNEL_ACTIVE(0, 1, odd)
+	TEST_CHANNEL_ACTIVE(1, 3, odd)
+	TEST_CHANNEL_ACTIVE(2, 5, odd)
+	TEST_CHANNEL_ACTIVE(3, 7, odd)
+	TEST_CHANNEL_ACTIVE(4, 9, odd)
+	TEST_CHANNEL_ACTIVE(5, 11, odd)
+	TEST_CHANNEL_ACTIVE(6, 13, odd)
+	TEST_CHANNEL_ACTIVE(7, 15, odd)
+	TEST_CHANNEL_ACTIVE(8, 17, odd)
+	TEST_CHANNEL_ACTIVE(9, 19, odd)
+	TEST_CHANNEL_ACTIVE(10, 21, odd)
+	TEST_CHANNEL_ACTIVE(11, 23, odd)
+	STORE_GPIO_MASK_ACTIVE(odd)
+
+	LBCO r_data0, CONST_PRUDRAM, ACTIVE_MASK_OFFSET_even, 16
+	OR r_gpio0_mask, r_gpio0_mask, r_data0
+	OR r_gpio1_mask, r_gpio1_mask, r_data1
+	OR r_gpio2_mask, r_gpio2_mask, r_data2
+	OR r_gpio3_mask, r_gpio3_mask, r_data3
+	STORE_GPIO_MASK_ACTIVE(all)
+
+	// Nothing to clock out on this PRU; answer straight away
+	QBEQ FRAME_SKIPPED, r_data_len, #0
+	QBEQ_GPIO_MASK_EMPTY(FRAME_SKIPPED)
+
+	// Frames that clock out every strip load the pin masks as immediates, which is quicker than from data RAM
+	QBNE_GPIO_MASK_NAMED(l_masked_frame_jump, all)
+	QBA l_unmasked_frame
+
+	// The masked frame loop is at the end of the program, too far away for a QBNE
+l_masked_frame_jump:
+	QBA l_masked_frame
+
+l_unmasked_frame:
+#define FRAME_MASKED 0
+#include "apa102-frame.p.h"
+
+l_frame_done:
 	// Write out that we are done!
 	// Store a non-zero response in the buffer so that they know that we are done
 	// aso a quick hack, we write the counter so that we know how
@@ -244,6 +147,12 @@ l_end_frame:
 	// Go back to waiting for the next frame buffer
 	QBA _LOOP
 
+FRAME_SKIPPED:
+	// Store a non-zero response without clocking anything out
+	MOV r2, #0x1
+	SBCO r2, CONST_PRUDRAM, 12, 4
+	QBA _LOOP
+
 EXIT:
 	// Write a 0xFF into the response field so that they know we're done
 	MOV r2, #0xFF
@@ -253,3 +162,8 @@ EXIT:
 
 	HALT
 
+l_masked_frame:
+#undef FRAME_MASKED
+#define FRAME_MASKED 1
+#include "apa102-frame.p.h"
+	QBA l_frame_done
@@ -55,6 +55,10 @@
 
 #define r_temp2 r28
 
+#define r_active_strips r12
+
+#define r_unpacked_addr r29
+
 // ***************************************
 // *      Global Macro definitions       *
 // ***************************************
@@ -314,6 +318,12 @@ lab:
                          MOV r_gpio2_ones, 0; \
                          MOV r_gpio3_ones, 0;
 
+/**
+ * Appended to the labels of the bit test macros below, so that a template can expand its bit loop more than once by
+ * redefining it between the copies
+ */
+#define BIT_LABEL_SUFFIX
+
 /**
  * Checks if the bit indexed by the r_bit_num register in the regN register is a zero, and if so, sets the bit in the
  * corresponding _zeros register. CHANNEL_BANK_NAME and CHANNEL_BIT are used to lookup the bank and bit num.
@@ -321,9 +331,9 @@ lab:
  * @param regN The data register to check. Generally one of the r_dataN registers.
  * @param channelIndex Which channel this check is for. Used to determine GPIO bank and bit.
  */
-#define TEST_BIT_ZERO(regN,channelIndex) QBBS CONCAT3(channel_,channelIndex,_zero_skip), regN, r_bit_num; \
+#define TEST_BIT_ZERO(regN,channelIndex) QBBS CONCAT4(channel_,channelIndex,_zero_skip,BIT_LABEL_SUFFIX), regN, r_bit_num; \
                                         SET CONCAT3(r_,CHANNEL_BANK_NAME(channelIndex),_zeros), CONCAT3(r_,CHANNEL_BANK_NAME(channelIndex),_zeros), CHANNEL_BIT(channelIndex); \
-                                        CONCAT3(channel_,channelIndex,_zero_skip): ;
+                                        CONCAT4(channel_,channelIndex,_zero_skip,BIT_LABEL_SUFFIX): ;
 
 /**
  * Checks if the bit indexed by the r_bit_num register in the regN register is a one, and if so, sets the bit in the
@@ -332,9 +342,9 @@ lab:
  * @param regN The data register to check. Generally one of the r_dataN registers.
  * @param channelIndex Which channel this check is for. Used to determine GPIO bank and bit.
  */
-#define TEST_BIT_ONE(regN,channelIndex) QBBC CONCAT3(channel_,channelIndex,_one_skip), regN, r_bit_num; \
+#define TEST_BIT_ONE(regN,channelIndex) QBBC CONCAT4(channel_,channelIndex,_one_skip,BIT_LABEL_SUFFIX), regN, r_bit_num; \
                                         SET CONCAT3(r_,CHANNEL_BANK_NAME(channelIndex),_ones), CONCAT3(r_,CHANNEL_BANK_NAME(channelIndex),_ones), CHANNEL_BIT(channelIndex); \
-                                        CONCAT3(channel_,channelIndex,_one_skip): ;
+                                        CONCAT4(channel_,channelIndex,_one_skip,BIT_LABEL_SUFFIX): ;
 
 /**
  * Loads more LED channel data into the r_dataN registers.
@@ -344,10 +354,142 @@ lab:
  */
 #define LOAD_CHANNEL_DATA(channelsPerPru, firstChannel,channelCount) LBBO r_data0, r_data_addr, PRU_NUM*channelsPerPru*4+firstChannel*4, channelCount*4
 
+/**
+ * Like LOAD_CHANNEL_DATA, for templates that read packed frames: the channel data comes from the buffer at
+ * r_unpacked_addr in PRU DRAM, where UNPACK_CHANNEL_DATA left it one word per channel.
+ *
+ * @param firstChannel The first channel index to load data for. Data for this channel will be loaded into r_data0
+ * @param channelCount The number of channels to load data for. Must be <= 16
+ */
+#define LOAD_CHANNEL_DATA_PACKED(firstChannel,channelCount) LBBO r_data0, r_unpacked_addr, firstChannel*4, channelCount*4
+
+/**
+ * Unpacks one channel of a row of a packed frame from DDR into its word of an unpacked buffer. The channel is
+ * channelsPerPru-1-r_bit_num, so a loop over the bits of a pixel unpacks every channel of a row one at a time, and each
+ * DDR read is short enough to hide in the wait of a bit. The fourth byte of the word is left as garbage.
+ * Clobbers r_temp1, r_temp2 and r_temp_addr.
+ *
+ * @param channelsPerPru The number of channels each PRU clocks out
+ * @param rowOffset Offset of the row from r_data_addr: 0 for the current pixel, PACKED_ROW_SIZE for the next one
+ * @param bufferToggle 0 to unpack into the buffer at r_unpacked_addr, UNPACKED_BUFFER_SIZE for the other one
+ */
+#define UNPACK_CHANNEL_DATA(channelsPerPru,rowOffset,bufferToggle) RSB r_temp1, r_bit_num, channelsPerPru-1; \
+                                        LSL r_temp_addr, r_temp1, 1; \
+                                        ADD r_temp_addr, r_temp_addr, r_temp1; \
+                                        ADD r_temp_addr, r_temp_addr, r_data_addr; \
+                                        LBBO r_temp2, r_temp_addr, rowOffset+PRU_NUM*channelsPerPru*PACKED_PIXEL_SIZE, PACKED_PIXEL_SIZE; \
+                                        LSL r_temp1, r_temp1, 2; \
+                                        ADD r_temp1, r_temp1, r_unpacked_addr; \
+                                        XOR r_temp1, r_temp1, bufferToggle; \
+                                        SBBO r_temp2, r_temp1, 0, 4
+
+/**
+ * For templates that read bit-plane frames: loads the masks of the pins to lower early for the next bit, those of the
+ * strips sending a 0, straight into the r_gpioN_zeros registers, and moves r_data_addr on to the next bit.
+ */
+#define LOAD_BIT_PLANE()                LBBO r_gpio0_zeros, r_data_addr, PRU_NUM*16, 16; \
+                                        ADD r_data_addr, r_data_addr, BITPLANE_PLANE_SIZE
+
+/**
+ * Reports the GPIO pin a channel drives to the ARM, as (bank << 5) | bit in the byte for the channel at
+ * CHANNEL_MAP_OFFSET, so that it can build bit-plane frames for this mapping. Clobbers r_temp1.
+ *
+ * @param channelIndex The channel to report
+ */
+#define STORE_CHANNEL_MAP_ENTRY(channelIndex) MOV r_temp1, (CHANNEL_INFO(channelIndex, bank) << 5) | CHANNEL_BIT(channelIndex); \
+                                        SBCO r_temp1, CONST_PRUDRAM, CHANNEL_MAP_OFFSET + channelIndex, 1
+
+/**
+ * Loads the active strip mask from the command block into r_active_strips, shifted so that bit n is this PRU's nth
+ * strip. The mask covers all of the strips in the frame; each PRU takes the stripsPerPru bits starting at its own.
+ * Clobbers r_data0 and r_data1.
+ *
+ * @param stripsPerPru The number of strips each PRU clocks out
+ */
+#define LOAD_ACTIVE_STRIPS(stripsPerPru) LBCO r_data0, CONST_PRUDRAM, CMD_ACTIVE_STRIPS_OFFSET, 8; \
+                                        LSR r_data0, r_data0, PRU_NUM*stripsPerPru; \
+                                        LSL r_data1, r_data1, 31-PRU_NUM*stripsPerPru; \
+                                        LSL r_data1, r_data1, 1; \
+                                        OR r_active_strips, r_data0, r_data1;
+
+/**
+ * Zeros the GPIO mask registers so that a set of active pins can be built up in them
+ */
+#define RESET_GPIO_MASKS() MOV r_gpio0_mask, 0; \
+                         MOV r_gpio1_mask, 0; \
+                         MOV r_gpio2_mask, 0; \
+                         MOV r_gpio3_mask, 0;
+
+/**
+ * Checks if the strip driven by a channel is set in r_active_strips, and if so, sets the channel's bit in the
+ * corresponding _mask register.
+ *
+ * @param stripIndex The strip, relative to this PRU, that the channel drives
+ * @param channelIndex The channel to check. Used to determine GPIO bank and bit.
+ * @param maskName Name of the mask being built; used to keep the labels unique
+ */
+#define TEST_CHANNEL_ACTIVE(stripIndex,channelIndex,maskName) QBBC CONCAT4(channel_,channelIndex,_inactive_,maskName), r_active_strips, stripIndex; \
+                                        SET CONCAT3(r_,CHANNEL_BANK_NAME(channelIndex),_mask), CONCAT3(r_,CHANNEL_BANK_NAME(channelIndex),_mask), CHANNEL_BIT(channelIndex); \
+                                        CONCAT4(channel_,channelIndex,_inactive_,maskName): ;
+
+/**
+ * Saves the GPIO mask registers as the active pins for maskName, for PREP_GPIO_MASK_ACTIVE to load back
+ */
+#define STORE_GPIO_MASK_ACTIVE(maskName) SBCO r_gpio0_mask, CONST_PRUDRAM, CONCAT2(ACTIVE_MASK_OFFSET_,maskName), 16
+
+/**
+ * Like PREP_GPIO_MASK_NAMED, but only for the pins of this frame's active strips
+ */
+#define PREP_GPIO_MASK_ACTIVE(maskName) LBCO r_gpio0_mask, CONST_PRUDRAM, CONCAT2(ACTIVE_MASK_OFFSET_,maskName), 16
+
+/**
+ * Jumps to a label if none of the pins in the GPIO mask registers are set. Clobbers r_temp1.
+ */
+#define QBEQ_GPIO_MASK_EMPTY(label)     OR r_temp1, r_gpio0_mask, r_gpio1_mask; \
+                                        OR r_temp1, r_temp1, r_gpio2_mask; \
+                                        OR r_temp1, r_temp1, r_gpio3_mask; \
+                                        QBEQ label, r_temp1, 0
+
+/**
+ * Jumps to a label unless the GPIO mask registers hold all of the pins of maskName, i.e. unless every strip is active.
+ * Templates use it to send full frames with the masks as immediates, as fast as if there were no active strip mask.
+ * Clobbers r_temp1.
+ */
+#define QBNE_GPIO_MASK_NAMED(label,maskName) MOV r_temp1, GPIO_MASK(0, maskName); \
+                                        QBNE label, r_gpio0_mask, r_temp1; \
+                                        MOV r_temp1, GPIO_MASK(1, maskName); \
+                                        QBNE label, r_gpio1_mask, r_temp1; \
+                                        MOV r_temp1, GPIO_MASK(2, maskName); \
+                                        QBNE label, r_gpio2_mask, r_temp1; \
+                                        MOV r_temp1, GPIO_MASK(3, maskName); \
+                                        QBNE label, r_gpio3_mask, r_temp1
+
 // ***************************************
 // *    Global Structure Definitions     *
 // ***************************************
 
+/** Offsets into the command block; see ws281x_command_t in ledscape.c */
+#define CMD_ACTIVE_STRIPS_OFFSET 16
+
+/** The GPIO masks of the active strips are worked out at the start of each frame and kept after the command block */
+#define ACTIVE_MASK_OFFSET_all 24
+#define ACTIVE_MASK_OFFSET_even 40
+#define ACTIVE_MASK_OFFSET_odd 56
+
+/** Packed frames leave out the unused fourth byte of each pixel, so a row is 3 bytes for each of the 48 strips */
+#define PACKED_PIXEL_SIZE 3
+#define PACKED_ROW_SIZE (48 * PACKED_PIXEL_SIZE)
+
+/** Templates that read packed frames unpack the rows into two buffers of channel words, after the active masks */
+#define UNPACKED_DATA_OFFSET 0x100
+#define UNPACKED_BUFFER_SIZE 0x80
+
+/** Bit-plane frames hold, for each bit of a pixel in the order they are sent, four GPIO bank masks for each PRU */
+#define BITPLANE_PLANE_SIZE (2 * 16)
+
+/** Templates that read bit-plane frames report the pin of each channel here; see ledscape_frame_format_t */
+#define CHANNEL_MAP_OFFSET 0xC0
+
 /** Mappings of the GPIO devices */
 #define GPIO0 0x44E07000
 #define GPIO1 0x4804c000
@@ -0,0 +1,109 @@
+// The frame loop of the WS281x template, expanded twice: with FRAME_MASKED set to 0 for frames that drive every strip,
+// with the pin masks as immediates, and set to 1 for frames that leave some strips out, with the masks worked out at
+// the start of the frame. Falls through once the frame has been clocked out.
+
+#if FRAME_MASKED
+	#define FRAME_LABEL(name) CONCAT2(name,_masked)
+	#define FRAME_BIT_LABEL_SUFFIX _masked
+	#define FRAME_PREP_GPIO_MASK(maskName) PREP_GPIO_MASK_ACTIVE(maskName)
+#else
+	#define FRAME_LABEL(name) name
+	#define FRAME_BIT_LABEL_SUFFIX
+	#define FRAME_PREP_GPIO_MASK(maskName) PREP_GPIO_MASK_NAMED(maskName)
+#endif
+
+#undef BIT_LABEL_SUFFIX
+#define BIT_LABEL_SUFFIX FRAME_BIT_LABEL_SUFFIX
+
+	// Reset the sleep timer
+	RESET_COUNTER
+
+FRAME_LABEL(l_word_loop):
+	// for bit in 24 to 0
+	MOV r_bit_num, 24
+
+	FRAME_LABEL(l_bit_loop):
+		DECREMENT r_bit_num
+
+		// Load 16 registers of data, starting at r10
+		LOAD_CHANNEL_DATA(24, 0, 16)
+
+		// Zero out the registers
+		RESET_GPIO_ZEROS()
+
+		TEST_BIT_ZERO(r_data0,  0)
+		TEST_BIT_ZERO(r_data1,  1)
+		TEST_BIT_ZERO(r_data2,  2)
+		TEST_BIT_ZERO(r_data3,  3)
+		TEST_BIT_ZERO(r_data4,  4)
+		TEST_BIT_ZERO(r_data5,  5)
+		TEST_BIT_ZERO(r_data6,  6)
+		TEST_BIT_ZERO(r_data7,  7)
+
+		TEST_BIT_ZERO(r_data8,  8)
+		TEST_BIT_ZERO(r_data9,  9)
+		TEST_BIT_ZERO(r_data10, 10)
+		TEST_BIT_ZERO(r_data11, 11)
+		TEST_BIT_ZERO(r_data12, 12)
+		TEST_BIT_ZERO(r_data13, 13)
+
+		TEST_BIT_ZERO(r_data14, 14)
+		TEST_BIT_ZERO(r_data15, 15)
+
+		// Load 8 more registers of data
+		LOAD_CHANNEL_DATA(24, 16, 8)
+		// Data loaded
+
+		// Load the address(es) of the GPIO devices
+		FRAME_PREP_GPIO_MASK(all)
+
+		// Clear lines from last bit
+		PREP_GPIO_ADDRS_FOR_CLEAR()
+
+		WAITNS 900, FRAME_LABEL(wait_one_time)
+		CHECK_TIMEOUT
+		GPIO_APPLY_MASK_TO_ADDR()
+
+		PREP_GPIO_ADDRS_FOR_SET()
+
+		// Wait until the end of the frame (including the time it takes to reset the counter)
+		WAITNS 1150, FRAME_LABEL(wait_frame_spacing_time)
+		CHECK_TIMEOUT
+		RESET_COUNTER
+
+		// Send all the start bits
+		GPIO_APPLY_MASK_TO_ADDR()
+
+		// Prepare to lower the zero bit lines
+		PREP_GPIO_ADDRS_FOR_CLEAR()
+
+		// Test some more bits to pass the time
+		TEST_BIT_ZERO(r_data0, 16)
+		TEST_BIT_ZERO(r_data1, 17)
+		TEST_BIT_ZERO(r_data2, 18)
+		TEST_BIT_ZERO(r_data3, 19)
+		TEST_BIT_ZERO(r_data4, 20)
+		TEST_BIT_ZERO(r_data5, 21)
+		TEST_BIT_ZERO(r_data6, 22)
+		TEST_BIT_ZERO(r_data7, 23)
+
+		WAITNS 240, FRAME_LABEL(wait_zero_time)
+		CHECK_TIMEOUT
+
+		// Lower the zero bit lines
+		GPIO_APPLY_ZEROS_TO_ADDR()
+
+		// The one bits are lowered in the next iteration of the loop
+		QBNE FRAME_LABEL(l_bit_loop), r_bit_num, 0
+
+	// The RGB streams have been clocked out
+	// Move to the next pixel on each row
+	ADD r_data_addr, r_data_addr, 48 * 4
+	DECREMENT r_data_len
+	QBNE FRAME_LABEL(l_word_loop), r_data_len, #0
+
+#undef FRAME_LABEL
+#undef FRAME_PREP_GPIO_MASK
+#undef FRAME_BIT_LABEL_SUFFIX
+#undef BIT_LABEL_SUFFIX
+#define BIT_LABEL_SUFFIX
@@ -0,0 +1,278 @@
+// WS281x Signal Generation PRU Program Template, for packed frames
+//
+// Drives up to 24 strips using a single PRU. LEDscape (in userspace) writes rendered frames into shared DDR memory
+// and sets a flag to indicate how many pixels are to be written.  The PRU then bit bangs the signal out the
+// 24 GPIO pins and sets a "complete" flag.
+//
+// Only the strips set in the command's active strip mask are driven; the others are left idle and keep showing
+// the last frame they were sent. If none of this PRU's strips are active the frame is answered without waiting.
+//
+// To stop, the ARM can write a 0xFF to the command, which will cause the PRU code to exit.
+//
+// At 800 KHz the ws281x signal is:
+//  ____
+// |  | |______|
+// 0  250 600  1250 offset
+//    250 350   650 delta
+//
+// Unlike ws281x.p, each pixel is stored in 3 bytes in the order GRB, with no unused 4th byte, so a row of the frame is
+// 144 bytes rather than 192. The channels are not word aligned, so each row is unpacked into a buffer of one word per
+// channel in PRU DRAM, where the bits can be tested as usual. While a pixel is clocked out, one channel of the next
+// pixel is unpacked into the other buffer after each bit, so DDR is only read once for each byte of the frame instead
+// of once per bit.
+//
+// unpack pixel 0
+// while len > 0:
+//    for bit# = 23 down to 0:
+//        write out bits
+//        unpack channel 23-bit# of the next pixel
+//    increment address by 144
+//    swap buffers
+//
+
+//
+//
+
+// Mapping lookup
+
+.origin 0
+.entrypoint START
+
+#include "common.p.h"
+
+#define CHECK_TIMEOUT WAIT_TIMEOUT 3000, FRAME_DONE
+
+START:
+	// Enable OCP master port
+	// clear the STANDBY_INIT bit in the SYSCFG register,
+	// otherwise the PRU will not be able to write outside the
+	// PRU memory space and to the BeagleBon's pins.
+	LBCO	r0, C4, 4, 4
+	CLR		r0, r0, 4
+	SBCO	r0, C4, 4, 4
+
+	// Configure the programmable pointer register for PRU0 by setting
+	// c28_pointer[15:0] field to 0x0120.  This will make C28 point to
+	// 0x00012000 (PRU shared RAM).
+	MOV		r0, 0x00000120
+	MOV		r1, CTPPR_0
+	ST32	r0, r1
+
+	// Configure the programmable pointer register for PRU0 by setting
+	// c31_pointer[15:0] field to 0x0010.  This will make C31 point to
+	// 0x80001000 (DDR memory).
+	MOV		r0, 0x00100000
+	MOV		r1, CTPPR_1
+	ST32	r0, r1
+
+	// Write a 0x1 into the response field so that they know we have started
+	MOV r2, #0x1
+	SBCO r2, CONST_PRUDRAM, 12, 4
+
+
+	MOV r20, 0xFFFFFFFF
+
+	// Wait for the start condition from the main program to indicate
+	// that we have a rendered frame ready to clock out.  This also
+	// handles the exit case if an invalid value is written to the start
+	// start position.
+_LOOP:
+	// Let ledscape know that we're starting the loop again. It waits for this
+	// interrupt before sending another frame
+	RAISE_ARM_INTERRUPT
+
+	// Load the pointer to the buffer from PRU DRAM into r0 and the
+	// length (in bytes-bit words) into r1.
+	// start command into r2
+	LBCO      r_data_addr, CONST_PRUDRAM, 0, 12
+
+	// Wait for a non-zero command
+	QBEQ _LOOP, r2, #0
+
+	// Zero out the start command so that they know we have received it
+	// This allows maximum speed frame drawing since they know that they
+	// can now swap the frame buffer pointer and write a new start command.
+	MOV r3, 0
+	SBCO r3, CONST_PRUDRAM, 8, 4
+
+	// Command of 0xFF is the signal to exit
+	QBEQ EXIT, r2, #0xFF
+
+	// Work out which pins to drive this frame; strips that aren't active are left idle
+	LOAD_ACTIVE_STRIPS(24)
+	RESET_GPIO_MASKS()
+
+	TEST_CHANNEL_ACTIVE(0, 0, all)
+	TEST_CHANNEL_ACTIVE(1, 1, all)
+	TEST_CHANNEL_ACTIVE(2, 2, all)
+	TEST_CHANNEL_ACTIVE(3, 3, all)
+	TEST_CHANNEL_ACTIVE(4, 4, all)
+	TEST_CHANNEL_ACTIVE(5, 5, all)
+	TEST_CHANNEL_ACTIVE(6, 6, all)
+	TEST_CHANNEL_ACTIVE(7, 7, all)
+	TEST_CHANNEL_ACTIVE(8, 8, all)
+	TEST_CHANNEL_ACTIVE(9, 9, all)
+	TEST_CHANNEL_ACTIVE(10, 10, all)
+	TEST_CHANNEL_ACTIVE(11, 11, all)
+	TEST_CHANNEL_ACTIVE(12, 12, all)
+	TEST_CHANNEL_ACTIVE(13, 13, all)
+	TEST_CHANNEL_ACTIVE(14, 14, all)
+	TEST_CHANNEL_ACTIVE(15, 15, all)
+	TEST_CHANNEL_ACTIVE(16, 16, all)
+	TEST_CHANNEL_ACTIVE(17, 17, all)
+	TEST_CHANNEL_ACTIVE(18, 18, all)
+	TEST_CHANNEL_ACTIVE(19, 19, all)
+	TEST_CHANNEL_ACTIVE(20, 20, all)
+	TEST_CHANNEL_ACTIVE(21, 21, all)
+	TEST_CHANNEL_ACTIVE(22, 22, all)
+	TEST_CHANNEL_ACTIVE(23, 23, all)
+
+	STORE_GPIO_MASK_ACTIVE(all)
+
+	// Nothing to clock out on this PRU; answer straight away
+	QBEQ FRAME_SKIPPED, r_data_len, #0
+	QBEQ_GPIO_MASK_EMPTY(FRAME_SKIPPED)
+
+	// Unpack the first pixel; the rest are unpacked while the pixel before them is clocked out
+	MOV r_unpacked_addr, UNPACKED_DATA_OFFSET
+	MOV r_bit_num, 24
+
+l_unpack_first_pixel:
+	DECREMENT r_bit_num
+	UNPACK_CHANNEL_DATA(24, 0, 0)
+	QBNE l_unpack_first_pixel, r_bit_num, 0
+
+	// Reset the sleep timer
+	RESET_COUNTER
+
+l_word_loop:
+	// for bit in 24 to 0
+	MOV r_bit_num, 24
+
+	// Each bit does the same work in the same three slots as the others, and every pin change follows a WAITNS, so
+	// every bit has the same timing whatever the data (the bit tests only vary in how long they leave to wait):
+	//  - after the ones of the previous bit are lowered: unpack a channel of the next pixel, then wait out the bit
+	//  - after the start bits are raised: test channels 12-23, then lower the zeros
+	//  - after the zeros are lowered: test channels 0-11 of the next bit, then lower the ones
+	l_bit_loop:
+		DECREMENT r_bit_num
+
+		// Load 12 registers of data, starting at r10; the GPIO addresses are still those for clearing
+		LOAD_CHANNEL_DATA_PACKED(0, 12)
+
+		// Zero out the registers
+		RESET_GPIO_ZEROS()
+
+		TEST_BIT_ZERO(r_data0,  0)
+		TEST_BIT_ZERO(r_data1,  1)
+		TEST_BIT_ZERO(r_data2,  2)
+		TEST_BIT_ZERO(r_data3,  3)
+		TEST_BIT_ZERO(r_data4,  4)
+		TEST_BIT_ZERO(r_data5,  5)
+		TEST_BIT_ZERO(r_data6,  6)
+		TEST_BIT_ZERO(r_data7,  7)
+		TEST_BIT_ZERO(r_data8,  8)
+		TEST_BIT_ZERO(r_data9,  9)
+		TEST_BIT_ZERO(r_data10, 10)
+		TEST_BIT_ZERO(r_data11, 11)
+
+		// The data overwrote the masks of the first two banks
+		PREP_GPIO_MASK_ACTIVE(all)
+
+		// Clear lines from last bit
+		WAITNS 780, wait_one_time
+		CHECK_TIMEOUT
+		GPIO_APPLY_MASK_TO_ADDR()
+
+		PREP_GPIO_ADDRS_FOR_SET()
+
+		// Unpack a channel of the next pixel while the lines are low. The last pixel has no next one, so it unpacks its
+		// own row again, into the buffer that is no longer needed, to take as long as any other.
+		QBEQ l_unpack_last_pixel, r_data_len, 1
+		UNPACK_CHANNEL_DATA(24, PACKED_ROW_SIZE, UNPACKED_BUFFER_SIZE)
+		QBA l_next_pixel_unpacked
+	l_unpack_last_pixel:
+		UNPACK_CHANNEL_DATA(24, 0, UNPACKED_BUFFER_SIZE)
+		NOP
+	l_next_pixel_unpacked:
+
+		// Wait until the end of the frame (including the time it takes to reset the counter)
+		WAITNS 1230, wait_frame_spacing_time
+		CHECK_TIMEOUT
+		RESET_COUNTER
+
+		// Send all the start bits
+		GPIO_APPLY_MASK_TO_ADDR()
+
+		// Prepare to lower the zero bit lines
+		PREP_GPIO_ADDRS_FOR_CLEAR()
+
+		// Load and test the rest of the channels
+		LOAD_CHANNEL_DATA_PACKED(12, 12)
+
+		TEST_BIT_ZERO(r_data0, 12)
+		TEST_BIT_ZERO(r_data1, 13)
+		TEST_BIT_ZERO(r_data2, 14)
+		TEST_BIT_ZERO(r_data3, 15)
+		TEST_BIT_ZERO(r_data4, 16)
+		TEST_BIT_ZERO(r_data5, 17)
+		TEST_BIT_ZERO(r_data6, 18)
+		TEST_BIT_ZERO(r_data7, 19)
+		TEST_BIT_ZERO(r_data8, 20)
+		TEST_BIT_ZERO(r_data9, 21)
+		TEST_BIT_ZERO(r_data10, 22)
+		TEST_BIT_ZERO(r_data11, 23)
+
+		WAITNS 440, wait_zero_time
+		CHECK_TIMEOUT
+
+		// Lower the zero bit lines
+		GPIO_APPLY_ZEROS_TO_ADDR()
+
+		// The one bits are lowered in the next iteration of the loop
+		QBNE l_bit_loop, r_bit_num, 0
+
+	// The RGB streams have been clocked out
+	// Move to the next pixel on each row, which has been unpacked into the other buffer
+	ADD r_data_addr, r_data_addr, PACKED_ROW_SIZE
+	XOR r_unpacked_addr, r_unpacked_addr, UNPACKED_BUFFER_SIZE
+	DECREMENT r_data_len
+	QBNE l_word_loop, r_data_len, #0
+
+FRAME_DONE:
+	// Final clear for the word
+	PREP_GPIO_MASK_NAMED(all)
+	PREP_GPIO_ADDRS_FOR_CLEAR()
+
+	WAITNS 780, end_of_frame_clear_wait
+	GPIO_APPLY_MASK_TO_ADDR()
+
+	// Delay at least 300 usec; this is the required reset
+	// time for the LED strip to update with the new pixels.
+	SLEEPNS 300000, 1, reset_time
+
+	// Write out that we are done!
+	// Store a non-zero response in the buffer so that they know that we are done
+	// aso a quick hack, we write the counter so that we know how
+	// long it took to write out.
+	MOV r8, PRU_CONTROL_ADDRESS // control register
+	LBBO r2, r8, 0xC, 4
+	SBCO r2, CONST_PRUDRAM, 12, 4
+
+	// Go back to waiting for the next frame buffer
+	QBA _LOOP
+
+FRAME_SKIPPED:
+	// Nothing was clocked out, so there is no reset time to wait for either
+	MOV r2, #0x1
+	SBCO r2, CONST_PRUDRAM, 12, 4
+	QBA _LOOP
+
+EXIT:
+	// Write a 0xFF into the response field so that they know we're done
+	MOV r2, #0xFF
+	SBCO r2, CONST_PRUDRAM, 12, 4
+
+	RAISE_ARM_INTERRUPT
+
+	HALT
@@ -4,6 +4,9 @@
 // and sets a flag to indicate how many pixels are to be written.  The PRU then bit bangs the signal out the
 // 24 GPIO pins and sets a "complete" flag.
 //
+// Only the strips set in the command's active strip mask are driven; the others are left idle and keep showing
+// the last frame they were sent. If none of this PRU's strips are active the frame is answered without waiting.
+//
 // To stop, the ARM can write a 0xFF to the command, which will cause the PRU code to exit.
 //
 // At 800 KHz the ws281x signal is:
@@ -79,9 +82,6 @@ _LOOP:
 	// Wait for a non-zero command
 	QBEQ _LOOP, r2, #0
 
-	// Reset the sleep timer
-	RESET_COUNTER
-
 	// Zero out the start command so that they know we have received it
 	// This allows maximum speed frame drawing since they know that they
 	// can now swap the frame buffer pointer and write a new start command.
@@ -91,89 +91,52 @@ _LOOP:
 	// Command of 0xFF is the signal to exit
 	QBEQ EXIT, r2, #0xFF
 
-l_word_loop:
-	// for bit in 24 to 0
-	MOV r_bit_num, 24
-
-	l_bit_loop:
-		DECREMENT r_bit_num
-
-		// Load 16 registers of data, starting at r10
-		LOAD_CHANNEL_DATA(24, 0, 16)
-
-		// Zero out the registers
-		RESET_GPIO_ZEROS()
-
-		TEST_BIT_ZERO(r_data0,  0)
-		TEST_BIT_ZERO(r_data1,  1)
-		TEST_BIT_ZERO(r_data2,  2)
-		TEST_BIT_ZERO(r_data3,  3)
-		TEST_BIT_ZERO(r_data4,  4)
-		TEST_BIT_ZERO(r_data5,  5)
-		TEST_BIT_ZERO(r_data6,  6)
-		TEST_BIT_ZERO(r_data7,  7)
-
-		TEST_BIT_ZERO(r_data8,  8)
-		TEST_BIT_ZERO(r_data9,  9)
-		TEST_BIT_ZERO(r_data10, 10)
-		TEST_BIT_ZERO(r_data11, 11)
-		TEST_BIT_ZERO(r_data12, 12)
-		TEST_BIT_ZERO(r_data13, 13)
-
-		TEST_BIT_ZERO(r_data14, 14)
-		TEST_BIT_ZERO(r_data15, 15)
-
-		// Load 8 more registers of data
-		LOAD_CHANNEL_DATA(24, 16, 8)
-		// Data loaded
-
-		// Load the address(es) of the GPIO devices
-		PREP_GPIO_MASK_NAMED(all)
-
-		// Clear lines from last bit
-		PREP_GPIO_ADDRS_FOR_CLEAR()
-
-		WAITNS 900, wait_one_time
-		CHECK_TIMEOUT
-		GPIO_APPLY_MASK_TO_ADDR()
-
-		PREP_GPIO_ADDRS_FOR_SET()
-
-		// Wait until the end of the frame (including the time it takes to reset the counter)
-		WAITNS 1150, wait_frame_spacing_time
-		CHECK_TIMEOUT
-		RESET_COUNTER
-
-		// Send all the start bits
-		GPIO_APPLY_MASK_TO_ADDR()
-
-		// Prepare to lower the zero bit lines
-		PREP_GPIO_ADDRS_FOR_CLEAR()
-
-		// Test some more bits to pass the time
-		TEST_BIT_ZERO(r_data0, 16)
-		TEST_BIT_ZERO(r_data1, 17)
-		TEST_BIT_ZERO(r_data2, 18)
-		TEST_BIT_ZERO(r_data3, 19)
-		TEST_BIT_ZERO(r_data4, 20)
-		TEST_BIT_ZERO(r_data5, 21)
-		TEST_BIT_ZERO(r_data6, 22)
-		TEST_BIT_ZERO(r_data7, 23)
-
-		WAITNS 240, wait_zero_time
-		CHECK_TIMEOUT
-
-		// Lower the zero bit lines
-		GPIO_APPLY_ZEROS_TO_ADDR()
-
-		// The one bits are lowered in the next iteration of the loop
-		QBNE l_bit_loop, r_bit_num, 0
-
-	// The RGB streams have been clocked out
-	// Move to the next pixel on each row
-	ADD r_data_addr, r_data_addr, 48 * 4
-	DECREMENT r_data_len
-	QBNE l_word_loop, r_data_len, #0
+	// Work out which pins to drive this frame; strips that aren't active are left idle
+	LOAD_ACTIVE_STRIPS(24)
+	RESET_GPIO_MASKS()
+
+	TEST_CHANNEL_ACTIVE(0, 0, all)
+	TEST_CHANNEL_ACTIVE(1, 1, all)
+	TEST_CHANNEL_ACTIVE(2, 2, all)
+	TEST_CHANNEL_ACTIVE(3, 3, all)
+	TEST_CHANNEL_ACTIVE(4, 4, all)
+	TEST_CHANNEL_ACTIVE(5, 5, all)
+	TEST_CHANNEL_ACTIVE(6, 6, all)
+	TEST_CHANNEL_ACTIVE(7, 7, all)
+	TEST_CHANNEL_ACTIVE(8, 8, all)
+	TEST_CHANNEL_ACTIVE(9, 9, all)
+	TEST_CHANNEL_ACTIVE(10, 10, all)
+	TEST_CHANNEL_ACTIVE(11, 11, all)
+	TEST_CHANNEL_ACTIVE(12, 12, all)
+	TEST_CHANNEL_ACTIVE(13, 13, all)
+	TEST_CHANNEL_ACTIVE(14, 14, all)
+	TEST_CHANNEL_ACTIVE(15, 15, all)
+	TEST_CHANNEL_ACTIVE(16, 16, all)
+	TEST_CHANNEL_ACTIVE(17, 17, all)
+	TEST_CHANNEL_ACTIVE(18, 18, all)
+	TEST_CHANNEL_ACTIVE(19, 19, all)
+	TEST_CHANNEL_ACTIVE(20, 20, all)
+	TEST_CHANNEL_ACTIVE(21, 21, all)
+	TEST_CHANNEL_ACTIVE(22, 22, all)
+	TEST_CHANNEL_ACTIVE(23, 23, all)
+
+	STORE_GPIO_MASK_ACTIVE(all)
+
+	// Nothing to clock out on this PRU; answer straight away
+	QBEQ FRAME_SKIPPED, r_data_len, #0
+	QBEQ_GPIO_MASK_EMPTY(FRAME_SKIPPED)
+
+	// Frames that drive every strip load the pin masks as immediates, which is quicker than from data RAM
+	QBNE_GPIO_MASK_NAMED(l_masked_frame_jump, all)
+	QBA l_unmasked_frame
+
+	// The masked frame loop is at the end of the program, too far away for a QBNE
+l_masked_frame_jump:
+	QBA l_masked_frame
+
+l_unmasked_frame:
+#define FRAME_MASKED 0
+#include "ws281x-frame.p.h"
 
 FRAME_DONE:
 	// Final clear for the word
@@ -198,6 +161,12 @@ FRAME_DONE:
 	// Go back to waiting for the next frame buffer
 	QBA _LOOP
 
+FRAME_SKIPPED:
+	// Nothing was clocked out, so there is no reset time to wait for either
+	MOV r2, #0x1
+	SBCO r2, CONST_PRUDRAM, 12, 4
+	QBA _LOOP
+
 EXIT:
 	// Write a 0xFF into the response field so that they know we're done
 	MOV r2, #0xFF
@@ -206,3 +175,9 @@ EXIT:
 	RAISE_ARM_INTERRUPT
 
 	HALT
+
+l_masked_frame:
+#undef FRAME_MASKED
+#define FRAME_MASKED 1
+#include "ws281x-frame.p.h"
+	QBA FRAME_DONE
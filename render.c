@@ -0,0 +1,1699 @@
+/** \file
+ * Render kernels for the OPC server.
+ *
+ * The vectorized kernels rely on a few identities that keep the dithering arithmetic in 8-bit lanes:
+ *
+ *  - For a 16-bit value v = hi:lo, (v + 0x80 + e) >> 8 == hi + ((lo + 0x80 + e) >> 8) for any dithering error e in
+ *    [-128, 127], and the carry term is always 0 or 1, so the clamped output is a saturating 8-bit add.
+ *  - The new dithering error is only ever stored as 8 bits, and (lo + e - carry*256) mod 256 == (lo + e) mod 256.
+ */
+#include <stdlib.h>
+#include <string.h>
+#include <math.h>
+#include <pthread.h>
+#include <sys/time.h>
+#include "util.h"
+#include "render.h"
+
+#if defined(__ARM_NEON__) || defined(__ARM_NEON)
+#include <arm_neon.h>
+#define RENDER_USE_NEON 1
+#endif
+
+#define min(a, b) ((a) < (b) ? (a) : (b))
+#define max(a, b) ((a) > (b) ? (a) : (b))
+
+static inline uint32_t lutInterpolate(uint32_t value, const uint32_t* lut) {
+	// Inspired by FadeCandy: https://github.com/scanlime/fadecandy/blob/master/firmware/fc_pixel_lut.cpp
+
+	uint32_t index = value >> 8; // Range [0, 0xFF]
+	uint32_t alpha = value & 0xFF; // Range [0, 0xFF]
+	uint32_t invAlpha = 0x100 - alpha; // Range [1, 0x100]
+
+	// Result in range [0, 0xFFFF]
+	return (lut[index] * invAlpha + lut[index + 1] * alpha) >> 8;
+}
+
+static inline uint16_t lut_pair_interpolate(uint16_t value, const uint32_t* lut_pairs) {
+	uint32_t pair = lut_pairs[value >> 8];
+	uint32_t alpha = value & 0xFF;
+
+	return (uint16_t) (((pair & 0xFFFF) * (0x100 - alpha) + (pair >> 16) * alpha) >> 8);
+}
+
+static inline uint16_t lut_4k_interpolate(uint16_t value, const uint32_t* lut_pairs) {
+	uint32_t pair = lut_pairs[value >> 4];
+	uint32_t alpha = value & 0xF;
+
+	return (uint16_t) (((pair & 0xFFFF) * (0x10 - alpha) + (pair >> 16) * alpha + 0x8) >> 4);
+}
+
+/**
+* The tables the vectorized kernels index for a lookup table mode: uint16_t outputs for RENDER_LUT_64K, otherwise
+* uint32_t pairs.
+*/
+static inline void render_lut_tables(const render_params_t* params, render_lut_mode_t lut_mode, const void* tables[3]) {
+	switch (lut_mode) {
+		case RENDER_LUT_64K:
+			tables[0] = params->lut_64k->red;
+			tables[1] = params->lut_64k->green;
+			tables[2] = params->lut_64k->blue;
+			break;
+
+		case RENDER_LUT_4K:
+			tables[0] = params->lut_4k->red;
+			tables[1] = params->lut_4k->green;
+			tables[2] = params->lut_4k->blue;
+			break;
+
+		case RENDER_LUT_INTERPOLATED:
+		default:
+			tables[0] = params->lut_pairs->red;
+			tables[1] = params->lut_pairs->green;
+			tables[2] = params->lut_pairs->blue;
+			break;
+	}
+}
+
+/**
+* Determine which input channel (0=r, 1=g, 2=b) ends up in each of the output pixel's a, b and c bytes.
+*/
+static inline void render_channel_order_map(color_channel_order_t color_channel_order, unsigned channel_map[3]) {
+	switch (color_channel_order) {
+		case COLOR_ORDER_RGB: channel_map[0] = 0; channel_map[1] = 1; channel_map[2] = 2; break;
+		case COLOR_ORDER_RBG: channel_map[0] = 0; channel_map[1] = 2; channel_map[2] = 1; break;
+		case COLOR_ORDER_GRB: channel_map[0] = 1; channel_map[1] = 0; channel_map[2] = 2; break;
+		case COLOR_ORDER_GBR: channel_map[0] = 1; channel_map[1] = 2; channel_map[2] = 0; break;
+		case COLOR_ORDER_BGR: channel_map[0] = 2; channel_map[1] = 1; channel_map[2] = 0; break;
+		case COLOR_ORDER_BRG:
+		default:              channel_map[0] = 2; channel_map[1] = 0; channel_map[2] = 1; break;
+	}
+}
+
+const char* render_lut_mode_to_string(render_lut_mode_t mode) {
+	switch (mode) {
+		case RENDER_LUT_INTERPOLATED: return "interpolated";
+		case RENDER_LUT_4K: return "4k";
+		case RENDER_LUT_64K: return "64k";
+		default: return "<invalid lut_mode>";
+	}
+}
+
+render_lut_mode_t render_lut_mode_from_string(const char* str) {
+	if (strcasecmp(str, "interpolated") == 0) {
+		return RENDER_LUT_INTERPOLATED;
+	}
+	else if (strcasecmp(str, "4k") == 0) {
+		return RENDER_LUT_4K;
+	}
+	else if (strcasecmp(str, "64k") == 0) {
+		return RENDER_LUT_64K;
+	}
+	else {
+		return -1;
+	}
+}
+
+uint16_t render_lut_curve(uint32_t value, double white_point, double power) {
+	double output = pow(((double) value / 65536) * white_point, power);
+	int64_t longOutput = (int64_t) ((output * 0xFFFF) + 0.5);
+	return (uint16_t) max(0, min(0xFFFF, longOutput));
+}
+
+static void render_build_lut_4k_channel(uint32_t* table, double white_point, double power) {
+	uint32_t next = render_lut_curve(0, white_point, power);
+
+	for (uint32_t i=0; i<RENDER_LUT_4K_SIZE; i++) {
+		const uint32_t current = next;
+		next = render_lut_curve((i + 1) << 4, white_point, power);
+		table[i] = current | (next << 16);
+	}
+}
+
+static void render_build_lut_64k_channel(uint16_t* table, double white_point, double power) {
+	for (uint32_t i=0; i<RENDER_LUT_64K_SIZE; i++) {
+		table[i] = render_lut_curve(i, white_point, power);
+	}
+}
+
+void render_build_lut_4k(render_lut_4k_t* out, const double white_points[3], double power) {
+	render_build_lut_4k_channel(out->red, white_points[0], power);
+	render_build_lut_4k_channel(out->green, white_points[1], power);
+	render_build_lut_4k_channel(out->blue, white_points[2], power);
+}
+
+void render_build_lut_64k(render_lut_64k_t* out, const double white_points[3], double power) {
+	render_build_lut_64k_channel(out->red, white_points[0], power);
+	render_build_lut_64k_channel(out->green, white_points[1], power);
+	render_build_lut_64k_channel(out->blue, white_points[2], power);
+}
+
+void render_build_lut_pairs(
+	render_lut_pairs_t* out_pairs,
+	const uint32_t* red_lookup,
+	const uint32_t* green_lookup,
+	const uint32_t* blue_lookup
+) {
+	for (uint32_t i=0; i<256; i++) {
+		out_pairs->red[i] = (red_lookup[i] & 0xFFFF) | (red_lookup[i+1] << 16);
+		out_pairs->green[i] = (green_lookup[i] & 0xFFFF) | (green_lookup[i+1] << 16);
+		out_pairs->blue[i] = (blue_lookup[i] & 0xFFFF) | (blue_lookup[i+1] << 16);
+	}
+}
+
+////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+// Lookup table sets
+
+render_lut_t* render_lut_create(
+	render_lut_mode_t mode,
+	const double white_points[3],
+	double power,
+	const render_lut_t* previous
+) {
+	render_lut_t* lut = calloc(1, sizeof(render_lut_t));
+	if (!lut)
+		die("calloc failed: %s", strerror(errno));
+
+	lut->ref_count = 1;
+	lut->mode = mode;
+	lut->power = power;
+	memcpy(lut->white_points, white_points, sizeof(lut->white_points));
+
+	if (mode == RENDER_LUT_4K) {
+		lut->lut_4k = malloc(sizeof(render_lut_4k_t));
+		if (!lut->lut_4k)
+			die("malloc failed: %s", strerror(errno));
+	} else if (mode == RENDER_LUT_64K) {
+		lut->lut_64k = malloc(sizeof(render_lut_64k_t));
+		if (!lut->lut_64k)
+			die("malloc failed: %s", strerror(errno));
+	}
+
+	uint32_t* lookups[3] = { lut->red_lookup, lut->green_lookup, lut->blue_lookup };
+	const uint32_t* previous_lookups[3] = { NULL, NULL, NULL };
+	uint32_t* tables_4k[3] = { NULL, NULL, NULL };
+	const uint32_t* previous_tables_4k[3] = { NULL, NULL, NULL };
+	uint16_t* tables_64k[3] = { NULL, NULL, NULL };
+	const uint16_t* previous_tables_64k[3] = { NULL, NULL, NULL };
+
+	if (previous != NULL) {
+		previous_lookups[0] = previous->red_lookup;
+		previous_lookups[1] = previous->green_lookup;
+		previous_lookups[2] = previous->blue_lookup;
+	}
+	if (lut->lut_4k != NULL) {
+		tables_4k[0] = lut->lut_4k->red;
+		tables_4k[1] = lut->lut_4k->green;
+		tables_4k[2] = lut->lut_4k->blue;
+	}
+	if (previous != NULL && previous->lut_4k != NULL) {
+		previous_tables_4k[0] = previous->lut_4k->red;
+		previous_tables_4k[1] = previous->lut_4k->green;
+		previous_tables_4k[2] = previous->lut_4k->blue;
+	}
+	if (lut->lut_64k != NULL) {
+		tables_64k[0] = lut->lut_64k->red;
+		tables_64k[1] = lut->lut_64k->green;
+		tables_64k[2] = lut->lut_64k->blue;
+	}
+	if (previous != NULL && previous->lut_64k != NULL) {
+		previous_tables_64k[0] = previous->lut_64k->red;
+		previous_tables_64k[1] = previous->lut_64k->green;
+		previous_tables_64k[2] = previous->lut_64k->blue;
+	}
+
+	// Only channels whose curve changed are recomputed; the rest are copied from the previous set
+	for (unsigned c=0; c<3; c++) {
+		const bool curve_unchanged = previous != NULL &&
+			previous->power == power &&
+			previous->white_points[c] == white_points[c];
+
+		if (curve_unchanged) {
+			memcpy(lookups[c], previous_lookups[c], sizeof(lut->red_lookup));
+		} else {
+			for (uint32_t i=0; i<257; i++) {
+				lookups[c][i] = render_lut_curve(i << 8, white_points[c], power);
+			}
+		}
+
+		if (tables_4k[c] != NULL) {
+			if (curve_unchanged && previous_tables_4k[c] != NULL) {
+				memcpy(tables_4k[c], previous_tables_4k[c], sizeof(lut->lut_4k->red));
+			} else {
+				render_build_lut_4k_channel(tables_4k[c], white_points[c], power);
+			}
+		}
+
+		if (tables_64k[c] != NULL) {
+			if (curve_unchanged && previous_tables_64k[c] != NULL) {
+				memcpy(tables_64k[c], previous_tables_64k[c], sizeof(lut->lut_64k->red));
+			} else {
+				render_build_lut_64k_channel(tables_64k[c], white_points[c], power);
+			}
+		}
+	}
+
+	render_build_lut_pairs(&lut->pairs, lut->red_lookup, lut->green_lookup, lut->blue_lookup);
+
+	return lut;
+}
+
+bool render_lut_matches(
+	const render_lut_t* lut,
+	render_lut_mode_t mode,
+	const double white_points[3],
+	double power
+) {
+	return lut != NULL &&
+		lut->mode == mode &&
+		lut->power == power &&
+		memcmp(lut->white_points, white_points, sizeof(lut->white_points)) == 0;
+}
+
+render_lut_t* render_lut_retain(render_lut_t* lut) {
+	__sync_fetch_and_add(&lut->ref_count, 1);
+	return lut;
+}
+
+void render_lut_release(render_lut_t* lut) {
+	if (lut == NULL || __sync_sub_and_fetch(&lut->ref_count, 1) > 0) {
+		return;
+	}
+
+	free(lut->lut_4k);
+	free(lut->lut_64k);
+	free(lut);
+}
+
+void render_lut_apply(const render_lut_t* lut, render_params_t* params) {
+	params->lut_mode = lut->mode;
+	params->red_lookup = lut->red_lookup;
+	params->green_lookup = lut->green_lookup;
+	params->blue_lookup = lut->blue_lookup;
+	params->lut_pairs = &lut->pairs;
+	params->lut_4k = lut->lut_4k;
+	params->lut_64k = lut->lut_64k;
+}
+
+static inline render_lut_t* render_lut_exchange(render_lut_t* volatile* slot, render_lut_t* lut) {
+	// __sync_bool_compare_and_swap is a full barrier, so the tables written before the exchange are visible to
+	// whoever takes them
+	render_lut_t* old;
+	do {
+		old = *slot;
+	} while (!__sync_bool_compare_and_swap(slot, old, lut));
+	return old;
+}
+
+void render_lut_publish(render_lut_t* volatile* slot, render_lut_t* lut) {
+	render_lut_release(render_lut_exchange(slot, lut));
+}
+
+render_lut_t* render_lut_take(render_lut_t* volatile* slot) {
+	// Cheap test first; the render thread polls this every frame
+	if (*slot == NULL) {
+		return NULL;
+	}
+
+	return render_lut_exchange(slot, NULL);
+}
+
+////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+// Reference kernel
+//
+// The kernels below take the render options as separate arguments and are always inlined, so that every caller that
+// passes them as constants gets a copy with the option checks folded away.
+
+static inline __attribute__((always_inline)) void render_pixels_reference(
+	const render_params_t* params,
+	const void* previous_data,
+	const void* current_data,
+	dither_state_t* dither_states,
+	ledscape_frame_t* frame,
+	uint32_t strip_index,
+	uint32_t led_count,
+	const bool input_16bit,
+	const bool interpolation_enabled,
+	const bool lut_enabled,
+	const render_lut_mode_t lut_mode,
+	const bool dithering_enabled,
+	const color_channel_order_t color_channel_order
+) {
+	const uint16_t frame_progress16 = params->frame_progress16;
+	const uint16_t inv_frame_progress16 = params->inv_frame_progress16;
+	const uint8_t dithering_frame = params->dithering_frame;
+	const uint8_t max_dither_frames = dither_max_frames(params->max_dither_frames);
+	const uint8_t min_residual = dither_min_residual(max_dither_frames);
+
+	for (uint32_t led_index=0; led_index<led_count; led_index++) {
+		dither_state_t* pixel_dither_state = &dither_states[led_index];
+
+		ledscape_pixel_t* const pixel_out = & frame[led_index].strip[strip_index];
+
+		int32_t interpolatedR;
+		int32_t interpolatedG;
+		int32_t interpolatedB;
+
+		// Interpolate. 16-bit input is already at the working precision; 8-bit input is widened on the way.
+		if (input_16bit) {
+			const buffer_pixel16_t* pixel_in_prev = &((const buffer_pixel16_t*) previous_data)[led_index];
+			const buffer_pixel16_t* pixel_in_current = &((const buffer_pixel16_t*) current_data)[led_index];
+
+			if (interpolation_enabled) {
+				interpolatedR = (int32_t) (((uint32_t) pixel_in_prev->r*inv_frame_progress16 + (uint32_t) pixel_in_current->r*frame_progress16) >> 16);
+				interpolatedG = (int32_t) (((uint32_t) pixel_in_prev->g*inv_frame_progress16 + (uint32_t) pixel_in_current->g*frame_progress16) >> 16);
+				interpolatedB = (int32_t) (((uint32_t) pixel_in_prev->b*inv_frame_progress16 + (uint32_t) pixel_in_current->b*frame_progress16) >> 16);
+			} else {
+				interpolatedR = pixel_in_current->r;
+				interpolatedG = pixel_in_current->g;
+				interpolatedB = pixel_in_current->b;
+			}
+		} else {
+			const buffer_pixel_t* pixel_in_prev = &((const buffer_pixel_t*) previous_data)[led_index];
+			const buffer_pixel_t* pixel_in_current = &((const buffer_pixel_t*) current_data)[led_index];
+
+			if (interpolation_enabled) {
+				interpolatedR = (pixel_in_prev->r*inv_frame_progress16 + pixel_in_current->r*frame_progress16) >> 8;
+				interpolatedG = (pixel_in_prev->g*inv_frame_progress16 + pixel_in_current->g*frame_progress16) >> 8;
+				interpolatedB = (pixel_in_prev->b*inv_frame_progress16 + pixel_in_current->b*frame_progress16) >> 8;
+			} else {
+				interpolatedR = pixel_in_current->r << 8;
+				interpolatedG = pixel_in_current->g << 8;
+				interpolatedB = pixel_in_current->b << 8;
+			}
+		}
+
+		// Apply LUT
+		if (lut_enabled) {
+			if (lut_mode == RENDER_LUT_64K) {
+				interpolatedR = params->lut_64k->red[interpolatedR];
+				interpolatedG = params->lut_64k->green[interpolatedG];
+				interpolatedB = params->lut_64k->blue[interpolatedB];
+			} else if (lut_mode == RENDER_LUT_4K) {
+				interpolatedR = lut_4k_interpolate((uint16_t) interpolatedR, params->lut_4k->red);
+				interpolatedG = lut_4k_interpolate((uint16_t) interpolatedG, params->lut_4k->green);
+				interpolatedB = lut_4k_interpolate((uint16_t) interpolatedB, params->lut_4k->blue);
+			} else {
+				interpolatedR = lutInterpolate((uint32_t) interpolatedR, params->red_lookup);
+				interpolatedG = lutInterpolate((uint32_t) interpolatedG, params->green_lookup);
+				interpolatedB = lutInterpolate((uint32_t) interpolatedB, params->blue_lookup);
+			}
+		}
+
+		// Dither
+		uint8_t r, g, b;
+
+		if (dithering_enabled) {
+			bool changed = false;
+
+			dither_expire(pixel_dither_state, dithering_frame, max_dither_frames);
+			r = dither_quantize((uint16_t) interpolatedR, &pixel_dither_state->r, min_residual, &changed);
+			g = dither_quantize((uint16_t) interpolatedG, &pixel_dither_state->g, min_residual, &changed);
+			b = dither_quantize((uint16_t) interpolatedB, &pixel_dither_state->b, min_residual, &changed);
+
+			if (changed) {
+				pixel_dither_state->last_effect_frame = dithering_frame;
+			}
+		} else {
+			r = (uint8_t) min((interpolatedR+0x80) >> 8, 255);
+			g = (uint8_t) min((interpolatedG+0x80) >> 8, 255);
+			b = (uint8_t) min((interpolatedB+0x80) >> 8, 255);
+		}
+
+		// NOTE: For some strange reason, reading the values from pixel_out causes strange memory corruption. As such
+		// we use temporary variables, r, g, and b. It probably has to do with things being loaded into the CPU cache
+		// when read, as such, don't read pixel_out from here.
+		ledscape_pixel_set_color(
+			pixel_out,
+			color_channel_order,
+			r,
+			g,
+			b
+		);
+	}
+}
+
+void render_strip_scalar(
+	const render_params_t* params,
+	const void* previous_data,
+	const void* current_data,
+	dither_state_t* dither_states,
+	ledscape_frame_t* frame,
+	uint32_t strip_index,
+	uint32_t led_count
+) {
+	render_pixels_reference(
+		params, previous_data, current_data, dither_states, frame, strip_index, led_count,
+		params->input_16bit,
+		params->interpolation_enabled,
+		params->lut_enabled,
+		params->lut_mode,
+		params->dithering_enabled,
+		params->color_channel_order
+	);
+}
+
+////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+// Vectorized kernels
+
+#ifdef RENDER_USE_NEON
+
+static inline __attribute__((always_inline)) void render_strip_neon(
+	const render_params_t* params,
+	const void* previous_data,
+	const void* current_data,
+	dither_state_t* dither_states,
+	ledscape_frame_t* frame,
+	uint32_t strip_index,
+	uint32_t led_count,
+	const bool input_16bit,
+	const bool interpolation_enabled,
+	const bool lut_enabled,
+	const render_lut_mode_t lut_mode,
+	const bool dithering_enabled,
+	const color_channel_order_t color_channel_order
+) {
+	unsigned channel_map[3];
+	render_channel_order_map(color_channel_order, channel_map);
+
+	const void* lut_tables[3] = { NULL, NULL, NULL };
+	if (lut_enabled) {
+		render_lut_tables(params, lut_mode, lut_tables);
+	}
+
+	const uint16x4_t frame_progress = vdup_n_u16(params->frame_progress16);
+	const uint16x4_t inv_frame_progress = vdup_n_u16(params->inv_frame_progress16);
+	const uint8x8_t dithering_frame = vdup_n_u8(params->dithering_frame);
+	const uint8x8_t max_dither_frames = vdup_n_u8(dither_max_frames(params->max_dither_frames));
+	const uint8x8_t min_residual = vdup_n_u8(dither_min_residual(dither_max_frames(params->max_dither_frames)));
+
+	uint32_t led_index = 0;
+	for (; led_index + RENDER_KERNEL_BLOCK_PIXELS <= led_count; led_index += RENDER_KERNEL_BLOCK_PIXELS) {
+		uint16x8_t value[3];
+
+		// Interpolate
+		if (input_16bit) {
+			// Already 16 bits a channel, so the channels deinterleave straight into full-width lanes
+			const uint16x8x3_t current = vld3q_u16(render_input_pixel(current_data, led_index, true));
+
+			if (interpolation_enabled) {
+				const uint16x8x3_t previous = vld3q_u16(render_input_pixel(previous_data, led_index, true));
+
+				for (unsigned c=0; c<3; c++) {
+					uint32x4_t low = vmull_u16(vget_low_u16(previous.val[c]), inv_frame_progress);
+					low = vmlal_u16(low, vget_low_u16(current.val[c]), frame_progress);
+					uint32x4_t high = vmull_u16(vget_high_u16(previous.val[c]), inv_frame_progress);
+					high = vmlal_u16(high, vget_high_u16(current.val[c]), frame_progress);
+
+					value[c] = vcombine_u16(vshrn_n_u32(low, 16), vshrn_n_u32(high, 16));
+				}
+			} else {
+				for (unsigned c=0; c<3; c++) {
+					value[c] = current.val[c];
+				}
+			}
+		} else {
+			const uint8x8x3_t current = vld3_u8(render_input_pixel(current_data, led_index, false));
+
+			if (interpolation_enabled) {
+				const uint8x8x3_t previous = vld3_u8(render_input_pixel(previous_data, led_index, false));
+
+				for (unsigned c=0; c<3; c++) {
+					const uint16x8_t prev16 = vmovl_u8(previous.val[c]);
+					const uint16x8_t current16 = vmovl_u8(current.val[c]);
+
+					uint32x4_t low = vmull_u16(vget_low_u16(prev16), inv_frame_progress);
+					low = vmlal_u16(low, vget_low_u16(current16), frame_progress);
+					uint32x4_t high = vmull_u16(vget_high_u16(prev16), inv_frame_progress);
+					high = vmlal_u16(high, vget_high_u16(current16), frame_progress);
+
+					value[c] = vcombine_u16(vshrn_n_u32(low, 8), vshrn_n_u32(high, 8));
+				}
+			} else {
+				for (unsigned c=0; c<3; c++) {
+					value[c] = vshll_n_u8(current.val[c], 8);
+				}
+			}
+		}
+
+		// Apply LUT; the table fetch is a gather so it stays scalar, the blend is vectorized
+		if (lut_enabled) {
+			for (unsigned c=0; c<3; c++) {
+				uint16_t lanes[RENDER_KERNEL_BLOCK_PIXELS];
+				vst1q_u16(lanes, value[c]);
+
+				if (lut_mode == RENDER_LUT_64K) {
+					// Nothing to blend
+					const uint16_t* table = lut_tables[c];
+					for (unsigned i=0; i<RENDER_KERNEL_BLOCK_PIXELS; i++) {
+						lanes[i] = table[lanes[i]];
+					}
+
+					value[c] = vld1q_u16(lanes);
+					continue;
+				}
+
+				const uint32_t* table = lut_tables[c];
+				uint32_t pairs[RENDER_KERNEL_BLOCK_PIXELS];
+				for (unsigned i=0; i<RENDER_KERNEL_BLOCK_PIXELS; i++) {
+					pairs[i] = table[lut_mode == RENDER_LUT_4K ? lanes[i] >> 4 : lanes[i] >> 8];
+				}
+
+				// val[0] holds lut[index], val[1] holds lut[index+1]
+				const uint16x8x2_t endpoints = vuzpq_u16(
+					vreinterpretq_u16_u32(vld1q_u32(pairs)),
+					vreinterpretq_u16_u32(vld1q_u32(pairs + 4))
+				);
+
+				if (lut_mode == RENDER_LUT_4K) {
+					const uint16x8_t alpha = vandq_u16(value[c], vdupq_n_u16(0xF));
+					const uint16x8_t inv_alpha = vsubq_u16(vdupq_n_u16(0x10), alpha);
+
+					uint32x4_t low = vmull_u16(vget_low_u16(endpoints.val[0]), vget_low_u16(inv_alpha));
+					low = vmlal_u16(low, vget_low_u16(endpoints.val[1]), vget_low_u16(alpha));
+					uint32x4_t high = vmull_u16(vget_high_u16(endpoints.val[0]), vget_high_u16(inv_alpha));
+					high = vmlal_u16(high, vget_high_u16(endpoints.val[1]), vget_high_u16(alpha));
+
+					value[c] = vcombine_u16(vrshrn_n_u32(low, 4), vrshrn_n_u32(high, 4));
+				} else {
+					const uint16x8_t alpha = vandq_u16(value[c], vdupq_n_u16(0xFF));
+					const uint16x8_t inv_alpha = vsubq_u16(vdupq_n_u16(0x100), alpha);
+
+					uint32x4_t low = vmull_u16(vget_low_u16(endpoints.val[0]), vget_low_u16(inv_alpha));
+					low = vmlal_u16(low, vget_low_u16(endpoints.val[1]), vget_low_u16(alpha));
+					uint32x4_t high = vmull_u16(vget_high_u16(endpoints.val[0]), vget_high_u16(inv_alpha));
+					high = vmlal_u16(high, vget_high_u16(endpoints.val[1]), vget_high_u16(alpha));
+
+					value[c] = vcombine_u16(vshrn_n_u32(low, 8), vshrn_n_u32(high, 8));
+				}
+			}
+		}
+
+		uint8x8_t out[3];
+
+		if (dithering_enabled) {
+			// Deinterleaves into the three errors and the last effect frames
+			uint8x8x4_t state = vld4_u8((const uint8_t*) &dither_states[led_index]);
+
+			// Clear the errors of pixels dithering hasn't changed for too long; see dither_expire()
+			const uint8x8_t stale = vcgt_u8(vsub_u8(dithering_frame, state.val[3]), max_dither_frames);
+			uint8x8_t changed = stale;
+
+			for (unsigned c=0; c<3; c++) {
+				const uint8x8_t high = vshrn_n_u16(value[c], 8);
+				const uint8x8_t low = vmovn_u16(value[c]);
+				const uint8x8_t exact_carry = vshr_n_u8(low, 7);
+
+				// See dither_quantize(); vabs_s8(-128) is 0x80, which is 128 once reinterpreted as unsigned
+				const uint8x8_t dithered = vcge_u8(vreinterpret_u8_s8(vabs_s8(vreinterpret_s8_u8(low))), min_residual);
+				const uint8x8_t error = vand_u8(vbic_u8(state.val[c], stale), dithered);
+
+				int16x8_t sum = vaddq_s16(vreinterpretq_s16_u16(vmovl_u8(low)), vmovl_s8(vreinterpret_s8_u8(error)));
+				sum = vaddq_s16(sum, vdupq_n_s16(0x80));
+				const uint8x8_t carry = vshrn_n_u16(vreinterpretq_u16_s16(sum), 8);
+
+				out[c] = vqadd_u8(high, carry);
+				changed = vorr_u8(changed, veor_u8(carry, exact_carry));
+				state.val[c] = vand_u8(vadd_u8(low, error), dithered);
+			}
+
+			state.val[3] = vbsl_u8(vtst_u8(changed, changed), dithering_frame, state.val[3]);
+			vst4_u8((uint8_t*) &dither_states[led_index], state);
+		} else {
+			for (unsigned c=0; c<3; c++) {
+				out[c] = vqadd_u8(vshrn_n_u16(value[c], 8), vshr_n_u8(vmovn_u16(value[c]), 7));
+			}
+		}
+
+		// Output pixels are a full frame row apart, so store each one's three bytes separately
+		const uint8x8x3_t pixels = {{ out[channel_map[0]], out[channel_map[1]], out[channel_map[2]] }};
+		#define RENDER_STORE_LANE(lane) vst3_lane_u8((uint8_t*) &frame[led_index + lane].strip[strip_index], pixels, lane)
+		RENDER_STORE_LANE(0); RENDER_STORE_LANE(1); RENDER_STORE_LANE(2); RENDER_STORE_LANE(3);
+		RENDER_STORE_LANE(4); RENDER_STORE_LANE(5); RENDER_STORE_LANE(6); RENDER_STORE_LANE(7);
+		#undef RENDER_STORE_LANE
+	}
+
+	if (led_index < led_count) {
+		render_pixels_reference(
+			params,
+			render_input_pixel(previous_data, led_index, input_16bit),
+			render_input_pixel(current_data, led_index, input_16bit),
+			dither_states + led_index,
+			frame + led_index,
+			strip_index,
+			led_count - led_index,
+			input_16bit,
+			interpolation_enabled,
+			lut_enabled,
+			lut_mode,
+			dithering_enabled,
+			color_channel_order
+		);
+	}
+}
+
+#else
+
+static inline __attribute__((always_inline)) void render_strip_portable(
+	const render_params_t* params,
+	const void* previous_data,
+	const void* current_data,
+	dither_state_t* dither_states,
+	ledscape_frame_t* frame,
+	uint32_t strip_index,
+	uint32_t led_count,
+	const bool input_16bit,
+	const bool interpolation_enabled,
+	const bool lut_enabled,
+	const render_lut_mode_t lut_mode,
+	const bool dithering_enabled,
+	const color_channel_order_t color_channel_order
+) {
+	unsigned channel_map[3];
+	render_channel_order_map(color_channel_order, channel_map);
+
+	const void* lut_tables[3] = { NULL, NULL, NULL };
+	if (lut_enabled) {
+		render_lut_tables(params, lut_mode, lut_tables);
+	}
+
+	const uint32_t frame_progress = params->frame_progress16;
+	const uint32_t inv_frame_progress = params->inv_frame_progress16;
+	const uint8_t dithering_frame = params->dithering_frame;
+	const uint8_t max_dither_frames = dither_max_frames(params->max_dither_frames);
+	const uint8_t min_residual = dither_min_residual(max_dither_frames);
+
+	uint32_t led_index = 0;
+	for (; led_index + RENDER_KERNEL_BLOCK_PIXELS <= led_count; led_index += RENDER_KERNEL_BLOCK_PIXELS) {
+		uint16_t value[3][RENDER_KERNEL_BLOCK_PIXELS];
+		uint8_t out[3][RENDER_KERNEL_BLOCK_PIXELS];
+
+		// Interpolate
+		if (input_16bit) {
+			const uint16_t* previous = render_input_pixel(previous_data, led_index, true);
+			const uint16_t* current = render_input_pixel(current_data, led_index, true);
+
+			for (unsigned c=0; c<3; c++) {
+				for (unsigned i=0; i<RENDER_KERNEL_BLOCK_PIXELS; i++) {
+					if (interpolation_enabled) {
+						value[c][i] = (uint16_t) ((previous[i*3 + c]*inv_frame_progress + current[i*3 + c]*frame_progress) >> 16);
+					} else {
+						value[c][i] = current[i*3 + c];
+					}
+				}
+			}
+		} else {
+			const uint8_t* previous = render_input_pixel(previous_data, led_index, false);
+			const uint8_t* current = render_input_pixel(current_data, led_index, false);
+
+			for (unsigned c=0; c<3; c++) {
+				for (unsigned i=0; i<RENDER_KERNEL_BLOCK_PIXELS; i++) {
+					if (interpolation_enabled) {
+						value[c][i] = (uint16_t) ((previous[i*3 + c]*inv_frame_progress + current[i*3 + c]*frame_progress) >> 8);
+					} else {
+						value[c][i] = (uint16_t) (current[i*3 + c] << 8);
+					}
+				}
+			}
+		}
+
+		// Apply LUT
+		if (lut_enabled) {
+			for (unsigned c=0; c<3; c++) {
+				for (unsigned i=0; i<RENDER_KERNEL_BLOCK_PIXELS; i++) {
+					if (lut_mode == RENDER_LUT_64K) {
+						value[c][i] = ((const uint16_t*) lut_tables[c])[value[c][i]];
+					} else if (lut_mode == RENDER_LUT_4K) {
+						value[c][i] = lut_4k_interpolate(value[c][i], lut_tables[c]);
+					} else {
+						value[c][i] = lut_pair_interpolate(value[c][i], lut_tables[c]);
+					}
+				}
+			}
+		}
+
+		// Dither
+		if (dithering_enabled) {
+			for (unsigned i=0; i<RENDER_KERNEL_BLOCK_PIXELS; i++) {
+				dither_state_t* state = &dither_states[led_index + i];
+				int8_t* errors[3] = { &state->r, &state->g, &state->b };
+				bool changed = false;
+
+				dither_expire(state, dithering_frame, max_dither_frames);
+				for (unsigned c=0; c<3; c++) {
+					out[c][i] = dither_quantize(value[c][i], errors[c], min_residual, &changed);
+				}
+
+				if (changed) {
+					state->last_effect_frame = dithering_frame;
+				}
+			}
+		} else {
+			for (unsigned c=0; c<3; c++) {
+				for (unsigned i=0; i<RENDER_KERNEL_BLOCK_PIXELS; i++) {
+					out[c][i] = (uint8_t) min((value[c][i] + 0x80) >> 8, 255);
+				}
+			}
+		}
+
+		for (unsigned i=0; i<RENDER_KERNEL_BLOCK_PIXELS; i++) {
+			ledscape_pixel_t* const pixel_out = &frame[led_index + i].strip[strip_index];
+			pixel_out->a = out[channel_map[0]][i];
+			pixel_out->b = out[channel_map[1]][i];
+			pixel_out->c = out[channel_map[2]][i];
+		}
+	}
+
+	if (led_index < led_count) {
+		render_pixels_reference(
+			params,
+			render_input_pixel(previous_data, led_index, input_16bit),
+			render_input_pixel(current_data, led_index, input_16bit),
+			dither_states + led_index,
+			frame + led_index,
+			strip_index,
+			led_count - led_index,
+			input_16bit,
+			interpolation_enabled,
+			lut_enabled,
+			lut_mode,
+			dithering_enabled,
+			color_channel_order
+		);
+	}
+}
+
+#endif
+
+#ifdef RENDER_USE_NEON
+#define render_strip_kernel render_strip_neon
+#else
+#define render_strip_kernel render_strip_portable
+#endif
+
+////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+// Specialized variants
+//
+// One copy of the kernel per combination of render options, e.g. render_strip_in8_interp_lut_dither_BRG().
+
+#define RENDER_FLAG_in8 0
+#define RENDER_FLAG_in16 1
+#define RENDER_FLAG_interp 1
+#define RENDER_FLAG_nointerp 0
+#define RENDER_FLAG_nolut 0
+#define RENDER_FLAG_lut 1
+#define RENDER_FLAG_lut4k 2
+#define RENDER_FLAG_lut64k 3
+#define RENDER_FLAG_dither 1
+#define RENDER_FLAG_nodither 0
+
+#define RENDER_FOR_EACH_ORDER(X, depth, interp, lut, dither) \
+	X(depth, interp, lut, dither, RGB) \
+	X(depth, interp, lut, dither, RBG) \
+	X(depth, interp, lut, dither, GRB) \
+	X(depth, interp, lut, dither, GBR) \
+	X(depth, interp, lut, dither, BGR) \
+	X(depth, interp, lut, dither, BRG)
+
+// The LUT flag doubles as the index of the lookup table mode, offset by one for nolut
+#define RENDER_LUT_MODE_nolut RENDER_LUT_INTERPOLATED
+#define RENDER_LUT_MODE_lut RENDER_LUT_INTERPOLATED
+#define RENDER_LUT_MODE_lut4k RENDER_LUT_4K
+#define RENDER_LUT_MODE_lut64k RENDER_LUT_64K
+
+#define RENDER_FOR_EACH_DITHER(X, depth, interp, lut) \
+	RENDER_FOR_EACH_ORDER(X, depth, interp, lut, nodither) \
+	RENDER_FOR_EACH_ORDER(X, depth, interp, lut, dither)
+
+#define RENDER_FOR_EACH_LUT(X, depth, interp) \
+	RENDER_FOR_EACH_DITHER(X, depth, interp, nolut) \
+	RENDER_FOR_EACH_DITHER(X, depth, interp, lut) \
+	RENDER_FOR_EACH_DITHER(X, depth, interp, lut4k) \
+	RENDER_FOR_EACH_DITHER(X, depth, interp, lut64k)
+
+#define RENDER_FOR_EACH_OPTION(X, depth) \
+	RENDER_FOR_EACH_LUT(X, depth, nointerp) \
+	RENDER_FOR_EACH_LUT(X, depth, interp)
+
+#define RENDER_FOR_EACH_VARIANT(X) \
+	RENDER_FOR_EACH_OPTION(X, in8) \
+	RENDER_FOR_EACH_OPTION(X, in16)
+
+#define RENDER_DEFINE_VARIANT(depth, interp, lut, dither, order) \
+	static void render_strip_##depth##_##interp##_##lut##_##dither##_##order( \
+		const render_params_t* params, \
+		const void* previous_data, \
+		const void* current_data, \
+		dither_state_t* dither_states, \
+		ledscape_frame_t* frame, \
+		uint32_t strip_index, \
+		uint32_t led_count \
+	) { \
+		render_strip_kernel( \
+			params, previous_data, current_data, dither_states, frame, strip_index, led_count, \
+			RENDER_FLAG_##depth, \
+			RENDER_FLAG_##interp, \
+			RENDER_FLAG_##lut != RENDER_FLAG_nolut, \
+			RENDER_LUT_MODE_##lut, \
+			RENDER_FLAG_##dither, \
+			COLOR_ORDER_##order \
+		); \
+	}
+
+#define RENDER_VARIANT_TABLE_ENTRY(depth, interp, lut, dither, order) \
+	[RENDER_FLAG_##depth][RENDER_FLAG_##interp][RENDER_FLAG_##lut][RENDER_FLAG_##dither][COLOR_ORDER_##order] = { \
+		.render_strip = render_strip_##depth##_##interp##_##lut##_##dither##_##order, \
+		.name = #depth "+" #interp "+" #lut "+" #dither "/" #order \
+	},
+
+RENDER_FOR_EACH_VARIANT(RENDER_DEFINE_VARIANT)
+
+static const render_variant_t g_render_variants[2][2][RENDER_LUT_64K + 2][2][COLOR_ORDER_BRG + 1] = {
+	RENDER_FOR_EACH_VARIANT(RENDER_VARIANT_TABLE_ENTRY)
+};
+
+const render_variant_t* render_select_variant(const render_params_t* params) {
+	color_channel_order_t color_channel_order = params->color_channel_order;
+	if (color_channel_order < COLOR_ORDER_RGB || color_channel_order > COLOR_ORDER_BRG) {
+		color_channel_order = COLOR_ORDER_BRG;
+	}
+
+	render_lut_mode_t lut_mode = params->lut_mode;
+	if (lut_mode < RENDER_LUT_INTERPOLATED || lut_mode > RENDER_LUT_64K) {
+		lut_mode = RENDER_LUT_INTERPOLATED;
+	}
+
+	return &g_render_variants
+		[params->input_16bit ? 1 : 0]
+		[params->interpolation_enabled ? 1 : 0]
+		[params->lut_enabled ? 1 + lut_mode : 0]
+		[params->dithering_enabled ? 1 : 0]
+		[color_channel_order];
+}
+
+void render_strip(
+	const render_params_t* params,
+	const void* previous_data,
+	const void* current_data,
+	dither_state_t* dither_states,
+	ledscape_frame_t* frame,
+	uint32_t strip_index,
+	uint32_t led_count
+) {
+	render_select_variant(params)->render_strip(
+		params, previous_data, current_data, dither_states, frame, strip_index, led_count
+	);
+}
+
+const char* render_kernel_name() {
+#ifdef RENDER_USE_NEON
+	return "neon";
+#else
+	return "portable";
+#endif
+}
+
+////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+// Strip layout
+
+void strip_layout_init(
+	strip_layout_t* layout,
+	const uint32_t* lengths,
+	uint32_t length_count,
+	uint32_t default_length
+) {
+	memset(layout, 0, sizeof(*layout));
+
+	for (uint32_t strip=0; strip<LEDSCAPE_NUM_STRIPS; strip++) {
+		const uint32_t length = lengths != NULL && strip < length_count ? lengths[strip] : default_length;
+
+		layout->lengths[strip] = length;
+		layout->offsets[strip] = layout->pixel_count;
+		layout->max_length = max(layout->max_length, length);
+		layout->pixel_count += length;
+	}
+}
+
+////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+// Worker pool
+
+// Pixels per tile: a whole number of kernel blocks, and small enough (64 rows of 192 bytes) to stay in L1 alongside the
+// input data
+#define RENDER_TILE_PIXELS (RENDER_KERNEL_BLOCK_PIXELS * 8)
+
+typedef struct {
+	render_pool_t* pool;
+	unsigned worker_index;
+	pthread_t handle;
+} render_worker_t;
+
+struct render_pool {
+	unsigned thread_count;
+	render_worker_t* workers;
+
+	// Workers wait on start_barrier for a job and on done_barrier once their slice is rendered
+	pthread_barrier_t start_barrier;
+	pthread_barrier_t done_barrier;
+
+	const render_job_t* job;
+	bool shutdown;
+
+	// Per-worker staging area of RENDER_TILE_PIXELS output rows, cache line aligned
+	ledscape_frame_t* tiles;
+
+	// Per-worker time spent rendering since the last render_pool_take_timings()
+	uint64_t* worker_usec_sums;
+	uint32_t frames_since_timings;
+};
+
+static void render_pool_render_slice(render_pool_t* pool, unsigned worker_index) {
+	const render_job_t* job = pool->job;
+
+	struct timeval start_tv, stop_tv, delta_tv;
+	gettimeofday(&start_tv, NULL);
+
+	// Contiguous, disjoint strip ranges so workers never touch the same dithering state or output bytes
+	const uint32_t first_strip = (uint32_t) (((uint64_t) job->strip_count * worker_index) / pool->thread_count);
+	const uint32_t end_strip = (uint32_t) (((uint64_t) job->strip_count * (worker_index + 1)) / pool->thread_count);
+
+	// The output frame is pixel-major, so rendering a strip at a time writes one pixel every frame row apart, and the
+	// output lives in uncached DDR shared with the PRUs. Render a tile of pixels of every strip in the slice into
+	// cached memory instead, then copy it out a row at a time: each row of the slice is a contiguous run, and when a
+	// worker has every strip the whole tile is one sequential write.
+	ledscape_frame_t* const tile = pool->tiles + worker_index * RENDER_TILE_PIXELS;
+	const uint32_t row_offset = first_strip * sizeof(ledscape_pixel_t);
+	const uint32_t row_size = (end_strip - first_strip) * sizeof(ledscape_pixel_t);
+
+	for (uint32_t tile_start=0; row_size > 0 && tile_start<job->layout->max_length; tile_start+=RENDER_TILE_PIXELS) {
+		const uint32_t tile_pixels = min(RENDER_TILE_PIXELS, job->layout->max_length - tile_start);
+
+		for (uint32_t strip_index=first_strip; strip_index<end_strip; strip_index++) {
+			const uint32_t length = job->layout->lengths[strip_index];
+			const uint32_t data_index = job->layout->offsets[strip_index] + tile_start;
+			const uint32_t led_count = length > tile_start ? min(tile_pixels, length - tile_start) : 0;
+
+			if (led_count > 0) {
+				job->variant->render_strip(
+					job->params,
+					render_input_pixel(job->previous_data, data_index, job->params->input_16bit),
+					render_input_pixel(job->current_data, data_index, job->params->input_16bit),
+					&job->dither_states[data_index],
+					tile,
+					strip_index,
+					led_count
+				);
+			}
+
+			// Past the end of the strip
+			for (uint32_t led_index=led_count; led_index<tile_pixels; led_index++) {
+				memset(&tile[led_index].strip[strip_index], 0, sizeof(ledscape_pixel_t));
+			}
+		}
+
+		if (row_size == sizeof(ledscape_frame_t)) {
+			memcpy(&job->frame[tile_start], tile, tile_pixels * sizeof(ledscape_frame_t));
+		} else {
+			for (uint32_t led_index=0; led_index<tile_pixels; led_index++) {
+				memcpy(
+					(uint8_t*) &job->frame[tile_start + led_index] + row_offset,
+					(const uint8_t*) &tile[led_index] + row_offset,
+					row_size
+				);
+			}
+		}
+	}
+
+	gettimeofday(&stop_tv, NULL);
+	timersub(&stop_tv, &start_tv, &delta_tv);
+	pool->worker_usec_sums[worker_index] += delta_tv.tv_sec * 1000000ULL + delta_tv.tv_usec;
+}
+
+static void* render_worker_thread(void* threadarg) {
+	render_worker_t* worker = threadarg;
+	render_pool_t* pool = worker->pool;
+
+	for (;;) {
+		pthread_barrier_wait(&pool->start_barrier);
+
+		if (pool->shutdown) {
+			break;
+		}
+
+		render_pool_render_slice(pool, worker->worker_index);
+
+		pthread_barrier_wait(&pool->done_barrier);
+	}
+
+	pthread_exit(NULL);
+}
+
+render_pool_t* render_pool_create(unsigned thread_count) {
+	if (thread_count < 1) {
+		thread_count = 1;
+	}
+
+	render_pool_t* pool = calloc(1, sizeof(*pool));
+	if (!pool)
+		die("calloc failed: %s", strerror(errno));
+
+	pool->thread_count = thread_count;
+	pool->workers = calloc(thread_count, sizeof(render_worker_t));
+	pool->worker_usec_sums = calloc(thread_count, sizeof(uint64_t));
+
+	const size_t tiles_size = thread_count * RENDER_TILE_PIXELS * sizeof(ledscape_frame_t);
+	const int tiles_result = posix_memalign((void**) &pool->tiles, 64, tiles_size);
+	if (tiles_result != 0)
+		die("posix_memalign failed: %s", strerror(tiles_result));
+	memset(pool->tiles, 0, tiles_size);
+
+	if (thread_count > 1) {
+		pthread_barrier_init(&pool->start_barrier, NULL, thread_count);
+		pthread_barrier_init(&pool->done_barrier, NULL, thread_count);
+
+		// The calling thread renders slice 0 itself
+		for (unsigned i=1; i<thread_count; i++) {
+			pool->workers[i].pool = pool;
+			pool->workers[i].worker_index = i;
+
+			if (pthread_create(&pool->workers[i].handle, NULL, render_worker_thread, &pool->workers[i]) != 0)
+				die("[render] Failed to start render worker %u: %s\n", i, strerror(errno));
+		}
+	}
+
+	return pool;
+}
+
+void render_pool_run(render_pool_t* pool, const render_job_t* job) {
+	pool->job = job;
+
+	if (pool->thread_count > 1) {
+		pthread_barrier_wait(&pool->start_barrier);
+		render_pool_render_slice(pool, 0);
+		pthread_barrier_wait(&pool->done_barrier);
+	} else {
+		render_pool_render_slice(pool, 0);
+	}
+
+	pool->job = NULL;
+	pool->frames_since_timings++;
+}
+
+unsigned render_pool_thread_count(const render_pool_t* pool) {
+	return pool->thread_count;
+}
+
+unsigned render_pool_take_timings(render_pool_t* pool, uint64_t* out_avg_usec, unsigned max_workers) {
+	const unsigned count = min(max_workers, pool->thread_count);
+
+	for (unsigned i=0; i<count; i++) {
+		out_avg_usec[i] = pool->frames_since_timings > 0
+			? pool->worker_usec_sums[i] / pool->frames_since_timings
+			: 0;
+	}
+
+	memset(pool->worker_usec_sums, 0, pool->thread_count * sizeof(uint64_t));
+	pool->frames_since_timings = 0;
+
+	return count;
+}
+
+void render_pool_destroy(render_pool_t* pool) {
+	if (pool->thread_count > 1) {
+		pool->shutdown = true;
+		pthread_barrier_wait(&pool->start_barrier);
+
+		for (unsigned i=1; i<pool->thread_count; i++) {
+			pthread_join(pool->workers[i].handle, NULL);
+		}
+
+		pthread_barrier_destroy(&pool->start_barrier);
+		pthread_barrier_destroy(&pool->done_barrier);
+	}
+
+	free(pool->tiles);
+	free(pool->worker_usec_sums);
+	free(pool->workers);
+	free(pool);
+}
+
+////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+// Self-check
+
+static uint32_t self_check_random(uint32_t* state) {
+	// xorshift32; deterministic so failures can be reproduced
+	uint32_t x = *state;
+	x ^= x << 13;
+	x ^= x >> 17;
+	x ^= x << 5;
+	return *state = x;
+}
+
+static void self_check_fill(uint8_t* data, size_t size, uint32_t* rng) {
+	for (size_t i=0; i<size; i++) {
+		uint32_t r = self_check_random(rng);
+
+		// Bias towards the extremes, where the rounding and clamping edge cases live
+		switch (r & 0x7) {
+			case 0: data[i] = 0; break;
+			case 1: data[i] = 0xFF; break;
+			case 2: data[i] = 0x80; break;
+			default: data[i] = (uint8_t) (r >> 8);
+		}
+	}
+}
+
+// Lookup tables for the self-checks
+typedef struct {
+	uint32_t lookup[3][257];
+	render_lut_pairs_t lut_pairs;
+	render_lut_4k_t* lut_4k;
+	render_lut_64k_t* lut_64k;
+} self_check_tables_t;
+
+/**
+ * Build lookup tables the same way as build_lookup_tables(), except for blue: the gamma tables never produce values
+ * that round up past 255, so give it arbitrary ones that do.
+ */
+static void self_check_tables_init(self_check_tables_t* tables, uint32_t* rng) {
+	const double white_points[] = { .9, 1, 1 };
+	for (uint16_t c=0; c<2; c++) {
+		for (uint16_t i=0; i<257; i++) {
+			tables->lookup[c][i] = render_lut_curve((uint32_t) i << 8, white_points[c], 2.2);
+		}
+	}
+
+	tables->lut_4k = malloc(sizeof(render_lut_4k_t));
+	tables->lut_64k = malloc(sizeof(render_lut_64k_t));
+	render_build_lut_4k(tables->lut_4k, white_points, 2.2);
+	render_build_lut_64k(tables->lut_64k, white_points, 2.2);
+
+	for (uint16_t i=0; i<257; i++) {
+		uint32_t r = self_check_random(rng);
+		tables->lookup[2][i] = (r & 0x3) == 0 ? 0xFFFF : (r >> 16);
+	}
+	for (uint32_t i=0; i<RENDER_LUT_4K_SIZE; i++) {
+		uint32_t r = self_check_random(rng);
+		tables->lut_4k->blue[i] = (r & 0x3) == 0 ? 0xFFFFFFFF : r;
+	}
+	for (uint32_t i=0; i<RENDER_LUT_64K_SIZE; i++) {
+		uint32_t r = self_check_random(rng);
+		tables->lut_64k->blue[i] = (r & 0x3) == 0 ? 0xFFFF : (uint16_t) (r >> 16);
+	}
+
+	render_build_lut_pairs(&tables->lut_pairs, tables->lookup[0], tables->lookup[1], tables->lookup[2]);
+}
+
+static void self_check_tables_free(self_check_tables_t* tables) {
+	free(tables->lut_4k);
+	free(tables->lut_64k);
+}
+
+/**
+ * Render uneven strips through worker pools of a few sizes and compare the tiled output with rendering a strip at a
+ * time straight into the frame.
+ */
+static int render_pool_self_check_params(FILE* out, const render_params_t* base_params) {
+	const uint32_t strip_lengths[] = { RENDER_TILE_PIXELS * 2 + 5, 0, RENDER_TILE_PIXELS, 7, 1 };
+	const uint32_t strip_counts[] = { LEDSCAPE_NUM_STRIPS, 29 };
+	const unsigned thread_counts[] = { 1, 3, 7 };
+
+	strip_layout_t layout;
+	strip_layout_init(&layout, strip_lengths, sizeof(strip_lengths) / sizeof(strip_lengths[0]), 90);
+
+	const size_t data_size = layout.pixel_count * render_input_pixel_size(base_params->input_16bit);
+	const size_t overflow_size = layout.pixel_count * sizeof(dither_state_t);
+	const size_t frame_size = layout.max_length * sizeof(ledscape_frame_t);
+
+	uint8_t* previous_data = malloc(data_size);
+	uint8_t* current_data = malloc(data_size);
+	dither_state_t* reference_overflow = malloc(overflow_size);
+	dither_state_t* pool_overflow = malloc(overflow_size);
+	ledscape_frame_t* reference_frame = malloc(frame_size);
+	ledscape_frame_t* pool_frame = malloc(frame_size);
+
+	uint32_t rng = 0x706f6f6c;
+	unsigned case_count = 0;
+	int failure_count = 0;
+
+	for (unsigned t=0; t<sizeof(thread_counts)/sizeof(thread_counts[0]); t++) {
+		render_pool_t* pool = render_pool_create(thread_counts[t]);
+
+		for (unsigned c=0; c<sizeof(strip_counts)/sizeof(strip_counts[0]); c++) {
+			render_params_t params = *base_params;
+
+			self_check_fill(previous_data, data_size, &rng);
+			self_check_fill(current_data, data_size, &rng);
+			self_check_fill((uint8_t*) reference_overflow, overflow_size, &rng);
+			self_check_fill((uint8_t*) reference_frame, frame_size, &rng);
+			memcpy(pool_overflow, reference_overflow, overflow_size);
+			memcpy(pool_frame, reference_frame, frame_size);
+
+			for (unsigned frame_num=0; frame_num<4; frame_num++) {
+				params.frame_progress16 = (uint16_t) self_check_random(&rng);
+				params.inv_frame_progress16 = (uint16_t) (0xFFFF - params.frame_progress16);
+				params.dithering_frame++;
+
+				for (uint32_t strip_index=0; strip_index<strip_counts[c]; strip_index++) {
+					const uint32_t offset = layout.offsets[strip_index];
+					const uint32_t length = layout.lengths[strip_index];
+
+					render_strip(&params,
+						render_input_pixel(previous_data, offset, params.input_16bit),
+						render_input_pixel(current_data, offset, params.input_16bit),
+						reference_overflow + offset, reference_frame, strip_index, length);
+
+					// The pool writes whole pixels, padding included, and clears the rest of the strip
+					for (uint32_t led_index=0; led_index<layout.max_length; led_index++) {
+						ledscape_pixel_t* pixel = &reference_frame[led_index].strip[strip_index];
+
+						if (led_index < length) {
+							pixel->unused = 0;
+						} else {
+							memset(pixel, 0, sizeof(*pixel));
+						}
+					}
+				}
+
+				const render_job_t job = {
+					.variant = render_select_variant(&params),
+					.params = &params,
+					.previous_data = previous_data,
+					.current_data = current_data,
+					.dither_states = pool_overflow,
+					.frame = pool_frame,
+					.layout = &layout,
+					.strip_count = strip_counts[c]
+				};
+				render_pool_run(pool, &job);
+
+				case_count++;
+
+				if (memcmp(reference_frame, pool_frame, frame_size) != 0 ||
+					memcmp(reference_overflow, pool_overflow, overflow_size) != 0) {
+					if (out != NULL) {
+						fprintf(out, "[self-check] MISMATCH render pool threads=%u strips=%u frame=%u\n",
+							thread_counts[t],
+							strip_counts[c],
+							frame_num
+						);
+					}
+
+					failure_count++;
+					break;
+				}
+			}
+		}
+
+		render_pool_destroy(pool);
+	}
+
+	if (out != NULL) {
+		fprintf(out, "[self-check] tiled render pool vs per-strip rendering, %u-bit input: %u frames checked, %d mismatches\n",
+			base_params->input_16bit ? 16 : 8,
+			case_count,
+			failure_count
+		);
+	}
+
+	free(previous_data);
+	free(current_data);
+	free(reference_overflow);
+	free(pool_overflow);
+	free(reference_frame);
+	free(pool_frame);
+
+	return failure_count;
+}
+
+int render_pool_self_check(FILE* out) {
+	uint32_t rng = 0x7461626c;
+	self_check_tables_t tables;
+	self_check_tables_init(&tables, &rng);
+
+	// Every option on, for each input depth
+	render_params_t params = {
+		.interpolation_enabled = true,
+		.lut_enabled = true,
+		.dithering_enabled = true,
+		.color_channel_order = COLOR_ORDER_BRG,
+		.max_dither_frames = 16,
+		.red_lookup = tables.lookup[0],
+		.green_lookup = tables.lookup[1],
+		.blue_lookup = tables.lookup[2],
+		.lut_pairs = &tables.lut_pairs,
+		.lut_4k = tables.lut_4k,
+		.lut_64k = tables.lut_64k
+	};
+	int failure_count = render_pool_self_check_params(out, &params);
+
+	params.input_16bit = true;
+	failure_count += render_pool_self_check_params(out, &params);
+
+	self_check_tables_free(&tables);
+
+	return failure_count;
+}
+
+int render_lut_self_check(FILE* out) {
+	const double white_points[] = { .9, 1, 1 };
+	const double tweaked_white_points[] = { .9, 1, .8 };
+	int failure_count = 0;
+
+	for (int lut_mode=RENDER_LUT_INTERPOLATED; lut_mode<=RENDER_LUT_64K; lut_mode++) {
+		// Built from an older set with a different mode, then from one with a different blue channel
+		render_lut_t* original = render_lut_create(RENDER_LUT_64K - lut_mode, white_points, 2.2, NULL);
+		render_lut_t* incremental = render_lut_create(lut_mode, white_points, 2.2, original);
+		render_lut_t* tweaked = render_lut_create(lut_mode, tweaked_white_points, 2.2, incremental);
+		render_lut_t* from_scratch = render_lut_create(lut_mode, tweaked_white_points, 2.2, NULL);
+
+		bool matches = render_lut_matches(tweaked, lut_mode, tweaked_white_points, 2.2) &&
+			!render_lut_matches(tweaked, lut_mode, white_points, 2.2) &&
+			memcmp(tweaked->red_lookup, from_scratch->red_lookup, sizeof(tweaked->red_lookup)) == 0 &&
+			memcmp(tweaked->green_lookup, from_scratch->green_lookup, sizeof(tweaked->green_lookup)) == 0 &&
+			memcmp(tweaked->blue_lookup, from_scratch->blue_lookup, sizeof(tweaked->blue_lookup)) == 0 &&
+			memcmp(&tweaked->pairs, &from_scratch->pairs, sizeof(tweaked->pairs)) == 0;
+
+		if (lut_mode == RENDER_LUT_4K) {
+			matches = matches && memcmp(tweaked->lut_4k, from_scratch->lut_4k, sizeof(render_lut_4k_t)) == 0;
+		} else if (lut_mode == RENDER_LUT_64K) {
+			matches = matches && memcmp(tweaked->lut_64k, from_scratch->lut_64k, sizeof(render_lut_64k_t)) == 0;
+		}
+
+		if (!matches) {
+			if (out != NULL) {
+				fprintf(out, "[self-check] MISMATCH rebuilt %s lookup tables\n", render_lut_mode_to_string(lut_mode));
+			}
+			failure_count++;
+		}
+
+		// Superseded before being taken: only the newest comes out, once
+		render_lut_t* volatile slot = NULL;
+		render_lut_publish(&slot, render_lut_retain(incremental));
+		render_lut_publish(&slot, render_lut_retain(tweaked));
+
+		render_lut_t* taken = render_lut_take(&slot);
+		if (taken != tweaked || render_lut_take(&slot) != NULL || incremental->ref_count != 1 || tweaked->ref_count != 2) {
+			if (out != NULL) {
+				fprintf(out, "[self-check] MISMATCH lookup table handoff\n");
+			}
+			failure_count++;
+		}
+
+		render_lut_release(taken);
+		render_lut_release(original);
+		render_lut_release(incremental);
+		render_lut_release(tweaked);
+		render_lut_release(from_scratch);
+	}
+
+	if (out != NULL) {
+		fprintf(out, "[self-check] lookup table rebuilds and handoff: %d modes checked, %d mismatches\n",
+			RENDER_LUT_64K + 1,
+			failure_count
+		);
+	}
+
+	return failure_count;
+}
+
+int render_self_check(FILE* out) {
+	const uint32_t strip_count = 3;
+	const uint32_t led_count = RENDER_KERNEL_BLOCK_PIXELS * 5 + 3; // exercise the tail as well
+	const uint32_t pixel_count = strip_count * led_count;
+	const unsigned frames_per_case = 24;
+	const uint32_t max_dither_frame_values[] = { 0, 1, 3, 16, 127, 300 };
+
+	// Big enough for either input depth
+	uint8_t* previous_data = malloc(pixel_count * sizeof(buffer_pixel16_t));
+	uint8_t* current_data = malloc(pixel_count * sizeof(buffer_pixel16_t));
+	dither_state_t* reference_overflow = malloc(pixel_count * sizeof(dither_state_t));
+	dither_state_t* kernel_overflow = malloc(pixel_count * sizeof(dither_state_t));
+	ledscape_frame_t* reference_frame = malloc(led_count * sizeof(ledscape_frame_t));
+	ledscape_frame_t* kernel_frame = malloc(led_count * sizeof(ledscape_frame_t));
+
+	uint32_t rng = 0x4c454473;
+	self_check_tables_t tables;
+	self_check_tables_init(&tables, &rng);
+
+	unsigned case_count = 0;
+	int failure_count = 0;
+
+	for (unsigned flags=0; flags<16; flags++) {
+		for (int lut_mode=RENDER_LUT_INTERPOLATED; lut_mode<=RENDER_LUT_64K; lut_mode++) {
+			// The LUT mode only matters with the LUT on
+			if ((flags & 2) == 0 && lut_mode != RENDER_LUT_INTERPOLATED) {
+				continue;
+			}
+
+			for (int order=COLOR_ORDER_RGB; order<=COLOR_ORDER_BRG; order++) {
+				for (unsigned m=0; m<sizeof(max_dither_frame_values)/sizeof(max_dither_frame_values[0]); m++) {
+					render_params_t params = {
+						.input_16bit = (flags & 8) != 0,
+						.interpolation_enabled = (flags & 1) != 0,
+						.lut_enabled = (flags & 2) != 0,
+						.lut_mode = (render_lut_mode_t) lut_mode,
+						.dithering_enabled = (flags & 4) != 0,
+						.color_channel_order = (color_channel_order_t) order,
+						.max_dither_frames = max_dither_frame_values[m],
+						.red_lookup = tables.lookup[0],
+						.green_lookup = tables.lookup[1],
+						.blue_lookup = tables.lookup[2],
+						.lut_pairs = &tables.lut_pairs,
+						.lut_4k = tables.lut_4k,
+						.lut_64k = tables.lut_64k
+					};
+
+					const size_t data_size = pixel_count * render_input_pixel_size(params.input_16bit);
+
+					self_check_fill(previous_data, data_size, &rng);
+					self_check_fill(current_data, data_size, &rng);
+					self_check_fill((uint8_t*) reference_overflow, pixel_count * sizeof(dither_state_t), &rng);
+					self_check_fill((uint8_t*) reference_frame, led_count * sizeof(ledscape_frame_t), &rng);
+					memcpy(kernel_overflow, reference_overflow, pixel_count * sizeof(dither_state_t));
+					memcpy(kernel_frame, reference_frame, led_count * sizeof(ledscape_frame_t));
+
+					// Start close to the wrap of the frame counter
+					uint8_t dithering_frame = (uint8_t) (240 + (self_check_random(&rng) & 0x1F));
+
+					for (unsigned frame_num=0; frame_num<frames_per_case; frame_num++) {
+						uint32_t r = self_check_random(&rng);
+						params.frame_progress16 = (frame_num == 0) ? 0 : (frame_num == 1) ? 0xFFFF : (uint16_t) r;
+						params.inv_frame_progress16 = (uint16_t) (0xFFFF - params.frame_progress16);
+						params.dithering_frame = ++dithering_frame;
+
+						// Let the content move now and then so the dithering state sees both steady and changing input
+						if ((r >> 16) % 4 == 0) {
+							memcpy(previous_data, current_data, data_size);
+							self_check_fill(current_data, data_size, &rng);
+						}
+
+						for (uint32_t strip_index=0; strip_index<strip_count; strip_index++) {
+							const uint32_t offset = strip_index * led_count;
+							const void* previous = render_input_pixel(previous_data, offset, params.input_16bit);
+							const void* current = render_input_pixel(current_data, offset, params.input_16bit);
+
+							render_strip_scalar(&params, previous, current,
+								reference_overflow + offset, reference_frame, strip_index, led_count);
+							render_strip(&params, previous, current,
+								kernel_overflow + offset, kernel_frame, strip_index, led_count);
+						}
+
+						case_count++;
+
+						if (memcmp(reference_frame, kernel_frame, led_count * sizeof(ledscape_frame_t)) != 0 ||
+							memcmp(reference_overflow, kernel_overflow, pixel_count * sizeof(dither_state_t)) != 0) {
+							if (out != NULL) {
+								fprintf(out,
+									"[self-check] MISMATCH variant=%s max_dither_frames=%u frame=%u progress=%u\n",
+									render_select_variant(&params)->name,
+									params.max_dither_frames,
+									frame_num,
+									params.frame_progress16
+								);
+							}
+
+							failure_count++;
+							break;
+						}
+					}
+				}
+			}
+		}
+	}
+
+	if (out != NULL) {
+		fprintf(out, "[self-check] %s kernel vs scalar reference: %u frames checked, %d mismatches\n",
+			render_kernel_name(),
+			case_count,
+			failure_count
+		);
+	}
+
+	self_check_tables_free(&tables);
+	free(previous_data);
+	free(current_data);
+	free(reference_overflow);
+	free(kernel_overflow);
+	free(reference_frame);
+	free(kernel_frame);
+
+	return failure_count;
+}
+
+////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+// LUT benchmark
+
+static uint16_t render_lut_benchmark_lookup(
+	render_lut_mode_t lut_mode,
+	unsigned channel,
+	uint16_t value,
+	const uint32_t lookup[3][257],
+	const render_lut_4k_t* lut_4k,
+	const render_lut_64k_t* lut_64k
+) {
+	switch (lut_mode) {
+		case RENDER_LUT_64K:
+			return (channel == 0 ? lut_64k->red : channel == 1 ? lut_64k->green : lut_64k->blue)[value];
+
+		case RENDER_LUT_4K:
+			return lut_4k_interpolate(value, channel == 0 ? lut_4k->red : channel == 1 ? lut_4k->green : lut_4k->blue);
+
+		case RENDER_LUT_INTERPOLATED:
+		default:
+			return (uint16_t) lutInterpolate(value, lookup[channel]);
+	}
+}
+
+void render_lut_benchmark(FILE* out) {
+	// The server's default white point and luminance power
+	const double white_points[3] = { .9, 1, 1 };
+	const double power = 2;
+
+	uint32_t lookup[3][257];
+	for (unsigned c=0; c<3; c++) {
+		for (uint32_t i=0; i<257; i++) {
+			lookup[c][i] = render_lut_curve(i << 8, white_points[c], power);
+		}
+	}
+
+	render_lut_pairs_t lut_pairs;
+	render_build_lut_pairs(&lut_pairs, lookup[0], lookup[1], lookup[2]);
+
+	render_lut_4k_t* lut_4k = malloc(sizeof(render_lut_4k_t));
+	render_lut_64k_t* lut_64k = malloc(sizeof(render_lut_64k_t));
+	render_build_lut_4k(lut_4k, white_points, power);
+	render_build_lut_64k(lut_64k, white_points, power);
+
+	const size_t table_sizes[] = {
+		sizeof(lookup) + sizeof(lut_pairs),
+		sizeof(render_lut_4k_t),
+		sizeof(render_lut_64k_t)
+	};
+
+	// Accuracy: every 16-bit input against the exact curve
+	for (int lut_mode=RENDER_LUT_INTERPOLATED; lut_mode<=RENDER_LUT_64K; lut_mode++) {
+		uint32_t max_error = 0;
+		uint64_t total_error = 0;
+
+		for (unsigned c=0; c<3; c++) {
+			for (uint32_t v=0; v<RENDER_LUT_64K_SIZE; v++) {
+				const int32_t exact = render_lut_curve(v, white_points[c], power);
+				const int32_t actual = render_lut_benchmark_lookup(lut_mode, c, (uint16_t) v, lookup, lut_4k, lut_64k);
+				const uint32_t error = (uint32_t) abs(actual - exact);
+
+				max_error = max(max_error, error);
+				total_error += error;
+			}
+		}
+
+		fprintf(out, "[lut-benchmark] %-12s %4zu KB of tables, max error %u, mean error %.3f (16-bit units)\n",
+			render_lut_mode_to_string(lut_mode),
+			table_sizes[lut_mode] / 1024,
+			max_error,
+			(double) total_error / (3 * RENDER_LUT_64K_SIZE)
+		);
+	}
+
+	// Throughput: a full frame of strips through the same variants the server would pick
+	const uint32_t strip_count = LEDSCAPE_NUM_STRIPS;
+	const uint32_t led_count = 512;
+	const uint32_t pixel_count = strip_count * led_count;
+	const unsigned frame_count = 40;
+
+	uint8_t* previous_data = malloc(pixel_count * sizeof(buffer_pixel16_t));
+	uint8_t* current_data = malloc(pixel_count * sizeof(buffer_pixel16_t));
+	dither_state_t* overflow = calloc(pixel_count, sizeof(dither_state_t));
+	ledscape_frame_t* frame = malloc(led_count * sizeof(ledscape_frame_t));
+
+	uint32_t rng = 0x4c555462;
+	self_check_fill(previous_data, pixel_count * sizeof(buffer_pixel16_t), &rng);
+	self_check_fill(current_data, pixel_count * sizeof(buffer_pixel16_t), &rng);
+
+	for (int input_16bit=0; input_16bit<2; input_16bit++) {
+		for (int lut_mode=RENDER_LUT_INTERPOLATED; lut_mode<=RENDER_LUT_64K; lut_mode++) {
+			render_params_t params = {
+				.input_16bit = input_16bit != 0,
+				.interpolation_enabled = true,
+				.lut_enabled = true,
+				.lut_mode = (render_lut_mode_t) lut_mode,
+				.dithering_enabled = true,
+				.color_channel_order = COLOR_ORDER_BRG,
+				.max_dither_frames = 16,
+				.red_lookup = lookup[0],
+				.green_lookup = lookup[1],
+				.blue_lookup = lookup[2],
+				.lut_pairs = &lut_pairs,
+				.lut_4k = lut_4k,
+				.lut_64k = lut_64k
+			};
+			const render_variant_t* variant = render_select_variant(&params);
+
+			struct timeval start_tv, stop_tv;
+			gettimeofday(&start_tv, NULL);
+
+			// One extra frame up front to warm the caches
+			for (unsigned frame_num=0; frame_num<=frame_count; frame_num++) {
+				if (frame_num == 1) {
+					gettimeofday(&start_tv, NULL);
+				}
+
+				params.frame_progress16 = (uint16_t) (frame_num * 0x0F0F);
+				params.inv_frame_progress16 = (uint16_t) (0xFFFF - params.frame_progress16);
+				params.dithering_frame = (uint8_t) frame_num;
+
+				for (uint32_t strip_index=0; strip_index<strip_count; strip_index++) {
+					const uint32_t offset = strip_index * led_count;
+
+					variant->render_strip(
+						&params,
+						render_input_pixel(previous_data, offset, params.input_16bit),
+						render_input_pixel(current_data, offset, params.input_16bit),
+						overflow + offset,
+						frame,
+						strip_index,
+						led_count
+					);
+				}
+			}
+
+			gettimeofday(&stop_tv, NULL);
+			const uint64_t usec = max(1,
+				(uint64_t) (stop_tv.tv_sec - start_tv.tv_sec) * 1000000 + stop_tv.tv_usec - start_tv.tv_usec
+			);
+
+			fprintf(out, "[lut-benchmark] %s kernel %-36s %7.2f Mpixels/s, %6llu usec per frame\n",
+				render_kernel_name(),
+				variant->name,
+				(double) pixel_count * frame_count / usec,
+				(unsigned long long) (usec / frame_count)
+			);
+		}
+	}
+
+	free(previous_data);
+	free(current_data);
+	free(overflow);
+	free(frame);
+	free(lut_4k);
+	free(lut_64k);
+}
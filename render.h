@@ -0,0 +1,349 @@
+/** \file
+ * Render kernels for the OPC server.
+ *
+ * Converts the 8-bit or 16-bit RGB input frames into LEDscape output pixels, applying frame interpolation, the
+ * luminance lookup tables and temporal dithering. A straightforward per-pixel reference implementation is kept alongside the
+ * vectorized kernel so the two can be checked against each other.
+ */
+#ifndef _render_h_
+#define _render_h_
+
+#include <stdio.h>
+#include <stdint.h>
+#include <stdbool.h>
+#include "ledscape.h"
+#include "dither.h"
+
+/** Number of pixels processed per iteration of the vectorized kernel. */
+#define RENDER_KERNEL_BLOCK_PIXELS 8
+
+typedef struct {
+	uint8_t r;
+	uint8_t g;
+	uint8_t b;
+} __attribute__((__packed__)) buffer_pixel_t;
+
+/**
+ * A pixel of a 16-bit input frame, in host byte order. Left naturally aligned so that a block of pixels is a single
+ * deinterleaving load and the scalar code never falls back to byte accesses.
+ */
+typedef struct {
+	uint16_t r;
+	uint16_t g;
+	uint16_t b;
+} buffer_pixel16_t;
+
+/** Size of one input pixel: buffer_pixel16_t for 16-bit input frames, otherwise buffer_pixel_t. */
+static inline uint32_t render_input_pixel_size(bool input_16bit) {
+	return input_16bit ? sizeof(buffer_pixel16_t) : sizeof(buffer_pixel_t);
+}
+
+/** The pixel at index in an input frame of either depth. */
+static inline const void* render_input_pixel(const void* data, uint32_t index, bool input_16bit) {
+	return (const uint8_t*) data + index * render_input_pixel_size(input_16bit);
+}
+
+
+/**
+ * Where each strip's pixels are in an input frame. Strips are packed back to back, each only as long as it really is,
+ * the same way OPC and E1.31 senders lay them out.
+ */
+typedef struct {
+	uint32_t lengths[LEDSCAPE_NUM_STRIPS];
+	uint32_t offsets[LEDSCAPE_NUM_STRIPS]; // in pixels from the start of the frame
+	uint32_t max_length;
+	uint32_t pixel_count;
+} strip_layout_t;
+
+/**
+ * Lay out strips of the given lengths. Strips past length_count, or every strip if lengths is NULL, get default_length
+ * pixels.
+ */
+extern void strip_layout_init(
+	strip_layout_t* layout,
+	const uint32_t* lengths,
+	uint32_t length_count,
+	uint32_t default_length
+);
+
+/**
+ * Lookup tables in the layout used by the vectorized kernel: entry i holds lut[i] in the low 16 bits and lut[i+1]
+ * in the high 16 bits, so both interpolation endpoints are fetched with a single load.
+ */
+typedef struct {
+	uint32_t red[256];
+	uint32_t green[256];
+	uint32_t blue[256];
+} render_lut_pairs_t;
+
+/**
+ * Resolution of the luminance lookup. Finer tables cost memory (and cache) but less arithmetic and error per lookup.
+ */
+typedef enum {
+	RENDER_LUT_INTERPOLATED = 0, // 257 entries per channel, interpolated with an 8-bit weight
+	RENDER_LUT_4K,               // 4097 entries per channel (48KB in all), interpolated with a 4-bit weight
+	RENDER_LUT_64K               // an entry for every 16-bit value (384KB in all), no interpolation
+} render_lut_mode_t;
+
+#define RENDER_LUT_4K_SIZE 4096
+#define RENDER_LUT_64K_SIZE 65536
+
+/** RENDER_LUT_4K tables, paired the same way as render_lut_pairs_t. */
+typedef struct {
+	uint32_t red[RENDER_LUT_4K_SIZE];
+	uint32_t green[RENDER_LUT_4K_SIZE];
+	uint32_t blue[RENDER_LUT_4K_SIZE];
+} render_lut_4k_t;
+
+/** RENDER_LUT_64K tables: the output for every input value. */
+typedef struct {
+	uint16_t red[RENDER_LUT_64K_SIZE];
+	uint16_t green[RENDER_LUT_64K_SIZE];
+	uint16_t blue[RENDER_LUT_64K_SIZE];
+} render_lut_64k_t;
+
+extern const char* render_lut_mode_to_string(render_lut_mode_t mode);
+
+/** \returns the mode named by str ("interpolated", "4k" or "64k"), or -1 if there is none. */
+extern render_lut_mode_t render_lut_mode_from_string(const char* str);
+
+/**
+ * The luminance curve the lookup tables are sampled from: (value / 65536 * white_point) ^ power, scaled to 16 bits.
+ * value runs from 0 to 65536 inclusive.
+ */
+extern uint16_t render_lut_curve(uint32_t value, double white_point, double power);
+
+/**
+ * Fill RENDER_LUT_4K or RENDER_LUT_64K tables straight from the luminance curve, rather than from the 257-entry
+ * tables, so that they are more accurate as well as faster.
+ */
+extern void render_build_lut_4k(render_lut_4k_t* out, const double white_points[3], double power);
+extern void render_build_lut_64k(render_lut_64k_t* out, const double white_points[3], double power);
+
+/**
+ * Everything a render kernel needs to know about the frame being rendered. Filled in once per frame by the render
+ * thread.
+ */
+typedef struct {
+	// Input frames are buffer_pixel16_t rather than buffer_pixel_t
+	bool input_16bit;
+
+	bool interpolation_enabled;
+	bool lut_enabled;
+	render_lut_mode_t lut_mode;
+	bool dithering_enabled;
+	color_channel_order_t color_channel_order;
+
+	uint16_t frame_progress16;
+	uint16_t inv_frame_progress16;
+
+	uint8_t dithering_frame; // wraps; see dither_is_stale()
+	uint32_t max_dither_frames;
+
+	// 257-entry tables; see render_lut_apply()
+	const uint32_t* red_lookup;
+	const uint32_t* green_lookup;
+	const uint32_t* blue_lookup;
+
+	// The same tables, repacked with render_build_lut_pairs()
+	const render_lut_pairs_t* lut_pairs;
+
+	// Only needed for the matching lut_mode
+	const render_lut_4k_t* lut_4k;
+	const render_lut_64k_t* lut_64k;
+} render_params_t;
+
+// previous_data and current_data are buffer_pixel16_t if params->input_16bit is set, otherwise buffer_pixel_t
+typedef void (*render_strip_fn)(
+	const render_params_t* params,
+	const void* previous_data,
+	const void* current_data,
+	dither_state_t* dither_states,
+	ledscape_frame_t* frame,
+	uint32_t strip_index,
+	uint32_t led_count
+);
+
+/**
+ * A copy of the vectorized kernel specialized for one combination of input depth, interpolation, LUT mode, dithering
+ * and color channel order, so that none of those options are tested inside the pixel loop.
+ */
+typedef struct {
+	render_strip_fn render_strip;
+	const char* name; // e.g. "in8+interp+lut4k+nodither/BRG"
+} render_variant_t;
+
+/**
+ * Repack the 257-entry lookup tables into the paired layout used by the vectorized kernel.
+ */
+extern void render_build_lut_pairs(
+	render_lut_pairs_t* out_pairs,
+	const uint32_t* red_lookup,
+	const uint32_t* green_lookup,
+	const uint32_t* blue_lookup
+);
+
+/**
+ * A complete set of lookup tables for one luminance curve, white point and LUT mode. Never modified once built, and
+ * reference counted so the render thread can keep using one while its replacement is built on another thread.
+ */
+typedef struct {
+	volatile int32_t ref_count;
+
+	render_lut_mode_t mode;
+	double white_points[3];
+	double power;
+
+	uint32_t red_lookup[257];
+	uint32_t green_lookup[257];
+	uint32_t blue_lookup[257];
+	render_lut_pairs_t pairs;
+
+	// Only allocated for the matching mode
+	render_lut_4k_t* lut_4k;
+	render_lut_64k_t* lut_64k;
+} render_lut_t;
+
+/**
+ * Build a set of lookup tables, holding one reference. Channels whose curve is the same as in previous (which may be
+ * NULL) are copied from it rather than recomputed, so tweaking one channel's white point only costs that channel.
+ */
+extern render_lut_t* render_lut_create(
+	render_lut_mode_t mode,
+	const double white_points[3],
+	double power,
+	const render_lut_t* previous
+);
+
+/** \returns true if lut (which may be NULL) was built from exactly these settings. */
+extern bool render_lut_matches(
+	const render_lut_t* lut,
+	render_lut_mode_t mode,
+	const double white_points[3],
+	double power
+);
+
+extern render_lut_t* render_lut_retain(render_lut_t* lut);
+
+/** Drop a reference, freeing the tables with the last one. lut may be NULL. */
+extern void render_lut_release(render_lut_t* lut);
+
+/** Point the lookup tables and lut_mode of params at lut. */
+extern void render_lut_apply(const render_lut_t* lut, render_params_t* params);
+
+/**
+ * Hand a reference to lut over through slot without locking, releasing any earlier one that was never taken.
+ */
+extern void render_lut_publish(render_lut_t* volatile* slot, render_lut_t* lut);
+
+/** \returns the reference last published through slot, or NULL if there is no new one; the caller now owns it. */
+extern render_lut_t* render_lut_take(render_lut_t* volatile* slot);
+
+/**
+ * Reference implementation: renders one strip a pixel at a time.
+ */
+extern void render_strip_scalar(
+	const render_params_t* params,
+	const void* previous_data,
+	const void* current_data,
+	dither_state_t* dither_states,
+	ledscape_frame_t* frame,
+	uint32_t strip_index,
+	uint32_t led_count
+);
+
+/**
+ * Renders one strip RENDER_KERNEL_BLOCK_PIXELS pixels at a time, using NEON where available and a portable blocked
+ * implementation otherwise. Output and dithering state are bit-exact with render_strip_scalar().
+ *
+ * Equivalent to calling render_select_variant(params)->render_strip; prefer selecting once per frame.
+ */
+extern void render_strip(
+	const render_params_t* params,
+	const void* previous_data,
+	const void* current_data,
+	dither_state_t* dither_states,
+	ledscape_frame_t* frame,
+	uint32_t strip_index,
+	uint32_t led_count
+);
+
+/**
+ * Pick the specialized kernel matching the options in params. The returned variant ignores those fields of params, so
+ * select again whenever they change.
+ */
+extern const render_variant_t* render_select_variant(const render_params_t* params);
+
+/** Name of the kernel used by render_strip(), e.g. "neon". */
+extern const char* render_kernel_name();
+
+/**
+ * One frame's worth of rendering: every strip from 0 to strip_count, rendered with the given variant. The input frames
+ * (of the depth given by params) and dithering state are in the given strip layout; pixels past the end of a strip are written as zero, out to the end
+ * of the longest strip.
+ */
+typedef struct {
+	const render_variant_t* variant;
+	const render_params_t* params;
+
+	const void* previous_data;
+	const void* current_data;
+	dither_state_t* dither_states;
+	ledscape_frame_t* frame;
+
+	const strip_layout_t* layout;
+	uint32_t strip_count;
+} render_job_t;
+
+/**
+ * A pool of render threads that split a frame's strips between them. The thread calling render_pool_run() renders the
+ * first slice itself, so a pool of one thread starts no threads at all.
+ */
+typedef struct render_pool render_pool_t;
+
+extern render_pool_t* render_pool_create(unsigned thread_count);
+
+/** Render the job across all of the pool's threads and return once every slice is complete. */
+extern void render_pool_run(render_pool_t* pool, const render_job_t* job);
+
+extern unsigned render_pool_thread_count(const render_pool_t* pool);
+
+/**
+ * Write each worker's average render time per frame since the last call into out_avg_usec and reset the sums.
+ * \returns the number of workers written.
+ */
+extern unsigned render_pool_take_timings(render_pool_t* pool, uint64_t* out_avg_usec, unsigned max_workers);
+
+extern void render_pool_destroy(render_pool_t* pool);
+
+/**
+ * Run render_strip() and render_strip_scalar() over randomized input for every combination of render options and
+ * compare the results byte for byte.
+ *
+ * \returns the number of mismatching cases; zero means the kernels are bit-exact.
+ */
+extern int render_self_check(FILE* out);
+
+/**
+ * Render uneven strips through worker pools of a few sizes, with every option on and at each input depth, and compare
+ * the tiled output with rendering a strip at a time straight into the frame.
+ *
+ * \returns the number of mismatching cases.
+ */
+extern int render_pool_self_check(FILE* out);
+
+/**
+ * Check that tables rebuilt from an earlier set match ones built from scratch, and that only the newest published set
+ * may be taken.
+ *
+ * \returns the number of problems found.
+ */
+extern int render_lut_self_check(FILE* out);
+
+/**
+ * Compare the lookup table modes: the error of each against the exact luminance curve, and how fast the kernel
+ * renders a frame with each.
+ */
+extern void render_lut_benchmark(FILE* out);
+
+#endif
@@ -0,0 +1,890 @@
+/** \file
+*  Checks the GPIO waveforms in a VCD trace against the timing each output protocol allows.
+*
+*  The trace can come from pru-sim or from a logic analyser (e.g. sigrok-cli -O vcd). Every pin is decoded as the
+*  chosen protocol and each timing parameter is compared with its limits: T0H, T1H, low time, bit period and reset for
+*  ws281x; clock high/low, data setup/hold and latch for ws2801 and apa102; break, mark after break, bit time, stop
+*  bits, slot time and break-to-break for dmx. The report gives the range and worst-case margin of every parameter and
+*  the transmission time of each frame, and the exit status is non-zero if any limit was violated, so templates can be
+*  tightened to the fastest timing that still conforms.
+*/
+#define _GNU_SOURCE
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdbool.h>
+#include <stdint.h>
+#include <inttypes.h>
+#include <string.h>
+#include <strings.h>
+#include <errno.h>
+#include <math.h>
+#include <float.h>
+#include <getopt.h>
+#include "util.h"
+
+////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+// DEFINES, CONSTANTS and UTILS
+
+#define MAX_SIGNALS 256
+#define MAX_TOKEN 256
+
+// Clock pins of the clocked protocols pulse this often relative to the busiest pin
+#define CLOCK_DETECT_FRACTION 0.9
+
+// Clocked protocols: a clock idle for this long separates two frames
+#define CLOCKED_FRAME_IDLE_NS 50000.0
+
+#define DMX_BIT_NS 4000.0
+#define DMX_SLOT_BITS 9
+// A low longer than a slot of zeros plus its stop bits can only be a break
+#define DMX_BREAK_DETECT_NS (11 * DMX_BIT_NS)
+
+#define NO_LIMIT DBL_MAX
+
+////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+// TYPES
+
+typedef enum {
+	PROTOCOL_WS281X,
+	PROTOCOL_WS2801,
+	PROTOCOL_APA102,
+	PROTOCOL_DMX
+} protocol_t;
+
+typedef enum {
+	CHECK_T0H,
+	CHECK_T1H,
+	CHECK_LOW,
+	CHECK_PERIOD,
+	CHECK_RESET,
+	CHECK_CLOCK_HIGH,
+	CHECK_CLOCK_LOW,
+	CHECK_SETUP,
+	CHECK_HOLD,
+	CHECK_LATCH,
+	CHECK_BREAK,
+	CHECK_MAB,
+	CHECK_BIT,
+	CHECK_STOP,
+	CHECK_SLOT,
+	CHECK_BREAK_TO_BREAK,
+	CHECK_COUNT
+} check_t;
+
+static const char* CHECK_NAMES[CHECK_COUNT] = {
+	[CHECK_T0H] = "t0h",
+	[CHECK_T1H] = "t1h",
+	[CHECK_LOW] = "low",
+	[CHECK_PERIOD] = "period",
+	[CHECK_RESET] = "reset",
+	[CHECK_CLOCK_HIGH] = "clock-high",
+	[CHECK_CLOCK_LOW] = "clock-low",
+	[CHECK_SETUP] = "setup",
+	[CHECK_HOLD] = "hold",
+	[CHECK_LATCH] = "latch",
+	[CHECK_BREAK] = "break",
+	[CHECK_MAB] = "mab",
+	[CHECK_BIT] = "bit",
+	[CHECK_STOP] = "stop",
+	[CHECK_SLOT] = "slot",
+	[CHECK_BREAK_TO_BREAK] = "break-to-break"
+};
+
+typedef struct {
+	bool used;
+	double min_ns;
+	double max_ns;
+} limit_t;
+
+typedef struct {
+	const char* name;
+	limit_t limits[CHECK_COUNT];
+} protocol_limits_t;
+
+/**
+ * Default limits in nanoseconds. ws281x: an envelope that WS2811 (high speed), WS2812 and WS2812B parts all accept;
+ * newer WS2812B and SK6812 parts need a reset of up to 280us. ws2801: the datasheet's 25MHz clock and 500us latch.
+ * apa102: a 20MHz clock. dmx: the transmitter timing of ANSI E1.11.
+ */
+static protocol_limits_t PROTOCOL_LIMITS[] = {
+	[PROTOCOL_WS281X] = {
+		.name = "ws281x",
+		.limits = {
+			[CHECK_T0H] = { true, 200, 500 },
+			[CHECK_T1H] = { true, 550, 950 },
+			[CHECK_LOW] = { true, 450, 5000 },
+			[CHECK_PERIOD] = { true, 650, 1850 },
+			[CHECK_RESET] = { true, 50000, NO_LIMIT }
+		}
+	},
+	[PROTOCOL_WS2801] = {
+		.name = "ws2801",
+		.limits = {
+			[CHECK_CLOCK_HIGH] = { true, 20, NO_LIMIT },
+			[CHECK_CLOCK_LOW] = { true, 20, CLOCKED_FRAME_IDLE_NS },
+			[CHECK_SETUP] = { true, 10, NO_LIMIT },
+			[CHECK_HOLD] = { true, 10, NO_LIMIT },
+			[CHECK_LATCH] = { true, 500000, NO_LIMIT }
+		}
+	},
+	[PROTOCOL_APA102] = {
+		.name = "apa102",
+		.limits = {
+			[CHECK_CLOCK_HIGH] = { true, 25, NO_LIMIT },
+			[CHECK_CLOCK_LOW] = { true, 25, CLOCKED_FRAME_IDLE_NS },
+			[CHECK_SETUP] = { true, 10, NO_LIMIT },
+			[CHECK_HOLD] = { true, 10, NO_LIMIT }
+		}
+	},
+	[PROTOCOL_DMX] = {
+		.name = "dmx",
+		.limits = {
+			[CHECK_BREAK] = { true, 92000, NO_LIMIT },
+			[CHECK_MAB] = { true, 12000, 1e9 },
+			[CHECK_BIT] = { true, 3920, 4080 },
+			[CHECK_STOP] = { true, 8000, 1e9 },
+			[CHECK_SLOT] = { true, 44000, 1e9 },
+			[CHECK_BREAK_TO_BREAK] = { true, 1204000, 1e9 }
+		}
+	}
+};
+
+#define PROTOCOL_COUNT (sizeof(PROTOCOL_LIMITS) / sizeof(PROTOCOL_LIMITS[0]))
+
+typedef struct {
+	double time_ns;
+	uint8_t value;
+} edge_t;
+
+typedef struct {
+	uint64_t count;
+	uint64_t violations;
+	double min_ns;
+	double max_ns;
+	double worst_margin_ns;
+	double worst_at_ns;
+} check_stats_t;
+
+typedef struct {
+	uint64_t count;
+	double min_ns;
+	double max_ns;
+} frame_stats_t;
+
+typedef struct {
+	char id[MAX_TOKEN];
+	char name[MAX_TOKEN];
+	bool selected;
+	bool is_clock;
+
+	int level;
+	edge_t* edges;
+	size_t edge_count;
+	size_t edge_capacity;
+	uint64_t rise_count;
+
+	check_stats_t checks[CHECK_COUNT];
+	frame_stats_t frames;
+	uint64_t units;
+} signal_t;
+
+typedef struct {
+	protocol_t protocol;
+	const char* trace_filename;
+	const char* pins;
+	const char* clocks;
+	bool verbose;
+} check_config_t;
+
+////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+// GLOBALS
+
+static check_config_t g_config = {
+	.protocol = PROTOCOL_WS281X
+};
+
+static signal_t g_signals[MAX_SIGNALS];
+static uint32_t g_signal_count;
+static double g_trace_end_ns;
+
+static inline const limit_t* limit_for(check_t check) {
+	return &PROTOCOL_LIMITS[g_config.protocol].limits[check];
+}
+
+////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+// Measurements
+
+static void record(signal_t* signal, check_t check, double value_ns, double at_ns) {
+	const limit_t* limit = limit_for(check);
+	check_stats_t* stats = &signal->checks[check];
+
+	double margin = value_ns - limit->min_ns;
+	if (limit->max_ns != NO_LIMIT && limit->max_ns - value_ns < margin) {
+		margin = limit->max_ns - value_ns;
+	}
+
+	if (stats->count == 0 || value_ns < stats->min_ns) stats->min_ns = value_ns;
+	if (stats->count == 0 || value_ns > stats->max_ns) stats->max_ns = value_ns;
+	if (stats->count == 0 || margin < stats->worst_margin_ns) {
+		stats->worst_margin_ns = margin;
+		stats->worst_at_ns = at_ns;
+	}
+	if (margin < 0) stats->violations++;
+	stats->count++;
+}
+
+static void record_frame(signal_t* signal, double start_ns, double end_ns) {
+	const double duration_ns = end_ns - start_ns;
+	frame_stats_t* frames = &signal->frames;
+
+	if (frames->count == 0 || duration_ns < frames->min_ns) frames->min_ns = duration_ns;
+	if (frames->count == 0 || duration_ns > frames->max_ns) frames->max_ns = duration_ns;
+	frames->count++;
+}
+
+////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+// ws281x
+
+static void check_ws281x(signal_t* signal) {
+	const limit_t* t0h = limit_for(CHECK_T0H);
+	const limit_t* t1h = limit_for(CHECK_T1H);
+	const limit_t* low = limit_for(CHECK_LOW);
+
+	// Pulses are told apart halfway between the longest 0 and the shortest 1; a low longer than any bit is a latch
+	const double one_threshold_ns = (t0h->max_ns + t1h->min_ns) / 2;
+	const double latch_threshold_ns = low->max_ns;
+
+	double rise_ns = -1, fall_ns = -1, frame_start_ns = -1;
+
+	for (size_t i=0; i<signal->edge_count; i++) {
+		const edge_t* edge = &signal->edges[i];
+
+		if (edge->value) {
+			if (fall_ns < 0) {
+				frame_start_ns = edge->time_ns;
+			} else if (edge->time_ns - fall_ns > latch_threshold_ns) {
+				record(signal, CHECK_RESET, edge->time_ns - fall_ns, fall_ns);
+				record_frame(signal, frame_start_ns, fall_ns);
+				frame_start_ns = edge->time_ns;
+			} else {
+				record(signal, CHECK_LOW, edge->time_ns - fall_ns, fall_ns);
+				record(signal, CHECK_PERIOD, edge->time_ns - rise_ns, rise_ns);
+			}
+			rise_ns = edge->time_ns;
+		} else if (rise_ns >= 0) {
+			const double high_ns = edge->time_ns - rise_ns;
+			record(signal, high_ns < one_threshold_ns ? CHECK_T0H : CHECK_T1H, high_ns, rise_ns);
+			fall_ns = edge->time_ns;
+			signal->units++;
+		}
+	}
+
+	if (frame_start_ns >= 0 && fall_ns > frame_start_ns) {
+		record_frame(signal, frame_start_ns, fall_ns);
+	}
+}
+
+////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+// ws2801 and apa102
+
+static double* g_clock_rises;
+static size_t g_clock_rise_count;
+
+static int compare_double(const void* a, const void* b) {
+	const double x = *(const double*) a, y = *(const double*) b;
+	return x < y ? -1 : x > y;
+}
+
+static void check_clock(signal_t* signal) {
+	const limit_t* latch = limit_for(CHECK_LATCH);
+	double rise_ns = -1, fall_ns = -1, frame_start_ns = -1;
+
+	for (size_t i=0; i<signal->edge_count; i++) {
+		const edge_t* edge = &signal->edges[i];
+
+		if (edge->value) {
+			if (fall_ns < 0) {
+				frame_start_ns = edge->time_ns;
+			} else if (edge->time_ns - fall_ns > CLOCKED_FRAME_IDLE_NS) {
+				if (latch->used) record(signal, CHECK_LATCH, edge->time_ns - fall_ns, fall_ns);
+				record_frame(signal, frame_start_ns, fall_ns);
+				frame_start_ns = edge->time_ns;
+			} else {
+				record(signal, CHECK_CLOCK_LOW, edge->time_ns - fall_ns, fall_ns);
+			}
+
+			rise_ns = edge->time_ns;
+			g_clock_rises[g_clock_rise_count++] = rise_ns;
+		} else if (rise_ns >= 0) {
+			record(signal, CHECK_CLOCK_HIGH, edge->time_ns - rise_ns, rise_ns);
+			fall_ns = edge->time_ns;
+			signal->units++;
+		}
+	}
+
+	if (frame_start_ns >= 0 && fall_ns > frame_start_ns) {
+		record_frame(signal, frame_start_ns, fall_ns);
+	}
+}
+
+/** Data pins are checked against the nearest rising edge of any clock pin; the clocks of one PRU rise together. */
+static void check_data(signal_t* signal) {
+	size_t next_rise = 0;
+
+	for (size_t i=0; i<signal->edge_count; i++) {
+		const double time_ns = signal->edges[i].time_ns;
+
+		while (next_rise < g_clock_rise_count && g_clock_rises[next_rise] < time_ns) {
+			next_rise++;
+		}
+
+		if (next_rise > 0 && time_ns - g_clock_rises[next_rise - 1] < CLOCKED_FRAME_IDLE_NS) {
+			record(signal, CHECK_HOLD, time_ns - g_clock_rises[next_rise - 1], time_ns);
+		}
+		if (next_rise < g_clock_rise_count && g_clock_rises[next_rise] - time_ns < CLOCKED_FRAME_IDLE_NS) {
+			record(signal, CHECK_SETUP, g_clock_rises[next_rise] - time_ns, time_ns);
+		}
+		signal->units++;
+	}
+}
+
+static bool list_contains(const char* list, const char* name) {
+	const size_t name_length = strlen(name);
+
+	for (const char* item = list; item != NULL && *item; ) {
+		const char* end = strchr(item, ',');
+		const size_t item_length = end ? (size_t) (end - item) : strlen(item);
+
+		if (item_length == name_length && strncmp(item, name, name_length) == 0) {
+			return true;
+		}
+		item = end ? end + 1 : NULL;
+	}
+	return false;
+}
+
+static void check_clocked() {
+	uint64_t most_rises = 0;
+	size_t total_edges = 0;
+
+	for (uint32_t i=0; i<g_signal_count; i++) {
+		if (g_signals[i].rise_count > most_rises) most_rises = g_signals[i].rise_count;
+		total_edges += g_signals[i].edge_count;
+	}
+
+	for (uint32_t i=0; i<g_signal_count; i++) {
+		signal_t* signal = &g_signals[i];
+		signal->is_clock = g_config.clocks != NULL
+			? list_contains(g_config.clocks, signal->name)
+			: signal->rise_count >= most_rises * CLOCK_DETECT_FRACTION;
+	}
+
+	g_clock_rises = malloc((total_edges + 1) * sizeof(double));
+	if (g_clock_rises == NULL)
+		die("malloc failed: %s\n", strerror(errno));
+
+	for (uint32_t i=0; i<g_signal_count; i++) {
+		if (g_signals[i].selected && g_signals[i].is_clock) check_clock(&g_signals[i]);
+	}
+
+	qsort(g_clock_rises, g_clock_rise_count, sizeof(double), compare_double);
+
+	for (uint32_t i=0; i<g_signal_count; i++) {
+		if (g_signals[i].selected && !g_signals[i].is_clock) check_data(&g_signals[i]);
+	}
+
+	free(g_clock_rises);
+}
+
+////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+// dmx
+
+static void check_dmx(signal_t* signal) {
+	enum { DMX_IDLE, DMX_MAB, DMX_SLOTS } state = DMX_IDLE;
+
+	const double slot_with_stop_ns = (DMX_SLOT_BITS + 2) * DMX_BIT_NS;
+	double low_start_ns = -1, break_start_ns = -1, break_end_ns = -1, slot_start_ns = -1, last_slot_end_ns = -1;
+
+	for (size_t i=0; i<signal->edge_count; i++) {
+		const edge_t* edge = &signal->edges[i];
+		const double time_ns = edge->time_ns;
+
+		if (!edge->value) {
+			if (state == DMX_MAB) {
+				record(signal, CHECK_MAB, time_ns - break_end_ns, break_end_ns);
+				state = DMX_SLOTS;
+				slot_start_ns = time_ns;
+			} else if (state == DMX_SLOTS) {
+				const double offset_ns = time_ns - slot_start_ns;
+				const double bits = fmax(1, round(offset_ns / DMX_BIT_NS));
+
+				if (bits <= DMX_SLOT_BITS) {
+					record(signal, CHECK_BIT, offset_ns / bits, time_ns);
+				} else {
+					// The start bit of the next slot
+					record(signal, CHECK_STOP, offset_ns - DMX_SLOT_BITS * DMX_BIT_NS, slot_start_ns + DMX_SLOT_BITS * DMX_BIT_NS);
+					record(signal, CHECK_SLOT, offset_ns, slot_start_ns);
+					signal->units++;
+					last_slot_end_ns = slot_start_ns + slot_with_stop_ns;
+					slot_start_ns = time_ns;
+				}
+			}
+			low_start_ns = time_ns;
+		} else if (low_start_ns >= 0) {
+			const double low_ns = time_ns - low_start_ns;
+
+			if (low_ns >= DMX_BREAK_DETECT_NS) {
+				// What looked like the start bit of another slot was the next break; slots are only counted once the
+				// next one starts, so there is nothing to undo
+				if (break_start_ns >= 0) {
+					record(signal, CHECK_BREAK_TO_BREAK, low_start_ns - break_start_ns, break_start_ns);
+					if (last_slot_end_ns > break_start_ns) record_frame(signal, break_start_ns, last_slot_end_ns);
+				}
+
+				record(signal, CHECK_BREAK, low_ns, low_start_ns);
+				break_start_ns = low_start_ns;
+				break_end_ns = time_ns;
+				state = DMX_MAB;
+			} else if (state == DMX_SLOTS) {
+				const double offset_ns = time_ns - slot_start_ns;
+				const double bits = fmax(1, round(offset_ns / DMX_BIT_NS));
+
+				if (bits <= DMX_SLOT_BITS) {
+					record(signal, CHECK_BIT, offset_ns / bits, time_ns);
+				} else {
+					// Still low where the stop bits should be: a framing error
+					record(signal, CHECK_STOP, 0, time_ns);
+				}
+			}
+		}
+	}
+
+	// The slot in progress at the end of the trace still counts if its stop bits were seen
+	if (state == DMX_SLOTS && g_trace_end_ns - slot_start_ns >= slot_with_stop_ns) {
+		signal->units++;
+		last_slot_end_ns = slot_start_ns + slot_with_stop_ns;
+	}
+
+	// A frame is timed from its break to the stop bits of its last slot
+	if (state == DMX_SLOTS && last_slot_end_ns > break_start_ns) {
+		record_frame(signal, break_start_ns, last_slot_end_ns);
+	}
+}
+
+////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+// VCD parsing
+
+static bool next_token(FILE* file, char* token) {
+	int c;
+	size_t length = 0;
+
+	while ((c = getc_unlocked(file)) != EOF && (c == ' ' || c == '\t' || c == '\n' || c == '\r'));
+	if (c == EOF) return false;
+
+	do {
+		if (length < MAX_TOKEN - 1) token[length++] = (char) c;
+	} while ((c = getc_unlocked(file)) != EOF && !(c == ' ' || c == '\t' || c == '\n' || c == '\r'));
+
+	token[length] = 0;
+	return true;
+}
+
+static double parse_timescale(FILE* file) {
+	char token[MAX_TOKEN], text[MAX_TOKEN * 2] = "";
+
+	while (next_token(file, token) && strcmp(token, "$end") != 0) {
+		strncat(text, token, sizeof(text) - strlen(text) - 1);
+	}
+
+	char* unit;
+	const double magnitude = strtod(text, &unit);
+	static const struct { const char* unit; double ns; } UNITS[] = {
+		{ "s", 1e9 }, { "ms", 1e6 }, { "us", 1e3 }, { "ns", 1 }, { "ps", 1e-3 }, { "fs", 1e-6 }
+	};
+
+	for (size_t i=0; i<sizeof(UNITS) / sizeof(UNITS[0]); i++) {
+		if (strcmp(unit, UNITS[i].unit) == 0) return magnitude * UNITS[i].ns;
+	}
+
+	die("Unsupported VCD timescale: %s\n", text);
+	return 0;
+}
+
+static void parse_var(FILE* file) {
+	char token[MAX_TOKEN], width[MAX_TOKEN] = "", id[MAX_TOKEN] = "", name[MAX_TOKEN] = "";
+
+	// $var <type> <width> <id> <name> [<bit select>] $end
+	for (int field=0; next_token(file, token) && strcmp(token, "$end") != 0; field++) {
+		if (field == 1) strcpy(width, token);
+		else if (field == 2) strcpy(id, token);
+		else if (field == 3) strcpy(name, token);
+		else if (field > 3) strncat(name, token, sizeof(name) - strlen(name) - 1);
+	}
+
+	if (strcmp(width, "1") != 0) {
+		return;
+	}
+
+	if (g_signal_count == MAX_SIGNALS)
+		die("More than %d signals in the trace\n", MAX_SIGNALS);
+
+	signal_t* signal = &g_signals[g_signal_count++];
+	strcpy(signal->id, id);
+	strcpy(signal->name, name);
+	signal->level = -1;
+	signal->selected = g_config.pins == NULL || list_contains(g_config.pins, name);
+}
+
+static void add_value(const char* id, int level, double time_ns) {
+	for (uint32_t i=0; i<g_signal_count; i++) {
+		signal_t* signal = &g_signals[i];
+		if (strcmp(signal->id, id) != 0) continue;
+
+		if (signal->level >= 0 && level >= 0 && level != signal->level) {
+			if (signal->edge_count == signal->edge_capacity) {
+				signal->edge_capacity = signal->edge_capacity ? signal->edge_capacity * 2 : 4096;
+				signal->edges = realloc(signal->edges, signal->edge_capacity * sizeof(edge_t));
+				if (signal->edges == NULL)
+					die("realloc failed: %s\n", strerror(errno));
+			}
+
+			signal->edges[signal->edge_count++] = (edge_t) { .time_ns = time_ns, .value = (uint8_t) level };
+			if (level) signal->rise_count++;
+		}
+
+		signal->level = level;
+		return;
+	}
+}
+
+static void load_trace(const char* filename) {
+	FILE* file = fopen(filename, "r");
+	if (file == NULL)
+		die("Failed to open %s: %s\n", filename, strerror(errno));
+
+	char token[MAX_TOKEN];
+	double ns_per_tick = 1, time_ns = 0;
+
+	while (next_token(file, token)) {
+		if (token[0] == '$') {
+			if (strcmp(token, "$timescale") == 0) {
+				ns_per_tick = parse_timescale(file);
+			} else if (strcmp(token, "$var") == 0) {
+				parse_var(file);
+			} else if (strcmp(token, "$dumpvars") == 0 || strcmp(token, "$dumpall") == 0
+				|| strcmp(token, "$dumpon") == 0 || strcmp(token, "$dumpoff") == 0 || strcmp(token, "$end") == 0
+			) {
+				// Value changes follow
+			} else {
+				while (next_token(file, token) && strcmp(token, "$end") != 0);
+			}
+		} else if (token[0] == '#') {
+			time_ns = strtod(token + 1, NULL) * ns_per_tick;
+		} else if (token[0] == 'b' || token[0] == 'B' || token[0] == 'r' || token[0] == 'R') {
+			// Vector values: skip the identifier that follows
+			next_token(file, token);
+		} else {
+			const int level = token[0] == '1' ? 1 : token[0] == '0' ? 0 : -1;
+			add_value(token + 1, level, time_ns);
+		}
+	}
+
+	g_trace_end_ns = time_ns;
+	fclose(file);
+}
+
+////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+// Reporting
+
+static void print_check(const char* pin, check_t check, const check_stats_t* stats) {
+	const limit_t* limit = limit_for(check);
+	char limits[64];
+
+	if (limit->max_ns == NO_LIMIT) {
+		snprintf(limits, sizeof(limits), ">= %.0f", limit->min_ns);
+	} else {
+		snprintf(limits, sizeof(limits), "%.0f-%.0f", limit->min_ns, limit->max_ns);
+	}
+
+	printf("[timing] %s %s: %" PRIu64 " samples, %.1f-%.1f ns (limits %s), worst margin %.1f ns at %.3f us%s",
+		pin,
+		CHECK_NAMES[check],
+		stats->count,
+		stats->min_ns,
+		stats->max_ns,
+		limits,
+		stats->worst_margin_ns,
+		stats->worst_at_ns / 1e3,
+		stats->violations ? "" : "\n"
+	);
+
+	if (stats->violations) {
+		printf(", %" PRIu64 " VIOLATIONS\n", stats->violations);
+	}
+}
+
+static void merge_check(check_stats_t* total, const check_stats_t* stats) {
+	if (stats->count == 0) return;
+
+	if (total->count == 0 || stats->min_ns < total->min_ns) total->min_ns = stats->min_ns;
+	if (total->count == 0 || stats->max_ns > total->max_ns) total->max_ns = stats->max_ns;
+	if (total->count == 0 || stats->worst_margin_ns < total->worst_margin_ns) {
+		total->worst_margin_ns = stats->worst_margin_ns;
+		total->worst_at_ns = stats->worst_at_ns;
+	}
+	total->count += stats->count;
+	total->violations += stats->violations;
+}
+
+/** Returns the number of violations */
+static uint64_t report() {
+	static const char* UNIT_NAMES[] = {
+		[PROTOCOL_WS281X] = "bits",
+		[PROTOCOL_WS2801] = "clocks",
+		[PROTOCOL_APA102] = "clocks",
+		[PROTOCOL_DMX] = "slots"
+	};
+
+	check_stats_t totals[CHECK_COUNT] = {{ 0 }};
+	const char* worst_pins[CHECK_COUNT] = { 0 };
+	frame_stats_t frames = { 0 };
+	uint32_t pin_count = 0;
+
+	for (uint32_t i=0; i<g_signal_count; i++) {
+		const signal_t* signal = &g_signals[i];
+		if (!signal->selected || signal->edge_count == 0) continue;
+
+		pin_count++;
+
+		if (g_config.verbose) {
+			printf("[timing] %s%s: %" PRIu64 " %s, %" PRIu64 " frames, transmission %.2f-%.2f us\n",
+				signal->name,
+				signal->is_clock ? " (clock)" : "",
+				signal->units,
+				signal->frames.count || signal->is_clock ? UNIT_NAMES[g_config.protocol] : "edges",
+				signal->frames.count,
+				signal->frames.min_ns / 1e3,
+				signal->frames.max_ns / 1e3
+			);
+		}
+
+		for (int check=0; check<CHECK_COUNT; check++) {
+			const check_stats_t* stats = &signal->checks[check];
+			if (stats->count == 0) continue;
+
+			if (g_config.verbose) print_check(signal->name, (check_t) check, stats);
+
+			if (totals[check].count == 0 || stats->worst_margin_ns < totals[check].worst_margin_ns) {
+				worst_pins[check] = signal->name;
+			}
+			merge_check(&totals[check], stats);
+		}
+
+		if (signal->frames.count) {
+			if (frames.count == 0 || signal->frames.min_ns < frames.min_ns) frames.min_ns = signal->frames.min_ns;
+			if (frames.count == 0 || signal->frames.max_ns > frames.max_ns) frames.max_ns = signal->frames.max_ns;
+			if (signal->frames.count > frames.count) frames.count = signal->frames.count;
+		}
+	}
+
+	printf("[timing] %s: %s, %u pins, %" PRIu64 " frames, transmission %.2f-%.2f us\n",
+		PROTOCOL_LIMITS[g_config.protocol].name,
+		g_config.trace_filename,
+		pin_count,
+		frames.count,
+		frames.min_ns / 1e3,
+		frames.max_ns / 1e3
+	);
+
+	uint64_t violations = 0;
+	check_t worst_check = CHECK_COUNT;
+
+	for (int check=0; check<CHECK_COUNT; check++) {
+		if (totals[check].count == 0) continue;
+
+		char pin[MAX_TOKEN + 16];
+		snprintf(pin, sizeof(pin), "all pins (worst %s)", worst_pins[check]);
+		print_check(pin, (check_t) check, &totals[check]);
+
+		violations += totals[check].violations;
+		if (worst_check == CHECK_COUNT || totals[check].worst_margin_ns < totals[worst_check].worst_margin_ns) {
+			worst_check = (check_t) check;
+		}
+	}
+
+	if (worst_check == CHECK_COUNT) {
+		printf("[timing] No %s signal found\n", PROTOCOL_LIMITS[g_config.protocol].name);
+		return 1;
+	}
+
+	printf("[timing] %s: worst margin %.1f ns (%s on %s)\n",
+		violations ? "FAIL" : "OK",
+		totals[worst_check].worst_margin_ns,
+		CHECK_NAMES[worst_check],
+		worst_pins[worst_check]
+	);
+
+	return violations;
+}
+
+////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+// main()
+static struct option long_options[] =
+	{
+		{"protocol", required_argument, NULL, 'p'},
+		{"pins", required_argument, NULL, 'P'},
+		{"clock", required_argument, NULL, 'c'},
+		{"limit", required_argument, NULL, 'l'},
+		{"verbose", no_argument, NULL, 'v'},
+		{"help", no_argument, NULL, 'h'},
+		{NULL, 0, NULL, 0}
+	};
+
+static void print_usage(char ** argv) {
+	printf("Usage: %s [options] trace.vcd\n", argv[0]);
+	printf("\n");
+	printf("--protocol <name>, -p <name>\n\tThe protocol on the pins: ws281x, ws2801, apa102 or dmx (default ws281x)\n");
+	printf("--pins <names>, -P <names>\n\tOnly check these comma-separated signals (default all)\n");
+	printf("--clock <names>, -c <names>\n\tThe comma-separated clock signals for ws2801 and apa102 (default: the pins that pulse most)\n");
+	printf("--limit <check>=<min>:<max>, -l <check>=<min>:<max>\n\tOverrides the limits of a check in ns; either bound may be left empty\n");
+	printf("--verbose, -v\n\tReports every pin as well as the totals\n");
+	printf("--help, -h\n\tDisplays this help message\n");
+	printf("\nChecks and default limits (ns):\n");
+
+	for (size_t protocol=0; protocol<PROTOCOL_COUNT; protocol++) {
+		printf("\t%s:", PROTOCOL_LIMITS[protocol].name);
+		for (int check=0; check<CHECK_COUNT; check++) {
+			const limit_t* limit = &PROTOCOL_LIMITS[protocol].limits[check];
+			if (!limit->used) continue;
+
+			if (limit->max_ns == NO_LIMIT) {
+				printf(" %s=%.0f:", CHECK_NAMES[check], limit->min_ns);
+			} else {
+				printf(" %s=%.0f:%.0f", CHECK_NAMES[check], limit->min_ns, limit->max_ns);
+			}
+		}
+		printf("\n");
+	}
+}
+
+static void parse_limit(const char* arg) {
+	const char* equals = strchr(arg, '=');
+	const char* colon = equals ? strchr(equals, ':') : NULL;
+
+	if (colon == NULL) {
+		printf("Invalid argument for --limit; expected <check>=<min>:<max>; actual: %s\n", arg);
+		exit(EXIT_FAILURE);
+	}
+
+	for (int check=0; check<CHECK_COUNT; check++) {
+		if (strlen(CHECK_NAMES[check]) != (size_t) (equals - arg) || strncmp(arg, CHECK_NAMES[check], equals - arg) != 0) {
+			continue;
+		}
+
+		limit_t* limit = &PROTOCOL_LIMITS[g_config.protocol].limits[check];
+		if (!limit->used) {
+			printf("Check %s does not apply to %s\n", CHECK_NAMES[check], PROTOCOL_LIMITS[g_config.protocol].name);
+			exit(EXIT_FAILURE);
+		}
+
+		limit->min_ns = colon == equals + 1 ? 0 : strtod(equals + 1, NULL);
+		limit->max_ns = colon[1] == 0 ? NO_LIMIT : strtod(colon + 1, NULL);
+		return;
+	}
+
+	printf("Unknown check in --limit: %s\n", arg);
+	exit(EXIT_FAILURE);
+}
+
+void handle_args(int argc, char ** argv) {
+	extern char *optarg;
+
+	// Limits apply to the protocol, so it is chosen first whatever the order of the options
+	for (int i=1; i<argc - 1; i++) {
+		if (strcmp(argv[i], "-p") == 0 || strcmp(argv[i], "--protocol") == 0) {
+			bool found = false;
+			for (size_t protocol=0; protocol<PROTOCOL_COUNT; protocol++) {
+				if (strcasecmp(argv[i + 1], PROTOCOL_LIMITS[protocol].name) == 0) {
+					g_config.protocol = (protocol_t) protocol;
+					found = true;
+				}
+			}
+
+			if (!found) {
+				printf("Invalid argument for --protocol; expected ws281x, ws2801, apa102 or dmx; actual: %s\n", argv[i + 1]);
+				exit(EXIT_FAILURE);
+			}
+		}
+	}
+
+	int opt;
+	while ((opt = getopt_long(argc, argv, "p:P:c:l:vh", long_options, NULL)) != -1)
+	{
+		switch (opt)
+		{
+			case 'p': {
+				// Handled above
+			} break;
+
+			case 'P': {
+				g_config.pins = optarg;
+			} break;
+
+			case 'c': {
+				g_config.clocks = optarg;
+			} break;
+
+			case 'l': {
+				parse_limit(optarg);
+			} break;
+
+			case 'v': {
+				g_config.verbose = true;
+			} break;
+
+			case 'h': {
+				print_usage(argv);
+				exit(EXIT_SUCCESS);
+			}
+
+			default:
+				print_usage(argv);
+				exit(EXIT_FAILURE);
+		}
+	}
+
+	if (optind != argc - 1) {
+		print_usage(argv);
+		exit(EXIT_FAILURE);
+	}
+
+	g_config.trace_filename = argv[optind];
+}
+
+int main(int argc, char ** argv)
+{
+	handle_args(argc, argv);
+	load_trace(g_config.trace_filename);
+
+	switch (g_config.protocol) {
+		case PROTOCOL_WS281X:
+			for (uint32_t i=0; i<g_signal_count; i++) {
+				if (g_signals[i].selected) check_ws281x(&g_signals[i]);
+			}
+		break;
+
+		case PROTOCOL_WS2801:
+		case PROTOCOL_APA102:
+			check_clocked();
+		break;
+
+		case PROTOCOL_DMX:
+			for (uint32_t i=0; i<g_signal_count; i++) {
+				if (g_signals[i].selected) check_dmx(&g_signals[i]);
+			}
+		break;
+	}
+
+	return report() ? EXIT_FAILURE : EXIT_SUCCESS;
+}